@@ -24,6 +24,7 @@
 
 ifdef UBLOX_GPS_HAL
 #SUPL_ENABLED := 1
+#DEBUGIF_ENABLED := 1
 
 LOCAL_PATH := $(call my-dir)
 TEMP_PATH:=$(LOCAL_PATH)
@@ -55,6 +56,8 @@ LOCAL_SRC_FILES := \
 	ubx_udpServer.cpp \
 	ubx_localDb.cpp \
 	ubx_timer.cpp \
+	ubx_rxStats.cpp \
+	ubx_debugIf.cpp \
 	ubx_xtraIf.cpp \
 	ubx_cfg.cpp \
 	ubx_log.cpp \
@@ -67,6 +70,11 @@ LOCAL_CFLAGS := \
 	-DANDROID_BUILD
 #	-DUDP_SERVER_PORT=46434
 
+# GPS debug interface, also exports the receive path statistics
+ifeq ($(DEBUGIF_ENABLED),1)
+LOCAL_CFLAGS += -DCDEBUGIF_EN
+endif
+
 # Additions for SUPL
 ifeq ($(SUPL_ENABLED),1)
 LOCAL_C_INCLUDES += external/openssl/include/
@@ -87,6 +95,7 @@ SUPL_SOURCE_FILES := \
 	supl/upldecod.cpp \
 	supl/uplsend.cpp \
 	supl/rrlpdecod.cpp \
+	supl/asnarena.cpp \
 	ubx_rilIf.cpp \
 	ubx_niIf.cpp \
 	ubx_agpsIf.cpp
@@ -108,6 +117,183 @@ LOCAL_MODULE_RELATIVE_PATH := hw
 
 include $(BUILD_SHARED_LIBRARY)
 
+# replay of data captured with SERIAL_CAPTURE, benchmarks parser and database, checks the receive path statistics
+include $(CLEAR_VARS)
+LOCAL_MODULE := ubx_replay
+LOCAL_MODULE_TAGS := optional
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	$(LOCAL_PATH)/parser
+LOCAL_SRC_FILES := \
+	ubx_replay.cpp \
+	ubx_benchUtil.cpp \
+	ubx_localDb.cpp \
+	ubx_rxStats.cpp \
+	ubx_timer.cpp \
+	$(PARSER_SRC_FILES)
+LOCAL_CFLAGS := \
+	-DPLATFORM_SDK_VERSION=$(PLATFORM_SDK_VERSION) \
+	-DUNIX_API \
+	-DANDROID_BUILD
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils
+include $(BUILD_EXECUTABLE)
+
+# latency from the end of an epoch to location_cb for the ways of detecting the end and with batching
+include $(CLEAR_VARS)
+LOCAL_MODULE := ubx_epochBench
+LOCAL_MODULE_TAGS := optional
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	$(LOCAL_PATH)/parser
+LOCAL_SRC_FILES := \
+	ubx_epochBench.cpp \
+	ubx_benchUtil.cpp \
+	ubx_localDb.cpp \
+	ubx_rxStats.cpp \
+	ubx_timer.cpp \
+	$(PARSER_SRC_FILES)
+LOCAL_CFLAGS := \
+	-DPLATFORM_SDK_VERSION=$(PLATFORM_SDK_VERSION) \
+	-DUNIX_API \
+	-DANDROID_BUILD
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils
+include $(BUILD_EXECUTABLE)
+
+# parser throughput with the mirrored ring, the flat buffer and without the sync char scan
+include $(CLEAR_VARS)
+LOCAL_MODULE := ubx_parserBench
+LOCAL_MODULE_TAGS := optional
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	$(LOCAL_PATH)/parser
+LOCAL_SRC_FILES := \
+	ubx_parserBench.cpp \
+	ubx_benchUtil.cpp \
+	ubx_timer.cpp \
+	$(PARSER_SRC_FILES)
+LOCAL_CFLAGS := \
+	-DPLATFORM_SDK_VERSION=$(PLATFORM_SDK_VERSION) \
+	-DUNIX_API \
+	-DANDROID_BUILD
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils
+include $(BUILD_EXECUTABLE)
+
+# NMEA number parser against strtod
+include $(CLEAR_VARS)
+LOCAL_MODULE := ubx_nmeaNumBench
+LOCAL_MODULE_TAGS := optional
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	$(LOCAL_PATH)/parser
+LOCAL_SRC_FILES := \
+	ubx_nmeaNumBench.cpp \
+	ubx_benchUtil.cpp \
+	ubx_timer.cpp \
+	$(PARSER_SRC_FILES)
+LOCAL_CFLAGS := \
+	-DPLATFORM_SDK_VERSION=$(PLATFORM_SDK_VERSION) \
+	-DUNIX_API \
+	-DANDROID_BUILD
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils
+include $(BUILD_EXECUTABLE)
+
+# ASN.1 decode arenas against the heap and PER bit coding, under AddressSanitizer
+include $(CLEAR_VARS)
+LOCAL_MODULE := ubx_asnBench
+LOCAL_MODULE_TAGS := optional
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	$(LOCAL_PATH)/supl \
+	$(LOCAL_PATH)/supl/asn1c_header
+LOCAL_SRC_FILES := \
+	ubx_asnBench.cpp \
+	ubx_benchUtil.cpp \
+	ubx_timer.cpp \
+	supl/asnarena.cpp
+LOCAL_STATIC_LIBRARIES := libSupl
+LOCAL_SANITIZE := address
+include $(BUILD_EXECUTABLE)
+
+# stand-in AssistNow Online server for testing the download
+include $(CLEAR_VARS)
+LOCAL_MODULE := ubx_agpsServer
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := \
+	ubx_agpsServer.cpp \
+	ubx_benchUtil.cpp
+include $(BUILD_EXECUTABLE)
+
+# aiding data written to the receiver with a write per message and in one batch, the aiding database, ALP file in memory and mapped
+include $(CLEAR_VARS)
+LOCAL_MODULE := ubx_aidBench
+LOCAL_MODULE_TAGS := optional
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	$(LOCAL_PATH)/parser
+LOCAL_SRC_FILES := \
+	ubx_aidBench.cpp \
+	ubx_benchUtil.cpp \
+	ubxgpsstate.cpp \
+	ubx_serial.cpp \
+	ubx_cfg.cpp \
+	ubx_log.cpp \
+	ubx_localDb.cpp \
+	ubx_rxStats.cpp \
+	ubx_timer.cpp \
+	$(PARSER_SRC_FILES)
+LOCAL_CFLAGS := \
+	-DPLATFORM_SDK_VERSION=$(PLATFORM_SDK_VERSION) \
+	-DUNIX_API \
+	-DANDROID_BUILD
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils
+include $(BUILD_EXECUTABLE)
+
+ifeq ($(SUPL_ENABLED),1)
+# Supl sessions against a stand-in SLP, set initiated with bursts of SUPL INITs
+include $(CLEAR_VARS)
+LOCAL_MODULE := ubx_suplBench
+LOCAL_MODULE_TAGS := optional
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	$(LOCAL_PATH)/parser \
+	$(LOCAL_PATH)/supl \
+	$(LOCAL_PATH)/supl/asn1c_header \
+	external/openssl/include/ \
+	external/openssl/ \
+	external/
+LOCAL_SRC_FILES := \
+	ubx_suplBench.cpp \
+	ubx_benchUtil.cpp \
+	$(SUPL_SOURCE_FILES) \
+	ubx_log.cpp \
+	ubx_localDb.cpp \
+	ubx_rxStats.cpp \
+	ubx_timer.cpp \
+	$(PARSER_SRC_FILES)
+LOCAL_CFLAGS := \
+	-DPLATFORM_SDK_VERSION=$(PLATFORM_SDK_VERSION) \
+	-DUNIX_API \
+	-DANDROID_BUILD \
+	-DSUPL_ENABLED
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils \
+	libcrypto \
+	libssl
+LOCAL_STATIC_LIBRARIES := libSupl
+include $(BUILD_EXECUTABLE)
+endif
+
 include $(CLEAR_VARS)
 LOCAL_MODULE := gps.conf
 LOCAL_MODULE_TAGS := optional
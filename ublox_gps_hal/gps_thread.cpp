@@ -34,6 +34,7 @@
 #include <errno.h>
 
 #include <sys/time.h>
+#include <sys/epoll.h>
 #include <assert.h>
 
 #include "ubx_log.h"
@@ -44,6 +45,7 @@
 #include "ubx_moduleIf.h"
 #include "ubx_xtraIf.h"
 #include "ubx_timer.h"
+#include "ubx_rxStats.h"
 
 #include "parserbuffer.h"
 #include "protocolubx.h"
@@ -72,6 +74,9 @@
 // Definitions & Types
 #define MAX_UDP_PACKET_LEN 16384    //!< Dimension of the temporary buffer for reading a complete UDP packet
 #define MIN_INTERVAL        200     //!< Minimum interval time (in ms) receiver is capable of
+#define MAX_POLL_EVENTS     8       //!< Number of events taken from epoll in one go
+#define RECONNECT_INTERVAL  1000    //!< Interval time (in ms) to retry opening the serial port
+#define XTRA_REQUEST_INTERVAL 60    //!< Interval time (in s) between ALP file requests
 
 // Debugging
 #ifdef SUPL_ENABLED
@@ -90,6 +95,7 @@ static void reportStatus(const ControlThreadInfo* pState);
 
 
 static CSerialPort s_ser;			//!< Hardware interface class instance(serial port / usb file handle)
+static int s_pollFd = -1;			//!< epoll instance of the main loop
 #if defined UDP_SERVER_PORT
 static CUdpServer s_udp;			//!< UPD server class instance
 #endif
@@ -127,6 +133,8 @@ static void signal_cmd_complete(ControlThreadInfo* pControlThreadInfo, int resul
 
 static void engineStop(ControlThreadInfo* pControlThreadInfo, bool si)
 {
+	// deliver the batched fixes before the client goes away
+	CMyDatabase::getInstance()->flushBatch();
 	if (si)
 	{
 		CMyDatabase::getInstance()->decPublish();
@@ -347,28 +355,25 @@ static void reportStatus(const ControlThreadInfo* pState)
 	}
 }
 
-static bool handleCmdInput(ControlThreadInfo* pState, fd_set* pRfds)
+static bool handleCmdInput(ControlThreadInfo* pState)
 {
 	bool finish = false;
 	
-	if(FD_ISSET(pState->cmdPipes[0], pRfds))
+	// Command received
+	U1 cmd;
+	if (read(pState->cmdPipes[0], &cmd, 1) == -1)
 	{
-		// Command received
-		U1 cmd;
-		if (read(pState->cmdPipes[0], &cmd, 1) == -1)
-		{
-			LOGE("%s : Cmd pipe read failure (%i)", __FUNCTION__, errno);
-		}
-		else
+		LOGE("%s : Cmd pipe read failure (%i)", __FUNCTION__, errno);
+	}
+	else
+	{
+		LOGV("%s (%u): Cmd received (%i)", __FUNCTION__, (unsigned int) pthread_self(), cmd);
+		if (handle_cmd(pState, cmd))
 		{
-			LOGV("%s (%u): Cmd received (%i)", __FUNCTION__, (unsigned int) pthread_self(), cmd);
-			if (handle_cmd(pState, cmd))
-			{
 #ifndef ANDROID_BUILD                    
-				LOGV("%s : Exit thread cmd received", __FUNCTION__);
-				finish = true;
+			LOGV("%s : Exit thread cmd received", __FUNCTION__);
+			finish = true;
 #endif
-			}
 		}
 	}
 	
@@ -377,26 +382,58 @@ static bool handleCmdInput(ControlThreadInfo* pState, fd_set* pRfds)
 }
 
 #if defined UDP_SERVER_PORT
-static void handleUdpInput(fd_set &rfds)
+static void handleUdpInput(void)
 {
-	if (s_udp.fdIsSet(rfds))
-	{
-		char tmpbuf[MAX_UDP_PACKET_LEN];
-		int len = s_udp.recvPort(tmpbuf, sizeof(tmpbuf));
+	char tmpbuf[MAX_UDP_PACKET_LEN];
+	int len = s_udp.recvPort(tmpbuf, sizeof(tmpbuf));
 //                LOGV("%s: Received something over UDP! %d", __FUNCTION__, len);
-		if (len > 0)
+	if (len > 0)
+	{
+		// UBX or PUBX data - forward to GPS
+		if (s_ser.writeSerial(tmpbuf,(unsigned int) len) != len)
 		{
-			// UBX or PUBX data - forward to GPS
-			if (s_ser.writeSerial(tmpbuf,(unsigned int) len) != len)
-			{
-				LOGE("unable to write %i to a master",len);
-			}
+			LOGE("unable to write %i to a master",len);
 		}
 	}
 }
 #endif
 
-static void connectReceiver(const ControlThreadInfo* pState, fd_set& rfds, int& rMaxFd)
+//! Register a file descriptor for input with the main loop epoll instance
+/*!
+  \param pollFd	: epoll instance
+  \param fd		: file descriptor to wait for input on
+  \return true on success
+*/
+static bool pollAdd(int pollFd, int fd)
+{
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	if (epoll_ctl(pollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+	{
+		LOGE("%s : Cannot poll fd %d (%i)", __FUNCTION__, fd, errno);
+		return false;
+	}
+	return true;
+}
+
+//! Reduce a poll timeout to the time left until a deadline
+/*!
+  \param timeoutMs	: current timeout in ms, -1 for infinite
+  \param leftMs		: time left until the deadline in ms
+  \return the new timeout in ms
+*/
+static int pollDeadline(int timeoutMs, int64_t leftMs)
+{
+	if (leftMs < 0)
+		leftMs = 0;
+	if ((timeoutMs < 0) || (leftMs < timeoutMs))
+		return (int) leftMs;
+	return timeoutMs;
+}
+
+static void connectReceiver(const ControlThreadInfo* pState)
 {
 	CUbxGpsState* pUbxGps = CUbxGpsState::getInstance();
 	
@@ -412,7 +449,6 @@ static void connectReceiver(const ControlThreadInfo* pState, fd_set& rfds, int&
 	{
 		// Serial port opened/reopened - Baud rate needs to be set
 		pUbxGps->setBaudRate();
-		s_ser.fdSet(rfds, rMaxFd);
 
 		pUbxGps = CUbxGpsState::getInstance();
 		pUbxGps->lock();
@@ -438,6 +474,7 @@ static void connectReceiver(const ControlThreadInfo* pState, fd_set& rfds, int&
 static void releaseGpsThreadResources(ControlThreadInfo* pControlThreadInfo)
 {
     s_ser.closeSerial();
+    s_ser.setPollFd(-1);
 #if defined UDP_SERVER_PORT
     s_udp.closeUdp();
 #endif
@@ -447,6 +484,9 @@ static void releaseGpsThreadResources(ControlThreadInfo* pControlThreadInfo)
     if (pControlThreadInfo->cmdPipes[1] != -1) 
 		close(pControlThreadInfo->cmdPipes[1]);
     pControlThreadInfo->cmdPipes[1] = -1;
+    if (s_pollFd != -1)
+		close(s_pollFd);
+    s_pollFd = -1;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -470,6 +510,8 @@ void ubx_thread(void *pThreadData)
 #endif 
     time_t timeoutLastValidMessage = now;	//!< timeout for serial port 
 	time_t timeoutLastXtraRequest = 0;
+	bool alpOk = true;
+	int64_t reconnectMs = 0;				//!< next time to try opening the serial port
 
 	pDatabase->setGpsState(pState);
 #ifdef SUPL_ENABLED
@@ -484,6 +526,7 @@ void ubx_thread(void *pThreadData)
     parser.Register(&protocolUBX);
     parser.Register(&protocolNmea);
     parser.RegisterUnknown(&protocolUnknown);
+    LOGV("%s: Parser buffer is %s", __FUNCTION__, parser.IsMirrored() ? "a mirrored ring" : "flat");
 
     LOGV("%s (%u): Gps background thread started", __FUNCTION__, (unsigned int) pthread_self()); 
 	CUbxGpsState* pUbxGps = CUbxGpsState::getInstance();
@@ -496,6 +539,10 @@ void ubx_thread(void *pThreadData)
 #endif
 
 	pUbxGps->setSerial(&s_ser);
+	if (pUbxGps->getCaptureFile())
+		s_ser.openCapture(pUbxGps->getCaptureFile());
+	pDatabase->SetEpochEnd(pUbxGps->getEpochEndMsg());
+	pDatabase->setBatching(pUbxGps->getBatchSize(), pUbxGps->getBatchIntervalMs());
 #if defined UDP_SERVER_PORT
 	pUbxGps->setUdp(&s_udp);
 #endif	
@@ -519,40 +566,63 @@ void ubx_thread(void *pThreadData)
         return;
     }
 
+    // the serial port and the SUPL sockets remove themselves from the epoll
+    // set before they are closed and register again when they are reopened
+    s_pollFd = epoll_create(MAX_POLL_EVENTS);
+    if ((s_pollFd == -1) || 
+        !pollAdd(s_pollFd, pState->cmdPipes[0])
+#if defined UDP_SERVER_PORT
+        || !s_udp.pollAdd(s_pollFd)
+#endif
+       )
+    {
+        LOGE("%s : Could not create epoll instance (%i)", __FUNCTION__, errno);
+        releaseGpsThreadResources(pState);
+        signal_cmd_complete(pState, 0);      // Signal init fail
+        return;
+    }
+    s_ser.setPollFd(s_pollFd);
+
     handle_init(pState);    // also turn off the device when the thread starts
                             // and complete (signal init handler function)
 
     for (;;)
     {
-        fd_set rfds;
-        int maxFd = 0;
-
-        /* Initialize the select mask */
-//lint -e{866} suppress "Unusual use of '' in argument to sizeof"
-        FD_ZERO(&rfds);
+        int64_t nowMs = getMonotonicMsCounter();
+        int timeoutMs = -1;		// nothing to do until input arrives
 
-        if (!s_ser.fdSet(rfds, maxFd))					// Add the gps device 
+        if (!s_ser.isFdOpen())
         {
 			// Serial channel to receiver not open
-			connectReceiver(pState, rfds, maxFd);
+			if (nowMs >= reconnectMs)
+			{
+				connectReceiver(pState);
+				reconnectMs = nowMs + RECONNECT_INTERVAL;
+			}
+			if (!s_ser.isFdOpen())
+				timeoutMs = pollDeadline(timeoutMs, reconnectMs - nowMs);
         }
-        FD_SET(pState->cmdPipes[0], &rfds);  			// Add cmd queue pipe
-
-        if (pState->cmdPipes[0]+1 > maxFd) 
-            maxFd = pState->cmdPipes[0]+1; 
-        
-#if defined UDP_SERVER_PORT
-        s_udp.fdSet(rfds, maxFd);						// Add UDP port connection
-#endif
 
 #ifdef SUPL_ENABLED
-		suplAddUplListeners(&rfds, &maxFd);				// Add Supl session sockets
+		suplAddUplListeners(s_pollFd);					// Add new Supl session sockets
+		int64_t suplTimeout = suplGetNextTimeout();
+		if (suplTimeout != -1)
+			timeoutMs = pollDeadline(timeoutMs, suplTimeout - nowMs);
+#endif
+#if defined UDP_SERVER_PORT
+		if (s_udp.isActive())
+			timeoutMs = pollDeadline(timeoutMs, (int64_t) (timeoutPts + 1 - time(NULL)) * 1000);
 #endif
-        /* make the select */
-		struct timeval tv;		/* and setup the timeout to 1.0 seconds */
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
-        int res = select(maxFd, &rfds, NULL, NULL, &tv);
+        if (pState->gpsState == GPS_STOPPING)
+			timeoutMs = pollDeadline(timeoutMs, pState->stoppingTimeoutMs + 1 - nowMs);
+        else if ((pState->gpsState == GPS_STARTED) && !alpOk)
+			timeoutMs = pollDeadline(timeoutMs, (int64_t) (timeoutLastXtraRequest + XTRA_REQUEST_INTERVAL - time(NULL)) * 1000);
+		if (pDatabase->getBatchDeadline())
+			timeoutMs = pollDeadline(timeoutMs, pDatabase->getBatchDeadline() - nowMs);
+
+        /* wait for input or the next deadline */
+        struct epoll_event events[MAX_POLL_EVENTS];
+        int res = epoll_wait(s_pollFd, events, MAX_POLL_EVENTS, timeoutMs);
         now = time(NULL);
         
 #if defined UDP_SERVER_PORT
@@ -566,9 +636,35 @@ void ubx_thread(void *pThreadData)
         }
 #endif
         
+        bool serIn = false;
+        bool cmdIn = false;
+#if defined UDP_SERVER_PORT
+        bool udpIn = false;
+#endif
+#ifdef SUPL_ENABLED
+        int suplNum = 0;
+        int suplFds[MAX_POLL_EVENTS];
+#endif
+        for (int i = 0; i < res; i++)
+        {
+			int fd = events[i].data.fd;
+			if (s_ser.isFd(fd))
+				serIn = true;
+			else if (fd == pState->cmdPipes[0])
+				cmdIn = true;
+#if defined UDP_SERVER_PORT
+			else if (s_udp.isFd(fd))
+				udpIn = true;
+#endif
+#ifdef SUPL_ENABLED
+			else
+				suplFds[suplNum++] = fd;
+#endif
+        }
+        
         if (res > 0)
         {
-            if (s_ser.fdIsSet(rfds))
+            if (serIn)
             {
 				// There is some input in the serial port
 				// fill the parser with new data 
@@ -582,6 +678,8 @@ void ubx_thread(void *pThreadData)
 					unsigned char* pMsg;
 				    CProtocol* pProtocol;
 
+                    CRxStats::read(iSize);
+                    int64_t parseUs = getMonotonicUsCounter();
                     // we read it so update the size
                     parser.Append(iSize);
                     // Parse ...
@@ -595,6 +693,7 @@ void ubx_thread(void *pThreadData)
 						if (pProtocol == &protocolUBX)
 						{
 					        timeoutLastValidMessage = now;
+							CRxStats::message(CRxStats::MSG_UBX, pMsg, iMsg);
                             //LOGV("MSG UBX %02X-%02X-%02X-%02X-%02X-%02X (size %d)\n", pMsg[2], pMsg[3], pMsg[4], pMsg[5], pMsg[6], pMsg[7], iMsg);
                             pUbxGps->lock();
 							pUbxGps->onNewUbxMsg(pState->gpsState, pMsg, (unsigned int) iMsg);
@@ -603,6 +702,7 @@ void ubx_thread(void *pThreadData)
                         else if (pProtocol == &protocolNmea)
 						{
 							timeoutLastValidMessage = now;
+							CRxStats::message(CRxStats::MSG_NMEA, pMsg, iMsg);
 #if 0
 #if (PLATFORM_SDK_VERSION > 8 /* >2.2 */)
                             if ((CGpsIf::getInstance()->m_callbacks.nmea_cb) && 
@@ -625,6 +725,7 @@ void ubx_thread(void *pThreadData)
                         else 
 						{
                             LOGV("%s: MSG UNKNOWN size %d\n", __FUNCTION__, iMsg);
+							CRxStats::message(CRxStats::MSG_UNKNOWN, pMsg, iMsg);
                         }
 						// PRINTF("size %5d ", iMsg);
                         // ... and Process
@@ -633,6 +734,7 @@ void ubx_thread(void *pThreadData)
                     }
 					
                     parser.Compact();
+                    CRxStats::parsed(parseUs);
                 }
                 else
                 {
@@ -663,13 +765,15 @@ void ubx_thread(void *pThreadData)
 
 #if defined UDP_SERVER_PORT
             /* UDP PORT READ HANDLING */
-			handleUdpInput(rfds);
+			if (udpIn)
+				handleUdpInput();
 #endif /* UDP_SERVER_PORT */
 
 #ifdef SUPL_ENABLED
-			suplReadUplSock(&rfds);			// Check and process any incoming SUPL data
+			for (int i = 0; i < suplNum; i++)
+				suplReadUplSock(suplFds[i]);	// Check and process any incoming SUPL data
 #endif
-			if (handleCmdInput(pState, &rfds))
+			if (cmdIn && handleCmdInput(pState))
 			{
 				break;		// Will only happen when using test harness
 			}
@@ -681,6 +785,11 @@ void ubx_thread(void *pThreadData)
 #ifdef SUPL_ENABLED
         suplCheckPendingActions();		// Check for any actions on existing SUPL sessions
 #endif
+        if (pDatabase->getBatchDeadline() && 
+            (getMonotonicMsCounter() >= pDatabase->getBatchDeadline()))
+        {
+            pDatabase->flushBatch();
+        }
         if (pState->gpsState == GPS_STOPPING)
         {
             handle_device_shutdown(pState);
@@ -689,10 +798,10 @@ void ubx_thread(void *pThreadData)
         {
             // Request a new ALP file if it seems outdated
             pUbxGps->lock();
-            bool ok = pUbxGps->checkAlpFile();
+            alpOk = pUbxGps->checkAlpFile();
             pUbxGps->unlock();
             
-            if (!ok && ((now - timeoutLastXtraRequest) >= 60/*one minute*/))
+            if (!alpOk && ((now - timeoutLastXtraRequest) >= XTRA_REQUEST_INTERVAL))
             {
 				CXtraIf::requestDownload();
                 timeoutLastXtraRequest = now;
@@ -33,6 +33,7 @@
 
 CDatabase::CDatabase(void)
 {
+	varE = MSG_NUM;
 	Reset();
 }
 
@@ -44,7 +45,34 @@ CDatabase::STATE_t CDatabase::Commit(bool bClear /* = true */)
 	CompleteHeading();
 	CompleteTimestamp();
 	
-	memcpy(varO,  varN, sizeof(varN));
+	// only touch the fields set in this or the previous epoch, 
+	// all others are empty in both varN and varO already
+	int k;
+	for (k = 0; k < varONum; k ++)
+	{
+		int ix = varOList[k];
+		if (!(varD[ix >> 5] & (1U << (ix & 31))))
+			varO[ix].Empty();
+	}
+	for (k = 0; k < varDNum; k ++)
+		varO[varDList[k]] = varN[varDList[k]];
+	memcpy(varOList, varDList, varDNum * sizeof(*varDList));
+	varONum = varDNum;
+	// the satellite table is replaced as a whole, only copy what is set
+	if (satD)
+	{
+		int num = satN.inView;
+		memcpy(&satO, &satN, (size_t)((const char*)&satN.prn[0] - (const char*)&satN));
+		memcpy(satO.prn,	 satN.prn,	   num * sizeof(*satN.prn));
+		memcpy(satO.az,		 satN.az,	   num * sizeof(*satN.az));
+		memcpy(satO.el,		 satN.el,	   num * sizeof(*satN.el));
+		memcpy(satO.cno,	 satN.cno,	   num * sizeof(*satN.cno));
+		memcpy(satO.orbSta,	 satN.orbSta,  num * sizeof(*satN.orbSta));
+		satO.used = satN.used;
+		memcpy(satO.usedPrn, satN.usedPrn, satN.used * sizeof(*satN.usedPrn));
+	}
+	else
+		ClearSats(satO);
 
 	// set time commit time stamp 
 	TIMESTAMP ts; 
@@ -68,6 +96,9 @@ CDatabase::STATE_t CDatabase::Commit(bool bClear /* = true */)
 												(i >= 4) ?  10 : 
 														   100 );
 		}
+		// not part of this epoch, make sure the next commit clears it
+		if (varO[DATA_ERROR_RADIUS_METERS].IsSet())
+			varOList[varONum++] = DATA_ERROR_RADIUS_METERS;
 	}
 	// compute the last known good fix 
 	if (varO[DATA_LONGITUDE_DEGREES].IsSet() && varO[DATA_LATITUDE_DEGREES].IsSet() && 
@@ -92,8 +123,16 @@ CDatabase::STATE_t CDatabase::Commit(bool bClear /* = true */)
 	// enable next line if you like noise
 	if (bClear)
 	{
-		memset(varN, 0, sizeof(varN));
+		for (k = 0; k < varDNum; k ++)
+			varN[varDList[k]].Empty();
+		memset(varD, 0, sizeof(varD));
+		varDNum = 0;
 		memset(varM, 0, sizeof(varM));
+		varEnd = false;
+		ClearSats(satN);
+		satD = false;
+		satTNum = 0;
+		satTSum = 0;
 	}
 	return vasS;
 }
@@ -101,8 +140,17 @@ CDatabase::STATE_t CDatabase::Commit(bool bClear /* = true */)
 void CDatabase::Reset(void)
 {
 	memset(varM, 0, sizeof(varM));
+	varEnd = false;
 	memset(varN, 0, sizeof(varN));
 	memset(varO, 0, sizeof(varO));
+	ClearSats(satN);
+	ClearSats(satO);
+	satD = false;
+	satTNum = 0;
+	satTSum = 0;
+	memset(varD, 0, sizeof(varD));
+	varDNum = 0;
+	varONum = 0;
 	vasS = STATE_NO_DATA;
 }
 
@@ -193,7 +241,7 @@ void CDatabase::CompleteTimestamp(void)
 		varN[DATA_TIME_MINUTE].Get(st.wMinute)	&& varN[DATA_TIME_SECOND].Get(seconds))
 	{
 		st.lMicroseconds = (unsigned long)(seconds * 1e6);
-		varN[DATA_UTC_TIMESTAMP].Set(st);
+		ModifyN(DATA_UTC_TIMESTAMP).Set(st);
 	}
 #if 0
 	int week; 
@@ -231,8 +279,8 @@ void CDatabase::CompleteTimestamp(void)
 		{
 			week = (int)(dTime / 604800.0)
 			tow = dTime - week * 604800.0;
-			varN[DATA_UBX_GPSTIME_WEEK].Set(week);
-			varN[DATA_UBX_GPSTIME_TOW].Set(tow);
+			ModifyN(DATA_UBX_GPSTIME_WEEK).Set(week);
+			ModifyN(DATA_UBX_GPSTIME_TOW).Set(tow);
 		}
 	}
 #endif
@@ -248,7 +296,7 @@ void CDatabase::CompletePosition(void)
 		double dLon = atan2(Y,X);
 		// Set Longitude if needed
 		if (varN[DATA_LONGITUDE_DEGREES].IsEmpty())
-			varN[DATA_LONGITUDE_DEGREES].Set(dLon * DEGREES_PER_RADIAN);
+			ModifyN(DATA_LONGITUDE_DEGREES).Set(dLon * DEGREES_PER_RADIAN);
 		if (varN[DATA_UBX_POSITION_ECEF_Z].Get(Z))
 		{
 			double p = sqrt(X * X + Y * Y);
@@ -258,7 +306,7 @@ void CDatabase::CompletePosition(void)
 			double dLat = atan2(Z + E2SQR * B * sinT * sinT * sinT, p - E1SQR * A * cosT * cosT * cosT);
 			// Set Latitude if needed
 			if (varN[DATA_LATITUDE_DEGREES].IsEmpty())
-				varN[DATA_LATITUDE_DEGREES].Set(dLat * DEGREES_PER_RADIAN);
+				ModifyN(DATA_LATITUDE_DEGREES).Set(dLat * DEGREES_PER_RADIAN);
 			// Set Altitude if needed
 			if (varN[DATA_ALTITUDE_ELLIPSOID_METERS].IsEmpty())
 			{
@@ -273,7 +321,7 @@ void CDatabase::CompletePosition(void)
 					double N =  A*A / sqrt(A*A * cosF*cosF + B*B * sinF*sinF);
 					dAlt = p / cosF - N;
 				}
-				varN[DATA_ALTITUDE_ELLIPSOID_METERS].Set(dAlt);
+				ModifyN(DATA_ALTITUDE_ELLIPSOID_METERS).Set(dAlt);
 			}
 		}
 	}
@@ -303,16 +351,16 @@ void CDatabase::CompleteVelocity(void)
 			if (varN[DATA_SPEED_KNOTS].IsEmpty())
 			{
 				double speed = sqrt(speed2);
-				varN[DATA_SPEED_KNOTS].Set(speed / METERS_PER_NAUTICAL_MILE);
+				ModifyN(DATA_SPEED_KNOTS).Set(speed / METERS_PER_NAUTICAL_MILE);
 			}
 
 			if (varN[DATA_TRUE_HEADING_DEGREES].IsEmpty() && (speed2 > (1.0*1.0)))
 			{
 				double cog = atan2(ve, vn);
-				varN[DATA_TRUE_HEADING_DEGREES].Set(cog * DEGREES_PER_RADIAN);
+				ModifyN(DATA_TRUE_HEADING_DEGREES).Set(cog * DEGREES_PER_RADIAN);
 			}
 			else
-				varN[DATA_TRUE_HEADING_DEGREES].Set(0.0);
+				ModifyN(DATA_TRUE_HEADING_DEGREES).Set(0.0);
 		}
 	}
 }
@@ -326,11 +374,11 @@ void CDatabase::CompleteAltitude(void)
 	bool bEll = varN[DATA_ALTITUDE_ELLIPSOID_METERS].Get(ell);
 
 	if      (!bEll && bMsl && bSep)
-		varN[DATA_ALTITUDE_ELLIPSOID_METERS].Set(sep + msl);
+		ModifyN(DATA_ALTITUDE_ELLIPSOID_METERS).Set(sep + msl);
 	else if (!bMsl && bSep && bEll)
-		varN[DATA_ALTITUDE_SEALEVEL_METERS].Set(ell - sep);
+		ModifyN(DATA_ALTITUDE_SEALEVEL_METERS).Set(ell - sep);
 	else if (!bSep && bEll && bMsl)
-		varN[DATA_GEOIDAL_SEPARATION].Set(ell - msl);
+		ModifyN(DATA_GEOIDAL_SEPARATION).Set(ell - msl);
 }
 
 void CDatabase::CompleteHeading(void)
@@ -342,11 +390,11 @@ void CDatabase::CompleteHeading(void)
 	bool bTh  = varN[DATA_TRUE_HEADING_DEGREES].Get(th);
 
 	if      (!bVar && bTh && bMh)
-		varN[DATA_MAGNETIC_VARIATION].Set(Degrees360(mh - th));
+		ModifyN(DATA_MAGNETIC_VARIATION).Set(Degrees360(mh - th));
 	else if (!bMh && bTh && bVar)
-		varN[DATA_MAGNETIC_HEADING_DEGREES].Set(Degrees360(th + var));
+		ModifyN(DATA_MAGNETIC_HEADING_DEGREES).Set(Degrees360(th + var));
 	else if (!bTh && bMh && bVar)
-		varN[DATA_TRUE_HEADING_DEGREES].Set(Degrees360(mh - var));
+		ModifyN(DATA_TRUE_HEADING_DEGREES).Set(Degrees360(mh - var));
 }
 
 void CDatabase::MsgOnce(MSG_t msg)
@@ -359,16 +407,56 @@ void CDatabase::MsgOnce(MSG_t msg)
 			Commit();
 		}
 		varM[msg] = true;
+		if (msg == varE)
+			varEnd = true;
 	}
 	TIMESTAMP ts; 
 	if (GetCurrentTimestamp(ts))
 	{	
 		if (varN[DATA_LOCAL_TIMESTAMP].IsEmpty())
-			varN[DATA_LOCAL_TIMESTAMP].Set(ts);
-		varN[DATA_LOCALX_TIMESTAMP].Set(ts);
+			ModifyN(DATA_LOCAL_TIMESTAMP).Set(ts);
+		ModifyN(DATA_LOCALX_TIMESTAMP).Set(ts);
 	}	
 }
 
+int CDatabase::SetTalkerSatsInView(int talker, int num, bool bStart)
+{
+	int t;
+	for (t = 0; (t < satTNum) && (satT[t] != talker); t ++)
+		/* nothing */;
+	if ((t < satTNum) && bStart)
+	{
+		// the talker reports a new epoch
+		Commit();
+		t = 0;
+	}
+	if (t == satTNum)
+	{
+		if (satTNum == MAX_TALKERS)
+			return -1;
+		// a further talker of this epoch, its GSV may end the epoch again
+		if (satTNum > 0)
+			varM[MSG_NMEA_GSV_1] = false;
+		satT[t] = (unsigned short)talker;
+		satTBase[t] = satTSum;
+		satTNum ++;
+		satTSum += (num > 0) ? num : 0;
+		SetSatsInView(satTSum);
+	}
+	return satTBase[t];
+}
+
+void CDatabase::EpochEnd(void)
+{
+	// nothing to publish if the epoch was committed already
+	if (varDNum > 0)
+	{
+		//printf("EpochEnd() -> Commit()\n");
+		Commit();
+	}
+	varEnd = false;
+}
+
 // Debugging Stuff / Tools to dump the Database 
 
 #define DUMP_X(ix, txt, fmt, fmtbad) 	\
@@ -438,27 +526,28 @@ void CDatabase::Dump(const CVar* pVar)
 	DUMP_X(DATA_DGPS_DATA_AGE,						"age ",		"%4.0f ",	"   ? ");
 	
 	Printf("\n");
+	const SATS_t& sats = (pVar == varO) ? satO : satN;
 	DUMP_X(DATA_SATELLITES_USED_COUNT,				"used ",	"%2.0f ",	" ? ");
 	Printf("prn ");
-	for (i = 0; i < CDatabase::MAX_SATELLITES_USED; i ++)
-		DUMP_X(DATA_SATELLITES_USED_PRNS_(i),		"",			"%2.0f ",	"");
+	for (i = 0; i < sats.used; i ++)
+		Printf("%2d ", sats.usedPrn[i]);
 	Printf("\n");
 	DUMP_X(DATA_SATELLITES_IN_VIEW,					"in view ",	"%2.0f ",	" ? ");
 	Printf("\nprn ");
-	for (i = 0; i < CDatabase::MAX_SATELLITES_IN_VIEW; i ++)
-		DUMP_X(DATA_SATELLITES_IN_VIEW_PRNS_(i),		"",		"%5.0f ",	"      ");
+	for (i = 0; i < sats.inView; i ++)
+		if (IsValid(sats.validPrn, i))		Printf("%5d ", sats.prn[i]);			else Printf("      ");
 	Printf("\norb ");
-	for (i = 0; i < CDatabase::MAX_SATELLITES_IN_VIEW; i ++)
-		DUMP_X(DATA_UBX_SATELLITES_IN_VIEW_ORB_STA_(i),	"",		"%5.0f ",	"      ");
+	for (i = 0; i < sats.inView; i ++)
+		if (IsValid(sats.validOrbSta, i))	Printf("%5d ", sats.orbSta[i]);			else Printf("      ");
 	Printf("\naz  ");
-	for (i = 0; i < CDatabase::MAX_SATELLITES_IN_VIEW; i ++)
-		DUMP_X(DATA_SATELLITES_IN_VIEW_AZIMUTH_(i),		"",		"%5.1f ",	"      ");
+	for (i = 0; i < sats.inView; i ++)
+		if (IsValid(sats.validAzEl, i))		Printf("%5.1f ", (double)sats.az[i]);	else Printf("      ");
 	Printf("\nel  ");
-	for (i = 0; i < CDatabase::MAX_SATELLITES_IN_VIEW; i ++)
-		DUMP_X(DATA_SATELLITES_IN_VIEW_ELEVATION_(i),	"",		"%5.1f ",	"      ");
+	for (i = 0; i < sats.inView; i ++)
+		if (IsValid(sats.validAzEl, i))		Printf("%5.1f ", (double)sats.el[i]);	else Printf("      ");
 	Printf("\ncno ");
-	for (i = 0; i < CDatabase::MAX_SATELLITES_IN_VIEW; i ++)
-		DUMP_X(DATA_SATELLITES_IN_VIEW_STN_RATIO_(i),	"",		"%5.1f ",	"      ");
+	for (i = 0; i < sats.inView; i ++)
+		if (IsValid(sats.validCno, i))		Printf("%5.1f ", (double)sats.cno[i]);	else Printf("      ");
 	Printf("\n");
 	
 	if (pVar == varO)
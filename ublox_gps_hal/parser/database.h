@@ -36,8 +36,9 @@ public:
 	
 	enum 
 	{ 
-		MAX_SATELLITES_USED    = 28,		// GPS + GLONASS + SBAS
-		MAX_SATELLITES_IN_VIEW = 36			// GPS + GLONASS + SBAS
+		MAX_SATELLITES_IN_VIEW = 36,		// GPS + GLONASS + SBAS measurements
+		MAX_SATELLITES         = 64,		// satellite table, multi constellation
+		MAX_TALKERS            = 8			// talkers reporting satellites in one epoch
 	};
 
 	typedef enum STATE_e
@@ -76,26 +77,8 @@ public:
 		//DATA_NMEA_SENTENCE
 		DATA_POSITION_DILUTION_OF_PRECISION,
 		//DATA_POSTALCODE
-		DATA_SATELLITES_IN_VIEW,
-		DATA_SATELLITES_IN_VIEW_AZIMUTH,
-#define DATA_SATELLITES_IN_VIEW_AZIMUTH_(ix)	(CDatabase::DATA_t)(CDatabase::DATA_SATELLITES_IN_VIEW_AZIMUTH + ix)
-		DATA_SATELLITES_IN_VIEW_AZIMUTH_X		= MAX_SATELLITES_IN_VIEW + DATA_SATELLITES_IN_VIEW_AZIMUTH,
-		DATA_SATELLITES_IN_VIEW_ELEVATION,
-#define DATA_SATELLITES_IN_VIEW_ELEVATION_(ix)	(CDatabase::DATA_t)(CDatabase::DATA_SATELLITES_IN_VIEW_ELEVATION + ix)
-		DATA_SATELLITES_IN_VIEW_ELEVATION_X		= MAX_SATELLITES_IN_VIEW + DATA_SATELLITES_IN_VIEW_ELEVATION,
-//		DATA_SATELLITES_IN_VIEW_ID,
-//#define DATA_SATELLITES_IN_VIEW_ID_(ix)			(CDatabase::DATA_t)(CDatabase::DATA_SATELLITES_IN_VIEW_ID + ix)
-//		DATA_SATELLITES_IN_VIEW_ID_X			= MAX_SATELLITES_IN_VIEW + DATA_SATELLITES_IN_VIEW_ID,
-		DATA_SATELLITES_IN_VIEW_PRNS,
-#define DATA_SATELLITES_IN_VIEW_PRNS_(ix)		(CDatabase::DATA_t)(CDatabase::DATA_SATELLITES_IN_VIEW_PRNS + ix)
-		DATA_SATELLITES_IN_VIEW_PRNS_X			= MAX_SATELLITES_IN_VIEW + DATA_SATELLITES_IN_VIEW_PRNS,
-		DATA_SATELLITES_IN_VIEW_STN_RATIO,
-#define DATA_SATELLITES_IN_VIEW_STN_RATIO_(ix)	(CDatabase::DATA_t)(CDatabase::DATA_SATELLITES_IN_VIEW_STN_RATIO + ix)
-		DATA_SATELLITES_IN_VIEW_STN_RATIO_X		= MAX_SATELLITES_IN_VIEW + DATA_SATELLITES_IN_VIEW_STN_RATIO,
+		DATA_SATELLITES_IN_VIEW,			// the satellites are kept in the satellite table 
 		DATA_SATELLITES_USED_COUNT,
-		DATA_SATELLITES_USED_PRNS,
-#define DATA_SATELLITES_USED_PRNS_(ix)			(CDatabase::DATA_t)(CDatabase::DATA_SATELLITES_USED_PRNS + ix)
-		DATA_SATELLITES_USED_PRNS_X				= MAX_SATELLITES_USED	 + DATA_SATELLITES_USED_PRNS,
 		DATA_SPEED_KNOTS,
 		//DATA_STATE_PROVINCE
 		DATA_TRUE_HEADING_DEGREES,
@@ -127,9 +110,6 @@ public:
 		DATA_UBX_VELOCITY_ECEF_VY,
 		DATA_UBX_VELOCITY_ECEF_VZ,
 		DATA_UBX_VELOCITY_ECEF_ACCURACY,
-		DATA_UBX_SATELLITES_IN_VIEW_ORB_STA,
-#define DATA_UBX_SATELLITES_IN_VIEW_ORB_STA_(ix)	(CDatabase::DATA_t)(CDatabase::DATA_UBX_SATELLITES_IN_VIEW_ORB_STA + ix)
-		DATA_UBX_SATELLITES_IN_VIEW_ORB_STA_X		= MAX_SATELLITES_IN_VIEW + DATA_UBX_SATELLITES_IN_VIEW_ORB_STA,
 
 #ifdef SUPL_ENABLED
 		// SUPL MS-ASSIST properties
@@ -212,7 +192,7 @@ public:
 				//printf("Set(%d, %f) -> Overwrite %f\n", v, d);
 			}
 #endif
-			varN[data].Set(v);
+			ModifyN(data).Set(v);
 		}
 	}
 
@@ -224,6 +204,99 @@ public:
 		return true;
 	}
 
+	/** Satellite table of an epoch, one array per field so that a report 
+		runs through each of them in a tight loop. A bit in a mask is set if 
+		the field of the satellite at this index is valid. 
+	*/
+	typedef struct SATS_s
+	{
+		int				inView;								// number of satellites in view
+		unsigned int	validPrn[MAX_SATELLITES / 32];		// satellite id valid
+		unsigned int	validAzEl[MAX_SATELLITES / 32];		// azimuth and elevation valid
+		unsigned int	validCno[MAX_SATELLITES / 32];		// carrier to noise ratio valid
+		unsigned int	validOrbSta[MAX_SATELLITES / 32];	// orbit state valid
+		unsigned short	prn[MAX_SATELLITES];				// nmea satellite id
+		float			az[MAX_SATELLITES];					// azimuth in degrees
+		float			el[MAX_SATELLITES];					// elevation in degrees
+		float			cno[MAX_SATELLITES];				// carrier to noise ratio in dBHz
+		unsigned char	orbSta[MAX_SATELLITES];				// 1: ephemeris, 2: almanac
+		int				used;								// number of satellites used
+		unsigned short	usedPrn[MAX_SATELLITES];			// nmea satellite id
+	} SATS_t;
+
+	static bool IsValid(const unsigned int* pMask, int ix)
+	{
+		return (pMask[ix >> 5] & (1U << (ix & 31))) != 0;
+	}
+
+	/** Set a satellite in view, this invalidates all its other fields 
+	*/
+	void SetSatInView(int ix, int prn)
+	{
+		if ((ix >= 0) && (ix < MAX_SATELLITES))
+		{
+			unsigned int uBit = 1U << (ix & 31);
+			satN.validAzEl[ix >> 5]   &= ~uBit;
+			satN.validCno[ix >> 5]    &= ~uBit;
+			satN.validOrbSta[ix >> 5] &= ~uBit;
+			satN.validPrn[ix >> 5]    |= uBit;
+			satN.prn[ix] = (unsigned short)prn;
+			satD = true;
+		}
+	}
+	void SetSatAzEl(int ix, double el, double az)
+	{
+		if ((ix >= 0) && (ix < MAX_SATELLITES))
+		{
+			satN.el[ix] = (float)el;
+			satN.az[ix] = (float)az;
+			satN.validAzEl[ix >> 5] |= 1U << (ix & 31);
+		}
+	}
+	void SetSatCno(int ix, double cno)
+	{
+		if ((ix >= 0) && (ix < MAX_SATELLITES))
+		{
+			satN.cno[ix] = (float)cno;
+			satN.validCno[ix >> 5] |= 1U << (ix & 31);
+		}
+	}
+	void SetSatOrbSta(int ix, int orbSta)
+	{
+		if ((ix >= 0) && (ix < MAX_SATELLITES))
+		{
+			satN.orbSta[ix] = (unsigned char)orbSta;
+			satN.validOrbSta[ix >> 5] |= 1U << (ix & 31);
+		}
+	}
+	void SetSatsInView(int num)
+	{
+		satN.inView = (num < MAX_SATELLITES) ? num : MAX_SATELLITES;
+		satD = true;
+		Set(DATA_SATELLITES_IN_VIEW, num);
+	}
+	/** Set the satellites in view reported by a talker (GP, GL, GA, ...), 
+		each talker gets the slots behind those of the talkers before it in 
+		the epoch and the number in view is the sum of all. A talker that 
+		starts again begins a new epoch. Returns the first slot of the 
+		talker, -1 if there are too many talkers.
+	*/
+	int SetTalkerSatsInView(int talker, int num, bool bStart);
+	void SetSatUsed(int ix, int prn)
+	{
+		if ((ix >= 0) && (ix < MAX_SATELLITES))
+		{
+			satN.usedPrn[ix] = (unsigned short)prn;
+			satD = true;
+		}
+	}
+	void SetSatsUsed(int num)
+	{
+		satN.used = (num < MAX_SATELLITES) ? num : MAX_SATELLITES;
+		satD = true;
+		Set(DATA_SATELLITES_USED_COUNT, num);
+	}
+
 	typedef enum 
 	{
 		MSG_NMEA_GBS,
@@ -250,6 +323,26 @@ public:
 	*/
 	__drv_floatUsed void MsgOnce(MSG_t msg);
 
+	/** Use this function after a message was processed, it commits the 
+		epoch if the message was the configured last message of an epoch.
+	*/
+	void MsgDone(void)
+	{
+		if (varEnd)
+			EpochEnd();
+	}
+
+	/** Use this function when the receiver signals the end of an epoch, 
+		the epoch is committed right away instead of with the first 
+		message of the next epoch.
+	*/
+	__drv_floatUsed void EpochEnd(void);
+
+	/** Set the message that is output last in each epoch, MSG_NUM if 
+		there is none.
+	*/
+	void SetEpochEnd(MSG_t msg) { varE = msg; }
+
 private:
 	__drv_floatUsed double CalcLeapSeconds(double dUtcSec) const;
 protected:
@@ -258,16 +351,57 @@ protected:
 	__drv_floatUsed void CompleteVelocity(void);
 	__drv_floatUsed void CompleteAltitude(void);
 	__drv_floatUsed void CompleteHeading(void);
+	static void ClearSats(SATS_t& sats)
+	{
+		// the arrays are only valid up to the counts and by the masks
+		sats.inView = 0;
+		sats.used = 0;
+		memset(sats.validPrn,	 0, sizeof(sats.validPrn));
+		memset(sats.validAzEl,	 0, sizeof(sats.validAzEl));
+		memset(sats.validCno,	 0, sizeof(sats.validCno));
+		memset(sats.validOrbSta, 0, sizeof(sats.validOrbSta));
+	}
 	
 	virtual bool GetCurrentTimestamp(TIMESTAMP& /*ft*/)				{ return false; }
 	
 	virtual __drv_floatUsed int Printf(const char* /*pFmt*/, ...)	{ return 0; }
 	void __drv_floatUsed Dump(const CVar* pVar);
 	
+	/** Return a field of the current epoch for writing and remember that 
+		it was touched, so that Commit only has to copy and clear the 
+		fields that were set in this epoch.
+	*/
+	CVar& ModifyN(DATA_t data)
+	{
+		unsigned int uBit = 1U << (data & 31);
+		if (!(varD[data >> 5] & uBit))
+		{
+			varD[data >> 5] |= uBit;
+			varDList[varDNum++] = (unsigned short)data;
+		}
+		return varN[data];
+	}
+
 	CVar	varN[DATA_PARSE];
 	CVar	varO[DATA_NUM];
+	SATS_t	satN;		// satellite table of the current epoch
+	SATS_t	satO;		// satellite table of the committed epoch
+	bool	satD;		// satellite table set in the current epoch
+	int		satTNum;					// talkers in the satellite table of the current epoch
+	int		satTSum;					// satellites in view reported by them
+	unsigned short satT[MAX_TALKERS];	// talker ids
+	int		satTBase[MAX_TALKERS];		// first slot of each talker
 	bool    varM[MSG_NUM];
 	STATE_t vasS;
+	MSG_t	varE;		// last message of an epoch
+	bool	varEnd;		// last message of the epoch is being processed
+
+	// dirty tracking of varN and the fields of varO set by the last commit
+	unsigned int	varD[(DATA_PARSE + 31) / 32];
+	unsigned short	varDList[DATA_PARSE];
+	int				varDNum;
+	unsigned short	varOList[DATA_PARSE + 1];	// the epoch's fields and a filled in error radius
+	int				varONum;
 };
 
 #endif //__DATABASE_H__
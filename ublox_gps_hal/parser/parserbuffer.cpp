@@ -28,17 +28,75 @@
 
 #include "parserbuffer.h"
 
+#ifdef UNIX_API
+ #include <sys/mman.h>
+ #include <unistd.h>
+#endif
+
 static const int BUFFER_SIZE = 0x10000; // 64KB Buffer 
 
+//--------------------------------------------------------------------------------
+//! Allocate a ring buffer where the same pages are mapped twice back to back
+/*! Any range of up to iSize bytes starting inside the first half is then
+	contiguous in memory, so messages wrapping the end of the ring can be 
+	handed to the protocols without copying them.
+	\param iSize	: size of the ring, must be a multiple of the page size
+	\return the start of the mapping or NULL if not supported
+*/
+static unsigned char* AllocMirror(int iSize)
+{
+#if defined(UNIX_API) && defined(MREMAP_FIXED)
+	long lPage = sysconf(_SC_PAGESIZE);
+	if ((lPage <= 0) || (iSize % lPage))
+		return NULL;
+	// reserve both halves with a shared mapping, ...
+	void* pBase = mmap(NULL, 2 * (size_t)iSize, PROT_READ | PROT_WRITE, 
+					   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (pBase == MAP_FAILED)
+		return NULL;
+	// ... then map the pages of the first half once more over the second half
+	// (mremap with a old size of zero duplicates a shared mapping)
+	void* pMirror = mremap(pBase, 0, (size_t)iSize, MREMAP_MAYMOVE | MREMAP_FIXED, 
+						   (unsigned char*)pBase + iSize);
+	if (pMirror == MAP_FAILED)
+	{
+		munmap(pBase, 2 * (size_t)iSize);
+		return NULL;
+	}
+	return (unsigned char*)pBase;
+#else
+	((void) (iSize));
+	return NULL;
+#endif
+}
+
+//--------------------------------------------------------------------------------
+static void FreeMirror(unsigned char* pBuffer, int iSize)
+{
+#if defined(UNIX_API) && defined(MREMAP_FIXED)
+	munmap(pBuffer, 2 * (size_t)iSize);
+#else
+	((void) (pBuffer));
+	((void) (iSize));
+#endif
+}
 
 //--------------------------------------------------------------------------------
-CParserBuffer::CParserBuffer()
+CParserBuffer::CParserBuffer(bool bMirror /*= true*/)
 {
 	mpRoot = NULL;
 	mpProtocolUnknown = NULL;
+	miSyncNum = 0;
+	mbSyncAny = false;
 	miSize = BUFFER_SIZE; 
-	//lint -e{1732,1733} new in constructor for class 'CParserBuffer' which has no assignment/copy operator
-	mpBuffer = new unsigned char[(size_t)miSize];
+	mpBuffer = bMirror ? AllocMirror(miSize) : NULL;
+	mbMirror = (mpBuffer != NULL);
+	// fall back to a flat buffer that needs to be compacted
+	if (!mbMirror)
+	{
+		//lint -e{1732,1733} new in constructor for class 'CParserBuffer' which has no assignment/copy operator
+		mpBuffer = new unsigned char[(size_t)miSize];
+	}
 	miUsed = 0;
 	miDone = 0;
 }
@@ -49,7 +107,10 @@ CParserBuffer::~CParserBuffer()
 	// free the buffer
 	if (mpBuffer != NULL)
 	{
-		delete [] mpBuffer;
+		if (mbMirror)
+			FreeMirror(mpBuffer, miSize);
+		else
+			delete [] mpBuffer;
 	}
 	// free all protocols
 	RegisterInfo* pTemp = mpRoot;
@@ -77,7 +138,11 @@ void CParserBuffer::Compact()
 {
 	// compact if possible and some data is consumed
 	PARSER_ASSERT(miDone <= miUsed);
-	if ((miUsed > 0) && (miDone > 0))
+	if (mbMirror)
+	{
+		// nothing to move, the ring is rebased by Remove 
+	}
+	else if ((miUsed > 0) && (miDone > 0))
 	{
 		if (miDone < miUsed)
 		{
@@ -104,18 +169,63 @@ void CParserBuffer::Remove(int iSize)
 		miDone = 0;
 		miUsed = 0;
 	}
+	else if (mbMirror && (miDone >= miSize))
+	{
+		// the read position has passed into the mirror, 
+		// rebase both positions to the first half
+		miDone -= miSize;
+		miUsed -= miSize;
+	}
 }
 
-					
+
+//--------------------------------------------------------------------------------
+//! Find the next offset where a message of a registered protocol may start
+/*! The search for every sync char is done with memchr, the result is kept in 
+	pNext so that each part of the buffer is searched only once per sync char 
+	during a single Parse call.
+	\param iStart	: the offset to start the search from
+	\param pNext	: next known offset of each sync char, -1 if not searched yet
+	\return the offset of the next candidate or miUsed if there is none
+*/
+int CParserBuffer::FindSync(int iStart, int* pNext) const
+{
+	if (mbSyncAny)
+		return iStart;
+	int iFound = miUsed;
+	for (int i = 0; i < miSyncNum; i ++)
+	{
+		if (pNext[i] < iStart)
+		{
+			const void* p = (iStart < miUsed) ? 
+				memchr(&mpBuffer[iStart], macSync[i], (size_t)(miUsed - iStart)) : NULL;
+			pNext[i] = p ? (int)((const unsigned char*)p - mpBuffer) : miUsed;
+		}
+		if (pNext[i] < iFound)
+			iFound = pNext[i];
+	}
+	return iFound;
+}
+
+//--------------------------------------------------------------------------------
 bool CParserBuffer::Parse(CProtocol* &pProtocol, unsigned char* &pData, int &iSize)
 {
-	// search the buffer 
-	for (int iStart = miDone; (iStart < miUsed); iStart ++)
+	int aiNext[MAX_SYNC];
+	for (int i = 0; i < miSyncNum; i ++)
+		aiNext[i] = -1;
+	// search the buffer, skipping straight to the candidate message starts
+	for (int iStart = FindSync(miDone, aiNext); (iStart < miUsed); iStart = FindSync(iStart + 1, aiNext))
 	{
 		// Loop through the Protocols
 		RegisterInfo* pItem = mpRoot;
 		while (pItem != NULL)
 		{
+			// only the protocols owning this lead byte need to look at it
+			if ((pItem->iSync != CProtocol::SYNC_ANY) && (pItem->iSync != mpBuffer[iStart]))
+			{
+				pItem = pItem->pNext;
+				continue;
+			}
 			// Is there a message at this point of the buffer with this protocol?
 			int iTemp = pItem->pProtocol->Parse(&mpBuffer[iStart], miUsed-iStart);
 			if (iTemp == WAIT)
@@ -123,7 +233,7 @@ bool CParserBuffer::Parse(CProtocol* &pProtocol, unsigned char* &pData, int &iSi
 				// the parser would like to wait
 			
 				// wait / there is a chance that we get the full message later
-				if ((miDone > 0) || (miUsed < BUFFER_SIZE))
+				if (GetSize() < miSize)
 				{
 					return false;
 				}
@@ -166,12 +276,12 @@ bool CParserBuffer::Parse(CProtocol* &pProtocol, unsigned char* &pData, int &iSi
 		}
 	}
 	// check for a buffer overrun 
-	if ((miDone == 0) && (miUsed == BUFFER_SIZE))
+	if (GetSize() == miSize)
 	{
 		// we have detected a buffer overrun
 		//TRACE(_T("CParserBuffer::Parse Buffer Overrun (full)\n"));
-		pData = &mpBuffer[0];
-		iSize = miUsed;
+		pData = &mpBuffer[miDone];
+		iSize = GetSize();
 		pProtocol = mpProtocolUnknown;
 		return true;
 	}
@@ -208,8 +318,22 @@ bool CParserBuffer::Register(CProtocol* pProtocol)
 	if ( pItem )
 	{
 		pItem->pProtocol = pProtocol;
+		pItem->iSync = pProtocol->GetSyncChar();
 		pItem->pNext = NULL;
 		*pNode = pItem;
+		// remember the sync char for the pre-scan in Parse
+		if ((pItem->iSync < 0) || (pItem->iSync > 0xFF))
+		{
+			pItem->iSync = CProtocol::SYNC_ANY;
+			mbSyncAny = true;
+		}
+		else if (!memchr(macSync, pItem->iSync, (size_t)miSyncNum))
+		{
+			if (miSyncNum < MAX_SYNC)
+				macSync[miSyncNum++] = (unsigned char)pItem->iSync;
+			else
+				mbSyncAny = true;
+		}
 		return true;
 	}
 	return false;
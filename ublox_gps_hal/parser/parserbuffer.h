@@ -38,7 +38,7 @@ class CParserBuffer
 public:
 	enum { WAIT = 0, NOT_FOUND = -1};
 	
-	CParserBuffer();
+	CParserBuffer(bool bMirror = true);
 	virtual ~CParserBuffer();
 
 	void Compact();
@@ -46,6 +46,7 @@ public:
 	bool Parse(CProtocol* &pProtocol, unsigned char* &pData, int &iSize);
 	bool Register(CProtocol* pProtocol);
 	void RegisterUnknown(CProtocol* pProtocol);
+	bool IsMirrored() const;
 	
 	unsigned char* GetPointer();
 	unsigned char* GetData();
@@ -55,17 +56,29 @@ public:
 	void Remove(int iSize);
 
 protected:
+	enum { MAX_SYNC = 8 };
+
+	int FindSync(int iStart, int* pNext) const;
+
 	typedef struct RegisterInfo_s
 	{
 		CProtocol* pProtocol;
+		int iSync;
 		struct RegisterInfo_s* pNext;
 	} RegisterInfo;
 	RegisterInfo* mpRoot;
+	//! distinct sync chars of all registered protocols
+	unsigned char macSync[MAX_SYNC];
+	int miSyncNum;
+	//! a protocol without sync char is registered, every offset has to be tried
+	bool mbSyncAny;
 	CProtocol* mpProtocolUnknown;
 	unsigned char* mpBuffer;
 	int miSize;
 	int miUsed;
 	int miDone;
+	//! the buffer is a ring, the same pages are mapped twice back to back
+	bool mbMirror;
 };
 
 inline unsigned char* CParserBuffer::GetPointer()
@@ -79,7 +92,9 @@ inline unsigned char* CParserBuffer::GetData()
 }
 inline int CParserBuffer::GetSpace() const
 {
-	return miSize - miUsed;
+	// in the mirrored case the free space runs up to one buffer size 
+	// behind the read position and is still contiguous
+	return (mbMirror ? miDone + miSize : miSize) - miUsed;
 }
 
 inline int CParserBuffer::GetSize() const
@@ -90,7 +105,7 @@ inline int CParserBuffer::GetSize() const
 inline void CParserBuffer::Append(int iSize)
 {
 	PARSER_ASSERT(iSize > 0);
-	PARSER_ASSERT(miUsed + iSize <= miSize);
+	PARSER_ASSERT(iSize <= GetSpace());
 	miUsed += iSize;
 }
 
@@ -99,4 +114,9 @@ inline void CParserBuffer::RegisterUnknown(CProtocol* pProtocol)
 	mpProtocolUnknown = pProtocol;
 }
 
+inline bool CParserBuffer::IsMirrored() const
+{
+	return mbMirror;
+}
+
 #endif // __PARSERBUFFER_H__
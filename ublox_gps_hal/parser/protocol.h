@@ -39,11 +39,15 @@ public:
 		NMEA		=  1
 	} PROTOCOL_t;
 
+	enum { SYNC_ANY = -1 };
+
 	CProtocol(void) {}
 	virtual ~CProtocol(void) {}
 	virtual int Parse(unsigned char* pBuffer, int iSize) = 0;
 	virtual void Process(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) = 0;
 	virtual PROTOCOL_t GetType(void) = 0;
+	//! The first byte of every message of this protocol, SYNC_ANY if a message may start with any byte
+	virtual int GetSyncChar(void) const { return SYNC_ANY; }
 };
 
 #endif //__PROTOCOL_H__
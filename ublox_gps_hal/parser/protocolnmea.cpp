@@ -64,7 +64,9 @@ int CProtocolNMEA::ParseFunc(const unsigned char* pBuffer, int iSize)
 			return CParserBuffer::NOT_FOUND;
 		iMaxSize = PUBX_MAX_SIZE;
 	}
-	// Payload
+	// Payload, the checksum is accumulated in the same pass
+	int calcCRC = 0;
+	int starCRC = 0;
 	for (int i = 1; (i < iSize); i ++)
 	{
 		if (i == iMaxSize)
@@ -88,13 +90,11 @@ int CProtocolNMEA::ParseFunc(const unsigned char* pBuffer, int iSize)
 							 (lowNibble  >= '0' && lowNibble  <= '9') ? lowNibble  - '0' : 0xFF ;
 				if (lowNibble <= 0xF && highNibble <= 0xF)
 				{
-					int calcCRC = 0;
-					for (int j = 1; j < iAsterix; j++)
-						calcCRC ^= pBuffer[j];
 					// Checksumme der NMEA-Message holen
 					int msgCRC = (highNibble << 4) | lowNibble;
-					// Checksumme vergleichen
-					if (msgCRC != calcCRC)
+					// Checksumme vergleichen, no other '*' can follow this one 
+					// so starCRC holds the xor of all chars up to iAsterix
+					if (msgCRC != starCRC)
 						return CParserBuffer::NOT_FOUND;
 				}
 				else
@@ -108,43 +108,68 @@ int CProtocolNMEA::ParseFunc(const unsigned char* pBuffer, int iSize)
 			// we are tolerant and tolerate spaces also
 			return CParserBuffer::NOT_FOUND;
 		}
+		else 
+		{
+			if (pBuffer[i] == '*')
+				starCRC = calcCRC;
+			calcCRC ^= pBuffer[i];
+		}
 	}
 	return CParserBuffer::WAIT;
 }
 
+// the sentence formatter packed into one integer, so that we can switch on it
+#define NMEA_ID(a,b,c)	((((unsigned int)(a)) << 16) | (((unsigned int)(b)) << 8) | ((unsigned int)(c)))
+
 void CProtocolNMEA::Process(unsigned char* pBuffer, int iSize, CDatabase* pDatabase)
 {
-	// enable next line if you like noise
-	if		(strncmp((char*)&pBuffer[3], "GBS", 3) == 0)	ProcessGBS(pBuffer, iSize, pDatabase);
-	else if (strncmp((char*)&pBuffer[3], "GGA", 3) == 0)	ProcessGGA(pBuffer, iSize, pDatabase);
-	else if (strncmp((char*)&pBuffer[3], "GLL", 3) == 0)	ProcessGLL(pBuffer, iSize, pDatabase);
-	else if (strncmp((char*)&pBuffer[3], "GNS", 3) == 0)	ProcessGNS(pBuffer, iSize, pDatabase);
-	else if (strncmp((char*)&pBuffer[3], "GRS", 3) == 0)	ProcessGRS(pBuffer, iSize, pDatabase);
-	else if (strncmp((char*)&pBuffer[3], "GSA", 3) == 0)	ProcessGSA(pBuffer, iSize, pDatabase);
-	else if (strncmp((char*)&pBuffer[3], "GST", 3) == 0)	ProcessGST(pBuffer, iSize, pDatabase);
-	else if (strncmp((char*)&pBuffer[3], "GSV", 3) == 0)	ProcessGSV(pBuffer, iSize, pDatabase);
-	else if (strncmp((char*)&pBuffer[3], "RMC", 3) == 0)	ProcessRMC(pBuffer, iSize, pDatabase);
-	else if (strncmp((char*)&pBuffer[3], "VTG", 3) == 0)	ProcessVTG(pBuffer, iSize, pDatabase);
-	else if (strncmp((char*)&pBuffer[3], "ZDA", 3) == 0)	ProcessZDA(pBuffer, iSize, pDatabase);
+	if (iSize >= 6)
+	{
+		typedef void (CProtocolNMEA::*PROCESS_t)(const FIELDS_t& f, CDatabase* pDatabase) const;
+		PROCESS_t pFunc = NULL;
+		switch (NMEA_ID(pBuffer[3], pBuffer[4], pBuffer[5]))
+		{
+			case NMEA_ID('G','B','S'):	pFunc = &CProtocolNMEA::ProcessGBS;	break;
+			case NMEA_ID('G','G','A'):	pFunc = &CProtocolNMEA::ProcessGGA;	break;
+			case NMEA_ID('G','L','L'):	pFunc = &CProtocolNMEA::ProcessGLL;	break;
+			case NMEA_ID('G','N','S'):	pFunc = &CProtocolNMEA::ProcessGNS;	break;
+			case NMEA_ID('G','R','S'):	pFunc = &CProtocolNMEA::ProcessGRS;	break;
+			case NMEA_ID('G','S','A'):	pFunc = &CProtocolNMEA::ProcessGSA;	break;
+			case NMEA_ID('G','S','T'):	pFunc = &CProtocolNMEA::ProcessGST;	break;
+			case NMEA_ID('G','S','V'):	pFunc = &CProtocolNMEA::ProcessGSV;	break;
+			case NMEA_ID('R','M','C'):	pFunc = &CProtocolNMEA::ProcessRMC;	break;
+			case NMEA_ID('V','T','G'):	pFunc = &CProtocolNMEA::ProcessVTG;	break;
+			case NMEA_ID('Z','D','A'):	pFunc = &CProtocolNMEA::ProcessZDA;	break;
+			default:														break;
+		}
+		if (pFunc)
+		{
+			// index all fields once, the handlers then access them directly
+			FIELDS_t f;
+			Tokenize(pBuffer, iSize, f);
+			(this->*pFunc)(f, pDatabase);
+		}
+	}
 
+	pDatabase->MsgDone();
 	pDatabase->AddMessage(pBuffer, iSize);
 }
 
-void CProtocolNMEA::ProcessGBS(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const
+void CProtocolNMEA::ProcessGBS(const FIELDS_t& f, CDatabase* pDatabase) const
 {
 	pDatabase->MsgOnce(CDatabase::MSG_NMEA_GBS);
 	// Time
-	CheckSetTime(pBuffer, iSize, pDatabase, 1);
+	CheckSetTime(f, pDatabase, 1);
 /*
 	double d, e;
 	// we do publish the nav accuarcies in these fileds 
 	// but the NMEA spec says we should publish the "expected error due to bias, with noise = 0"
-	if (GetItem(2, pBuffer, iSize, d) && GetItem(3, pBuffer, iSize, e))
+	if (GetItem(2, f, d) && GetItem(3, f, e))
 	{
 		d = sqrt(d*d + e*e);
 		pDatabase->Set(CDatabase::DATA_ERROR_RADIUS_METERS, d);
 	}
-	if (GetItem(4, pBuffer, iSize, d))
+	if (GetItem(4, f, d))
 	{
 		pDatabase->Set(CDatabase::DATA_ALTITUDE_SEALEVEL_ERROR_METERS, d);
 		pDatabase->Set(CDatabase::DATA_ALTITUDE_ELLIPSOID_ERROR_METERS, d);
@@ -152,16 +177,16 @@ void CProtocolNMEA::ProcessGBS(unsigned char* pBuffer, int iSize, CDatabase* pDa
 */
 }
 
-void CProtocolNMEA::ProcessGGA(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const
+void CProtocolNMEA::ProcessGGA(const FIELDS_t& f, CDatabase* pDatabase) const
 {
 	pDatabase->MsgOnce(CDatabase::MSG_NMEA_GGA);
 	double d;
 	int i;
 	char ch;
 	// Time
-	CheckSetTime(pBuffer, iSize, pDatabase, 1);
+	CheckSetTime(f, pDatabase, 1);
 	// Position
-	SetLatLon(pBuffer, iSize, pDatabase, 2 /* .. 5 */);
+	SetLatLon(f, pDatabase, 2 /* .. 5 */);
 	// NMEA: GGA quality indicator
 	// '0' = Fix not available or invalid
 	// '1' = GPS SPS Mode, fix valid
@@ -172,53 +197,53 @@ void CProtocolNMEA::ProcessGGA(unsigned char* pBuffer, int iSize, CDatabase* pDa
 	// '6' = Estimated (dead reckoning) Mode
 	// '7' = Manual Input Mode
 	// '8' = Simulator Mode
-	if (GetItem(6, pBuffer, iSize, i) && ((i >= 0) && (i <= 8)))
+	if (GetItem(6, f, i) && ((i >= 0) && (i <= 8)))
 		pDatabase->Set(CDatabase::DATA_FIX_QUALITY, i); // todo map >=3 to 0..2
 	// used SVS
-	if (GetItem(7, pBuffer, iSize, i) && (i >= 0))
+	if (GetItem(7, f, i) && (i >= 0))
 		pDatabase->Set(CDatabase::DATA_SATELLITES_USED_COUNT, i);
 	// horizontal DOP
-	if (GetItem(8, pBuffer, iSize, d) && (d < dopLimit))
+	if (GetItem(8, f, d) && (d < dopLimit))
 		pDatabase->Set(CDatabase::DATA_HORIZONAL_DILUTION_OF_PRECISION, d);
 	// altitude
-	if (GetItem(9, pBuffer, iSize, d) && GetItem(10, pBuffer, iSize, ch) && (toupper(ch) == 'M'))
+	if (GetItem(9, f, d) && GetItem(10, f, ch) && (toupper(ch) == 'M'))
 	{
 		pDatabase->Set(CDatabase::DATA_ALTITUDE_SEALEVEL_METERS, d);
 		//pDatabase->Set(CDatabase::DATA_ALTITUDE_ANTENNA_SEALEVEL_METERS, d); // todo
 	}
 	// geodial separation
-	if (GetItem(11, pBuffer, iSize, d) && GetItem(12, pBuffer, iSize, ch) && (toupper(ch) == 'M'))
+	if (GetItem(11, f, d) && GetItem(12, f, ch) && (toupper(ch) == 'M'))
 		pDatabase->Set(CDatabase::DATA_GEOIDAL_SEPARATION, d);
 	// dgps age
-	if (GetItem(13, pBuffer, iSize, i) && (i >= 0))
+	if (GetItem(13, f, i) && (i >= 0))
 		pDatabase->Set(CDatabase::DATA_DGPS_DATA_AGE, i);
 	// dgps station id
-	if (GetItem(14, pBuffer, iSize, i) && (i >= 0) && (i <= 1023))
+	if (GetItem(14, f, i) && (i >= 0) && (i <= 1023))
 		pDatabase->Set(CDatabase::DATA_DIFFERENTIAL_REFERENCE_STATION_ID, i);
 }
 
-void CProtocolNMEA::ProcessGLL(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const
+void CProtocolNMEA::ProcessGLL(const FIELDS_t& f, CDatabase* pDatabase) const
 {
 	pDatabase->MsgOnce(CDatabase::MSG_NMEA_GLL);
 	// Time
-	CheckSetTime(pBuffer, iSize, pDatabase, 5);
+	CheckSetTime(f, pDatabase, 5);
 	// Position
-	SetLatLon(pBuffer, iSize, pDatabase, 1 /* .. 4 */ );
+	SetLatLon(f, pDatabase, 1 /* .. 4 */ );
 	// Status
-	SetStatus(pBuffer, iSize, pDatabase, 6);
+	SetStatus(f, pDatabase, 6);
 	// Mode Indicator
-	SetModeIndicator(pBuffer, iSize, pDatabase, 7);
+	SetModeIndicator(f, pDatabase, 7);
 }
 
-void CProtocolNMEA::ProcessGNS(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const
+void CProtocolNMEA::ProcessGNS(const FIELDS_t& f, CDatabase* pDatabase) const
 {
 	pDatabase->MsgOnce(CDatabase::MSG_NMEA_GNS);
 	double d;
 	int i;
 	// Time
-	CheckSetTime(pBuffer, iSize, pDatabase, 1);
+	CheckSetTime(f, pDatabase, 1);
 	// Position
-	SetLatLon(pBuffer, iSize, pDatabase, 2 /* .. 5 */);
+	SetLatLon(f, pDatabase, 2 /* .. 5 */);
 #if 0 // windows 7 does not expect parsing this
 	{ 
 		// NMEA: GNS mode indicator two chars GPS / Glonass
@@ -232,8 +257,8 @@ void CProtocolNMEA::ProcessGNS(unsigned char* pBuffer, int iSize, CDatabase* pDa
 		// P = Precise.
 		// R = Real Time Kinematic
 		// F = Float RTK
-		char* pEnd = (char*) &pBuffer[iSize];
-		char* pPos = FindPos(6, (char*)pBuffer, pEnd);
+		char* pEnd = (char*) &f.pBuffer[f.iSize];
+		char* pPos = FindPos(6, f);
 		// find the start
 		if (pPos && (pEnd > pPos))
 		{
@@ -245,149 +270,150 @@ void CProtocolNMEA::ProcessGNS(unsigned char* pBuffer, int iSize, CDatabase* pDa
 	}
 #endif
 	// used SVS
-	if (GetItem(7, pBuffer, iSize, i) && (i >= 0))
+	if (GetItem(7, f, i) && (i >= 0))
 		pDatabase->Set(CDatabase::DATA_SATELLITES_USED_COUNT, i);
 	// horizontal DOP
-	if (GetItem(8, pBuffer, iSize, d) && (d < dopLimit))
+	if (GetItem(8, f, d) && (d < dopLimit))
 		pDatabase->Set(CDatabase::DATA_HORIZONAL_DILUTION_OF_PRECISION, d);
 	// altitude
-	if (GetItem(9, pBuffer, iSize, d))
+	if (GetItem(9, f, d))
 		pDatabase->Set(CDatabase::DATA_ALTITUDE_SEALEVEL_METERS, d);
 	// geodial separation
-	if (GetItem(10, pBuffer, iSize, d))
+	if (GetItem(10, f, d))
 		pDatabase->Set(CDatabase::DATA_GEOIDAL_SEPARATION, d);
 	// dgps age
-	if (GetItem(11, pBuffer, iSize, i) && (i >= 0))
+	if (GetItem(11, f, i) && (i >= 0))
 		pDatabase->Set(CDatabase::DATA_DGPS_DATA_AGE, i);
 	// dgps station id
-	if (GetItem(12, pBuffer, iSize, i) && (i >= 0) && (i <= 1023))
+	if (GetItem(12, f, i) && (i >= 0) && (i <= 1023))
 		pDatabase->Set(CDatabase::DATA_DIFFERENTIAL_REFERENCE_STATION_ID, i);
 }
 
-void CProtocolNMEA::ProcessGRS(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const
+void CProtocolNMEA::ProcessGRS(const FIELDS_t& f, CDatabase* pDatabase) const
 {
 	pDatabase->MsgOnce(CDatabase::MSG_NMEA_GRS);
 	// Time
-	CheckSetTime(pBuffer, iSize, pDatabase, 1);
+	CheckSetTime(f, pDatabase, 1);
 	// Mode
 	// Residuals
 }
 
 
-void CProtocolNMEA::ProcessGSA(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const
+void CProtocolNMEA::ProcessGSA(const FIELDS_t& f, CDatabase* pDatabase) const
 {
 	pDatabase->MsgOnce(CDatabase::MSG_NMEA_GSA);
 	double d;
 	int i;
 	char ch;
-	if (GetItem(1, pBuffer, iSize, ch) && MatchChar("MA", ch, i))
+	if (GetItem(1, f, ch) && MatchChar("MA", ch, i))
 		pDatabase->Set(CDatabase::DATA_GPS_OPERATION_MODE, i);
 	// GSA navigation mode
 	// '1' = Fix not available
 	// '2' = 2D/DR
 	// '3' = 3D
-	if (GetItem(2, pBuffer, iSize, i) && (i >= 1) && (i <= 3))
+	if (GetItem(2, f, i) && (i >= 1) && (i <= 3))
 		pDatabase->Set(CDatabase::DATA_FIX_TYPE, i - 1 /*M$ why add 1*/);
 	// SVS
 	unsigned char svsUsed = 0;
-	for (int ix = 0; (ix < 12) && (svsUsed < CDatabase::MAX_SATELLITES_USED); ix ++)
+	for (int ix = 0; (ix < 12) && (svsUsed < CDatabase::MAX_SATELLITES); ix ++)
 	{
-		if (GetItem(3+ix, pBuffer, iSize, i))
+		if (GetItem(3+ix, f, i))
 		{	
 			//if ((i >= 33) && (i <= 64)) i += 120-33;
-			pDatabase->Set(DATA_SATELLITES_USED_PRNS_(svsUsed), i);
+			pDatabase->SetSatUsed(svsUsed, i);
 			svsUsed ++;
 		}
 	}
-	pDatabase->Set(CDatabase::DATA_SATELLITES_USED_COUNT, svsUsed);
+	pDatabase->SetSatsUsed(svsUsed);
 	// DOP
-	if (GetItem(15, pBuffer, iSize, d) && (d < dopLimit))
+	if (GetItem(15, f, d) && (d < dopLimit))
 		pDatabase->Set(CDatabase::DATA_POSITION_DILUTION_OF_PRECISION, d);
-	if (GetItem(16, pBuffer, iSize, d) && (d < dopLimit))
+	if (GetItem(16, f, d) && (d < dopLimit))
 		pDatabase->Set(CDatabase::DATA_HORIZONAL_DILUTION_OF_PRECISION, d);
-	if (GetItem(17, pBuffer, iSize, d) && (d < dopLimit))
+	if (GetItem(17, f, d) && (d < dopLimit))
 		pDatabase->Set(CDatabase::DATA_VERTICAL_DILUTION_OF_PRECISION, d);
 }
 
-void CProtocolNMEA::ProcessGST(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const
+void CProtocolNMEA::ProcessGST(const FIELDS_t& f, CDatabase* pDatabase) const
 {
 	double d, e;
 	pDatabase->MsgOnce(CDatabase::MSG_NMEA_GST);
 	// Time
-	CheckSetTime(pBuffer, iSize, pDatabase, 1);
+	CheckSetTime(f, pDatabase, 1);
 	// RMS
 	// Std Dev Maj
 	// Std Dev Min
 	// Orient
 	// Std Dev Lat / Lon 
-	if (GetItem(6, pBuffer, iSize, d) && (d < stdDevLimit) && 
-		GetItem(7, pBuffer, iSize, e) && (d < stdDevLimit))
+	if (GetItem(6, f, d) && (d < stdDevLimit) && 
+		GetItem(7, f, e) && (d < stdDevLimit))
 	{
 		d = sqrt(d*d + e*e);
 		pDatabase->Set(CDatabase::DATA_ERROR_RADIUS_METERS, d);
 	}
 	// Std Dev Alt	
-	if (GetItem(8, pBuffer, iSize, d) && (d < stdDevLimit))
+	if (GetItem(8, f, d) && (d < stdDevLimit))
 	{
 		pDatabase->Set(CDatabase::DATA_ALTITUDE_SEALEVEL_ERROR_METERS, d);
 		pDatabase->Set(CDatabase::DATA_ALTITUDE_ELLIPSOID_ERROR_METERS, d);
 	}
 }
 
-void CProtocolNMEA::ProcessGSV(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const
+void CProtocolNMEA::ProcessGSV(const FIELDS_t& f, CDatabase* pDatabase) const
 {
 	int iMessage, iNumber;
-	if (GetItem(1, pBuffer, iSize, iNumber) && GetItem(2, pBuffer, iSize, iMessage) && 
+	if (GetItem(1, f, iNumber) && GetItem(2, f, iMessage) && 
 		(iMessage > 0) && (iNumber > 0) && (iMessage <= iNumber))
 	{
-		if (iMessage == iNumber) // when done set number 
-			pDatabase->MsgOnce(CDatabase::MSG_NMEA_GSV_1);
 		int iChannels;
-		if (GetItem(3, pBuffer, iSize, iChannels))
+		if (GetItem(3, f, iChannels))
 		{
-			pDatabase->Set(CDatabase::DATA_SATELLITES_IN_VIEW, iChannels);
-			if (iChannels > 0)
+			// the slots of this talker follow those of the other talkers in the epoch
+			int talker = (f.pBuffer[1] << 8) | f.pBuffer[2];
+			int ixBase = pDatabase->SetTalkerSatsInView(talker, iChannels, iMessage == 1);
+			if ((ixBase >= 0) && (iChannels > 0))
 			{
 				int ix, ixInView;
 				for ( ix = 0,     ixInView = ix + (iMessage - 1) * 4; 
-					 (ix < 4) && (ixInView < iChannels) && (ixInView < CDatabase::MAX_SATELLITES_IN_VIEW); 
+					 (ix < 4) && (ixInView < iChannels) && (ixBase + ixInView < CDatabase::MAX_SATELLITES); 
 					  ix++,       ixInView ++) 
 				{
 					int i;
 					// prn
-					if (GetItem(4*ix+4, pBuffer, iSize, i))
+					if (GetItem(4*ix+4, f, i))
 					{
 						double d, az, el;
 						//if ((i >= 33) && (i <= 64))	i += 120-33;
-						pDatabase->Set(DATA_SATELLITES_IN_VIEW_PRNS_(ixInView), i);
+						pDatabase->SetSatInView(ixBase + ixInView, i);
 						// cno
-						if (GetItem(4*ix+7, pBuffer, iSize, d) && (d > 0.0) && (d < 70.0))
-							pDatabase->Set(DATA_SATELLITES_IN_VIEW_STN_RATIO_(ixInView), d);
+						if (GetItem(4*ix+7, f, d) && (d > 0.0) && (d < 70.0))
+							pDatabase->SetSatCno(ixBase + ixInView, d);
 						// el / az
-						if ( GetItem(4*ix+5, pBuffer, iSize, el) && (el >=  -90.0) && (el <=  90.0) && 
-							 GetItem(4*ix+6, pBuffer, iSize, az) && (az >= -180.0) && (az <= 360.0)
+						if ( GetItem(4*ix+5, f, el) && (el >=  -90.0) && (el <=  90.0) && 
+							 GetItem(4*ix+6, f, az) && (az >= -180.0) && (az <= 360.0)
 							 // && (el || az) /* some receivers report 0/0 if az cannot be determined*/
 							 )
 						{
-							pDatabase->Set(DATA_SATELLITES_IN_VIEW_ELEVATION_(ixInView), el);
-							pDatabase->Set(DATA_SATELLITES_IN_VIEW_AZIMUTH_(ixInView),	 CDatabase::Degrees360(az));
+							pDatabase->SetSatAzEl(ixBase + ixInView, el, CDatabase::Degrees360(az));
 						}
 					}
 				}
 			}
 		}
+		if (iMessage == iNumber) // when done set number 
+			pDatabase->MsgOnce(CDatabase::MSG_NMEA_GSV_1);
 	}
 }
 
-void CProtocolNMEA::ProcessRMC(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const
+void CProtocolNMEA::ProcessRMC(const FIELDS_t& f, CDatabase* pDatabase) const
 {
 	pDatabase->MsgOnce(CDatabase::MSG_NMEA_RMC);
 	char ch;
 	double d, second = 0.0;
 	int year = 0, month = 0, day = 0, hour = 0, minute = 0, i = 0;
 	// Time / Date
-	bool bTimeOk = GetItem(1, pBuffer, iSize, d) && CalcTime(d, hour, minute, second);
-	bool bDateOk = GetItem(9, pBuffer, iSize, i) && CalcDate(i, day, month, year);
+	bool bTimeOk = GetItem(1, f, d) && CalcTime(d, hour, minute, second);
+	bool bDateOk = GetItem(9, f, i) && CalcDate(i, day, month, year);
 	if (bDateOk)
 	{
 		if (year < 80)
@@ -413,20 +439,20 @@ void CProtocolNMEA::ProcessRMC(unsigned char* pBuffer, int iSize, CDatabase* pDa
 		pDatabase->Set(CDatabase::DATA_DATE_DAY,   day);
 	}
 	// RMC/GLL status
-	SetStatus(pBuffer, iSize, pDatabase, 2);
+	SetStatus(f, pDatabase, 2);
 	// Lat / Lon
-	SetLatLon(pBuffer, iSize, pDatabase, 3 /* .. 6 */);
+	SetLatLon(f, pDatabase, 3 /* .. 6 */);
 	// SOG
-	if (GetItem(7, pBuffer, iSize, d) && (d >= 0.0))
+	if (GetItem(7, f, d) && (d >= 0.0))
 		pDatabase->Set(CDatabase::DATA_SPEED_KNOTS,  d);
 	// COG
-	if (GetItem(8, pBuffer, iSize, d) && (d >= -180.0) && (d <= 360.0))
+	if (GetItem(8, f, d) && (d >= -180.0) && (d <= 360.0))
 	{
 		d = (d < 0.0) ? d + 360.0 : d;
 		pDatabase->Set(CDatabase::DATA_TRUE_HEADING_DEGREES,  d);
 	}
 	// COG Mag
-	if (GetItem(10, pBuffer, iSize, d) && GetItem(11, pBuffer, iSize, ch) && (d >= 0.0) && (d <= 180.0))
+	if (GetItem(10, f, d) && GetItem(11, f, ch) && (d >= 0.0) && (d <= 180.0))
 	{
 		ch = (char) toupper(ch); // be tolerant
 		// (E)ast subtracts from true course
@@ -437,48 +463,48 @@ void CProtocolNMEA::ProcessRMC(unsigned char* pBuffer, int iSize, CDatabase* pDa
 			pDatabase->Set(CDatabase::DATA_MAGNETIC_VARIATION, -d);
 	}
 	// Mode Indicator
-	SetModeIndicator(pBuffer, iSize, pDatabase, 12);
+	SetModeIndicator(f, pDatabase, 12);
 }
 
-void CProtocolNMEA::ProcessVTG(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const
+void CProtocolNMEA::ProcessVTG(const FIELDS_t& f, CDatabase* pDatabase) const
 {
 	pDatabase->MsgOnce(CDatabase::MSG_NMEA_VTG);
 	double d;
 	char ch;
 	// COG (true)
-	if (GetItem(1, pBuffer, iSize, d) && (d >= -180.0) && (d <= 360.0) && 
-		GetItem(2, pBuffer, iSize, ch) && (toupper(ch) == _T('T')))
+	if (GetItem(1, f, d) && (d >= -180.0) && (d <= 360.0) && 
+		GetItem(2, f, ch) && (toupper(ch) == _T('T')))
 		pDatabase->Set(CDatabase::DATA_TRUE_HEADING_DEGREES, CDatabase::Degrees360(d));
 	// COG (magnetic) 
-	if (GetItem(3, pBuffer, iSize, d) && (d >= -180.0) && (d <= 360.0) && 
-		GetItem(4, pBuffer, iSize, ch) && (toupper(ch) == _T('M')))
+	if (GetItem(3, f, d) && (d >= -180.0) && (d <= 360.0) && 
+		GetItem(4, f, ch) && (toupper(ch) == _T('M')))
 		pDatabase->Set(CDatabase::DATA_MAGNETIC_HEADING_DEGREES, CDatabase::Degrees360(d));
 	// SOG (knots) 
-	if (GetItem(5, pBuffer, iSize, d) && (d >= 0.0) && 
-		GetItem(6, pBuffer, iSize, ch) && (toupper(ch) == _T('N')))
+	if (GetItem(5, f, d) && (d >= 0.0) && 
+		GetItem(6, f, ch) && (toupper(ch) == _T('N')))
 	{
 		pDatabase->Set(CDatabase::DATA_SPEED_KNOTS, d);
 	}
 	// SOG (km/hr) 
-	else if (GetItem(7, pBuffer, iSize, d) && (d >= 0.0) && 
-			 GetItem(8, pBuffer, iSize, ch) && (toupper(ch) == _T('K')))
+	else if (GetItem(7, f, d) && (d >= 0.0) && 
+			 GetItem(8, f, ch) && (toupper(ch) == _T('K')))
 	{
 		pDatabase->Set(CDatabase::DATA_SPEED_KNOTS, d * 3600.0 / METERS_PER_NAUTICAL_MILE);
 	}
 	// Mode Indicator
-	SetModeIndicator(pBuffer, iSize, pDatabase, 9);
+	SetModeIndicator(f, pDatabase, 9);
 }
 
-void CProtocolNMEA::ProcessZDA(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const
+void CProtocolNMEA::ProcessZDA(const FIELDS_t& f, CDatabase* pDatabase) const
 {
 	pDatabase->MsgOnce(CDatabase::MSG_NMEA_ZDA);
 	double d, second = 0.0;
 	int year = 0, month = 0, day = 0, hour = 0, minute = 0;
-	bool bTimeOk = GetItem(1, pBuffer, iSize, d) && 
+	bool bTimeOk = GetItem(1, f, d) && 
 				   CalcTime(d, hour, minute, second);
-	bool bDateOk = GetItem(2, pBuffer, iSize, day) && 
-				   GetItem(3, pBuffer, iSize, month) && 
-				   GetItem(4, pBuffer, iSize, year);
+	bool bDateOk = GetItem(2, f, day) && 
+				   GetItem(3, f, month) && 
+				   GetItem(4, f, year);
 	if ((bTimeOk && !pDatabase->CheckTime(hour,minute,second)) ||
 		(bDateOk && !pDatabase->CheckDate(year,month,day)))
 	{
@@ -500,29 +526,29 @@ void CProtocolNMEA::ProcessZDA(unsigned char* pBuffer, int iSize, CDatabase* pDa
 
 // HELPER for NMEA decoding 
 
-void CProtocolNMEA::SetLatLon(unsigned char* pBuffer, int iSize, CDatabase* pDatabase, int ix)
+void CProtocolNMEA::SetLatLon(const FIELDS_t& f, CDatabase* pDatabase, int ix)
 {
 	double d;
 	char ch;
-	if (GetItem(ix, pBuffer, iSize, d)   && GetItem(ix+1, pBuffer, iSize, ch) && CalcLat(ch, d))
+	if (GetItem(ix, f, d)   && GetItem(ix+1, f, ch) && CalcLat(ch, d))
 		pDatabase->Set(CDatabase::DATA_LATITUDE_DEGREES,  d);
 	// Position Longitude
-	if (GetItem(ix+2, pBuffer, iSize, d) && GetItem(ix+3, pBuffer, iSize, ch) && CalcLon(ch, d))
+	if (GetItem(ix+2, f, d) && GetItem(ix+3, f, ch) && CalcLon(ch, d))
 		pDatabase->Set(CDatabase::DATA_LONGITUDE_DEGREES, d);
 }	
 
-void CProtocolNMEA::SetStatus(unsigned char* pBuffer, int iSize, CDatabase* pDatabase, int ix)
+void CProtocolNMEA::SetStatus(const FIELDS_t& f, CDatabase* pDatabase, int ix)
 {
 	int i;
 	char ch;
 	// NMEA: RMC/GLL status
 	// 'A' = Data valid
 	// 'V' = Navigation receiver warning (inValid)
-	if (GetItem(ix, pBuffer, iSize, ch) && MatchChar("AV", ch, i))
+	if (GetItem(ix, f, ch) && MatchChar("AV", ch, i))
 		pDatabase->Set(CDatabase::DATA_GPS_STATUS, i + 1 /* M$ why add 1 */);
 }
 
-void CProtocolNMEA::SetModeIndicator(unsigned char* pBuffer, int iSize, CDatabase* pDatabase, int ix)
+void CProtocolNMEA::SetModeIndicator(const FIELDS_t& f, CDatabase* pDatabase, int ix)
 {
 	int i;
 	char ch;
@@ -534,15 +560,15 @@ void CProtocolNMEA::SetModeIndicator(unsigned char* pBuffer, int iSize, CDatabas
 	// 'A' = Autonomous mode
 	// 'M' = Manual input mode
 	// 'S' = Simulator mode
-	if (GetItem(ix, pBuffer, iSize, ch) && MatchChar("ADEMSN", ch, i))
+	if (GetItem(ix, f, ch) && MatchChar("ADEMSN", ch, i))
 		pDatabase->Set(CDatabase::DATA_GPS_SELECTION_MODE, i);
 }
 
-void CProtocolNMEA::CheckSetTime(unsigned char* pBuffer, int iSize, CDatabase* pDatabase, int ix)
+void CProtocolNMEA::CheckSetTime(const FIELDS_t& f, CDatabase* pDatabase, int ix)
 {
 	double d, second = 0.0;
 	int hour = 0, minute = 0;
-	bool bTimeOk = GetItem(ix, pBuffer, iSize, d) && CalcTime(d, hour, minute, second);
+	bool bTimeOk = GetItem(ix, f, d) && CalcTime(d, hour, minute, second);
 	if (bTimeOk && !pDatabase->CheckTime(hour,minute,second))
 	{
 		pDatabase->Commit();			
@@ -609,44 +635,115 @@ const char* CProtocolNMEA::GetItem(int iIndex, unsigned char* pBuffer, int iSize
 }
 #endif
 
-char* CProtocolNMEA::FindPos(int iIndex, char* pStart, const char* pEnd)
+void CProtocolNMEA::Tokenize(unsigned char* pBuffer, int iSize, FIELDS_t& f)
 {
-	// find the start
-	for (; (pStart < pEnd) && (iIndex > 0); pStart ++)
+	// record where each field starts, field 0 is the address field
+	f.pBuffer = pBuffer;
+	f.iSize = iSize;
+	f.iNum = 1;
+	f.aiStart[0] = 0;
+	for (int i = 0; (i < iSize) && (f.iNum < NMEA_MAX_FIELDS); i ++)
 	{
-		if (*pStart == ',')
-			iIndex --;
+		if (pBuffer[i] == ',')
+			f.aiStart[f.iNum ++] = i + 1;
 	}
+}
+
+char* CProtocolNMEA::FindPos(int iIndex, const FIELDS_t& f)
+{
 	// found and check bounds
-	if ((iIndex == 0) && (pStart < pEnd) && 
-		(*pStart != ',') && (*pStart != '*') && (*pStart != '\r') && (*pStart != '\n'))
-		return pStart;
-	else 
-		return NULL;
+	if ((iIndex >= 0) && (iIndex < f.iNum) && (f.aiStart[iIndex] < f.iSize))
+	{
+		char* pStart = (char*) &f.pBuffer[f.aiStart[iIndex]];
+		if ((*pStart != ',') && (*pStart != '*') && (*pStart != '\r') && (*pStart != '\n'))
+			return pStart;
+	}
+	return NULL;
 }
 
-bool CProtocolNMEA::GetItem(int iIndex, unsigned char* pBuffer, int iSize, double& dValue)
+bool CProtocolNMEA::GetItem(int iIndex, const FIELDS_t& f, double& dValue)
 {
-	char* pEnd = (char*) &pBuffer[iSize];
-	char* pPos = FindPos(iIndex, (char*)pBuffer, pEnd);
+	const char* pEnd = (const char*) &f.pBuffer[f.iSize];
+	const char* pPos = FindPos(iIndex, f);
 	// find the start
 	if (!pPos || (pEnd <= pPos))
 		return false;
+	// the last char of the sentence is never part of a number (same as the 
+	// zero termination we used to put there for strtod)
+	return ParseDouble(pPos, pEnd - 1, dValue);
+}
+
+bool CProtocolNMEA::ParseDouble(const char* pStart, const char* pEnd, double& dValue)
+{
+	// exact powers of ten, all of them are representable in a double
+	static const double s_pow10[] = {
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11, 
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const char* p = pStart;
+	// same leading white space and sign handling as strtod
+	while ((p < pEnd) && isspace((unsigned char) *p))
+		p ++;
+	bool bNeg = false;
+	if ((p < pEnd) && ((*p == '-') || (*p == '+')))
+	{
+		bNeg = (*p == '-');
+		p ++;
+	}
+	// collect the digits of ddmm.mmmmm or any other plain decimal as an integer 
+	unsigned long long mant = 0;
+	int iAll = 0;
+	int iDigits = 0;
+	int iFrac = 0;
+	bool bDot = false;
+	for (; p < pEnd; p ++)
+	{
+		if ((*p >= '0') && (*p <= '9'))
+		{
+			iAll ++;
+			// ignore leading zeros, they do not limit the precision
+			if (mant || (*p != '0'))
+				iDigits ++;
+			mant = mant * 10 + (unsigned long long)(*p - '0');
+			if (bDot)
+				iFrac ++;
+			if (iDigits > 15)
+				break; // may not be exact anymore
+		}
+		else if ((*p == '.') && !bDot)
+			bDot = true;
+		else
+			break;
+	}
+	// the value is a integer below 2^53 divided by an exact power of ten, a single 
+	// division of two exact values is correctly rounded and gives the same result 
+	// as strtod. Exponents, hex, inf, nan and long numbers are left to strtod.
+	if ((iDigits <= 15) && (iFrac < (int)(sizeof(s_pow10)/sizeof(*s_pow10))) &&
+		((p == pEnd) || !isalnum((unsigned char)*p)))
+	{
+		if (iAll == 0)
+			return false;
+		double d = (double) mant;
+		if (iFrac)
+			d /= s_pow10[iFrac];
+		dValue = bNeg ? -d : d;
+		return true;
+	}
+	// the rare cases, use a zero terminated copy instead of touching the buffer
+	char str[NMEA_MAX_SIZE + 1];
+	size_t len = (size_t)(pEnd - pStart);
+	if (len > NMEA_MAX_SIZE)
+		len = NMEA_MAX_SIZE;
+	memcpy(str, pStart, len);
+	str[len] = '\0';
 	char* pTemp;
-	// M$ specific - because the strtod function uses a strlen we make sure that 
-	// the string is zero terminated, this ensures correct behaviour of the function 
-	char chEnd = pEnd[-1];
-	pEnd[-1] = '\0';
-	dValue = strtod(pPos, &pTemp);
-	// restore the last character
-	pEnd[-1] = chEnd;
-	return (pTemp > pPos);
+	dValue = strtod(str, &pTemp);
+	return (pTemp > str);
 }
 
-bool CProtocolNMEA::GetItem(int iIndex, unsigned char* pBuffer, int iSize, int& iValue, int iBase /*=10*/)
+bool CProtocolNMEA::GetItem(int iIndex, const FIELDS_t& f, int& iValue, int iBase /*=10*/)
 {
-	char* pEnd = (char*) &pBuffer[iSize];
-	char* pPos = FindPos(iIndex, (char*)pBuffer, pEnd);
+	char* pPos = FindPos(iIndex, f);
 	// find the start
 	if (!pPos)
 		return false;
@@ -655,15 +752,15 @@ bool CProtocolNMEA::GetItem(int iIndex, unsigned char* pBuffer, int iSize, int&
 	return (pTemp > pPos);
 }
 
-bool CProtocolNMEA::GetItem(int iIndex, unsigned char* pBuffer, int iSize, char& chValue)
+bool CProtocolNMEA::GetItem(int iIndex, const FIELDS_t& f, char& chValue)
 {
-	char* pEnd = (char*) &pBuffer[iSize];
-	char* pPos = FindPos(iIndex, (char*)pBuffer, pEnd);
+	char* pEnd = (char*) &f.pBuffer[f.iSize];
+	char* pPos = FindPos(iIndex, f);
 	// find the start
 	if (!pPos)
 		return false;
 	// skip leading spaces
-	while ((pPos < pEnd) && isspace(*pPos))
+	while ((pPos < pEnd) && isspace((unsigned char) *pPos))
 		pPos++;
 	// check bound
 	if ((pPos < pEnd) && 
@@ -35,38 +35,51 @@ public:
 	enum { 
 		NMEA_CHAR_SYNC = 36 /* '$' */,
 		NMEA_MAX_SIZE  = 82 /* this is the limit of the NMEA standard */,
-		PUBX_MAX_SIZE  = 512
+		PUBX_MAX_SIZE  = 512,
+		NMEA_MAX_FIELDS = NMEA_MAX_SIZE /* a standard sentence can not have more fields */
 	};
 
 	int Parse(unsigned char* pBuffer, int iSize); 
 	static int ParseFunc(const unsigned char* pBuffer, int iSize); 
 	void __drv_floatUsed Process(unsigned char* pBuffer, int iSize, CDatabase* pDatabase);
 	PROTOCOL_t GetType(void) { return NMEA; }
+	int GetSyncChar(void) const { return NMEA_CHAR_SYNC; }
 
 protected:
-	void __drv_floatUsed ProcessGBS(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const;
-	void __drv_floatUsed ProcessGGA(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const;
-	void __drv_floatUsed ProcessGLL(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const;
-	void __drv_floatUsed ProcessGNS(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const;
-	void __drv_floatUsed ProcessGRS(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const;
-	void __drv_floatUsed ProcessGSA(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const;
-	void __drv_floatUsed ProcessGST(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const;
-	void __drv_floatUsed ProcessGSV(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const;
-	void __drv_floatUsed ProcessRMC(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const;
-	void __drv_floatUsed ProcessVTG(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const;
-	void __drv_floatUsed ProcessZDA(unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const;
+	//! Start offsets of all fields of a sentence, see Tokenize
+	typedef struct
+	{
+		unsigned char* pBuffer;			//!< the sentence
+		int iSize;						//!< size of the sentence
+		int iNum;						//!< number of fields found (including the address field)
+		int aiStart[NMEA_MAX_FIELDS];	//!< offset of the first char of each field
+	} FIELDS_t;
+
+	void __drv_floatUsed ProcessGBS(const FIELDS_t& f, CDatabase* pDatabase) const;
+	void __drv_floatUsed ProcessGGA(const FIELDS_t& f, CDatabase* pDatabase) const;
+	void __drv_floatUsed ProcessGLL(const FIELDS_t& f, CDatabase* pDatabase) const;
+	void __drv_floatUsed ProcessGNS(const FIELDS_t& f, CDatabase* pDatabase) const;
+	void __drv_floatUsed ProcessGRS(const FIELDS_t& f, CDatabase* pDatabase) const;
+	void __drv_floatUsed ProcessGSA(const FIELDS_t& f, CDatabase* pDatabase) const;
+	void __drv_floatUsed ProcessGST(const FIELDS_t& f, CDatabase* pDatabase) const;
+	void __drv_floatUsed ProcessGSV(const FIELDS_t& f, CDatabase* pDatabase) const;
+	void __drv_floatUsed ProcessRMC(const FIELDS_t& f, CDatabase* pDatabase) const;
+	void __drv_floatUsed ProcessVTG(const FIELDS_t& f, CDatabase* pDatabase) const;
+	void __drv_floatUsed ProcessZDA(const FIELDS_t& f, CDatabase* pDatabase) const;
 	
-	static __drv_floatUsed void SetLatLon(unsigned char* pBuffer, int iSize, CDatabase* pDatabase, int ix);
-	static void SetStatus(unsigned char* pBuffer, int iSize, CDatabase* pDatabase, int ix);
-	static void SetModeIndicator(unsigned char* pBuffer, int iSize, CDatabase* pDatabase, int ix);
-	static __drv_floatUsed void CheckSetTime(unsigned char* pBuffer, int iSize, CDatabase* pDatabase, int ix);
+	static __drv_floatUsed void SetLatLon(const FIELDS_t& f, CDatabase* pDatabase, int ix);
+	static void SetStatus(const FIELDS_t& f, CDatabase* pDatabase, int ix);
+	static void SetModeIndicator(const FIELDS_t& f, CDatabase* pDatabase, int ix);
+	static __drv_floatUsed void CheckSetTime(const FIELDS_t& f, CDatabase* pDatabase, int ix);
 
+	static void Tokenize(unsigned char* pBuffer, int iSize, FIELDS_t& f);
 	static int GetItemCount(unsigned char* pBuffer, int iSize);
 	static const char* GetItem(int iIndex, unsigned char* pBuffer, int iSize);
-	static char* FindPos(int iIndex, char* pStart, const char* pEnd);
-	static bool __drv_floatUsed GetItem(int iIndex, unsigned char* pBuffer, int iSize, double& dValue);
-	static bool GetItem(int iIndex, unsigned char* pBuffer, int iSize, int& iValue, int iBase = 10);
-	static bool GetItem(int iIndex, unsigned char* pBuffer, int iSize, char& ch);
+	static char* FindPos(int iIndex, const FIELDS_t& f);
+	static bool __drv_floatUsed GetItem(int iIndex, const FIELDS_t& f, double& dValue);
+	static bool __drv_floatUsed ParseDouble(const char* pStart, const char* pEnd, double& dValue);
+	static bool GetItem(int iIndex, const FIELDS_t& f, int& iValue, int iBase = 10);
+	static bool GetItem(int iIndex, const FIELDS_t& f, char& ch);
 	static bool MatchChar(const char* string, char ch, int& i);
 	static __drv_floatUsed double Limit360(double);
 	static double CalcAngle(double d);
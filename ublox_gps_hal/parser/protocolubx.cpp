@@ -85,10 +85,12 @@ void CProtocolUBX::Process(unsigned char* pBuffer, int iSize, CDatabase* pDataba
 	if      (pBuffer[2] == 0x01/*NAV*/ && pBuffer[3] == 0x06/*SOL*/)	ProcessNavSol(   pBuffer, iSize, pDatabase);
 	else if (pBuffer[2] == 0x01/*NAV*/ && pBuffer[3] == 0x07/*PVT*/)	ProcessNavPvt(   pBuffer, iSize, pDatabase);
 	else if (pBuffer[2] == 0x01/*NAV*/ && pBuffer[3] == 0x30/*SVINFO*/)	ProcessNavSvInfo(pBuffer, iSize, pDatabase);
+	else if (pBuffer[2] == 0x01/*NAV*/ && pBuffer[3] == 0x61/*EOE*/)	ProcessNavEoe(   pBuffer, iSize, pDatabase);
 #ifdef SUPL_ENABLED
 	else if (pBuffer[2] == 0x02/*RXM*/ && pBuffer[3] == 0x12/*MEAS*/)	ProcessRxmMeas(pBuffer, iSize, pDatabase);
 #endif	
 
+	pDatabase->MsgDone();
 	pDatabase->AddMessage(pBuffer, iSize);
 }
 
@@ -272,30 +274,27 @@ void CProtocolUBX::ProcessNavSvInfo(const unsigned char* pBuffer, int iSize, CDa
 				memcpy(pCh, &pBuffer[(size_t)(6+(int)sizeof(STRUCT)+ix*(int)sizeof(STRUCT_CH))], sizeof(ch));
 				int svid = CDatabase::ConvertPrn2NmeaSvid((int)pCh->svid);
 				bool bAzEl = (pCh->az >= -180) && (pCh->az <= 360) && (pCh->el >= -90) && (pCh->el <= 90);
-				if (svid && (ixInView <= CDatabase::MAX_SATELLITES_IN_VIEW) && (bAzEl || pCh->cno))
+				if (svid && (ixInView < CDatabase::MAX_SATELLITES) && (bAzEl || pCh->cno))
 				{
-					pDatabase->Set(DATA_SATELLITES_IN_VIEW_PRNS_(ixInView), svid);
+					pDatabase->SetSatInView(ixInView, svid);
 					if (bAzEl)
-					{
-						pDatabase->Set(DATA_SATELLITES_IN_VIEW_ELEVATION_(ixInView), (double)pCh->el);
-						pDatabase->Set(DATA_SATELLITES_IN_VIEW_AZIMUTH_(ixInView),	 CDatabase::Degrees360((double)pCh->az));
-					}
+						pDatabase->SetSatAzEl(ixInView, (double)pCh->el, CDatabase::Degrees360((double)pCh->az));
 					if (pCh->cno)
-						pDatabase->Set(DATA_SATELLITES_IN_VIEW_STN_RATIO_(ixInView), (double)pCh->cno);
-					pDatabase->Set(DATA_UBX_SATELLITES_IN_VIEW_ORB_STA_(ixInView), 
+						pDatabase->SetSatCno(ixInView, (double)pCh->cno);
+					pDatabase->SetSatOrbSta(ixInView, 
 								((pCh->flags & ALM) ? 2 : 0) | 
 								((pCh->flags & EPH) ? 1 : 0));
 					ixInView ++;
 					// not used:  pch->ch,  (pch->prres*1e-2)
 				}
-				if (svid && (ixUsed <= CDatabase::MAX_SATELLITES_USED) && (pCh->flags & USED))
+				if (svid && (ixUsed < CDatabase::MAX_SATELLITES) && (pCh->flags & USED))
 				{
-					pDatabase->Set(DATA_SATELLITES_USED_PRNS_(ixUsed), svid);
+					pDatabase->SetSatUsed(ixUsed, svid);
 					ixUsed++;
 				}
 			}
-			pDatabase->Set(CDatabase::DATA_SATELLITES_IN_VIEW,	  ixInView);
-			pDatabase->Set(CDatabase::DATA_SATELLITES_USED_COUNT, ixUsed);
+			pDatabase->SetSatsInView(ixInView);
+			pDatabase->SetSatsUsed(ixUsed);
 		}
 	}
 }
@@ -357,6 +356,14 @@ void CProtocolUBX::ProcessRxmMeas(const unsigned char* pBuffer, int iSize, CData
 }
 #endif
 
+void CProtocolUBX::ProcessNavEoe(const unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const
+{
+	// output after all navigation messages of the epoch 
+	if (iSize == (int)(sizeof(U4) + UBX_FRM_SIZE))
+		pDatabase->EpochEnd();
+	((void) (pBuffer));
+}
+
 void CProtocolUBX::CheckSetTtag(CDatabase* pDatabase, U4 ttag) const
 {
 	double d = ttag * 1e-3;
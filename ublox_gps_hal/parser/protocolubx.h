@@ -70,12 +70,14 @@ public:
 	static int ParseFunc(const unsigned char* pBuffer, int iSize);
 	void __drv_floatUsed Process(unsigned char* pBuffer, int iSize, CDatabase* pDatabase);
 	PROTOCOL_t GetType(void) { return UBX; }
+	int GetSyncChar(void) const { return UBX_CHAR_SYNC0; }
     unsigned int NewMsg(U1 classId, U1 msgId, const void* pPayload, unsigned int iPayloadSize, unsigned char **ppMsg) const;
 
 protected:
 	void __drv_floatUsed ProcessNavSol(   const unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const;
 	void __drv_floatUsed ProcessNavPvt(   const unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const;
 	void __drv_floatUsed ProcessNavSvInfo(const unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const;
+	void __drv_floatUsed ProcessNavEoe(   const unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const;
 #ifdef SUPL_ENABLED		
 	void __drv_floatUsed ProcessRxmMeas(const unsigned char* pBuffer, int iSize, CDatabase* pDatabase) const;
 #endif
@@ -35,7 +35,7 @@ LOCAL_MODULE := libSupl
 
 LOCAL_MODULE_TAGS := eng
 
-LOCAL_CFLAGS :=
+LOCAL_CFLAGS := -DASN_ARENA
 
 LOCAL_PRELINK_MODULE := false
 #LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/
@@ -23,10 +23,21 @@ extern "C" {
 #define	ASN1C_ENVIRONMENT_VERSION	922	/* Compile-time version */
 int get_asn1c_environment_version(void);	/* Run-time version */
 
+#ifdef	ASN_ARENA	/* Decoded messages are allocated in arenas, see supl/asnarena.cpp */
+void *asnArenaCalloc(size_t nmemb, size_t size);
+void *asnArenaMalloc(size_t size);
+void *asnArenaRealloc(void *ptr, size_t size);
+void asnArenaFree(void *ptr);
+#define	CALLOC(nmemb, size)	asnArenaCalloc(nmemb, size)
+#define	MALLOC(size)		asnArenaMalloc(size)
+#define	REALLOC(oldptr, size)	asnArenaRealloc(oldptr, size)
+#define	FREEMEM(ptr)		asnArenaFree(ptr)
+#else	/* !ASN_ARENA */
 #define	CALLOC(nmemb, size)	calloc(nmemb, size)
 #define	MALLOC(size)		malloc(size)
 #define	REALLOC(oldptr, size)	realloc(oldptr, size)
 #define	FREEMEM(ptr)		free(ptr)
+#endif	/* ASN_ARENA */
 
 /*
  * A macro for debugging the ASN.1 internals.
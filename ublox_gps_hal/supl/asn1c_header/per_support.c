@@ -31,15 +31,76 @@ per_get_undo(asn_per_data_t *pd, int nbits) {
 	}
 }
 
+/*
+ * Load the next 8 bytes as a big-endian word, bytes past (avail) read as 0.
+ * A whole word is loaded at once where the stream is long enough.
+ */
+static inline uint64_t
+per_load_be64(const uint8_t *buf, size_t avail) {
+	uint64_t word = 0;
+	size_t i;
+
+	if(avail >= 8) {
+#if	defined(__GNUC__) && defined(__BYTE_ORDER__) \
+	&& (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+		memcpy(&word, buf, 8);
+		return __builtin_bswap64(word);
+#elif	defined(__GNUC__) && defined(__BYTE_ORDER__) \
+	&& (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+		memcpy(&word, buf, 8);
+		return word;
+#else
+		avail = 8;
+#endif
+	}
+
+	if(avail == 0)
+		return 0;
+	for(i = 0; i < avail; i++)
+		word = (word << 8) | buf[i];
+	return word << (8 * (8 - avail));
+}
+
+/*
+ * Store a word as 8 big-endian bytes.
+ */
+static inline void
+per_store_be64(uint8_t *buf, uint64_t word) {
+#if	defined(__GNUC__) && defined(__BYTE_ORDER__) \
+	&& (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+	word = __builtin_bswap64(word);
+	memcpy(buf, &word, 8);
+#elif	defined(__GNUC__) && defined(__BYTE_ORDER__) \
+	&& (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	memcpy(buf, &word, 8);
+#else
+	int i;
+	for(i = 0; i < 8; i++)
+		buf[i] = word >> (56 - 8 * i);
+#endif
+}
+
+/*
+ * Normalize position indicator.
+ */
+static inline void
+per_get_normalize(asn_per_data_t *pd) {
+	if(pd->nboff >= 8) {
+		pd->buffer += (pd->nboff >> 3);
+		pd->nbits  -= (pd->nboff & ~0x07);
+		pd->nboff  &= 0x07;
+	}
+}
+
 /*
  * Extract a small number of bits (<= 31) from the specified PER data pointer.
  */
 int32_t
 per_get_few_bits(asn_per_data_t *pd, int nbits) {
-	size_t off;	/* Next after last bit offset */
 	ssize_t nleft;	/* Number of bits left in this stream */
 	uint32_t accum;
-	const uint8_t *buf;
+	uint64_t word;
+	size_t avail;
 
 	if(nbits < 0)
 		return -1;
@@ -62,46 +123,22 @@ per_get_few_bits(asn_per_data_t *pd, int nbits) {
 		return tailv;
 	}
 
+	if(nbits > 31) return -1;
+	if(nbits == 0) return 0;
+
+	per_get_normalize(pd);
+
 	/*
-	 * Normalize position indicator.
+	 * Extract specified number of bits. With at most 7 bits offset
+	 * they are always within the first 38 bits of the word.
 	 */
-	if(pd->nboff >= 8) {
-		pd->buffer += (pd->nboff >> 3);
-		pd->nbits  -= (pd->nboff & ~0x07);
-		pd->nboff  &= 0x07;
-	}
+	avail = (pd->nbits + 7) >> 3;
+	if(avail < 8)	/* Only load the bytes needed */
+		avail = (pd->nboff + nbits + 7) >> 3;
+	word = per_load_be64(pd->buffer, avail);
+	accum = (uint32_t)((word << pd->nboff) >> (64 - nbits));
 	pd->moved += nbits;
 	pd->nboff += nbits;
-	off = pd->nboff;
-	buf = pd->buffer;
-
-	/*
-	 * Extract specified number of bits.
-	 */
-	if(off <= 8)
-		accum = nbits ? (buf[0]) >> (8 - off) : 0;
-	else if(off <= 16)
-		accum = ((buf[0] << 8) + buf[1]) >> (16 - off);
-	else if(off <= 24)
-		accum = ((buf[0] << 16) + (buf[1] << 8) + buf[2]) >> (24 - off);
-	else if(off <= 31)
-		accum = ((buf[0] << 24) + (buf[1] << 16)
-			+ (buf[2] << 8) + (buf[3])) >> (32 - off);
-	else if(nbits <= 31) {
-		asn_per_data_t tpd = *pd;
-		/* Here are we with our 31-bits limit plus 1..7 bits offset. */
-		per_get_undo(&tpd, nbits);
-		/* The number of available bits in the stream allow
-		 * for the following operations to take place without
-		 * invoking the ->refill() function */
-		accum  = per_get_few_bits(&tpd, nbits - 24) << 24;
-		accum |= per_get_few_bits(&tpd, 24);
-	} else {
-		per_get_undo(pd, nbits);
-		return -1;
-	}
-
-	accum &= (((uint32_t)1 << nbits) - 1);
 
 	ASN_DEBUG("  [PER got %2d<=%2d bits => span %d %+d[%d..%d]:%02x (%d) => 0x%x]",
 		nbits, nleft,
@@ -130,6 +167,43 @@ per_get_many_bits(asn_per_data_t *pd, uint8_t *dst, int alright, int nbits) {
 		nbits &= ~7;
 	}
 
+	if(nbits >= 8 && nbits <= (ssize_t)(pd->nbits - pd->nboff)) {
+		/*
+		 * All whole bytes are in this stream: copy them directly,
+		 * shifting 7 bytes of a word at a time if unaligned.
+		 */
+		const uint8_t *buf;
+		size_t avail;
+		int nbytes = nbits >> 3;
+		int shift;
+		int i = 0;
+
+		per_get_normalize(pd);
+		buf = pd->buffer;
+		avail = (pd->nbits + 7) >> 3;
+		shift = pd->nboff;
+		if(shift == 0) {
+			memcpy(dst, buf, nbytes);
+			i = nbytes;
+		}
+		for(; nbytes - i >= 7; i += 7) {
+			uint64_t word = per_load_be64(buf + i, avail - i) << shift;
+			dst[i]     = word >> 56;
+			dst[i + 1] = word >> 48;
+			dst[i + 2] = word >> 40;
+			dst[i + 3] = word >> 32;
+			dst[i + 4] = word >> 24;
+			dst[i + 5] = word >> 16;
+			dst[i + 6] = word >> 8;
+		}
+		for(; i < nbytes; i++)
+			dst[i] = (buf[i] << shift) | (buf[i + 1] >> (8 - shift));
+		pd->nboff += nbytes << 3;
+		pd->moved += nbytes << 3;
+		dst += nbytes;
+		nbits &= 7;
+	}
+
 	while(nbits) {
 		if(nbits >= 24) {
 			value = per_get_few_bits(pd, 24);
@@ -264,18 +338,17 @@ uper_put_nsnnwn(asn_per_outp_t *po, int n) {
 
 
 /*
- * Put a small number of bits (<= 31).
+ * Put up to 56 bits, combined with the bits already in the last byte
+ * and stored a whole word at a time.
  */
-int
-per_put_few_bits(asn_per_outp_t *po, uint32_t bits, int obits) {
+static int
+per_put_bits(asn_per_outp_t *po, uint64_t bits, int obits) {
 	size_t off;	/* Next after last bit offset */
 	size_t omsk;	/* Existing last byte meaningful bits mask */
 	uint8_t *buf;
 
-	if(obits <= 0 || obits >= 32) return obits ? -1 : 0;
-
-	ASN_DEBUG("[PER put %d bits %x to %p+%d bits]",
-			obits, (int)bits, po->buffer, po->nboff);
+	ASN_DEBUG("[PER put %d bits %llx to %p+%d bits]",
+			obits, (unsigned long long)bits, po->buffer, po->nboff);
 
 	/*
 	 * Normalize position indicator.
@@ -287,9 +360,10 @@ per_put_few_bits(asn_per_outp_t *po, uint32_t bits, int obits) {
 	}
 
 	/*
-	 * Flush whole-bytes output, if necessary.
+	 * Flush whole-bytes output, if necessary. A whole word
+	 * is stored below, so keep 8 bytes of space.
 	 */
-	if(po->nboff + obits > po->nbits) {
+	if(po->nbits < 64) {
 		int complete_bytes = (po->buffer - po->tmpspace);
 		ASN_DEBUG("[PER output %d complete + %d]",
 			complete_bytes, po->flushed_bytes);
@@ -310,43 +384,32 @@ per_put_few_bits(asn_per_outp_t *po, uint32_t bits, int obits) {
 	off = (po->nboff += obits);
 
 	/* Clear data of debris before meaningful bits */
-	bits &= (((uint32_t)1 << obits) - 1);
+	bits &= (((uint64_t)1 << obits) - 1);
 
-	ASN_DEBUG("[PER out %d %u/%x (t=%d,o=%d) %x&%x=%x]", obits,
-		(int)bits, (int)bits,
+	ASN_DEBUG("[PER out %d %llx (t=%d,o=%d) %x&%x=%x]", obits,
+		(unsigned long long)bits,
 		po->nboff - obits, off, buf[0], omsk&0xff, buf[0] & omsk);
 
-	if(off <= 8)	/* Completely within 1 byte */
-		bits <<= (8 - off),
-		buf[0] = (buf[0] & omsk) | bits;
-	else if(off <= 16)
-		bits <<= (16 - off),
-		buf[0] = (buf[0] & omsk) | (bits >> 8),
-		buf[1] = bits;
-	else if(off <= 24)
-		bits <<= (24 - off),
-		buf[0] = (buf[0] & omsk) | (bits >> 16),
-		buf[1] = bits >> 8,
-		buf[2] = bits;
-	else if(off <= 31)
-		bits <<= (32 - off),
-		buf[0] = (buf[0] & omsk) | (bits >> 24),
-		buf[1] = bits >> 16,
-		buf[2] = bits >> 8,
-		buf[3] = bits;
-	else {
-		ASN_DEBUG("->[PER out split %d]", obits);
-		per_put_few_bits(po, bits >> 8, 24);
-		per_put_few_bits(po, bits, obits - 24);
-		ASN_DEBUG("<-[PER out split %d]", obits);
-	}
+	/* With at most 7 bits offset, off is at most 63. The bytes
+	 * past the meaningful bits are overwritten by the next put */
+	per_store_be64(buf, ((uint64_t)(buf[0] & omsk) << 56) | (bits << (64 - off)));
 
-	ASN_DEBUG("[PER out %u/%x => %02x buf+%d]",
-		(int)bits, (int)bits, buf[0], po->buffer - po->tmpspace);
+	ASN_DEBUG("[PER out %llx => %02x buf+%d]",
+		(unsigned long long)bits, buf[0], po->buffer - po->tmpspace);
 
 	return 0;
 }
 
+/*
+ * Put a small number of bits (<= 31).
+ */
+int
+per_put_few_bits(asn_per_outp_t *po, uint32_t bits, int obits) {
+	if(obits <= 0 || obits >= 32) return obits ? -1 : 0;
+
+	return per_put_bits(po, bits, obits);
+}
+
 
 /*
  * Output a large number of bits.
@@ -354,27 +417,15 @@ per_put_few_bits(asn_per_outp_t *po, uint32_t bits, int obits) {
 int
 per_put_many_bits(asn_per_outp_t *po, const uint8_t *src, int nbits) {
 
-	while(nbits) {
-		uint32_t value;
+	/* 7 bytes per word, the last partial byte is left-aligned in src */
+	while(nbits > 0) {
+		int obits = nbits > 56 ? 56 : nbits;
+		uint64_t value = per_load_be64(src, (nbits + 7) >> 3);
 
-		if(nbits >= 24) {
-			value = (src[0] << 16) | (src[1] << 8) | src[2];
-			src += 3;
-			nbits -= 24;
-			if(per_put_few_bits(po, value, 24))
-				return -1;
-		} else {
-			value = src[0];
-			if(nbits > 8)
-				value = (value << 8) | src[1];
-			if(nbits > 16)
-				value = (value << 8) | src[2];
-			if(nbits & 0x07)
-				value >>= (8 - (nbits & 0x07));
-			if(per_put_few_bits(po, value, nbits))
-				return -1;
-			break;
-		}
+		if(per_put_bits(po, value >> (64 - obits), obits))
+			return -1;
+		src += 7;
+		nbits -= obits;
 	}
 
 	return 0;
@@ -8,6 +8,12 @@ rm Makefile.am.sample
 # Then regenerate the whole structure
 make regen
 
+# Re-apply the local changes to the asn1c skeletons: the ASN_ARENA
+# allocator hooks in asn_internal.h, the word wise bit access in
+# per_support.c and the encoded length of BOOLEAN_encode_uper in
+# BOOLEAN.c. Update asn1c_local.patch when changing these files.
+patch -p1 < asn1c_local.patch || exit 1
+
 # Build the debug library
 make -f Makefile.debug
 
@@ -0,0 +1,281 @@
+/*******************************************************************************
+ *
+ * Copyright (C) u-blox AG 
+ * u-blox AG, Thalwil, Switzerland
+ *
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose without fee is hereby granted, provided that this entire notice
+ * is included in all copies of any software which is or includes a copy
+ * or modification of this software and in all copies of the supporting
+ * documentation for such software.
+ *
+ * THIS SOFTWARE IS BEING PROVIDED "AS IS", WITHOUT ANY EXPRESS OR IMPLIED
+ * WARRANTY. IN PARTICULAR, NEITHER THE AUTHOR NOR U-BLOX MAKES ANY
+ * REPRESENTATION OR WARRANTY OF ANY KIND CONCERNING THE MERCHANTABILITY
+ * OF THIS SOFTWARE OR ITS FITNESS FOR ANY PARTICULAR PURPOSE.
+ *
+ *******************************************************************************
+ *
+ * Project: PE_ANS
+ *
+ ******************************************************************************/
+/*!
+  \file
+  \brief  Arena allocator for decoded ASN.1 messages
+
+  Decoding a SUPL or RRLP message allocates every nested structure, string
+  and list separately, and freeing it again walks the whole message. While
+  a message is decoded, the allocations of the decoding thread are instead
+  taken one after the other from a fixed block of memory, an arena. Freeing
+  the parts of such a message does nothing, except for the top level
+  structure, which is always allocated first and releases the whole arena.
+  So ASN_STRUCT_FREE still works on decoded messages as before. Messages
+  not fitting in an arena continue on the heap, as do all allocations when
+  no arena is free.
+*/
+/*******************************************************************************
+ * $Id$
+ * $HeadURL$
+ ******************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "asnarena.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Types & Definitions
+#define ASN_ARENA_NUM	4					//!< Number of decoded messages that can be held in arenas
+#define ASN_ARENA_SIZE	16384				//!< Size of an arena in bytes
+
+//! States of an arena
+typedef enum
+{
+	ARENA_FREE,								//!< Not used
+	ARENA_CLAIMED,							//!< Being set up for a decoding thread
+	ARENA_DECODING,							//!< The owner thread decodes a message into it
+	ARENA_HOLDING							//!< Holds a decoded message until it is freed
+} ArenaState_t;
+
+//! Header in front of each allocation in an arena
+typedef union
+{
+	size_t size;							//!< Size of the allocation
+	long long align;						//!< Keeps the allocations aligned
+} arenaBlock_t;
+
+//! Arena control
+typedef struct
+{
+	volatile int state;						//!< ArenaState_t of the arena
+	pthread_t owner;						//!< Thread decoding into the arena
+	size_t used;							//!< Bytes in use, allocations are taken from the end
+	size_t last;							//!< Offset of the latest allocation, can be grown in place
+	bool topFreed;							//!< The top level structure was freed while decoding
+} asnArena_t;
+
+///////////////////////////////////////////////////////////////////////////////
+// Static data
+static asnArena_t s_arena[ASN_ARENA_NUM];								//!< Arena control
+static arenaBlock_t s_arenaMem[ASN_ARENA_NUM][ASN_ARENA_SIZE / sizeof(arenaBlock_t)];	//!< Arena memory
+static volatile int s_decodingNum = 0;									//!< Number of arenas in ARENA_DECODING
+
+///////////////////////////////////////////////////////////////////////////////
+//! Get the arena of the calling thread
+/*!
+  \return      : index of the arena the calling thread decodes into, -1 if none
+*/
+static int currentArena(void)
+{
+	if (s_decodingNum == 0)
+		return -1;
+	
+	pthread_t self = pthread_self();
+	for (int i = 0; i < ASN_ARENA_NUM; i++)
+	{
+		if ((s_arena[i].state == ARENA_DECODING) && pthread_equal(s_arena[i].owner, self))
+			return i;
+	}
+	return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Get the arena memory belongs to
+/*!
+  \param ptr   : memory to check
+  \return      : index of the arena containing ptr, -1 if ptr is heap memory
+*/
+static int arenaOf(const void *ptr)
+{
+	const char *pMem = (const char *) s_arenaMem;
+	const char *p = (const char *) ptr;
+	if ((p < pMem) || (p >= pMem + sizeof(s_arenaMem)))
+		return -1;
+	return (int) ((p - pMem) / sizeof(s_arenaMem[0]));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Allocate from an arena
+/*!
+  \param ix    : index of the arena
+  \param size  : number of bytes needed
+  \return      : pointer to the memory, NULL if the arena is full
+*/
+static void *arenaAlloc(int ix, size_t size)
+{
+	asnArena_t *pArena = &s_arena[ix];
+	size_t blocks = 1 + (size + sizeof(arenaBlock_t) - 1) / sizeof(arenaBlock_t);
+	if ((size > ASN_ARENA_SIZE) || (pArena->used + blocks * sizeof(arenaBlock_t) > ASN_ARENA_SIZE))
+		return NULL;
+	
+	arenaBlock_t *pBlock = &s_arenaMem[ix][pArena->used / sizeof(arenaBlock_t)];
+	pBlock->size = size;
+	pArena->last = pArena->used;
+	pArena->used += blocks * sizeof(arenaBlock_t);
+	return pBlock + 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Start decoding a message into an arena
+/*! Until asnArenaEnd is called, the asn1c allocations of the calling thread
+    are taken from the arena claimed here.
+  \return      : true if an arena was claimed, false if all are in use and
+                 the heap is used
+*/
+bool asnArenaBegin(void)
+{
+	for (int i = 0; i < ASN_ARENA_NUM; i++)
+	{
+		if (__sync_bool_compare_and_swap(&s_arena[i].state, ARENA_FREE, ARENA_CLAIMED))
+		{
+			// Owner has to be valid before other threads can see the arena decoding
+			s_arena[i].owner = pthread_self();
+			s_arena[i].used = 0;
+			s_arena[i].last = 0;
+			s_arena[i].topFreed = false;
+			__sync_synchronize();
+			s_arena[i].state = ARENA_DECODING;
+			__sync_fetch_and_add(&s_decodingNum, 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Stop decoding a message into an arena
+/*! The arena keeps the decoded message until its top level structure is
+    freed. Nothing is done if asnArenaBegin did not claim an arena.
+*/
+void asnArenaEnd(void)
+{
+	int ix = currentArena();
+	if (ix < 0)
+		return;
+	
+	__sync_fetch_and_sub(&s_decodingNum, 1);
+	__sync_synchronize();
+	if ((s_arena[ix].used == 0) || s_arena[ix].topFreed)
+		s_arena[ix].state = ARENA_FREE;
+	else
+		s_arena[ix].state = ARENA_HOLDING;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! CALLOC hook of the asn1c runtime
+/*!
+  \param nmemb : number of elements
+  \param size  : size of an element
+  \return      : pointer to the cleared memory, NULL if out of memory
+*/
+void *asnArenaCalloc(size_t nmemb, size_t size)
+{
+	int ix = currentArena();
+	if ((ix >= 0) && (size != 0) && (nmemb <= ASN_ARENA_SIZE / size))
+	{
+		void *p = arenaAlloc(ix, nmemb * size);
+		if (p != NULL)
+		{
+			memset(p, 0, nmemb * size);
+			return p;
+		}
+	}
+	return calloc(nmemb, size);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! MALLOC hook of the asn1c runtime
+/*!
+  \param size  : number of bytes needed
+  \return      : pointer to the memory, NULL if out of memory
+*/
+void *asnArenaMalloc(size_t size)
+{
+	int ix = currentArena();
+	if (ix >= 0)
+	{
+		void *p = arenaAlloc(ix, size);
+		if (p != NULL)
+			return p;
+	}
+	return malloc(size);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! REALLOC hook of the asn1c runtime
+/*! Arena memory is grown in place if it is the latest allocation of the
+    arena the calling thread decodes into, otherwise it is copied.
+  \param ptr   : memory to resize, may be NULL
+  \param size  : number of bytes needed
+  \return      : pointer to the memory, NULL if out of memory
+*/
+void *asnArenaRealloc(void *ptr, size_t size)
+{
+	if (ptr == NULL)
+		return asnArenaMalloc(size);
+	
+	int ix = arenaOf(ptr);
+	if (ix < 0)
+		return realloc(ptr, size);
+	
+	arenaBlock_t *pBlock = (arenaBlock_t *) ptr - 1;
+	size_t offset = (size_t) ((char *) pBlock - (char *) s_arenaMem[ix]);
+	asnArena_t *pArena = &s_arena[ix];
+	if ((ix == currentArena()) && (offset == pArena->last) && (size <= ASN_ARENA_SIZE - offset - sizeof(arenaBlock_t)))
+	{
+		// Latest allocation, so the arena can be extended
+		pBlock->size = size;
+		pArena->used = offset + (1 + (size + sizeof(arenaBlock_t) - 1) / sizeof(arenaBlock_t)) * sizeof(arenaBlock_t);
+		return ptr;
+	}
+	
+	void *p = asnArenaMalloc(size);
+	if (p != NULL)
+		memcpy(p, ptr, (pBlock->size < size) ? pBlock->size : size);
+	return p;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! FREEMEM hook of the asn1c runtime
+/*! Heap memory is freed. Arena memory stays in use, unless it is the top
+    level structure of the message, which releases the arena.
+  \param ptr   : memory to free, may be NULL
+*/
+void asnArenaFree(void *ptr)
+{
+	int ix = arenaOf(ptr);
+	if (ix < 0)
+	{
+		free(ptr);
+	}
+	else if (ptr == &s_arenaMem[ix][1])
+	{
+		if (!__sync_bool_compare_and_swap(&s_arena[ix].state, ARENA_HOLDING, ARENA_FREE))
+		{
+			// Still decoding, released when done
+			s_arena[ix].topFreed = true;
+		}
+	}
+}
@@ -0,0 +1,53 @@
+/*******************************************************************************
+ *
+ * Copyright (C) u-blox AG 
+ * u-blox AG, Thalwil, Switzerland
+ *
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose without fee is hereby granted, provided that this entire notice
+ * is included in all copies of any software which is or includes a copy
+ * or modification of this software and in all copies of the supporting
+ * documentation for such software.
+ *
+ * THIS SOFTWARE IS BEING PROVIDED "AS IS", WITHOUT ANY EXPRESS OR IMPLIED
+ * WARRANTY. IN PARTICULAR, NEITHER THE AUTHOR NOR U-BLOX MAKES ANY
+ * REPRESENTATION OR WARRANTY OF ANY KIND CONCERNING THE MERCHANTABILITY
+ * OF THIS SOFTWARE OR ITS FITNESS FOR ANY PARTICULAR PURPOSE.
+ *
+ *******************************************************************************
+ *
+ * Project: PE_ANS
+ *
+ ******************************************************************************/
+/*!
+  \file
+  \brief  Arena allocator for decoded ASN.1 messages
+
+  Interface of the allocator the asn1c runtime uses through its CALLOC,
+  MALLOC, REALLOC and FREEMEM macros when built with ASN_ARENA defined
+*/
+/*******************************************************************************
+ * $Id$
+ * $HeadURL$
+ ******************************************************************************/
+
+#ifndef __ASNARENA_H__
+#define __ASNARENA_H__
+
+#include <stddef.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Functions
+bool asnArenaBegin(void);
+void asnArenaEnd(void);
+
+extern "C" {
+void *asnArenaCalloc(size_t nmemb, size_t size);
+void *asnArenaMalloc(size_t size);
+void *asnArenaRealloc(void *ptr, size_t size);
+void asnArenaFree(void *ptr);
+}
+
+#endif /* __ASNARENA_H__ */
@@ -38,6 +38,7 @@
 #include <malloc.h>
 
 #include "rrlpdecod.h"
+#include "asnarena.h"
 #include "ubx_log.h"
 
 /////////////////////////////////////////////////////////////////////////////////////////
@@ -60,13 +61,7 @@
 struct PDU *rrlpDecode(unsigned char *pBuffer, int size)
 {
 	asn_dec_rval_t rval;
-    PDU_t *pMsg;
-
-    pMsg = (PDU_t *) MC_CALLOC(sizeof(PDU_t),1);
-    if (pMsg == NULL)
-	{
-        LOGE("%s: allocation error", __FUNCTION__);
-	}
+    PDU_t *pMsg = NULL;
 
 #ifdef SUPL_LOG_RRLP
     FILE *f = fopen("/data/gnss/rrlp.bin", "w");
@@ -86,11 +81,21 @@ struct PDU *rrlpDecode(unsigned char *pBuffer, int size)
 #endif
 
 	LOGV("%s: inBuffer %p, inSize %i", __FUNCTION__, pBuffer, size);
+	/* the decoder allocates the message, all of it in one arena if possible */
+	asnArenaBegin();
     rval = uper_decode_complete(0, 
                                 &asn_DEF_PDU,
                                 (void **) &pMsg,
                                 pBuffer,
                                 (unsigned int) size);
+	asnArenaEnd();
+
+    if (pMsg == NULL)
+	{
+        LOGE("%s: allocation error", __FUNCTION__);
+		return NULL;
+	}
+
     switch(rval.code) 
 	{
     case RC_OK:
@@ -48,6 +48,7 @@
 #include "ubxgpsstate.h"
 #include "ubx_messageDef.h"
 #include "ubx_log.h"
+#include "ubx_timer.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 // Types and Definitions
@@ -55,6 +56,8 @@
 //#define TIME_REFERENCE_OFFSET_MILLS  1500		/*!< offset for assumption how old is the time reference: now it seems 1500 in average! */
 #define TIME_REFERENCE_OFFSET_MILLS  0		/*!< offset for assumption how old is the time reference: now it seems 1500 in average! */
 #define GPS_TIME_REFERENCE_TOLERANCE 2500      	//!< the tolerance in setting the time reference should be less then 3 seconds
+#define NAV_MODEL_MAX_SATS 32					//!< Max number of satellites of a navigation model sent to the receiver
+#define NAV_MODEL_EPH_WORDS 26					//!< Words of an AID-EPH payload: sv, how and 3 x 8 subframe words
 
 
 //! Ephemeris collection structure
@@ -135,7 +138,7 @@ static const char* _strMethodTypeType[] = {
 ///////////////////////////////////////////////////////////////////////////////
 // Local Functions
 static char *buildRrlpAssistAck(int *pOutSize, int referenceNumber);
-static void convertNavModelForSat(int satellite, const UncompressedEphemeris_t *pemer, int tow, int wn);
+static bool convertNavModelForSat(int satellite, const UncompressedEphemeris_t *pemer, int tow, int wn, U4 *pRawData);
 static void manageAssistanceData(int sid, const ControlHeader_t *pCtl);
 static void fillRefTime(GPS_UBX_AID_INI_U5__t *pHandl, int tow, int wn);
 static void fillRefLoc(GPS_UBX_AID_INI_U5__t *pHandl, const unsigned char *pBuf, int size);
@@ -328,9 +331,43 @@ char* buildRrlpMsaPosResp(int sid, int *pOutSize, int referenceNumber)
 	
 	CMyDatabase* pDatabase = CMyDatabase::getInstance();
 	I4 svCount = 0;
+	I4 gnssTow = 0;
+	I4 dopCenter = 0;
+	struct
+	{
+		I4 svid;
+		I4 cNo;
+		R8 prRms;
+		U4 multipathIndicator;
+		I4 redSigtow;
+		I4 doppler;
+	} meas[CDatabase::MAX_SATELLITES_IN_VIEW];
 	bool r;
 	
-	r = pDatabase->getData(CDatabase::DATA_UBX_SATELLITES_IN_MEAS_COUNT, svCount);
+	// take all measurements from the same epoch
+	memset(meas, 0, sizeof(meas));
+	unsigned int seq;
+	do
+	{
+		seq = pDatabase->beginRead();
+		r = pDatabase->getData(CDatabase::DATA_UBX_SATELLITES_IN_MEAS_COUNT, svCount);
+		if (svCount > CDatabase::MAX_SATELLITES_IN_VIEW)
+			svCount = CDatabase::MAX_SATELLITES_IN_VIEW;
+		if (r && (svCount > 0))
+		{
+			r = pDatabase->getData(CDatabase::DATA_UBX_GNSS_TOW, gnssTow) && 
+				pDatabase->getData(CDatabase::DATA_UBX_GNSS_DOP_CENTER, dopCenter);
+			for (int i = 0; r && (i < svCount); i++)
+			{
+				r = pDatabase->getData(DATA_UBX_SATELLITES_IN_MEAS_(i), meas[i].svid) &&
+					pDatabase->getData(DATA_UBX_SATELLITES_IN_MEAS_CNO_(i), meas[i].cNo) &&
+					pDatabase->getData(DATA_UBX_SATELLITES_IN_MEAS_PRRMS_(i), meas[i].prRms) &&
+					pDatabase->getData(DATA_UBX_SATELLITES_IN_MEAS_MULTIPATH_IND_(i), meas[i].multipathIndicator) &&
+					pDatabase->getData(DATA_UBX_SATELLITES_IN_MEAS_REL_CODEPHASE_(i), meas[i].redSigtow);
+				pDatabase->getData(DATA_UBX_SATELLITES_IN_MEAS_DOPPLER_(i), meas[i].doppler);
+			}
+		}
+	} while (pDatabase->retryRead(seq));
 	assert(r == true);
 	
 	if (svCount > 0)
@@ -338,13 +375,6 @@ char* buildRrlpMsaPosResp(int sid, int *pOutSize, int referenceNumber)
 		// Only add optional GPS_MeasureInfo as we have 1 or more satellites
 		msg.component.choice.msrPositionRsp.gps_MeasureInfo = (GPS_MeasureInfo_t*) MC_CALLOC(sizeof(GPS_MeasureInfo_t), 1);
 	
-		I4 gnssTow = 0;
-		r = pDatabase->getData(CDatabase::DATA_UBX_GNSS_TOW, gnssTow);
-		assert(r == true);
-
-		I4 dopCenter = 0;
-		r = pDatabase->getData(CDatabase::DATA_UBX_GNSS_DOP_CENTER, dopCenter);
-		assert(r == true);
 		LOGV("%s: dop Center %i (Hz) ", __FUNCTION__, dopCenter);
 		dopCenter *= 5;			// Scale to 0.2 resolution
 		
@@ -361,31 +391,11 @@ char* buildRrlpMsaPosResp(int sid, int *pOutSize, int referenceNumber)
 		int validSv = 0;
 		for(int i = 0; i < svCount; i++)
 		{
-			I4 svid = 0;
-			r = pDatabase->getData(DATA_UBX_SATELLITES_IN_MEAS_(i), svid);
-			assert(r == true);
-			
-			I4 cNo = 0;
-			r = pDatabase->getData(DATA_UBX_SATELLITES_IN_MEAS_CNO_(i), cNo);
-			assert(r == true);
-			
+			I4 svid = meas[i].svid;
+			I4 cNo = meas[i].cNo;
 			iBuf += sprintf(&buf[iBuf], " ,%d,%d", svid, cNo);
-		        
-			R8 prRms = 0;
-			r = pDatabase->getData(DATA_UBX_SATELLITES_IN_MEAS_PRRMS_(i), prRms);
-			assert(r == true);
-			
-			U4 multipathIndicator = 0;
-			r = pDatabase->getData(DATA_UBX_SATELLITES_IN_MEAS_MULTIPATH_IND_(i), multipathIndicator);
-			assert(r == true);
-			
-			I4 redSigtow = 0;
-			r = pDatabase->getData(DATA_UBX_SATELLITES_IN_MEAS_REL_CODEPHASE_(i), redSigtow);  
-			assert(r == true);
-			
-			I4 doppler = 0;
-			pDatabase->getData(DATA_UBX_SATELLITES_IN_MEAS_DOPPLER_(i), doppler);
-			assert(r == true);
+			I4 redSigtow = meas[i].redSigtow;
+			I4 doppler = meas[i].doppler;
 
 			I4 adjustedDoppler = (doppler / (0x1000 / 5)) - dopCenter;
 			
@@ -575,16 +585,17 @@ static char *buildRrlpAssistAck(int *pOutSize, int referenceNumber)
 
 ///////////////////////////////////////////////////////////////////////////////
 //! Strip the parity bits from the subframe data
-/*! This will strip the 6 parity bits and place the subframe data to bits 0-23
+/*! This will strip the 6 parity bits and place the subframe data to bits 0-23.
+    The words of several ephemerides can be stripped in one go, the loop is
+	simple enough for the compiler to vectorise.
 	\param pData : Pointer to the subframe words
 	\param words : Number of subframe words
 */
 static void nav_orb_aidSfrStripParity(U4 *pData, U words)
 {
-	while (words--)
+	for (U i = 0; i < words; i++)
 	{
-		*(pData) = (*pData >> 6);
-		pData++;
+		pData[i] >>= 6;
 	}
 }
 
@@ -648,16 +659,18 @@ static bool nav_gps_reconstructRawEph(const NAV_GPS_EPH_COLLECT_t *pkEph, U4 *pR
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-//! Convert and send Supl/RRLP ephemeris data to receiver
+//! Convert Supl/RRLP ephemeris data for the receiver
 /*! Converts the nav model data (ephemeris) for a given satellite into the raw
-    sub frame with parity removed format that u-blox receivers understand.
-	Then transmits this data to the receiver.
+    sub frame format that u-blox receivers understand. The parity is still 
+	to be removed, the satellite number is filled in afterwards.
 	\param satellite : Satellite number Gxx (1..32)
 	\param pEphemer  : Pointer to Supl/RRLP ephemeris data to send
 	\parame tow      : time of week in seconds
 	\param wn        : week number
+	\param pRawData  : Pointer to the AID-EPH payload to fill, NAV_MODEL_EPH_WORDS words
+	\return true if the ephemeris was converted, false otherwise
 */
-static void convertNavModelForSat(int satellite, const UncompressedEphemeris_t *pEphemer, int tow, int wn)
+static bool convertNavModelForSat(int satellite, const UncompressedEphemeris_t *pEphemer, int tow, int wn, U4 *pRawData)
 {
     NAV_GPS_EPH_COLLECT_t eph;
 
@@ -716,20 +729,15 @@ static void convertNavModelForSat(int satellite, const UncompressedEphemeris_t *
     eph.IDOT     = pEphemer->ephemIDot;
 
 	// get the ephemeris data
-	U4 rawData[26];
-	memset(rawData, 0, sizeof(rawData));
-
-    if (nav_gps_reconstructRawEph(&eph, rawData))
+	memset(pRawData, 0, NAV_MODEL_EPH_WORDS * sizeof(U4));
+    if (!nav_gps_reconstructRawEph(&eph, pRawData))
     {
-        nav_orb_aidSfrStripParity(rawData, 26);
+		LOGW("%s: Conversion of Supl nav model data for sat G%i failed", __FUNCTION__, satellite);
+		return false;
     }
-	rawData[0] = (U) satellite;
 	
-	LOGV("%s: Sending Supl nav model data for sat G%i to receiver", __FUNCTION__, satellite);
-	CUbxGpsState* pUbxGps = CUbxGpsState::getInstance();
-	pUbxGps->lock();
-    pUbxGps->sendEph(rawData, sizeof(rawData));
-	pUbxGps->unlock();
+	LOGV("%s: Converted Supl nav model data for sat G%i", __FUNCTION__, satellite);
+	return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -780,6 +788,7 @@ static void fillIonosphericModel(GPS_UBX_AID_HUI_t* pUbxUtcModel, const Ionosphe
 */
 static void manageAssistanceData(int sid, const ControlHeader_t *pCtl)
 {
+	int64_t startMs = getMonotonicMsCounter();
     int wnoe = -1;
 	int towe = -1;
     /* assist data handler for gps section */
@@ -841,9 +850,14 @@ static void manageAssistanceData(int sid, const ControlHeader_t *pCtl)
 
 	 	char buf[256];
 		int iBuf = sprintf(buf, "%d, 1.0.0, %d, %d, %d", sid, pCtl->navigationModel->navModelList.list.count, towe, wnoe);
+		
+		// All ephemerides are converted into one buffer and sent together
+		U4 rawData[NAV_MODEL_MAX_SATS][NAV_MODEL_EPH_WORDS];
+		int sats[NAV_MODEL_MAX_SATS];
+		int num = 0;
 			 
         /* browse all the satellites */
-        for (i = 0; i < pCtl->navigationModel->navModelList.list.count; i++)
+        for (i = 0; (i < pCtl->navigationModel->navModelList.list.count) && (num < NAV_MODEL_MAX_SATS); i++)
         {
             NavModelElement_t *pElement = pCtl->navigationModel->navModelList.list.array[i];
             if (pElement == NULL)
@@ -858,19 +872,25 @@ static void manageAssistanceData(int sid, const ControlHeader_t *pCtl)
                 {
                     LOGV("%s: ephemeris for the new satellite and model", __FUNCTION__);
                     /* the satellite number is offset +1 */
-                    convertNavModelForSat(pElement->satelliteID + 1, 
-                                          &pElement->satStatus.choice.newSatelliteAndModelUC, 
-                                          (towe * 80) / 1000,
-                                          wnoe);
+                    sats[num] = pElement->satelliteID + 1;
+                    if (convertNavModelForSat(sats[num], 
+                                              &pElement->satStatus.choice.newSatelliteAndModelUC, 
+                                              (towe * 80) / 1000,
+                                              wnoe,
+                                              rawData[num]))
+                        num++;	// a failed satellite is overwritten by the next
                 }
                 else if (pElement->satStatus.present == SatStatus_PR_newNaviModelUC)
                 {
                     LOGV("%s: ephemeris for the new navi model", __FUNCTION__);
                     /* the satellite number is offset +1 */
-                    convertNavModelForSat(pElement->satelliteID + 1, 
-                                          &pElement->satStatus.choice.newNaviModelUC, 
-                                          (towe * 80) / 1000,
-                                          wnoe);
+                    sats[num] = pElement->satelliteID + 1;
+                    if (convertNavModelForSat(sats[num], 
+                                              &pElement->satStatus.choice.newNaviModelUC, 
+                                              (towe * 80) / 1000,
+                                              wnoe,
+                                              rawData[num]))
+                        num++;	// a failed satellite is overwritten by the next
                 }
                 else
                 {
@@ -880,6 +900,22 @@ static void manageAssistanceData(int sid, const ControlHeader_t *pCtl)
         }
 		iBuf += sprintf(&buf[iBuf], " # ephemeris info");
 		logAgps.write(0x00000004, buf);
+		
+		if (num > 0)
+		{
+			// Remove the parity of all ephemerides at once, then put in the satellite numbers
+			nav_orb_aidSfrStripParity(&rawData[0][0], (U) (num * NAV_MODEL_EPH_WORDS));
+			for (i = 0; i < num; i++)
+			{
+				rawData[i][0] = (U4) sats[i];
+			}
+			
+			LOGV("%s: Sending Supl nav model data for %d sats to receiver", __FUNCTION__, num);
+			CUbxGpsState* pUbxGps = CUbxGpsState::getInstance();
+			pUbxGps->lock();
+			pUbxGps->sendEphs(rawData, sizeof(rawData[0]), num);
+			pUbxGps->unlock();
+		}
     }
 	
 	bool utcModelPresent = false;
@@ -906,6 +942,8 @@ static void manageAssistanceData(int sid, const ControlHeader_t *pCtl)
 		pUbxGps->sendUtcModel(&ubxUtcModel);
 		pUbxGps->unlock();
 	}
+	
+	LOGV("%s: Assistance injected in %lld ms", __FUNCTION__, (long long) (getMonotonicMsCounter() - startMs));
 }
 
 ///////////////////////////////////////////////////////////////////////////////
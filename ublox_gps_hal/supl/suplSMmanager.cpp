@@ -42,6 +42,11 @@
 #include "openssl/ssl.h"
 #include <openssl/err.h>
 #include <semaphore.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
 
 #include "upldecod.h"
 #include "uplsend.h"
@@ -76,6 +81,9 @@ typedef enum
 								// If this is changed to > 1, then the position publish to framework
 								// control mechanism needs to be made smarter to allow for multiple 
 								// supl sessions.
+#define SUPL_HANDLER_POOL (MAX_SM_INSTANCES + 1)	//!< Number of preallocated Supl state handling structures
+#define SUPL_INDEX_BITS 4							//!< Log2 of the number of entries in a session index
+#define SUPL_INDEX_SIZE (1 << SUPL_INDEX_BITS)		//!< Number of entries in a session index, at least twice the pool size
 
 #define START_SID_NUMBER 1001   				//!< Start Session Id number
 #define MAX_SID_NUMBER (START_SID_NUMBER + 200)	//!< Max SID number
@@ -86,6 +94,27 @@ typedef enum
 #define SUPL_NOTIFICATION_TIMEOUT 120			//!< Timeout default for the notification from UI, 2 minutes
 #define SUPL_POLL_INTERVAL	(3600 * 24 * 1000)	//!< 1 day - what should this really be? TODO
 #define SUPL_NONETWORK_TIMEOUT 60				//!< 60 seconds timeout if Supl transaction requested but no network
+#define SUPL_NETWORK_POLL_INTERVAL 1000			//!< Interval in ms the network state is checked for a pending session
+#define SUPL_CONNECT_TIMEOUT 5					//!< Maximum time (in seconds) to connect and handshake with the SLP
+
+//! Timers each Supl session can have running
+typedef enum
+{
+	TIMER_SESSION,							//!< Session timeout, the session is ended when it expires
+	TIMER_MSA_RESPONSE,						//!< Time to respond to the server with the MSA data available
+	TIMER_NETWORK_POLL,						//!< Check if the network came up for a session waiting for it
+	TIMER_CONNECT,							//!< Time to set up the connection and deliver the messages queued meanwhile
+	TIMER_NUM								//!< Number of timers per session
+} SuplTimer_t;
+
+//! Setup state of the connection to the SLP
+typedef enum
+{
+	CONN_NONE,								//!< No connection opened
+	CONN_CONNECTING,						//!< Waiting for the SLP to accept the TCP connection
+	CONN_HANDSHAKING,						//!< Performing the TLS handshake
+	CONN_ESTABLISHED						//!< Connected, messages queued while connecting may still be pending
+} SuplConnState_t;
 
 //! Handler for the state machine instancies */
 typedef struct suplHandler {
@@ -93,8 +122,12 @@ typedef struct suplHandler {
     SlpSessionID_t *pSlpId;      			//!< must be linked with the SLP ID
     SetSessionID_t *pSetId;      			//!< must be linked with the SLP ID
     SMState_t state;            			//!< state of the current SM instance
-    BIO *bio;                   			//!< Bio handler
-    SSL_CTX *ctx;               			//!< SSL context handler
+    BIO *bio;                   			//!< Bio handler, messages are written to it
+    BIO *pConnBio;              			//!< Connection below the buffer bio queuing messages on bio while connecting
+    SuplConnState_t connState;  			//!< Setup state of the connection
+    uint32_t pollEvents;        			//!< Events the socket is registered for with the main loop epoll instance
+    int64_t connStartMs;        			//!< Time the connection setup started
+    bool closePending;          			//!< Session ended, released when the queued messages are delivered
     long long hash;             			//!< Hash of the SUPL INIT
     NotificationType_t notificationType;    //!< Notification type of SUPL INIT
 	EncodingType_t encodingType;			//!< Notification texts encoding type
@@ -102,12 +135,13 @@ typedef struct suplHandler {
 	FormatIndicator_t requestorIdType;		//!< Received requestor id text type. Used for notify/verify request to framework
 	OCTET_STRING_t* pClientName;			//!< Pointer to received client name text. Used for notify/verify request to framework
 	FormatIndicator_t clientNameType;		//!< Received requestor client name type. Used for notify/verify request to framework
-    time_t timeout;             			//!< socket file descriptor of the current session
+    int timerIx[TIMER_NUM];        			//!< Position of the session timers in the timer heap, -1 if not running
     int rrlpRefNum;             			//!< rrlp reference number for delayed responce
     int  nonProxy;              			//!< The server is requesting a non proxy mode
     int reqHorAccuracy;         			//!< Requested Horizontal accuracy
     int reqVerAccuracy;         			//!< Requested Vertical accuracy
-    struct suplHandler *pNext;  			//!< Pointer to the next handler active in the linked list
+    struct suplHandler *pNext;  			//!< Pointer to the next handler active in the linked list, or the next free one in the pool
+    struct suplHandler *pPrev;  			//!< Pointer to the previous handler active in the linked list
 	RrlpRespData_t responseType;			//!< Type of pending response
 	int msaPosResponseTime;					//!< The time to wait before responsing to server with MSA data
 	int QopDelay;							//!< Delay trieved from Quality of Position 'delay' field in SUPLINIT
@@ -115,6 +149,10 @@ typedef struct suplHandler {
 	bool networkInitiated;					//!< true if the session is an NI one, false if SI
 	bool assistanceRequested;				//!< true is assitance data was requested from the server, false if not
 	struct ULP_PDU* pNiMsg;					//!< Pointer NI supl init message
+	bool polled;							//!< true if the socket is registered with the main loop epoll instance
+	int rxOff;								//!< Start of the received data not processed yet in rxBuf
+	int rxLen;								//!< Length of the received data not processed yet in rxBuf
+	unsigned char rxBuf[MAX_UPL_PACKET];	//!< Data received from the SLP, reassembled to whole messages
 } suplHandler_t;
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -154,11 +192,61 @@ static const char* _strUlpMessageType[] = {		//!< Logging texts for Supl message
 	"msSUPLAUTHRESP",
 };
 
-static suplHandler_t *s_pQueueTail						= NULL;		//!< Tail of the supl sessions list
+//! Entry of a Supl session index
+typedef struct
+{
+	int key;								//!< Session ID or socket the session is found by
+	suplHandler_t *pHandler;				//!< Session, NULL if the entry is empty
+} suplIndexEntry_t;
+
+//! Entry of the Supl timer heap
+typedef struct
+{
+	int64_t dueMs;							//!< Monotonic time in ms the timer expires
+	suplHandler_t *pHandler;				//!< Session the timer belongs to
+	SuplTimer_t type;						//!< Which of the session timers
+} suplTimer_t;
+
+#define MAX_SUPL_TIMERS (SUPL_HANDLER_POOL * TIMER_NUM)	//!< Max number of running timers
+
+//! Statistics of the connections set up to the SLP
+typedef struct
+{
+	int connects;							//!< Number of new connections established
+	int resumed;							//!< Number of TLS handshakes which resumed a cached session
+	int reused;								//!< Number of sessions run on an idle connection
+	int64_t handshakeMs;					//!< Accumulated time spent connecting and handshaking
+	int64_t handshakeMaxMs;					//!< Longest time spent connecting and handshaking
+} suplConnStats_t;
+
+static suplHandler_t s_handlerPool[SUPL_HANDLER_POOL];				//!< Storage of all Supl state handling structures
+static suplHandler_t *s_pFreeHandlers					= NULL;		//!< Unused structures of s_handlerPool, linked by pNext
+static suplHandler_t *s_pQueueTail						= NULL;		//!< Tail of the supl sessions list, the oldest session
+static suplHandler_t *s_pQueueHead						= NULL;		//!< Head of the supl sessions list, the newest session
+static suplIndexEntry_t s_sidIndex[SUPL_INDEX_SIZE];				//!< Sessions by session ID, protected by s_handlerMutex
+static suplIndexEntry_t s_fdIndex[SUPL_INDEX_SIZE];					//!< Sessions by socket registered with epoll. Main thread only
+static int s_unpolledNum								= 0;		//!< Number of session sockets not registered with epoll yet
+static int s_uplPollFd									= -1;		//!< Main loop epoll instance the session sockets are registered with
+static suplTimer_t s_timerHeap[MAX_SUPL_TIMERS];					//!< Running timers, binary min-heap on dueMs. Main thread only
+static int s_timerNum									= 0;		//!< Number of running timers
 static int64_t s_lastSuplSiTime							= 0;		//!< Last time a Supl SI session was performed
 static GpsControlEventInterface* s_pGpsControlInterface	= NULL;		//!< Interface to Gps engine control
 static void* s_pEventContext 							= NULL;		//!< Pointer to context for Gps engine control interface calls
 static pthread_mutex_t s_handlerMutex;								//!< Handler list mutex
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+static HMAC_CTX s_hashCtxData;										//!< Storage of the SUPL INIT hash context
+static HMAC_CTX* s_pHashCtx								= &s_hashCtxData;	//!< HMAC context keyed with the SLP address
+#else
+static HMAC_CTX* s_pHashCtx								= NULL;		//!< HMAC context keyed with the SLP address
+#endif
+static int s_hashServerGen								= -1;		//!< Supl server setting the hash context is keyed for
+static pthread_mutex_t s_hashMutex;									//!< Hash context mutex
+static SSL_CTX* s_pSslCtx								= NULL;		//!< TLS context shared by all sessions. Main thread only
+static SSL_SESSION* s_pSslSession						= NULL;		//!< Last TLS session negotiated with the SLP, offered for resumption
+static BIO* s_pIdleBio									= NULL;		//!< Connection to the SLP kept open after its session ended
+static int64_t s_idleBioTimeMs							= 0;		//!< Time the idle connection was parked
+static int s_connServerGen								= -1;		//!< Supl server setting the cached TLS session and idle connection belong to
+static suplConnStats_t s_connStats;									//!< Connection setup statistics
 
 ///////////////////////////////////////////////////////////////////////////////
 // Local functions
@@ -170,9 +258,20 @@ static void endSuplSession(suplHandler_t* pHandler);
 static void freeSuplHandler(suplHandler_t *pHandler);
 static int getNewSid(void);
 static void processRawSuplMessage(const char *buffer, int size, suplHandler_t *pReceivedHandler);
+static bool processUplPdus(suplHandler_t *pHandler, int fd);
 static long long calculateHash(const char *buffer, int size);
-static int connectTimeout(BIO *bio, int sid, int seconds);
+static SSL_CTX *getSslContext(void);
+static void saveSslSession(SSL *pSsl);
+static void checkConnServer(void);
+static bool isConnectionIdle(BIO *bio);
+static BIO *takeIdleConnection(void);
+static void releaseConnection(BIO *bio);
+static void closeConnection(BIO *bio);
 static int createUplSession(suplHandler_t *pHandler);
+static bool driveConnection(suplHandler_t *pHandler);
+static void serviceConnection(suplHandler_t *pHandler);
+static void failConnection(suplHandler_t *pHandler);
+static uint32_t connPollEvents(const suplHandler_t *pHandler);
 static void generateSuplEndMsg(suplHandler_t * pHandler, StatusCode statusCode);
 static int sendPositionResponse(suplHandler_t *pHandler, char* pSendBuffer, int size);
 static void setNotificationAndResponse(NotificationType_t ans1cNotifyType, 
@@ -188,6 +287,11 @@ static bool compareOctets(const OCTET_STRING_t *pOct1, const OCTET_STRING_t *pOc
 static bool verifySlpSessionId(SlpSessionID_t *pSlpSessionId_1, SlpSessionID_t *pSlpSessionId_2);
 static bool verifySetSessionId(const SetSessionID_t *pSetSessionId_1, const SetSessionID_t *pSetSessionId_2);
 static void safeFreeHandler(suplHandler_t* pHandler);
+static void setTimer(suplHandler_t *pHandler, SuplTimer_t type, int64_t delayMs);
+static void clearTimer(suplHandler_t *pHandler, SuplTimer_t type);
+static void indexAdd(suplIndexEntry_t *pIndex, int key, suplHandler_t *pHandler);
+static suplHandler_t *indexFind(const suplIndexEntry_t *pIndex, int key);
+static void indexRemove(suplIndexEntry_t *pIndex, int key, const suplHandler_t *pHandler);
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -198,6 +302,21 @@ static void safeFreeHandler(suplHandler_t* pHandler);
 void suplInit(void)
 {
 	pthread_mutex_init(&s_handlerMutex, NULL);
+	pthread_mutex_init(&s_hashMutex, NULL);
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+	HMAC_CTX_init(s_pHashCtx);
+#else
+	s_pHashCtx = HMAC_CTX_new();
+#endif
+	s_hashServerGen = -1;						// keyed on first use
+	
+	// All handlers are free
+	s_pFreeHandlers = NULL;
+	for (int i = SUPL_HANDLER_POOL - 1; i >= 0; i--)
+	{
+		s_handlerPool[i].pNext = s_pFreeHandlers;
+		s_pFreeHandlers = &s_handlerPool[i];
+	}
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -207,6 +326,29 @@ void suplInit(void)
 */
 void suplDeinit(void)
 {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+	HMAC_CTX_cleanup(s_pHashCtx);
+#else
+	HMAC_CTX_free(s_pHashCtx);
+	s_pHashCtx = NULL;
+#endif
+	if (s_pIdleBio != NULL)
+	{
+		closeConnection(s_pIdleBio);
+		s_pIdleBio = NULL;
+	}
+	if (s_pSslSession != NULL)
+	{
+		SSL_SESSION_free(s_pSslSession);
+		s_pSslSession = NULL;
+	}
+	if (s_pSslCtx != NULL)
+	{
+		SSL_CTX_free(s_pSslCtx);
+		s_pSslCtx = NULL;
+	}
+	s_connServerGen = -1;
+	pthread_mutex_destroy(&s_hashMutex);
 	pthread_mutex_destroy(&s_handlerMutex);
 }
 
@@ -292,6 +434,71 @@ void suplCheckPendingActions(void)
 {
 	assert(pthread_self() == g_gpsDrvMainThread);
 
+	/* handle the expired timers, the earliest is always on top of the heap */
+	int64_t nowMs = getMonotonicMsCounter();
+	while ((s_timerNum > 0) && (s_timerHeap[0].dueMs <= nowMs))
+	{
+		suplHandler_t *pHandler = s_timerHeap[0].pHandler;
+		SuplTimer_t type = s_timerHeap[0].type;
+		clearTimer(pHandler, type);
+		
+		if (type == TIMER_CONNECT)
+		{
+			LOGV("%s: connection timeout", __FUNCTION__);
+			logAgps.write(0x21000001, "%d # tls failed", pHandler->sid);
+			failConnection(pHandler);
+		}
+		else if (type == TIMER_SESSION)
+		{
+			// Normal timeout
+			LOGV("%s: SUPL Timer expired",__FUNCTION__);
+
+			/* send the message to the state machine */
+			suplSM(pHandler, NULL, SUPL_TIMEOUT);
+
+			/* After timeout,  session always ended, deallocate handler */
+			endSuplSession(pHandler);
+		}
+		else if (type == TIMER_MSA_RESPONSE)
+		{
+			if ((pHandler->state == RRLP_RESP) && (pHandler->responseType == RESP_MSA_DATA))
+			{
+				LOGV("%s: MSA request timeout - send what data we have", __FUNCTION__);
+				if (suplSM(pHandler, NULL, SUPL_MSA_DATA_AVAIL) < 0)
+				{
+					/* error/supl session ended, deallocate handler */
+					endSuplSession(pHandler);
+				}
+			}
+		}
+		else if (pHandler->state == NO_NETWORK)
+		{
+			// Session pending
+			if (CRilIf::getInstance()->isConnected())
+			{
+				if (suplSM(pHandler, NULL, SUPL_NETWORK_CONNECTED) < 0)
+				{
+					/* error/supl session ended, deallocate handler */
+					endSuplSession(pHandler);
+				}
+			}
+			else
+			{
+				setTimer(pHandler, TIMER_NETWORK_POLL, SUPL_NETWORK_POLL_INTERVAL);
+			}
+		}
+	}
+
+	/* close the idle connection when it expired or the SLP closed it */
+	if (s_pIdleBio != NULL)
+	{
+		BIO *bio = takeIdleConnection();
+		if (bio != NULL)
+		{
+			s_pIdleBio = bio;
+		}
+	}
+
 	pthread_mutex_lock(&s_handlerMutex);
     suplHandler_t *pHandler =  s_pQueueTail;  
 	pthread_mutex_unlock(&s_handlerMutex);
@@ -300,7 +507,7 @@ void suplCheckPendingActions(void)
 	
 	assert(pDatabase != NULL);
 	
-    /* browse the list of handler */
+    /* browse the list of handler for the actions not driven by a timer */
     while (pHandler != NULL)
     {
         /* save next in the chain */
@@ -308,9 +515,6 @@ void suplCheckPendingActions(void)
         suplHandler_t *pNext = pHandler->pNext;
 		pthread_mutex_unlock(&s_handlerMutex);
 			
-        /* check for timeout of existing SUPL transactions */
-		time_t now  = time(NULL);
-		
 		if ((pHandler->state == START) && (pHandler->networkInitiated))
 		{
 			// Get the NI session going
@@ -319,31 +523,24 @@ void suplCheckPendingActions(void)
 				endSuplSession(pHandler);	// error/supl session ended, deallocate handler
 			}
 		}
-        else if ((pHandler->timeout != -1) && (pHandler->timeout <= now))
-        {
-			// Normal timeout
-			LOGV("%s: SUPL Timer expired",__FUNCTION__);
-			/* Clear the timer */
-			pHandler->timeout = -1;
-
-			/* send the message to the state machine */
-			suplSM(pHandler, NULL, SUPL_TIMEOUT);
-
-			/* After timeout,  session always ended, deallocate handler */
-			endSuplSession(pHandler);
-        }
 		else if (pHandler->state == RRLP_RESP)
 		{
 			if (pHandler->responseType == RESP_POSITION_DATA)
 			{
 				/* check if we can fulfil any pending SUPL transactions requiring position information */
 				double lat, lon = 0.0, speed;
-				int accuracy = pHandler->reqHorAccuracy;
-				bool posAvail = (pDatabase->getData(CMyDatabase::DATA_LATITUDE_DEGREES, lat) && 
-								 pDatabase->getData(CMyDatabase::DATA_LONGITUDE_DEGREES, lon));
-				bool speedAvail = pDatabase->getData(CMyDatabase::DATA_SPEED_KNOTS, speed);
-				
-				pDatabase->getData(CMyDatabase::DATA_ERROR_RADIUS_METERS, accuracy);
+				int accuracy;
+				bool posAvail, speedAvail;
+				unsigned int seq;
+				do
+				{
+					seq = pDatabase->beginRead();
+					accuracy = pHandler->reqHorAccuracy;
+					posAvail = (pDatabase->getData(CMyDatabase::DATA_LATITUDE_DEGREES, lat) && 
+								pDatabase->getData(CMyDatabase::DATA_LONGITUDE_DEGREES, lon));
+					speedAvail = pDatabase->getData(CMyDatabase::DATA_SPEED_KNOTS, speed);
+					pDatabase->getData(CMyDatabase::DATA_ERROR_RADIUS_METERS, accuracy);
+				} while (pDatabase->retryRead(seq));
 				/*LOGV("%s: Pos response pending - PA %i  SA %i  Acc %i  RHAcc %i  RVAcc %i", 
 					__FUNCTION__, posAvail, speedAvail, accuracy, pHandler->reqHorAccuracy, pHandler->reqVerAccuracy);
 				*/
@@ -363,59 +560,54 @@ void suplCheckPendingActions(void)
 					}
 				}
 			}
-			else if (pHandler->responseType == RESP_MSA_DATA)
-			{
-				/*LOGV("%s: MSA response still pending - delay %ld - TO %ld",
-					 __FUNCTION__, 
-					 pHandler->msaPosResponseTime - now,
-					 pHandler->timeout - now);
-				*/
-				if (pHandler->msaPosResponseTime < now)
-				{
-					LOGV("%s: MSA request timeout - send what data we have", __FUNCTION__);
-					if (suplSM(pHandler, NULL, SUPL_MSA_DATA_AVAIL) < 0)
-					{
-						/* error/supl session ended, deallocate handler */
-						endSuplSession(pHandler);
-					}
-				}
-			}
 			else
 			{
-				// Nothing ready
+				// Nothing ready, MSA responses are sent by their timer
 			}
         }
-		else if (pHandler->state == NO_NETWORK)
-		{
-			// Session pending
-			if (CRilIf::getInstance()->isConnected())
-			{
-				if (suplSM(pHandler, NULL, SUPL_NETWORK_CONNECTED) < 0)
-				{
-					/* error/supl session ended, deallocate handler */
-					endSuplSession(pHandler);
-				}
-			}
-		}
 
         /* go to the next */
         pHandler = pNext;
     }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//! Get the time suplCheckPendingActions next has something to do
+/*! Returns the expiry of the earliest running session timer. Events
+    caused by socket or receiver input, or by commands like the start of a
+    NI session, are not included, the main loop runs suplCheckPendingActions
+    after those anyway.
+  \return      : monotonic time in ms of the next pending action, -1 if there is none
+*/
+int64_t suplGetNextTimeout(void)
+{
+	assert(pthread_self() == g_gpsDrvMainThread);
+
+	int64_t dueMs = (s_timerNum > 0) ? s_timerHeap[0].dueMs : -1;
+	if (s_pIdleBio != NULL)
+	{
+		/* the idle connection is closed when it expires */
+		int64_t idleDueMs = s_idleBioTimeMs + (int64_t) CUbxGpsState::getInstance()->getSuplKeepAlive() * 1000 + 1;
+		if ((dueMs < 0) || (idleDueMs < dueMs))
+		{
+			dueMs = idleDueMs;
+		}
+	}
+	return dueMs;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //! Add Supl sockets to listen on
-/*! Function used to add the sockets of any existing SUPL transactions to the list
-    of sockets 'select' will listen on
-  \param pRfds  : pointer to file descriptor array (used by 'select') to added SUPL sockets to
-  \param pMaxFd : pointer allowing the largest file descriptor in the array to be returned
+/*! Function used to register the sockets of any new SUPL transactions with 
+    the epoll instance of the main loop. Sockets stay registered until their
+    session ends, the events waited for follow the connection setup.
+  \param pollFd : epoll instance to add the SUPL sockets to
   \return       : 1 if queue empty, 0 if not
 */
-int suplAddUplListeners(fd_set *pRfds, int *pMaxFd)
+int suplAddUplListeners(int pollFd)
 {
 	assert(pthread_self() == g_gpsDrvMainThread);
-	assert(pRfds);
-	assert(pMaxFd);
+	s_uplPollFd = pollFd;
 
     /* check if the handler queue is empty! */
     if (s_pQueueTail == NULL)
@@ -423,21 +615,36 @@ int suplAddUplListeners(fd_set *pRfds, int *pMaxFd)
         return 1;
     }    
 	
+	/* nothing to do unless a session opened a socket */
+	if (s_unpolledNum == 0)
+	{
+		return 0;
+	}
+	
 	suplHandler_t *pHandler = s_pQueueTail;  
 
     /* browse the list of handler */
     while (pHandler != NULL)
     {
-        /* Make the FD_SET */
-        if (pHandler->bio != 0)
+        /* Register new sockets */
+        if ((pHandler->bio != 0) && (!pHandler->polled))
         {
             int fd = BIO_get_fd(pHandler->bio, NULL);
 //			LOGV("%s: Open SUPL handle - Listerning for data on %d", __FUNCTION__, fd);
-            FD_SET(fd, pRfds);
-			
-			if ((fd + 1) > *pMaxFd)
+			struct epoll_event ev;
+			memset(&ev, 0, sizeof(ev));
+			ev.events = connPollEvents(pHandler);
+			ev.data.fd = fd;
+			if ((fd >= 0) && (epoll_ctl(pollFd, EPOLL_CTL_ADD, fd, &ev) == 0))
+			{
+				pHandler->polled = true;
+				pHandler->pollEvents = ev.events;
+				s_unpolledNum--;
+				indexAdd(s_fdIndex, fd, pHandler);
+			}
+			else
 			{
-				*pMaxFd = fd + 1;
+				LOGE("%s: Cannot poll SUPL socket %d (%i)", __FUNCTION__, fd, errno);
 			}
         }
 		pthread_mutex_lock(&s_handlerMutex);
@@ -450,14 +657,16 @@ int suplAddUplListeners(fd_set *pRfds, int *pMaxFd)
 
 ///////////////////////////////////////////////////////////////////////////////
 //! Function  for reading a SUPL socket
-/*! This function must be used to read any input on a SUPL socket
-  \param pRfds : Pointer to file descriptor array
+/*! This function must be used to read any input on a SUPL socket. While the
+    connection is set up or messages queued meanwhile are pending the socket
+    only drives the connection. The data is read straight into the session's
+    reassembly buffer, which may receive several messages or parts of one.
+  \param fd    : Socket the main loop has seen input on
   \return      : 1 if session queue is empty, 0 if not
 */
-int suplReadUplSock(fd_set *pRfds)
+int suplReadUplSock(int fd)
 {
 	assert(pthread_self() == g_gpsDrvMainThread);
-	assert(pRfds);
 	
     /* check if the handler queue is empty! */
     if (s_pQueueTail == NULL)
@@ -465,48 +674,96 @@ int suplReadUplSock(fd_set *pRfds)
         return 1;
     } 
 
-    suplHandler_t *pHandler = s_pQueueTail;  
-    suplHandler_t *pNext = NULL;  
-    char buffer[MAX_UPL_PACKET];
+    suplHandler_t *pHandler = indexFind(s_fdIndex, fd);
     int res;
 	
-	/* browse the list of handler */
-    while (pHandler != NULL)
+    if ((pHandler != NULL) && (pHandler->bio != NULL) &&
+		((pHandler->connState != CONN_ESTABLISHED) || (pHandler->bio != pHandler->pConnBio)))
+	{
+		serviceConnection(pHandler);
+	}
+    else if ((pHandler != NULL) && (pHandler->bio != NULL))
     {
-        int fd = BIO_get_fd(pHandler->bio, NULL);
-        /* Store the next pointer */
-		pthread_mutex_lock(&s_handlerMutex);
-        pNext = pHandler->pNext;
-		pthread_mutex_unlock(&s_handlerMutex);
-		
-        if (pHandler->bio != NULL)
-        {
-            if (FD_ISSET(fd, pRfds))
-            {
-                LOGV("%s: Received data over UPL socket %d", __FUNCTION__, fd);
-                /* read into a local buffer */
-                res = BIO_read(pHandler->bio, buffer, MAX_UPL_PACKET);
-                LOGV("%s: read result is %d", __FUNCTION__, res);
-                if (res > MAX_UPL_PACKET)
-                {
-                    LOGE("%s: Unexpected reading size!", __FUNCTION__);
-                }
-                else if (res > 0)
-                {
-                    processRawSuplMessage(buffer, res, pHandler);
-                }
-                else
-                {
-                    /* Connection has been closed! deallocate the state machine... */
-					endSuplSession(pHandler);
-                }
-            }
-        }
-        pHandler = pNext;
+        LOGV("%s: Received data over UPL socket %d", __FUNCTION__, fd);
+		// The TLS layer can hold decrypted data the socket does not signal anymore
+		do
+		{
+			/* move a partially received message to the start of the buffer */
+			if (pHandler->rxOff > 0)
+			{
+				memmove(pHandler->rxBuf, pHandler->rxBuf + pHandler->rxOff, (size_t) pHandler->rxLen);
+				pHandler->rxOff = 0;
+			}
+			
+			/* read behind what is there already */
+			res = BIO_read(pHandler->bio, pHandler->rxBuf + pHandler->rxLen, MAX_UPL_PACKET - pHandler->rxLen);
+			LOGV("%s: read result is %d", __FUNCTION__, res);
+			if (res <= 0)
+			{
+				if ((res < 0) && BIO_should_retry(pHandler->bio))
+				{
+					// No complete TLS record yet
+					break;
+				}
+				/* Connection has been closed! deallocate the state machine... */
+				endSuplSession(pHandler);
+				break;
+			}
+			pHandler->rxLen += res;
+		}
+		while (processUplPdus(pHandler, fd) && (BIO_pending(pHandler->bio) > 0));
     }
 
     return 0;
-//lint -e{818} remove Pointer parameter 'pRfds' (line 445) could be declared as pointing to const
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Process the complete messages in a session's reassembly buffer
+/*! Messages are framed by the 2 byte length at their start, which covers 
+    the whole message. They are decoded where they were received, an 
+    incomplete message is left in the buffer for the next read.
+  \param pHandler : Pointer to Supl state structure
+  \param fd       : Socket of the session
+  \return true if the session goes on, false if it was ended
+*/
+static bool processUplPdus(suplHandler_t *pHandler, int fd)
+{
+	assert(pHandler);
+	assert(pthread_self() == g_gpsDrvMainThread);
+
+	while (pHandler->rxLen >= 2)
+	{
+		const unsigned char *pPdu = pHandler->rxBuf + pHandler->rxOff;
+		int size = (pPdu[0] << 8) | pPdu[1];
+		if ((size <= 2) || (size > MAX_UPL_PACKET))
+		{
+			// Not in sync with the message boundaries anymore
+			LOGE("%s: Invalid message length %d", __FUNCTION__, size);
+			endSuplSession(pHandler);
+			return false;
+		}
+		if (size > pHandler->rxLen)
+		{
+			// Wait for the rest
+			break;
+		}
+		
+		pHandler->rxOff += size;
+		pHandler->rxLen -= size;
+		processRawSuplMessage((const char *) pPdu, size, pHandler);
+		
+		/* the message may have ended the session */
+		if (indexFind(s_fdIndex, fd) != pHandler)
+		{
+			return false;
+		}
+	}
+	
+	if (pHandler->rxLen == 0)
+	{
+		pHandler->rxOff = 0;
+	}
+	return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -769,7 +1026,8 @@ static int suplSM(suplHandler_t *pHandler, struct ULP_PDU *pMsg, SuplCmd_t cmd)
 					// Supl session is pending
 					LOGV("%s: No network. Deferring SI until network present", __FUNCTION__);
 					pHandler->state = NO_NETWORK;
-					pHandler->timeout = time(NULL) + SUPL_NONETWORK_TIMEOUT;
+					setTimer(pHandler, TIMER_SESSION, SUPL_NONETWORK_TIMEOUT * 1000);
+					setTimer(pHandler, TIMER_NETWORK_POLL, SUPL_NETWORK_POLL_INTERVAL);
 				}
             }
             else
@@ -910,7 +1168,7 @@ static int suplSM(suplHandler_t *pHandler, struct ULP_PDU *pMsg, SuplCmd_t cmd)
                 pHandler->pSlpId = copySlpId(pMsg->sessionID.slpSessionID);
 
                 // Timeout is set to UI notifcation timeout, which is handled else where
-                pHandler->timeout = -1;
+                clearTimer(pHandler, TIMER_SESSION);
 				
 				logAgps.write(0x10000000, "%d # network connecting...", pHandler->sid);
 				if (CRilIf::getInstance()->isConnected())
@@ -965,7 +1223,8 @@ static int suplSM(suplHandler_t *pHandler, struct ULP_PDU *pMsg, SuplCmd_t cmd)
 					// Supl session is pending
 					LOGV("%s: No network. Deferring NI until network present", __FUNCTION__);
 					pHandler->state = NO_NETWORK;
-					pHandler->timeout = time(NULL) + SUPL_NONETWORK_TIMEOUT;
+					setTimer(pHandler, TIMER_SESSION, SUPL_NONETWORK_TIMEOUT * 1000);
+					setTimer(pHandler, TIMER_NETWORK_POLL, SUPL_NETWORK_POLL_INTERVAL);
 				}
             }
             else 
@@ -1147,7 +1406,7 @@ static int suplSM(suplHandler_t *pHandler, struct ULP_PDU *pMsg, SuplCmd_t cmd)
 						pHandler->state = RRLP;
 						
 						/* Set the timeout */
-						pHandler->timeout = time(NULL) + SUPL_STD_TIMEOUT;
+						setTimer(pHandler, TIMER_SESSION, SUPL_STD_TIMEOUT * 1000);
 					}
 					else
 					{
@@ -1197,13 +1456,21 @@ static int suplSM(suplHandler_t *pHandler, struct ULP_PDU *pMsg, SuplCmd_t cmd)
 
                     /* here need to be verified what can be done depending on the GPS state */
 					double lat, lon, speed;
-					int accuracy = pHandler->reqHorAccuracy;
+					int accuracy;
+					bool fixAvail;
 					
 					CMyDatabase* pDatabase = CMyDatabase::getInstance();
-					pDatabase->getData(CMyDatabase::DATA_ERROR_RADIUS_METERS, accuracy);
+					unsigned int seq;
+					do
+					{
+						seq = pDatabase->beginRead();
+						accuracy = pHandler->reqHorAccuracy;
+						pDatabase->getData(CMyDatabase::DATA_ERROR_RADIUS_METERS, accuracy);
+						fixAvail = (pDatabase->getData(CMyDatabase::DATA_LATITUDE_DEGREES, lat) && pDatabase->getData(CMyDatabase::DATA_LONGITUDE_DEGREES, lon)) &&
+								   pDatabase->getData(CMyDatabase::DATA_SPEED_KNOTS, speed);
+					} while (pDatabase->retryRead(seq));
 					
-					if ((pDatabase->getData(CMyDatabase::DATA_LATITUDE_DEGREES, lat) && pDatabase->getData(CMyDatabase::DATA_LONGITUDE_DEGREES, lon)) &&	
-						pDatabase->getData(CMyDatabase::DATA_SPEED_KNOTS, speed) &&
+					if (fixAvail &&
                         (pHandler->reqHorAccuracy == -1 || accuracy < pHandler->reqHorAccuracy) &&
                         (pHandler->reqVerAccuracy == -1 || accuracy < pHandler->reqVerAccuracy) )
                     {
@@ -1229,7 +1496,7 @@ static int suplSM(suplHandler_t *pHandler, struct ULP_PDU *pMsg, SuplCmd_t cmd)
                     sendSuplPosInit(pHandler->bio, &par);
 
                     /* Set the timeout */
-                    pHandler->timeout = time(NULL) + SUPL_STD_TIMEOUT;
+                    setTimer(pHandler, TIMER_SESSION, SUPL_STD_TIMEOUT * 1000);
                 
                     /* Next state:  RRLP*/
                     pHandler->state = RRLP;
@@ -1374,28 +1641,30 @@ static int suplSM(suplHandler_t *pHandler, struct ULP_PDU *pMsg, SuplCmd_t cmd)
 							if (aux.responseType == RESP_MSA_DATA)
 							{
 								// MSA
-								pHandler->timeout = -1;		// There is no timeout as such
-								pHandler->msaPosResponseTime = maxDelay < aux.responseTime ? maxDelay : aux.responseTime;
-								pHandler->msaPosResponseTime += now;
+								int delay = maxDelay < aux.responseTime ? maxDelay : aux.responseTime;
+								clearTimer(pHandler, TIMER_SESSION);		// There is no timeout as such
+								setTimer(pHandler, TIMER_MSA_RESPONSE, (int64_t) delay * 1000);
+								pHandler->msaPosResponseTime = delay + now;
 							}
 							else
 							{
 								// MSB
+								int delay;
 								if (pHandler->QopDelay > 0)
 								{
-									pHandler->timeout = pHandler->QopDelay;
+									delay = pHandler->QopDelay;
 								}
 								else
 								{
-									pHandler->timeout = aux.responseTime;
+									delay = aux.responseTime;
 								}
 								
 								// Config setting gives upper limit on delay
-								if (pHandler->timeout > maxDelay)
+								if (delay > maxDelay)
 								{
-									pHandler->timeout = maxDelay;
+									delay = maxDelay;
 								}
-								pHandler->timeout += now;
+								setTimer(pHandler, TIMER_SESSION, (int64_t) delay * 1000);
 							}
 							
 							pHandler->state = RRLP_RESP;
@@ -1424,7 +1693,7 @@ static int suplSM(suplHandler_t *pHandler, struct ULP_PDU *pMsg, SuplCmd_t cmd)
 						MC_FREE(par.buffer);
 				
 						/* Set the timeout */
-						pHandler->timeout = time(NULL) + SUPL_STD_TIMEOUT;
+						setTimer(pHandler, TIMER_SESSION, SUPL_STD_TIMEOUT * 1000);
 					}
 				}
 				else
@@ -1580,16 +1849,25 @@ static int suplSM(suplHandler_t *pHandler, struct ULP_PDU *pMsg, SuplCmd_t cmd)
 */
 static suplHandler_t *allocateSM(bool ni)
 {
-    // Allocate the handler - remember to deallocate in case of error
-    suplHandler_t *pHandler = (suplHandler_t*) MC_CALLOC(sizeof(suplHandler_t), 1);
+    // Take the handler from the pool - remember to deallocate in case of error
+	pthread_mutex_lock(&s_handlerMutex);
+    suplHandler_t *pHandler = s_pFreeHandlers;
+	if (pHandler != NULL)
+	{
+		s_pFreeHandlers = pHandler->pNext;
+	}
+	pthread_mutex_unlock(&s_handlerMutex);
+	
     if (pHandler == NULL)
 	{
-        LOGV("%s: Error in allocation", __FUNCTION__);
+        LOGV("%s: too many instancies... %d", __FUNCTION__, SUPL_HANDLER_POOL);
 		return NULL;
 	}
+	memset(pHandler, 0, sizeof(*pHandler));
 
     pHandler->state = START;								/* set the start of the state machine */
-    pHandler->timeout = -1;									/* set the timer initial value */
+    for (int i = 0; i < TIMER_NUM; i++)
+		pHandler->timerIx[i] = -1;							/* no timers running */
 	pHandler->requestedPosMethod = PosMethod_noPosition;	// No pos method defined
 	pHandler->networkInitiated = ni;						// Initiation type
     
@@ -1600,50 +1878,53 @@ static suplHandler_t *allocateSM(bool ni)
     return pHandler;		/* return the handler pointer */
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//! Inserts a Supl state handling structure into the list of sessions
+/*! The number of sessions is limited by the handler pool, so there is always
+    space for a handler obtained from allocateSM
+  \param pHandler : Pointer to the Supl state handling structure to insert
+  \param pSetId   : SET session ID received from the server, NULL to generate a new one
+  \return true if inserted, false if the session ID could not be set up
+*/
 static bool suplInsertHandler(suplHandler_t *pHandler, const SetSessionID_t *pSetId)
 {
 	assert(pHandler);
-	assert(MAX_SM_INSTANCES < (MAX_SID_NUMBER - START_SID_NUMBER));
+	assert(SUPL_HANDLER_POOL < (MAX_SID_NUMBER - START_SID_NUMBER));
+	assert(2 * SUPL_HANDLER_POOL <= SUPL_INDEX_SIZE);
 	pthread_mutex_lock(&s_handlerMutex);
 
-    if (s_pQueueTail == NULL)
+    if (pSetId != NULL)
     {
-        /* the queue is empty.. */
-        s_pQueueTail = pHandler;
+        pHandler->pSetId = copySetId(pSetId);
+        pHandler->sid = pSetId->sessionId;
     }
     else
     {
-        /* browse the queue */
-		suplHandler_t *pTmp = s_pQueueTail;
-		int cnt = 0;
-        while (pTmp->pNext != NULL)
-        {
-            pTmp = pTmp->pNext;
-
-            /* check number of SM instancies */
-            cnt++;
-            if (cnt > MAX_SM_INSTANCES)
-            {
-                /* Error in number of instancies */
-				pthread_mutex_unlock(&s_handlerMutex);
-                LOGV("%s: too many instancies... %d", __FUNCTION__, cnt);
-                return false;
-            }
-        }
-		// Space for insertion
-        pTmp->pNext = pHandler;				// Insert
+        pHandler->sid = getNewSid();		// Get a unique sid - NB handler list mutex is locked
+        pHandler->pSetId = fillDefaultSetId(pHandler->sid);
     }
+	
+	if (pHandler->pSetId == NULL)
+	{
+		pthread_mutex_unlock(&s_handlerMutex);
+		LOGV("%s: no SET session ID for %d", __FUNCTION__, pHandler->sid);
+		return false;
+	}
 
-    if (pSetId != NULL)
+	/* append to the queue */
+	pHandler->pNext = NULL;
+	pHandler->pPrev = s_pQueueHead;
+    if (s_pQueueHead == NULL)
     {
-        pHandler->pSetId = copySetId(pSetId);
-        pHandler->sid = pSetId->sessionId;
+        /* the queue is empty.. */
+        s_pQueueTail = pHandler;
     }
     else
     {
-        pHandler->sid = getNewSid();		// Get a unique sid - NB handler list mutex is locked
-        pHandler->pSetId = fillDefaultSetId(pHandler->sid);
+        s_pQueueHead->pNext = pHandler;
     }
+	s_pQueueHead = pHandler;
+	indexAdd(s_sidIndex, pHandler->sid, pHandler);
 
 	pthread_mutex_unlock(&s_handlerMutex);
 
@@ -1663,50 +1944,67 @@ static void freeSuplHandler(suplHandler_t *pHandler)
 
     /* Check the consistency of the queue */
     assert(s_pQueueTail);
+	assert(indexFind(s_sidIndex, pHandler->sid) != NULL);
+
+    /* stop the timers of the session */
+	for (int i = 0; i < TIMER_NUM; i++)
+		clearTimer(pHandler, (SuplTimer_t) i);
 
     /* close the socket, if it is open... */
 	if (pHandler->bio != 0)
 	{
-        CAgpsIf* pAgps = CAgpsIf::getInstance();
-
-        /*TODO if (pAgps->isTlsActive())
-        {
-            SSL *pSsl = NULL;
-            BIO_get_ssl(pHandler->bio, &pSsl);
-            if (pSsl != NULL)
-            {
-                SSL_shutdown(pSsl);
-            }
-            else
-            {
-                LOGW("%s: ssl instance is NULL", __FUNCTION__);
-            }
-        }*/
-		BIO_free_all(pHandler->bio);
-		SSL_CTX_free(pHandler->ctx); 
-		LOGV("%s: closed socket", __FUNCTION__);
-	}
-
-    /* check if it's the first element */
-	suplHandler_t *pTmp = s_pQueueTail;
-    if (pTmp == pHandler)
-    {
-        s_pQueueTail = pHandler->pNext;
-    }
-	else
-	{
-		while (pTmp->pNext != pHandler)
+		if (pHandler->polled)
+		{
+			/* an idle connection must not wake up the main loop, nor be added twice when reused */
+			int fd = BIO_get_fd(pHandler->bio, NULL);
+			indexRemove(s_fdIndex, fd, pHandler);
+			if (epoll_ctl(s_uplPollFd, EPOLL_CTL_DEL, fd, NULL) < 0)
+			{
+				LOGE("%s: Cannot stop polling SUPL socket %d (%i)", __FUNCTION__, fd, errno);
+			}
+			pHandler->polled = false;
+			pHandler->pollEvents = 0;
+		}
+		else
 		{
-			/* Check the consistency of the queue */
-			assert(pTmp->pNext != NULL);
+			s_unpolledNum--;
+		}
 
-			/* Browse the tree to get the right handler */
-			pTmp = pTmp->pNext;
+		if (pHandler->connState == CONN_ESTABLISHED)
+		{
+			/* tickets sent after the handshake are only known now */
+			SSL *pSsl = NULL;
+			BIO_get_ssl(pHandler->pConnBio, &pSsl);
+			if (pSsl != NULL)
+			{
+				saveSslSession(pSsl);
+			}
 		}
 
-		/* shift the elements */
-		pTmp->pNext = pHandler->pNext;
+		if ((pHandler->connState == CONN_ESTABLISHED) && (pHandler->bio == pHandler->pConnBio) && (pHandler->rxLen == 0))
+		{
+			/* keep the connection for the next session or close it */
+			releaseConnection(pHandler->bio);
+		}
+		else
+		{
+			/* setup not completed */
+			closeConnection(pHandler->bio);
+		}
+		pHandler->bio = NULL;
+		pHandler->pConnBio = NULL;
 	}
+
+    /* unlink from the queue */
+	if (pHandler->pPrev == NULL)
+		s_pQueueTail = pHandler->pNext;
+	else
+		pHandler->pPrev->pNext = pHandler->pNext;
+	if (pHandler->pNext == NULL)
+		s_pQueueHead = pHandler->pPrev;
+	else
+		pHandler->pNext->pPrev = pHandler->pPrev;
+	indexRemove(s_sidIndex, pHandler->sid, pHandler);
 	
 	pthread_mutex_unlock(&s_handlerMutex);
 
@@ -1731,46 +2029,195 @@ static suplHandler_t *searchSMInst(int sid, bool lock)
 	if (lock) 
     {
         pthread_mutex_lock(&s_handlerMutex);
-	
-        /* take a pointer to the tail */
-        suplHandler_t *pTmp = s_pQueueTail;
-
-        while(pTmp != NULL)
-        {
-            if (pTmp->sid == sid)
-            {
-                /* found the correct one */
-                break;
-            }
-            /* browse the queu */
-            pTmp = pTmp->pNext;
-        }
-	
+        suplHandler_t *pTmp = indexFind(s_sidIndex, sid);
         pthread_mutex_unlock(&s_handlerMutex);
-        /* no instance available with the sid */
         return pTmp;
     }
     else
     {
-        /* take a pointer to the tail */
-        suplHandler_t *pTmp = s_pQueueTail;
-
-        while(pTmp != NULL)
-        {
-            if (pTmp->sid == sid)
-            {
-                /* found the correct one */
-                break;
-            }
-            /* browse the queu */
-            pTmp = pTmp->pNext;
-        }
-	
-        /* no instance available with the sid */
-        return pTmp;
+        return indexFind(s_sidIndex, sid);
     }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//! Position of a key in a session index if there are no collisions
+/*!
+  \param key : Session ID or socket
+  \return Index entry to start probing at
+*/
+static unsigned int indexHome(int key)
+{
+	// Fibonacci hashing, consecutive keys end up far apart
+	return ((unsigned int) key * 2654435761U) >> (32 - SUPL_INDEX_BITS);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Adds a session to a session index
+/*! Collisions are resolved by linear probing. The index is twice the size of
+    the handler pool, so there is always an empty entry.
+  \param pIndex   : Session index to add to
+  \param key      : Session ID or socket the session is found by
+  \param pHandler : Pointer to the Supl state handling structure
+*/
+static void indexAdd(suplIndexEntry_t *pIndex, int key, suplHandler_t *pHandler)
+{
+	unsigned int ix = indexHome(key);
+	while (pIndex[ix].pHandler != NULL)
+	{
+		ix = (ix + 1) & (SUPL_INDEX_SIZE - 1);
+	}
+	pIndex[ix].key = key;
+	pIndex[ix].pHandler = pHandler;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Finds a session in a session index
+/*!
+  \param pIndex   : Session index to search
+  \param key      : Session ID or socket
+  \return Pointer to the Supl state handling structure, NULL if not found
+*/
+static suplHandler_t *indexFind(const suplIndexEntry_t *pIndex, int key)
+{
+	unsigned int ix = indexHome(key);
+	while (pIndex[ix].pHandler != NULL)
+	{
+		if (pIndex[ix].key == key)
+			return pIndex[ix].pHandler;
+		ix = (ix + 1) & (SUPL_INDEX_SIZE - 1);
+	}
+	return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Removes a session from a session index
+/*! The entries following in the probe sequence are moved back into the
+    gap, so lookups never need to skip deleted entries.
+  \param pIndex   : Session index to remove from
+  \param key      : Session ID or socket the session was added with
+  \param pHandler : Pointer to the Supl state handling structure
+*/
+static void indexRemove(suplIndexEntry_t *pIndex, int key, const suplHandler_t *pHandler)
+{
+	unsigned int gap = indexHome(key);
+	while (pIndex[gap].pHandler != pHandler)
+	{
+		if (pIndex[gap].pHandler == NULL)
+			return;		// not in the index
+		gap = (gap + 1) & (SUPL_INDEX_SIZE - 1);
+	}
+	
+	unsigned int ix = gap;
+	for (;;)
+	{
+		ix = (ix + 1) & (SUPL_INDEX_SIZE - 1);
+		if (pIndex[ix].pHandler == NULL)
+			break;
+		// The entry can fill the gap if it does not have to stay behind it
+		unsigned int home = indexHome(pIndex[ix].key);
+		if (((ix - home) & (SUPL_INDEX_SIZE - 1)) >= ((ix - gap) & (SUPL_INDEX_SIZE - 1)))
+		{
+			pIndex[gap] = pIndex[ix];
+			gap = ix;
+		}
+	}
+	pIndex[gap].pHandler = NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Moves a timer heap entry and updates the index kept in its session
+/*!
+  \param ix    : Position in the heap to store the entry at
+  \param timer : Timer heap entry
+*/
+static void placeTimer(int ix, const suplTimer_t &timer)
+{
+	s_timerHeap[ix] = timer;
+	timer.pHandler->timerIx[timer.type] = ix;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Restores the heap order for an entry that may violate it
+/*! The entry is moved up towards the root if it expires earlier than its
+    parent, or else down while one of its children expires earlier
+  \param ix    : Position in the heap of the entry
+*/
+static void siftTimer(int ix)
+{
+	suplTimer_t timer = s_timerHeap[ix];
+	
+	while (ix > 0)
+	{
+		int parent = (ix - 1) / 2;
+		if (s_timerHeap[parent].dueMs <= timer.dueMs)
+			break;
+		placeTimer(ix, s_timerHeap[parent]);
+		ix = parent;
+	}
+	for (;;)
+	{
+		int child = 2 * ix + 1;
+		if (child >= s_timerNum)
+			break;
+		if ((child + 1 < s_timerNum) && (s_timerHeap[child + 1].dueMs < s_timerHeap[child].dueMs))
+			child++;
+		if (timer.dueMs <= s_timerHeap[child].dueMs)
+			break;
+		placeTimer(ix, s_timerHeap[child]);
+		ix = child;
+	}
+	placeTimer(ix, timer);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Starts or restarts a timer of a Supl session
+/*! The timer will be handled by suplCheckPendingActions once it expired.
+    Has to be called from the main thread only.
+  \param pHandler : Pointer to the Supl state handling structure
+  \param type     : Which of the session timers
+  \param delayMs  : Time from now in ms the timer expires
+*/
+static void setTimer(suplHandler_t *pHandler, SuplTimer_t type, int64_t delayMs)
+{
+	assert(pthread_self() == g_gpsDrvMainThread);
+	
+	int ix = pHandler->timerIx[type];
+	if (ix == -1)
+	{
+		assert(s_timerNum < MAX_SUPL_TIMERS);
+		ix = s_timerNum++;
+		s_timerHeap[ix].pHandler = pHandler;
+		s_timerHeap[ix].type = type;
+	}
+	s_timerHeap[ix].dueMs = getMonotonicMsCounter() + delayMs;
+	siftTimer(ix);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Stops a timer of a Supl session
+/*! Nothing is done if the timer is not running.
+    Has to be called from the main thread only.
+  \param pHandler : Pointer to the Supl state handling structure
+  \param type     : Which of the session timers
+*/
+static void clearTimer(suplHandler_t *pHandler, SuplTimer_t type)
+{
+	assert(pthread_self() == g_gpsDrvMainThread);
+	
+	int ix = pHandler->timerIx[type];
+	if (ix == -1)
+		return;
+	
+	pHandler->timerIx[type] = -1;
+	s_timerNum--;
+	if (ix < s_timerNum)
+	{
+		// fill the gap with the last entry
+		placeTimer(ix, s_timerHeap[s_timerNum]);
+		siftTimer(ix);
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //! Generates a new Session ID
 /*! 
@@ -1796,9 +2243,10 @@ static int getNewSid(void)
 
 ///////////////////////////////////////////////////////////////////////////////
 //! Generate a new Supl session
-/*! Generates a new Supl session by setting up a socket connection to a the Supl
+/*! Generates a new Supl session by starting a socket connection to a the Supl
     server and filling the supplied supl state structure with appropriate session
-    information
+    information. The connection is set up by the main loop, messages written 
+    to the session meanwhile are queued until it is established.
   \param pHandler : Pointer to Supl state structure
   \return 0 id successful, < 0 if failed
 */
@@ -1809,9 +2257,23 @@ static int createUplSession(suplHandler_t *pHandler)
 	
 	CAgpsIf* pAgps = CAgpsIf::getInstance();
     char tmpString[50];
-    SSL * ssl;
     BIO *bio;
 
+	/* continue on the connection of a previous session if it is still open */
+	checkConnServer();
+	bio = takeIdleConnection();
+	if (bio != NULL)
+	{
+		s_connStats.reused++;
+		LOGV("%s: Reusing idle connection (%d reused)", __FUNCTION__, s_connStats.reused);
+		logAgps.write(0x10000003, "%d # server connection success", pHandler->sid);
+		pHandler->bio = bio;
+		pHandler->pConnBio = bio;
+		pHandler->connState = CONN_ESTABLISHED;
+		s_unpolledNum++;		// main loop registers the socket
+		return 0;
+	}
+
     /* prepare the address */
 	int suplPort;
 	char* pSuplServerAddress;
@@ -1821,228 +2283,556 @@ static int createUplSession(suplHandler_t *pHandler)
     if (pAgps->isTlsActive())
     {
         LOGV("%s: **SECURE** TLS connection", __FUNCTION__);
-        /* Set up the SSL context */
-        if ( (pHandler->ctx = SSL_CTX_new(SSLv23_client_method())) == NULL)
+        /* Get the shared SSL context */
+		SSL_CTX *ctx = getSslContext();
+        if (ctx == NULL)
         {
-            LOGE("%s: Error in creation of new context: %s", __FUNCTION__, ERR_error_string(ERR_get_error(),NULL));
 			return -1;
         }
 
-        /* Load the trust store */
-		const char* certFileName = pAgps->getCertificateFileName();
-		assert(certFileName);
-		
-        if(*certFileName)
-        {
-            LOGV("%s: Loading the certificate %s", __FUNCTION__, certFileName);
-
-            if(!SSL_CTX_load_verify_locations(pHandler->ctx, certFileName, NULL))
-            {
-                LOGE("%s: Error loading trust store %s", __FUNCTION__, certFileName);
-                return -1;
-            }
-
-            LOGV("%s: Certificate loaded", __FUNCTION__);
-        }
-
         /* Setup the connection, store temporary locally */
-        /*TODO if ( (bio = BIO_new_ssl_connect(pHandler->ctx)) == NULL)
+        if ( (bio = BIO_new_ssl_connect(ctx)) == NULL)
         {
             LOGE("%s: Cannot connect", __FUNCTION__);
 			return -1;
-        }*/
+        }
 
         /* Set the SSL_MODE_AUTO_RETRY flag */
-        /*TODO BIO_get_ssl(bio, &ssl);
+		SSL *ssl = NULL;
+        BIO_get_ssl(bio, &ssl);
         SSL_set_mode(ssl, SSL_MODE_AUTO_RETRY);
-	*/
+		SSL_set_tlsext_host_name(ssl, pSuplServerAddress);
+
+		/* Offer the session of the previous connection for an abbreviated handshake */
+		if (s_pSslSession != NULL)
+		{
+			SSL_set_session(ssl, s_pSslSession);
+		}
+
         /* Create and setup the connection */
-        //TODO BIO_set_conn_hostname(bio, tmpString);
+        BIO_set_conn_hostname(bio, tmpString);
+    }
+    else
+    {
+        LOGV("%s: Non TLS connection to %s", __FUNCTION__, tmpString);
+		bio = BIO_new_connect(tmpString);
+		if (bio == NULL)
+		{
+            LOGE("%s: Cannot connect", __FUNCTION__);
+			return -1;
+		}
+    }
+    BIO_set_nbio(bio, 1);		// Set to non blocking
+    //lint -e{522} remove Highest operation, a 'cast', lacks side-effects
+    BIO_set_close(bio, BIO_CLOSE);
 
-	BIO_new_connect(tmpString);
+	/* queue the messages of the session until the connection is established */
+	BIO *pTxBio = BIO_new(BIO_f_buffer());
+	if ((pTxBio == NULL) || (BIO_set_write_buffer_size(pTxBio, MAX_UPL_PACKET) <= 0))
+	{
+		LOGE("%s: Cannot create transmit buffer", __FUNCTION__);
+		if (pTxBio != NULL)
+		{
+			BIO_free(pTxBio);
+		}
+		BIO_free_all(bio);
+		return -1;
+	}
+	pHandler->pConnBio = bio;
+	pHandler->bio = BIO_push(pTxBio, bio);
+	pHandler->connState = CONN_CONNECTING;
+	pHandler->connStartMs = getMonotonicMsCounter();
+
+	/* start connecting, the main loop does the rest */
+	LOGV("%s # server connecting...", __FUNCTION__);
+	logAgps.write(0x10000002, "%d # server connecting...", pHandler->sid);
+	if (!driveConnection(pHandler))
+	{
+		LOGV("%s: Session connection failed", __FUNCTION__);
+		BIO_free_all(pHandler->bio);
+		pHandler->bio = NULL;
+		pHandler->pConnBio = NULL;
+		pHandler->connState = CONN_NONE;
+		return -1;
+	}
+	if (pHandler->connState != CONN_ESTABLISHED)
+	{
+		setTimer(pHandler, TIMER_CONNECT, SUPL_CONNECT_TIMEOUT * 1000);
+	}
+	s_unpolledNum++;		// main loop registers the socket
 
-        if (connectTimeout(bio, pHandler->sid, 5) == -1)
-        {
-			LOGV("%s: TLS Session connection failed", __FUNCTION__);
-            return -1;
-        }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Advance the setup of a Supl connection
+/*! Continues connecting and the TLS handshake as far as possible without
+    blocking. Once established the messages queued meanwhile are sent, and 
+    the transmit buffer is removed when they are all delivered.
+  \param pHandler : Pointer to Supl state structure
+  \return true if the setup is progressing or completed, false if it failed
+*/
+static bool driveConnection(suplHandler_t *pHandler)
+{
+	assert(pHandler);
+	assert(pHandler->bio);
+	assert(pthread_self() == g_gpsDrvMainThread);
 
-        /* Check the certificate */
-		if (*certFileName)
+	BIO *bio = pHandler->pConnBio;
+	if (pHandler->connState != CONN_ESTABLISHED)
+	{
+		if (BIO_do_connect(bio) <= 0)
 		{
-			long res = SSL_get_verify_result(ssl);
-			if(res != X509_V_OK)
+			if (!BIO_should_retry(bio))
+			{
+				LOGE("%s: Cannot connect", __FUNCTION__);
+				logAgps.write(0x21000001, "%d # no network", pHandler->sid);
+				return false;
+			}
+			// Connect bio waiting for the TCP connection, else the TLS handshake is running
+			if (BIO_should_io_special(bio) && (BIO_get_retry_reason(bio) == BIO_RR_CONNECT))
+			{
+				pHandler->connState = CONN_CONNECTING;
+			}
+			else
 			{
-				LOGE("%s: Certificate verification error: %ld", __FUNCTION__, res);
-				return -1;
+				pHandler->connState = CONN_HANDSHAKING;
 			}
+			return true;
 		}
+		int64_t handshakeMs = getMonotonicMsCounter() - pHandler->connStartMs;
 
-        LOGV("%s: TLS Session established...", __FUNCTION__);
-        /* update the handler */
-        pHandler->bio = bio;
-    }
-    else
-    {
-        LOGV("%s: Non TLS connection to %s", __FUNCTION__, tmpString);
-		pHandler->bio = BIO_new_connect(tmpString);
+		SSL *ssl = NULL;
+		BIO_get_ssl(bio, &ssl);
+		if (ssl != NULL)
+		{
+			/* Check the certificate */
+			const char* certFileName = CAgpsIf::getInstance()->getCertificateFileName();
+			if (*certFileName)
+			{
+				long res = SSL_get_verify_result(ssl);
+				if(res != X509_V_OK)
+				{
+					LOGE("%s: Certificate verification error: %ld", __FUNCTION__, res);
+					return false;
+				}
+			}
 
-		if (connectTimeout(pHandler->bio, pHandler->sid, 5) == -1)
-        {
-			LOGV("%s: Non TLS Session connection failed", __FUNCTION__);
-            pHandler->bio = NULL;
-            return -1;
-        }
+			if (SSL_session_reused(ssl))
+			{
+				s_connStats.resumed++;
+			}
+			saveSslSession(ssl);
+		}
 
-        LOGV("%s: Non TLS Session established...", __FUNCTION__);
-    }
+		/* Every message is written at once. Nagle would hold the first message of the next
+		   session on a kept connection until the SLP acknowledges the last one */
+		int fd = BIO_get_fd(bio, NULL);
+		int on = 1;
+		if ((fd >= 0) && (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) < 0))
+		{
+			LOGW("%s: Cannot disable Nagle: %s", __FUNCTION__, strerror(errno));
+		}
 
-    return 0;
+		s_connStats.connects++;
+		s_connStats.handshakeMs += handshakeMs;
+		if (handshakeMs > s_connStats.handshakeMaxMs)
+		{
+			s_connStats.handshakeMaxMs = handshakeMs;
+		}
+		LOGI("%s: Session established in %lld ms%s (%d connects, %d resumed, avg %lld ms, max %lld ms)", __FUNCTION__,
+			 handshakeMs, ((ssl != NULL) && SSL_session_reused(ssl)) ? ", TLS session resumed" : "",
+			 s_connStats.connects, s_connStats.resumed,
+			 s_connStats.handshakeMs / s_connStats.connects, s_connStats.handshakeMaxMs);
+		logAgps.write(0x10000003, "%d # server connection success", pHandler->sid);
+
+		pHandler->connState = CONN_ESTABLISHED;
+		clearTimer(pHandler, TIMER_CONNECT);
+	}
+
+	if (pHandler->bio != bio)
+	{
+		/* send the queued messages */
+		if (BIO_flush(pHandler->bio) <= 0)
+		{
+			if (!BIO_should_retry(pHandler->bio))
+			{
+				LOGE("%s: Cannot send queued messages", __FUNCTION__);
+				return false;
+			}
+			return true;
+		}
+
+		/* all delivered, write to the connection directly from now on */
+		BIO *pTxBio = pHandler->bio;
+		BIO_pop(pTxBio);
+		BIO_free(pTxBio);
+		pHandler->bio = bio;
+	}
+	return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-//! Calculate a hash based on the contents of the supplied buffer
+//! Handle socket events of a Supl connection being set up
 /*! 
-  \param buffer : Pointer to buffer
-  \param size   : Size of buffer
-  \return 64 bit hash value
+  \param pHandler : Pointer to Supl state structure
 */
-static long long calculateHash(const char *buffer, int size)
+static void serviceConnection(suplHandler_t *pHandler)
 {
-	assert(buffer);
-	
-    unsigned char *returnCode;
-    long long res;
-    unsigned int sizeOut;
-    unsigned char outHash[EVP_MAX_MD_SIZE];
-	CAgpsIf* pAgps = CAgpsIf::getInstance();
-	int suplPort;
-#if defined SUPL_FQDN_SLP
-	char pSuplServerAddress[] = SUPL_FQDN_SLP;
-#else
-	char* pSuplServerAddress;
-	pAgps->getSuplServerInfo(&pSuplServerAddress, &suplPort);
-#endif
-		
-    LOGV("%s: Size of the HMAC input buffer is %d", __FUNCTION__, size);
-    LOGV("%s: the key is %s", __FUNCTION__, pSuplServerAddress);
-    LOGV("%s: the key length is %zd", __FUNCTION__, strlen(pSuplServerAddress));
-    returnCode = HMAC(EVP_sha1(),
-                      pSuplServerAddress,
-                      (int) strlen(pSuplServerAddress),
-                      (unsigned char *) const_cast<char *>(buffer),
-                      (unsigned int) size,
-                      outHash,
-                      &sizeOut);
-    LOGV("%s: size of the hash = %d", __FUNCTION__, size);
-
-    memcpy(&res, returnCode, sizeof(res));
-    LOGV("%s: The calculated HASH is: %.16LX", __FUNCTION__, res);
+	assert(pHandler);
+	assert(pthread_self() == g_gpsDrvMainThread);
 
-    return res;
+	if (!driveConnection(pHandler))
+	{
+		failConnection(pHandler);
+		return;
+	}
+
+	if ((pHandler->connState == CONN_ESTABLISHED) && (pHandler->bio == pHandler->pConnBio))
+	{
+		LOGV("%s: Session %d connection ready", __FUNCTION__, pHandler->sid);
+		if (pHandler->closePending)
+		{
+			/* the session ended already, its last messages are delivered now */
+			freeSuplHandler(pHandler);
+			return;
+		}
+	}
+
+	/* wait for what the connection needs next */
+	uint32_t events = connPollEvents(pHandler);
+	if (pHandler->polled && (events != pHandler->pollEvents))
+	{
+		int fd = BIO_get_fd(pHandler->bio, NULL);
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = events;
+		ev.data.fd = fd;
+		if (epoll_ctl(s_uplPollFd, EPOLL_CTL_MOD, fd, &ev) == 0)
+		{
+			pHandler->pollEvents = events;
+		}
+		else
+		{
+			LOGE("%s: Cannot poll SUPL socket %d (%i)", __FUNCTION__, fd, errno);
+		}
+	}
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-//! Connects to Supl server
+//! End a Supl session whose connection could not be set up
 /*! 
   \param pHandler : Pointer to Supl state structure
-  \param seconds  : Maximum time to spend trying to connect
-  \return 0 if connection is successful, < 0 if not
 */
-static int connectTimeout(BIO *bio, int sid, int seconds)
+static void failConnection(suplHandler_t *pHandler)
 {
-	assert(bio);
+	assert(pHandler);
 
-    ((void)(seconds));
-	
-    BIO_set_nbio(bio, 1);		// Set to non blocking
-    //lint -e{522} remove Highest operation, a 'cast', lacks side-effects
-    BIO_set_close(bio, BIO_CLOSE);
+	/* the queued messages can not be delivered anymore */
+	if (pHandler->bio != pHandler->pConnBio)
+	{
+		BIO *pTxBio = pHandler->bio;
+		pHandler->bio = BIO_pop(pTxBio);
+		BIO_free(pTxBio);
+	}
+
+	if (pHandler->closePending)
+	{
+		// Session ended already
+		freeSuplHandler(pHandler);
+	}
+	else
+	{
+		LOGV("%s: Session connection failed", __FUNCTION__);
+		pHandler->state = END;
+		endSuplSession(pHandler);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Socket events a Supl connection waits for
+/*! 
+  \param pHandler : Pointer to Supl state structure
+  \return epoll event mask
+*/
+static uint32_t connPollEvents(const suplHandler_t *pHandler)
+{
+	assert(pHandler);
+
+	switch (pHandler->connState)
+	{
+	case CONN_CONNECTING:
+		return EPOLLOUT;
+	case CONN_HANDSHAKING:
+		return BIO_should_write(pHandler->pConnBio) ? EPOLLOUT : EPOLLIN;
+	default:
+		// Queued messages not yet delivered need the socket writable
+		return (pHandler->bio != pHandler->pConnBio) ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Get the TLS context shared by all Supl sessions
+/*! The context is created and the trust store loaded on first use only, so
+    the certificates are not parsed again for every session.
+  \return Pointer to the SSL context, NULL if it could not be set up
+*/
+static SSL_CTX *getSslContext(void)
+{
+	assert(pthread_self() == g_gpsDrvMainThread);
+
+	if (s_pSslCtx != NULL)
+	{
+		return s_pSslCtx;
+	}
+
+	/* Set up the SSL context */
+	SSL_CTX *ctx = SSL_CTX_new(SSLv23_client_method());
+	if (ctx == NULL)
+	{
+		LOGE("%s: Error in creation of new context: %s", __FUNCTION__, ERR_error_string(ERR_get_error(),NULL));
+		return NULL;
+	}
+
+	/* Load the trust store */
+	const char* certFileName = CAgpsIf::getInstance()->getCertificateFileName();
+	assert(certFileName);
 	
-	do
-    {
-        int fd;
-		fd_set          readfds;
-        fd_set          writefds;
-        struct timeval  tv;
-        int err;
-
-		LOGV("%s # server connecting...", __FUNCTION__);
-		logAgps.write(0x10000002, "%d # server connecting...", sid);
-        if (BIO_do_connect(bio) == 1) 
-		{
-			break;          /* Connection established */
-        }
-        
-		if (! BIO_should_retry(bio)) 
-		{ 
-			/* Hard error? */
-            LOGE("%s: Cannot connect", __FUNCTION__);
-            BIO_free_all(bio);
-			logAgps.write(0x21000001, "%d # no network", sid);
-            return -1;
-        }
-		
-        /* Wait until there's a change in the socket's status or until
-         * the timeout period.
-         *
-         * Get underlying file descriptor, needed for the select call.
-         */
-        fd = BIO_get_fd(bio, NULL);
-        if (fd == -1) 
-		{
-            LOGE("%s: BIO isn't initialized in oh_ssl_connect()", __FUNCTION__);
-        }
-        assert(fd != -1);
+	if(*certFileName)
+	{
+		LOGV("%s: Loading the certificate %s", __FUNCTION__, certFileName);
 
-//lint -e{866} suppress "Unusual use of '' in argument to sizeof"
-        FD_ZERO(&readfds);
-//lint -e{866} suppress "Unusual use of '' in argument to sizeof"
-        FD_ZERO(&writefds);
-        if (BIO_should_read(bio)) 
+		if(!SSL_CTX_load_verify_locations(ctx, certFileName, NULL))
 		{
-			FD_SET(fd, &readfds);
-        }
-        else if (BIO_should_write(bio)) 
+			LOGE("%s: Error loading trust store %s", __FUNCTION__, certFileName);
+			SSL_CTX_free(ctx);
+			return NULL;
+		}
+
+		LOGV("%s: Certificate loaded", __FUNCTION__);
+	}
+
+	/* Sessions are resumed from s_pSslSession, the internal cache is not needed */
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	s_pSslCtx = ctx;
+	return s_pSslCtx;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Remember the TLS session of a connection for resumption
+/*! 
+  \param pSsl : Pointer to the SSL instance of an established connection
+*/
+static void saveSslSession(SSL *pSsl)
+{
+	assert(pSsl);
+
+	SSL_SESSION *pSession = SSL_get1_session(pSsl);
+	if (pSession == NULL)
+	{
+		return;
+	}
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	/* With TLS 1.3 the ticket arrives after the handshake */
+	if (!SSL_SESSION_is_resumable(pSession))
+	{
+		SSL_SESSION_free(pSession);
+		return;
+	}
+#endif
+	if (s_pSslSession != NULL)
+	{
+		SSL_SESSION_free(s_pSslSession);
+	}
+	s_pSslSession = pSession;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Drop the cached TLS session and idle connection if the Supl server changed
+/*! 
+*/
+static void checkConnServer(void)
+{
+	assert(pthread_self() == g_gpsDrvMainThread);
+
+	int serverGen = CAgpsIf::getInstance()->getSuplServerGeneration();
+	if (serverGen == s_connServerGen)
+	{
+		return;
+	}
+
+	if (s_pIdleBio != NULL)
+	{
+		closeConnection(s_pIdleBio);
+		s_pIdleBio = NULL;
+	}
+	if (s_pSslSession != NULL)
+	{
+		SSL_SESSION_free(s_pSslSession);
+		s_pSslSession = NULL;
+	}
+	s_connServerGen = serverGen;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Check if a connection is open and has nothing left to read
+/*! 
+  \param bio : Bio of the connection
+  \return true if the connection can carry a new session, false if not
+*/
+static bool isConnectionIdle(BIO *bio)
+{
+	assert(bio);
+
+	SSL *pSsl = NULL;
+	BIO_get_ssl(bio, &pSsl);
+	if ((pSsl != NULL) && (SSL_pending(pSsl) > 0))
+	{
+		return false;
+	}
+
+	int fd = BIO_get_fd(bio, NULL);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	/* Closed by the peer (0) or with unread data (> 0) */
+	char c;
+	ssize_t res = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+	return (res < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Take the idle connection to the SLP
+/*! 
+  \return Bio of the idle connection, NULL if there is none or it is no longer usable
+*/
+static BIO *takeIdleConnection(void)
+{
+	assert(pthread_self() == g_gpsDrvMainThread);
+
+	BIO *bio = s_pIdleBio;
+	if (bio == NULL)
+	{
+		return NULL;
+	}
+	s_pIdleBio = NULL;
+
+	int64_t keepAliveMs = (int64_t) CUbxGpsState::getInstance()->getSuplKeepAlive() * 1000;
+	if ((getMonotonicMsCounter() - s_idleBioTimeMs > keepAliveMs) || !isConnectionIdle(bio))
+	{
+		LOGV("%s: Idle connection expired", __FUNCTION__);
+		closeConnection(bio);
+		return NULL;
+	}
+	return bio;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Release the connection of a finished session
+/*! The connection is kept open for the next session if enabled with 
+    SUPL_KEEP_ALIVE and the SLP did not close it, else it is closed.
+  \param bio : Bio of the connection
+*/
+static void releaseConnection(BIO *bio)
+{
+	assert(bio);
+	assert(pthread_self() == g_gpsDrvMainThread);
+
+	if ((CUbxGpsState::getInstance()->getSuplKeepAlive() > 0) &&
+		(CAgpsIf::getInstance()->getSuplServerGeneration() == s_connServerGen) &&
+		isConnectionIdle(bio))
+	{
+		if (s_pIdleBio != NULL)
 		{
-            FD_SET(fd, &writefds);
-        }
-        else 
-		{                  
-			/* This is BIO_should_io_special().
-			 * Not sure what "special" needs to
-			 * wait for, but both read and write
-			 * seems to work without unnecessary
-			 * retries.
-			 */
-            FD_SET(fd, &readfds);
-            FD_SET(fd, &writefds);
-        }
+			closeConnection(s_pIdleBio);
+		}
+		s_pIdleBio = bio;
+		s_idleBioTimeMs = getMonotonicMsCounter();
+		LOGV("%s: keeping connection open", __FUNCTION__);
+		return;
+	}
+	closeConnection(bio);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Close a connection to the SLP
+/*! The shutdown is only marked, so the TLS session stays resumable without
+    writing to a socket the SLP may have closed already. The session is not
+    saved here, the connection may have failed the certificate verification.
+    Sessions are only saved from connections that were established.
+  \param bio : Bio of the connection
+*/
+static void closeConnection(BIO *bio)
+{
+	assert(bio);
 
-        tv.tv_sec = 5;
-        tv.tv_usec = 0;
-        err = select(fd+1, &readfds, &writefds, NULL, &tv);
+	SSL *pSsl = NULL;
+	BIO_get_ssl(bio, &pSsl);
+	if (pSsl != NULL)
+	{
+		SSL_set_shutdown(pSsl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+	}
+	BIO_free_all(bio);
+	LOGV("%s: closed socket", __FUNCTION__);
+}
 
-        /* Evaluate select() return code */
-        if (err <= 0) 
+///////////////////////////////////////////////////////////////////////////////
+//! Calculate a hash based on the contents of the supplied buffer
+/*! The HMAC context is keyed with the SLP address only when the Supl server
+    setting changed, for all other messages the keyed state is reused.
+  \param buffer : Pointer to buffer
+  \param size   : Size of buffer
+  \return 64 bit hash value
+*/
+static long long calculateHash(const char *buffer, int size)
+{
+	assert(buffer);
+	
+    long long res = 0;
+    unsigned int sizeOut = 0;
+    unsigned char outHash[EVP_MAX_MD_SIZE];
+	CAgpsIf* pAgps = CAgpsIf::getInstance();
+	
+    LOGV("%s: Size of the HMAC input buffer is %d", __FUNCTION__, size);
+	pthread_mutex_lock(&s_hashMutex);
+	int serverGen = pAgps->getSuplServerGeneration();
+	if (serverGen != s_hashServerGen)
+	{
+		// (Re)key the context
+		int suplPort;
+#if defined SUPL_FQDN_SLP
+		char pSuplServerAddress[] = SUPL_FQDN_SLP;
+#else
+		char* pSuplServerAddress;
+		pAgps->getSuplServerInfo(&pSuplServerAddress, &suplPort);
+#endif
+		if (pSuplServerAddress == NULL)
 		{
-			if (err < 0) 
-			{
-				LOGE("%s: error during select()", __FUNCTION__);
-			}
-			else
-			{
-				LOGV("%s: connection timeout", __FUNCTION__);
-			}
-            BIO_free_all(bio);
-			logAgps.write(0x21000001, "%d # tls failed", sid);
-			return -1;   /* Timeout */
-        }
-    }
-    while(1);
+			pthread_mutex_unlock(&s_hashMutex);
+			LOGE("%s: No Supl server to use as key", __FUNCTION__);
+			return 0;
+		}
+		LOGV("%s: the key is %s", __FUNCTION__, pSuplServerAddress);
+		LOGV("%s: the key length is %zd", __FUNCTION__, strlen(pSuplServerAddress));
+		HMAC_Init_ex(s_pHashCtx, pSuplServerAddress, (int) strlen(pSuplServerAddress), EVP_sha1(), NULL);
+		s_hashServerGen = serverGen;
+	}
+	else
+	{
+		// Same key, just reset
+		HMAC_Init_ex(s_pHashCtx, NULL, 0, NULL, NULL);
+	}
+	HMAC_Update(s_pHashCtx, (const unsigned char *) buffer, (size_t) size);
+	HMAC_Final(s_pHashCtx, outHash, &sizeOut);
+	pthread_mutex_unlock(&s_hashMutex);
+    LOGV("%s: size of the hash = %d", __FUNCTION__, sizeOut);
 
-	logAgps.write(0x10000003, "%d # server connection success", sid);
-    return 0;
+    memcpy(&res, outHash, sizeof(res));
+    LOGV("%s: The calculated HASH is: %.16LX", __FUNCTION__, res);
+
+    return res;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -2115,7 +2905,7 @@ static int sendPositionResponse(suplHandler_t *pHandler, char* pSendBuffer, int
 		sendSuplPos(pHandler->bio, &par);
 
 		/* Set the timeout */
-		pHandler->timeout = time(NULL) + SUPL_STD_TIMEOUT;
+		setTimer(pHandler, TIMER_SESSION, SUPL_STD_TIMEOUT * 1000);
 		pHandler->state = RRLP;
 		
 		MC_FREE(pSendBuffer);
@@ -2336,12 +3126,20 @@ static void determineAssistance(suplHandler_t* pHandler, suplPosInitParam_t* pPo
 	assert(pPosInitParams);
 	
 	double lat, lon;
+	bool posAvail;
 	
 	CMyDatabase* pDatabase = CMyDatabase::getInstance();
 	assert(pDatabase);
 	
-	if (pDatabase->getData(CMyDatabase::DATA_LATITUDE_DEGREES, lat) && 
-		pDatabase->getData(CMyDatabase::DATA_LONGITUDE_DEGREES, lon))
+	unsigned int seq;
+	do
+	{
+		seq = pDatabase->beginRead();
+		posAvail = (pDatabase->getData(CMyDatabase::DATA_LATITUDE_DEGREES, lat) && 
+					pDatabase->getData(CMyDatabase::DATA_LONGITUDE_DEGREES, lon));
+	} while (pDatabase->retryRead(seq));
+	
+	if (posAvail)
 	{
 		// Don't need assistance as we already have position
 		pPosInitParams->posEn = 1;
@@ -2385,7 +3183,7 @@ static int startSiSession(suplHandler_t* pHandler)
 		/* Next state */
 		pHandler->state = WAIT_RES;
 		/* set the timeout */
-		pHandler->timeout = time(NULL) + SUPL_STD_TIMEOUT;
+		setTimer(pHandler, TIMER_SESSION, SUPL_STD_TIMEOUT * 1000);
 	}
 	
 	return res;
@@ -2420,6 +3218,21 @@ static void endSuplSession(suplHandler_t* pHandler)
 		}
 	}
 	
+	if ((pHandler->bio != NULL) && (pHandler->bio != pHandler->pConnBio) && (BIO_wpending(pHandler->bio) > 0))
+	{
+		/* a message (e.g. SUPL END) is queued on the connection being set up, 
+		   release the handler when it is delivered */
+		LOGV("%s: delivering queued messages before closing", __FUNCTION__);
+		pHandler->state = END;
+		pHandler->closePending = true;
+		clearTimer(pHandler, TIMER_SESSION);
+		clearTimer(pHandler, TIMER_MSA_RESPONSE);
+		clearTimer(pHandler, TIMER_NETWORK_POLL);
+		if (pHandler->timerIx[TIMER_CONNECT] == -1)
+			setTimer(pHandler, TIMER_CONNECT, SUPL_CONNECT_TIMEOUT * 1000);
+		return;
+	}
+	
 	freeSuplHandler(pHandler);
 }
 
@@ -2550,6 +3363,9 @@ static void safeFreeHandler(suplHandler_t* pHandler)
     }
 
 
-    /* Deallocating the hanlder itself */
-    MC_FREE(pHandler);
+    /* Return the hanlder itself to the pool */
+	pthread_mutex_lock(&s_handlerMutex);
+    pHandler->pNext = s_pFreeHandlers;
+	s_pFreeHandlers = pHandler;
+	pthread_mutex_unlock(&s_handlerMutex);
 }
@@ -35,6 +35,7 @@
 #define __SUPLSMMANAGER_H__
 
 #include <unistd.h>
+#include <stdint.h>
 #include "rrlpmanager.h"
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -57,8 +58,9 @@ typedef enum
 ///////////////////////////////////////////////////////////////////////////////
 // Functions
 void suplRegisterEventCallbacks(GpsControlEventInterface *pEventInterface, void* pContext);
-int suplAddUplListeners(fd_set *pRfds, int *pMaxFd);
-int suplReadUplSock(fd_set *pRfds);
+int suplAddUplListeners(int pollFd);
+int suplReadUplSock(int fd);
+int64_t suplGetNextTimeout(void);
 bool suplStartSetInitiatedAction(void);
 void suplHandleNetworkInitiatedAction(const char *buffer, int size);
 void suplCheckPendingActions(void);
@@ -40,6 +40,7 @@
 
 #include "upldecod.h"
 #include "uplsend.h"
+#include "asnarena.h"
 #include "ubx_log.h"
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -53,19 +54,22 @@
 struct ULP_PDU *uplDecode(const char *pBuffer, int size)
 {
 	asn_dec_rval_t rval;
-    ULP_PDU_t *pMsg;
-
-    pMsg = (ULP_PDU_t *) MC_CALLOC(sizeof(ULP_PDU_t),1);
-    if (pMsg == NULL)
-	{
-        LOGE("%s: allocation error", __FUNCTION__);
-	}
+    ULP_PDU_t *pMsg = NULL;
 
+	/* the decoder allocates the message, all of it in one arena if possible */
+	asnArenaBegin();
     rval = uper_decode_complete(0, 
                                 &asn_DEF_ULP_PDU,
                                 (void **) &pMsg,
                                 pBuffer,
                                 (unsigned int) size);
+	asnArenaEnd();
+
+    if (pMsg == NULL)
+	{
+        LOGE("%s: allocation error", __FUNCTION__);
+		return NULL;
+	}
 
 	logSupl(pMsg, true);
     switch(rval.code) {
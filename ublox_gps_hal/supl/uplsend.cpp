@@ -368,8 +368,14 @@ int sendSuplEnd(BIO *bio, const suplEndParam_t *pParam)
 		CMyDatabase* pDatabase = CMyDatabase::getInstance();
 		
 		double lat, lon = 0.0;
-		bool posAvail = (pDatabase->getData(CMyDatabase::DATA_LATITUDE_DEGREES, lat) && 
-						 pDatabase->getData(CMyDatabase::DATA_LONGITUDE_DEGREES, lon));
+		bool posAvail;
+		unsigned int seq;
+		do
+		{
+			seq = pDatabase->beginRead();
+			posAvail = (pDatabase->getData(CMyDatabase::DATA_LATITUDE_DEGREES, lat) && 
+						pDatabase->getData(CMyDatabase::DATA_LONGITUDE_DEGREES, lon));
+		} while (pDatabase->retryRead(seq));
         if (posAvail)
 		{
 			pSuplEnd->position = allocatePosition(lat, lon);
@@ -56,6 +56,8 @@ CAgpsIf::CAgpsIf()
 	m_agpsServersCnt = 0;
 #ifdef SUPL_ENABLED
 	m_certificateFileName = NULL;
+	m_suplServer = -1;
+	m_suplServerGen = 0;
 #endif	
     memset(&m_callbacks, 0, sizeof(m_callbacks));
     memset(m_agpsServers, 0, sizeof(m_agpsServers));
@@ -114,17 +116,36 @@ int CAgpsIf::setServer(AGpsType type, const char* hostname, int port)
 {
 	LOGD("CAgpsIf::%s : type=%i(%s) host=%s port=%i", __FUNCTION__, type, _LOOKUPSTR(type, AGpsType), hostname, port);
 	int cnt = s_myIf.m_agpsServersCnt;
-	if (cnt < NUM_AGPS_SERVERS)
+	int i;
+	// Entries are never overwritten, a server set again is taken from the list
+	for (i = 0; i < cnt; i ++)
+	{
+		const AGPS_SERVER_DATA_t* pServer = &s_myIf.m_agpsServers[i];
+		if ((pServer->type == type) && (pServer->port == port) &&
+			!strncmp(pServer->hostname, hostname, MAX_HOSTNAME))
+			break;
+	}
+	if (i == cnt)
 	{
+		if (cnt == NUM_AGPS_SERVERS)
+		{
+			LOGE("CAgpsIf::%s : no space", __FUNCTION__);
+			return 0;
+		}
 		s_myIf.m_agpsServers[cnt].type = type;
 		s_myIf.m_agpsServers[cnt].port = port;
 		strncpy(s_myIf.m_agpsServers[cnt].hostname, hostname, MAX_HOSTNAME);
 		s_myIf.m_agpsServersCnt = cnt +1;
 	}
-	else
+#ifdef SUPL_ENABLED
+	if ((type == AGPS_TYPE_SUPL) && (s_myIf.m_suplServer != i))
 	{
-		LOGE("CAgpsIf::%s : no space", __FUNCTION__);
+		// Server is stored before users see the change
+		__sync_synchronize();
+		s_myIf.m_suplServer = i;
+		s_myIf.m_suplServerGen++;
 	}
+#endif
 	
     return 0;
 }
@@ -148,14 +169,11 @@ void CAgpsIf::getSuplServerInfo(char** ppSuplServerAddress, int *pSuplPort)
 	*ppSuplServerAddress = NULL;
 	*pSuplPort = -1;
 
-	int i;
-	for (i = 0; i < m_agpsServersCnt; i ++)
+	int i = m_suplServer;
+	if (i >= 0)
 	{
-		if (m_agpsServers[i].type == AGPS_TYPE_SUPL)
-		{
-			*ppSuplServerAddress = m_agpsServers[i].hostname;
-			*pSuplPort = m_agpsServers[i].port;
-		}
+		*ppSuplServerAddress = m_agpsServers[i].hostname;
+		*pSuplPort = m_agpsServers[i].port;
 	}
 	LOGV("CAgpsIf::%s : Address:Port %s:%d", __FUNCTION__, *ppSuplServerAddress, *pSuplPort);
 }
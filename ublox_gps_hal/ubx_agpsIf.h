@@ -56,6 +56,8 @@ public:
 	};
 	const char* getCertificateFileName(void) const { return m_certificateFileName; };
 	bool isTlsActive(void) const { return (m_certificateFileName != NULL); };
+	//! Counter changing each time the Supl server is set, for caches depending on it
+	int getSuplServerGeneration(void) const { return m_suplServerGen; };
 #endif
 
 protected:
@@ -86,6 +88,8 @@ protected:
 	
 #ifdef SUPL_ENABLED		
 	char* m_certificateFileName;
+	volatile int m_suplServer;		//!< Entry of m_agpsServers used for Supl, -1 if none
+	volatile int m_suplServerGen;
 #endif
 };
 
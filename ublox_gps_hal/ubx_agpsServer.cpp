@@ -0,0 +1,261 @@
+/*******************************************************************************
+ *
+ * Copyright (C) u-blox AG
+ * u-blox AG, Thalwil, Switzerland
+ *
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose without fee is hereby granted, provided that this entire notice
+ * is included in all copies of any software which is or includes a copy
+ * or modification of this software and in all copies of the supporting
+ * documentation for such software.
+ *
+ * THIS SOFTWARE IS BEING PROVIDED "AS IS", WITHOUT ANY EXPRESS OR IMPLIED
+ * WARRANTY. IN PARTICULAR, NEITHER THE AUTHOR NOR U-BLOX MAKES ANY
+ * REPRESENTATION OR WARRANTY OF ANY KIND CONCERNING THE MERCHANTABILITY
+ * OF THIS SOFTWARE OR ITS FITNESS FOR ANY PARTICULAR PURPOSE.
+ *
+ *******************************************************************************
+ *
+ * Project: PE_ANS
+ *
+ ******************************************************************************/
+/*!
+  \file
+  \brief  Stand-in AssistNow Online server
+
+  Answers the requests of agpsDownloadThread the way the u-blox AssistNow
+  Online server does, so the download can be tested without network access.
+  Point UBX_HOST and UBX_PORT of u-blox.conf to the machine running it. The
+  reply is application/ubx aiding data, AID-INI, AID-HUI and AID-EPH and
+  AID-ALM of 32 satellites or the contents of a file, or a text/plain error
+  message. It can be sent at once, a few bytes at a time or cut off in the
+  middle, the HAL has to keep the complete messages of a cut off download.
+  The request of each connection is printed.
+
+  usage: ubx_agpsServer [-p port] [-n connections] [-m mode] [ubx-file]
+    -p  port to listen on, default 46434
+    -n  connections served before exiting, default 0 for no limit
+    -m  full, slow (7 bytes every ms), trunc (the first 1000 bytes of the
+        data, then the connection is closed) or text, default full
+*/
+/*******************************************************************************
+ * $Id: ubx_agpsServer.cpp $
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "ubx_benchUtil.h"
+
+#define UBX_PORT		46434	//!< Default port, as in u-blox.conf
+#define SLOW_CHUNK		7		//!< Bytes sent at a time in slow mode
+#define TRUNC_SIZE		1000	//!< Bytes of the data sent in trunc mode
+
+//! The modes of the reply
+typedef enum { MODE_FULL, MODE_SLOW, MODE_TRUNC, MODE_TEXT } MODE_t;
+
+//! Append a UBX message with a pseudo random payload
+static void addUbx(unsigned char*& pData, int& size, unsigned char cls, unsigned char id, int len, int sv)
+{
+	unsigned char* p = (unsigned char*) realloc(pData, (size_t) (size + len + 8));
+	if (!p)
+		return;
+	pData = p;
+	p += size;
+	for (int i = 0; i < len; i ++)
+		p[6 + i] = (unsigned char) (sv * 31 + i * 7);
+	if (sv && (len >= 4))
+	{
+		// svid is the first U4 of AID-EPH and AID-ALM
+		p[6] = (unsigned char) sv;
+		p[7] = p[8] = p[9] = 0;
+	}
+	size += benchFrameUbx(p, cls, id, len);
+}
+
+//! Send all of a buffer
+static bool sendAll(int sock, const void* pData, int size)
+{
+	const char* p = (const char*) pData;
+	while (size > 0)
+	{
+		ssize_t n = send(sock, p, (size_t) size, 0);
+		if ((n < 0) && (errno == EINTR))
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= (int) n;
+	}
+	return true;
+}
+
+//! Read the request and reply to it
+static void serve(int sock, MODE_t mode, const unsigned char* pData, int size)
+{
+	// the HAL sends the request without a line end and waits for the reply
+	char request[1024];
+	ssize_t n = recv(sock, request, sizeof(request) - 1, 0);
+	request[(n > 0) ? n : 0] = '\0';
+	printf("request   '%s'\n", request);
+
+	char header[256];
+	int len;
+	if (mode == MODE_TEXT)
+	{
+		static const char s_text[] = "error: unknown user";
+		len = snprintf(header, sizeof(header), "u-blox a-gps server (c) 1997-2009 u-blox AG\n"
+					   "Content-Length: %d\nContent-Type: text/plain\n\n", (int) sizeof(s_text) - 1);
+		sendAll(sock, header, len);
+		sendAll(sock, s_text, (int) sizeof(s_text) - 1);
+		printf("reply     text/plain, %d bytes\n", (int) sizeof(s_text) - 1);
+		return;
+	}
+	len = snprintf(header, sizeof(header), "u-blox a-gps server (c) 1997-2009 u-blox AG\r\n"
+				   "Content-Length: %d\r\nContent-Type: application/ubx\r\n\r\n", size);
+	if (mode == MODE_SLOW)
+	{
+		// the header and data in small pieces, so every split of a message occurs
+		int total = len + size;
+		for (int i = 0; i < total; i += SLOW_CHUNK)
+		{
+			char chunk[SLOW_CHUNK];
+			int num = (total - i < SLOW_CHUNK) ? total - i : SLOW_CHUNK;
+			for (int j = 0; j < num; j ++)
+				chunk[j] = (i + j < len) ? header[i + j] : (char) pData[i + j - len];
+			if (!sendAll(sock, chunk, num))
+				break;
+			usleep(1000);
+		}
+	}
+	else
+	{
+		int num = ((mode == MODE_TRUNC) && (size > TRUNC_SIZE)) ? TRUNC_SIZE : size;
+		sendAll(sock, header, len);
+		sendAll(sock, pData, num);
+		if (num < size)
+		{
+			printf("reply     application/ubx, cut off after %d of %d bytes\n", num, size);
+			return;
+		}
+	}
+	printf("reply     application/ubx, %d bytes%s\n", size, (mode == MODE_SLOW) ? ", slowly" : "");
+}
+
+//! Read the data to send from a file
+static bool load(const char* pName, unsigned char*& pData, int& size)
+{
+	FILE* pFile = fopen(pName, "rb");
+	if (!pFile)
+	{
+		fprintf(stderr, "cannot open '%s'\n", pName);
+		return false;
+	}
+	fseek(pFile, 0, SEEK_END);
+	size = (int) ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+	pData = (unsigned char*) malloc((size > 0) ? (size_t) size : 1);
+	bool ok = (size > 0) && pData && (fread(pData, 1, (size_t) size, pFile) == (size_t) size);
+	fclose(pFile);
+	if (!ok)
+		fprintf(stderr, "cannot read '%s'\n", pName);
+	return ok;
+}
+
+int main(int argc, char* argv[])
+{
+	int port = UBX_PORT;
+	int connections = 0;
+	MODE_t mode = MODE_FULL;
+	bool ok = true;
+	int opt;
+	while (ok && ((opt = getopt(argc, argv, "p:n:m:")) != -1))
+	{
+		if (opt == 'p')
+			port = atoi(optarg);
+		else if (opt == 'n')
+			connections = atoi(optarg);
+		else if ((opt == 'm') && !strcmp(optarg, "full"))
+			mode = MODE_FULL;
+		else if ((opt == 'm') && !strcmp(optarg, "slow"))
+			mode = MODE_SLOW;
+		else if ((opt == 'm') && !strcmp(optarg, "trunc"))
+			mode = MODE_TRUNC;
+		else if ((opt == 'm') && !strcmp(optarg, "text"))
+			mode = MODE_TEXT;
+		else
+			ok = false;
+	}
+	if (!ok || (optind < argc - 1))
+	{
+		fprintf(stderr, "usage: %s [-p port] [-n connections] [-m full|slow|trunc|text] [ubx-file]\n", argv[0]);
+		return 1;
+	}
+
+	unsigned char* pData = NULL;
+	int size = 0;
+	if (optind == argc - 1)
+	{
+		if (!load(argv[optind], pData, size))
+			return 1;
+	}
+	else
+	{
+		addUbx(pData, size, 0x0B, 0x01, 48, 0);			// AID-INI
+		addUbx(pData, size, 0x0B, 0x02, 72, 0);			// AID-HUI
+		for (int sv = 1; sv <= 32; sv ++)
+			addUbx(pData, size, 0x0B, 0x31, 104, sv);	// AID-EPH
+		for (int sv = 1; sv <= 32; sv ++)
+			addUbx(pData, size, 0x0B, 0x30, 40, sv);	// AID-ALM
+	}
+
+	// a client closing early must not end the server
+	signal(SIGPIPE, SIG_IGN);
+	int listenSock = socket(AF_INET, SOCK_STREAM, 0);
+	int on = 1;
+	setsockopt(listenSock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons((unsigned short) port);
+	if ((listenSock < 0) || bind(listenSock, (struct sockaddr*) &addr, sizeof(addr)) ||
+		listen(listenSock, 4))
+	{
+		fprintf(stderr, "cannot listen on port %d: %s\n", port, strerror(errno));
+		free(pData);
+		return 1;
+	}
+	printf("listening on port %d, %d bytes of aiding data\n", port, size);
+	fflush(stdout);
+
+	for (int i = 0; (connections == 0) || (i < connections); i ++)
+	{
+		struct sockaddr_in client;
+		socklen_t clientLen = sizeof(client);
+		int sock = accept(listenSock, (struct sockaddr*) &client, &clientLen);
+		if (sock < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "accept failed: %s\n", strerror(errno));
+			break;
+		}
+		printf("connection from %s\n", inet_ntoa(client.sin_addr));
+		serve(sock, mode, pData, size);
+		fflush(stdout);
+		close(sock);
+	}
+	close(listenSock);
+	free(pData);
+	return 0;
+}
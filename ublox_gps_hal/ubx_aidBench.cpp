@@ -0,0 +1,692 @@
+/*******************************************************************************
+ *
+ * Copyright (C) u-blox AG
+ * u-blox AG, Thalwil, Switzerland
+ *
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose without fee is hereby granted, provided that this entire notice
+ * is included in all copies of any software which is or includes a copy
+ * or modification of this software and in all copies of the supporting
+ * documentation for such software.
+ *
+ * THIS SOFTWARE IS BEING PROVIDED "AS IS", WITHOUT ANY EXPRESS OR IMPLIED
+ * WARRANTY. IN PARTICULAR, NEITHER THE AUTHOR NOR U-BLOX MAKES ANY
+ * REPRESENTATION OR WARRANTY OF ANY KIND CONCERNING THE MERCHANTABILITY
+ * OF THIS SOFTWARE OR ITS FITNESS FOR ANY PARTICULAR PURPOSE.
+ *
+ *******************************************************************************
+ *
+ * Project: PE_ANS
+ *
+ ******************************************************************************/
+/*!
+  \file
+  \brief  Writing of aiding data to the receiver
+
+  Stores the ephemeris, AssistNow Autonomous and almanac of 32 satellites
+  and the health/UTC/iono parameters in CUbxGpsState, as the receiver
+  reports them, and writes them to a pseudo terminal opened with
+  CSerialPort. A receiver thread reads the other end at the baud rate and
+  compares every byte with what has to arrive. Each pass is written
+    single   a write for each message, as sendAidData did before
+    batch    sendAidData, all messages with one writev
+  and the ephemeris payloads are framed
+    single   writeUbx for each message
+    batch    writeUbxBatch
+  The CPU time of the writer and the time until the last byte has been
+  read are reported.
+
+  The messages are then stored in the aiding database file by a driver
+  and loaded by a fresh one, as after a restart, both are timed. All of
+  them have to come back, and after two ephemeris records in the file are
+  damaged, all but those two. With a damaged magic word none is loaded.
+
+  Then an AssistNow Offline file of several weeks is put into a fresh
+  process for each way it is kept
+    heap     a copy in memory, without persistence
+    mmap     stored and mapped from the data file
+    load     mapped from the data file stored before, as after a restart
+  and the UBX-AID-ALP requests of the receiver, at random offsets, are
+  answered. The time to put or load the file, the latency of the requests
+  and the anonymous, file backed and peak memory of the process are
+  reported.
+
+  usage: ubx_aidBench [-n passes] [-r baud] [-w weeks] [-q requests] [-d dir]
+    -n  passes of each way, default 10
+    -r  baud rate of the receiver, 0 reads as fast as possible, default 115200
+    -w  weeks of the ALP file, 1 to 4, default 4
+    -q  ALP requests answered, default 100
+    -d  directory for the aiding files, default /data/local/tmp
+*/
+/*******************************************************************************
+ * $Id: ubx_aidBench.cpp $
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "std_types.h"
+#include "ubx_moduleIf.h"
+#include "ubxgpsstate.h"
+#include "ubx_timer.h"
+#include "ubx_benchUtil.h"
+
+#define NUM_SVS			32		//!< Satellites with aiding data, as NUM_GPS_SVS of CUbxGpsState
+#define EPH_SIZE		104		//!< Payload of UBX-AID-EPH
+#define ALM_SIZE		40		//!< Payload of UBX-AID-ALM
+#define AOP_SIZE		59		//!< Payload of UBX-AID-AOP
+#define HUI_SIZE		72		//!< Payload of UBX-AID-HUI
+#define RX_CHUNK		256		//!< Bytes read by the receiver at once
+#define RX_TIMEOUT		2000	//!< Time in ms the receiver may lag behind the line
+#define ALP_MAGIC		0x015062b5	//!< Magic word of an ALP file
+#define ALP_DAY_SIZE	4096	//!< Bytes of an ALP file for each day, 4 weeks stay within the word offsets
+#define ALP_CHUNK		512		//!< Bytes the receiver requests at once
+
+//! Anonymous and file backed memory of the process in kB
+static void memKb(long& anonKb, long& fileKb)
+{
+	long size = 0, resident = 0, shared = 0;
+	FILE* pFile = fopen("/proc/self/statm", "r");
+	if (pFile)
+	{
+		if (fscanf(pFile, "%ld %ld %ld", &size, &resident, &shared) != 3)
+			resident = shared = 0;
+		fclose(pFile);
+	}
+	long pageKb = sysconf(_SC_PAGESIZE) / 1024;
+	anonKb = (resident - shared) * pageKb;
+	fileKb = shared * pageKb;
+}
+
+//! Peak resident memory of the process in kB
+static long peakKb(void)
+{
+	long kb = 0;
+	char line[128];
+	FILE* pFile = fopen("/proc/self/status", "r");
+	if (!pFile)
+		return 0;
+	while (fgets(line, sizeof(line), pFile))
+	{
+		if (sscanf(line, "VmHWM: %ld", &kb) == 1)
+			break;
+	}
+	fclose(pFile);
+	return kb;
+}
+
+//! CPU time of the calling thread in us
+static long long cpuUs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The driver state, with access to the database and serial port
+
+class CAidBench : public CUbxGpsState
+{
+public:
+	//! Write each stored message with a write of its own
+	void sendAidDataSingle(void)
+	{
+		for (int svix = 0; svix < NUM_GPS_SVS; svix ++)
+			writeBuf(&m_Db.sv[svix].eph);
+		for (int svix = 0; svix < NUM_GPS_SVS; svix ++)
+			writeBuf(&m_Db.sv[svix].aop);
+		for (int svix = 0; svix < NUM_GPS_SVS; svix ++)
+			writeBuf(&m_Db.sv[svix].alm);
+		writeBuf(&m_Db.hui);
+	}
+	//! Frame each payload with writeUbx
+	void writeEphSingle(const unsigned char* pData, int num)
+	{
+		for (int i = 0; i < num; i ++)
+			writeUbx(0x0B, 0x31, pData + i * EPH_SIZE, EPH_SIZE);
+	}
+	//! Frame all payloads with writeUbxBatch
+	void writeEphBatch(const unsigned char* pData, int num)
+	{
+		writeUbxBatch(0x0B, 0x31, pData, EPH_SIZE, num);
+	}
+	//! Keep the aiding files in a directory, persistence stores the ALP file there
+	void setFiles(const char* pDir, bool persistence)
+	{
+		free(m_pAlpTempFile);
+		free(m_pAlpDataFile);
+		free(m_pAlpDataTmpFile);
+		m_pAlpTempFile = (char*) malloc(strlen(pDir) + 12);
+		m_pAlpDataFile = (char*) malloc(strlen(pDir) + 16);
+		m_pAlpDataTmpFile = (char*) malloc(strlen(pDir) + 20);
+		sprintf(m_pAlpTempFile, "%s/aiding.ubx", pDir);
+		sprintf(m_pAlpDataFile, "%s.alp", m_pAlpTempFile);
+		sprintf(m_pAlpDataTmpFile, "%s.alp.tmp", m_pAlpTempFile);
+		m_persistence = persistence;
+	}
+	bool load(void) { return loadAiding() && (m_Db.alp.file.p != NULL); }
+	bool loadDb(void) { return loadAiding() && (m_pAidDb != NULL); }
+	//! Offset of the record of an ephemeris in the aiding database file
+	static long ephRecOffset(int svix)
+	{
+		return (long) (offsetof(AIDDB_FILE_t, eph) + svix * sizeof(AIDDB_REC_t));
+	}
+	unsigned short getAlpFileId(void) const { return m_Db.alp.fileId; }
+	//! The stored messages in the order they are sent
+	int getAidData(unsigned char* pData) const
+	{
+		int size = 0;
+		for (int svix = 0; svix < NUM_GPS_SVS; svix ++)
+			size += copyBuf(&m_Db.sv[svix].eph, pData + size);
+		for (int svix = 0; svix < NUM_GPS_SVS; svix ++)
+			size += copyBuf(&m_Db.sv[svix].aop, pData + size);
+		for (int svix = 0; svix < NUM_GPS_SVS; svix ++)
+			size += copyBuf(&m_Db.sv[svix].alm, pData + size);
+		size += copyBuf(&m_Db.hui, pData + size);
+		return size;
+	}
+private:
+	void writeBuf(const BUF_t* p)
+	{
+		if ((p->p != NULL) && (p->i > 0))
+			m_pSer->writeSerial(p->p, p->i);
+	}
+	static int copyBuf(const BUF_t* p, unsigned char* pData)
+	{
+		if ((p->p == NULL) || (p->i == 0))
+			return 0;
+		memcpy(pData, p->p, p->i);
+		return (int) p->i;
+	}
+};
+
+//! Frame a UBX message, the payload is pseudo random with the svid in front
+static int makeUbx(unsigned char* pMsg, unsigned char cls, unsigned char id, int len, int sv)
+{
+	for (int i = 0; i < len; i ++)
+		pMsg[6 + i] = (unsigned char) (sv * 13 + id + i * 5);
+	if (sv)
+	{
+		// svid is the first U4 of the per satellite messages
+		pMsg[6] = (unsigned char) sv;
+		pMsg[7] = pMsg[8] = pMsg[9] = 0;
+	}
+	return benchFrameUbx(pMsg, cls, id, len);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The receiver, reads the line at the baud rate
+
+static int s_rxFd = -1;						//!< Master side of the pseudo terminal
+static int s_baud = 115200;					//!< Baud rate of the receiver, 0 for no limit
+static volatile bool s_rxStop = false;		//!< Set to end the receiver thread
+static const unsigned char* s_pExpect;		//!< Bytes each pass has to deliver
+static volatile int s_expectSize = 0;		//!< Size of s_pExpect
+static volatile int s_rxBytes = 0;			//!< Bytes received in this pass
+static volatile int s_rxBad = 0;			//!< Bytes received in this pass that differ
+static volatile long long s_rxLastUs = 0;	//!< Time the last byte of this pass was read
+
+static void* rxThread(void* /*pArg*/)
+{
+	unsigned char buf[RX_CHUNK];
+	long long lastUs = getMonotonicUsCounter();
+	double credit = 0;
+	while (!s_rxStop)
+	{
+		struct pollfd fds = { s_rxFd, POLLIN, 0 };
+		if (poll(&fds, 1, 10) <= 0)
+		{
+			lastUs = getMonotonicUsCounter();
+			credit = 0;
+			continue;
+		}
+		int num = RX_CHUNK;
+		if (s_baud)
+		{
+			// 10 bits per byte, start, 8 data and stop bit
+			long long us = getMonotonicUsCounter();
+			credit += (double) (us - lastUs) * s_baud / 10000000.0;
+			lastUs = us;
+			if (credit > RX_CHUNK)
+				credit = RX_CHUNK;
+			if (credit < 1)
+			{
+				usleep(1000);
+				continue;
+			}
+			num = (int) credit;
+		}
+		ssize_t n = read(s_rxFd, buf, (size_t) num);
+		if (n <= 0)
+			continue;
+		credit -= (double) n;
+		for (int i = 0; i < n; i ++)
+		{
+			int pos = s_rxBytes + i;
+			if ((pos >= s_expectSize) || (buf[i] != s_pExpect[pos]))
+				s_rxBad ++;
+		}
+		s_rxLastUs = getMonotonicUsCounter();
+		__sync_fetch_and_add(&s_rxBytes, (int) n);
+	}
+	return NULL;
+}
+
+static pthread_t s_rxThread;
+
+static bool startRx(void)
+{
+	s_rxStop = false;
+	return pthread_create(&s_rxThread, NULL, rxThread, NULL) == 0;
+}
+
+static void stopRx(void)
+{
+	s_rxStop = true;
+	pthread_join(s_rxThread, NULL);
+}
+
+//! Set the bytes the next write has to deliver
+static void expect(const unsigned char* pData, int size)
+{
+	s_pExpect = pData;
+	s_rxBad = 0;
+	s_rxBytes = 0;
+	s_expectSize = size;
+	__sync_synchronize();
+}
+
+//! Wait for the receiver to read what is expected
+/*! 
+eturn the time from startUs until the last byte has been read */
+static long long await(long long startUs, int& bad, int& missing)
+{
+	// the receiver must not lag much behind the line
+	int size = s_expectSize;
+	long long endUs = getMonotonicUsCounter() + (s_baud ? 10000000LL * size / s_baud : 0) + RX_TIMEOUT * 1000LL;
+	while ((s_rxBytes < size) && (getMonotonicUsCounter() < endUs))
+		usleep(1000);
+	// anything behind arrives as bad
+	usleep(10000);
+	bad += s_rxBad;
+	if (s_rxBytes < size)
+		missing += size - s_rxBytes;
+	return s_rxLastUs - startUs;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// AssistNow Offline
+
+//! Header of an ALP file, as ALP_FILE_HEADER_t of ubxgpsstate.cpp
+typedef struct
+{
+	U4 magic;
+	U2 reserved0[32];
+	U2 size;				//!< Size of the file in units of 4 bytes
+	U2 reserved1;
+	U4 reserved2;
+	U4 p_tow;				//!< Start of the predictions, time of week
+	U2 p_wno;				//!< Start of the predictions, week number
+	U2 duration;			//!< Duration of the predictions in units of 10 minutes
+} ALP_HEADER_t;
+
+//! The ways the ALP file is kept
+typedef enum { ALP_HEAP, ALP_MMAP, ALP_LOAD, ALP_NUM } ALP_t;
+
+//! Generate an ALP file as downloaded, the header followed by pseudo random predictions
+static unsigned char* makeAlp(int weeks, int& size)
+{
+	size = weeks * 7 * ALP_DAY_SIZE;
+	unsigned char* pData = (unsigned char*) malloc((size_t) size);
+	if (!pData)
+		return NULL;
+	unsigned int seed = 1;
+	for (int i = 0; i < size; i ++)
+		pData[i] = (unsigned char) rand_r(&seed);
+	ALP_HEADER_t head;
+	memset(&head, 0, sizeof(head));
+	head.magic = ALP_MAGIC;
+	head.size = (U2) (size / 4);
+	head.p_tow = 345600;
+	head.p_wno = 1720;
+	head.duration = (U2) (weeks * 7 * 144);
+	memcpy(pData, &head, sizeof(head));
+	return pData;
+}
+
+//! Put the ALP file into a fresh driver and answer the requests of the receiver
+/*! Runs in a process of its own, so the memory is that of the driver.
+	
+eturn the exit code, 0 if all answers arrived as expected
+*/
+static int runAlp(ALP_t way, CSerialPort* pSer, const char* pDir, int weeks, int requests)
+{
+	CAidBench* pState = new CAidBench;
+	pState->setFiles(pDir, way != ALP_HEAP);
+	pState->setSerial(pSer);
+
+	// the receiver checks the answers against its own copy
+	int size;
+	unsigned char* pAlp = makeAlp(weeks, size);
+	unsigned char* pDownload = (unsigned char*) malloc((size_t) size);
+	if (!pAlp || !pDownload || !startRx())
+	{
+		fprintf(stderr, "cannot prepare the ALP file\n");
+		return 1;
+	}
+	memcpy(pDownload, pAlp, (size_t) size);
+
+	// only what the driver adds to the downloaded file counts
+	long anon0Kb, file0Kb;
+	memKb(anon0Kb, file0Kb);
+	long peak0Kb = peakKb();
+	long long startUs = getMonotonicUsCounter();
+	bool ok = (way == ALP_LOAD) ? pState->load() : pState->putAlpFile(pDownload, (unsigned int) size);
+	long long putUs = getMonotonicUsCounter() - startUs;
+	free(pDownload);
+	if (!ok)
+	{
+		printf("FAILED ALP file not %s\n", (way == ALP_LOAD) ? "loaded" : "put");
+		stopRx();
+		return 1;
+	}
+
+	unsigned int seed = 7;
+	long long procSum = 0, procMax = 0, lineSum = 0, lineMax = 0;
+	int bad = 0, missing = 0;
+	for (int i = 0; i < requests; i ++)
+	{
+		// offsets and sizes in 16 bit words, within the file
+		int ofs = 2 * (int) (rand_r(&seed) % (unsigned int) ((size - ALP_CHUNK) / 2));
+		GPS_UBX_AID_ALPSRV_SRV_t srv;
+		memset(&srv, 0, sizeof(srv));
+		srv.idSize = sizeof(srv);
+		srv.type = 0;
+		srv.ofs = (U2) (ofs / 2);
+		srv.size = ALP_CHUNK / 2;
+		srv.id1 = (U1) i;
+		srv.id3 = (U4) rand_r(&seed);
+		unsigned char req[sizeof(srv) + 8];
+		unsigned char answer[sizeof(srv) + ALP_CHUNK + 8];
+		memcpy(req + 6, &srv, sizeof(srv));
+		benchFrameUbx(req, 0x0B, 0x32, sizeof(srv));
+		srv.fileId = pState->getAlpFileId();
+		srv.dataSize = ALP_CHUNK;
+		memcpy(answer + 6, &srv, sizeof(srv));
+		memcpy(answer + 6 + sizeof(srv), pAlp + ofs, ALP_CHUNK);
+		benchFrameUbx(answer, 0x0B, 0x32, sizeof(srv) + ALP_CHUNK);
+
+		expect(answer, (int) sizeof(answer));
+		long long reqUs = getMonotonicUsCounter();
+		pState->onNewUbxMsg(GPS_STARTED, req, sizeof(req));
+		long long procUs = getMonotonicUsCounter() - reqUs;
+		long long lineUs = await(reqUs, bad, missing);
+		procSum += procUs;
+		lineSum += lineUs;
+		if (procUs > procMax) procMax = procUs;
+		if (lineUs > lineMax) lineMax = lineUs;
+	}
+	stopRx();
+
+	long anonKb, fileKb;
+	memKb(anonKb, fileKb);
+	static const char* const s_name[ALP_NUM] = { "heap", "mmap", "load" };
+	printf("%-9s %s %7.2f ms, request %6.1f us avg %6.1f us max, line %6.2f ms avg %6.2f ms max, "
+		   "anon %+5ld kB, file %+5ld kB, peak %+5ld kB\n", s_name[way], (way == ALP_LOAD) ? "load" : "put ",
+		   1e-3 * (double) putUs, (double) procSum / requests, (double) procMax,
+		   1e-3 * (double) lineSum / requests, 1e-3 * (double) lineMax,
+		   anonKb - anon0Kb, fileKb - file0Kb, peakKb() - peak0Kb);
+	if (bad || missing)
+	{
+		printf("FAILED %d bytes of the ALP answers bad, %d missing\n", bad, missing);
+		return 1;
+	}
+	pState->setSerial(NULL);
+	free(pAlp);
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The aiding database file
+
+//! Load the database into a fresh driver and compare the messages with those expected
+static bool loadDb(const char* pDir, const unsigned char* pExpect, int size, long long& loadUs)
+{
+	static unsigned char loaded[NUM_SVS * (EPH_SIZE + ALM_SIZE + AOP_SIZE + 24) + HUI_SIZE + 8];
+	CAidBench* pState = new CAidBench;
+	pState->setFiles(pDir, true);
+	long long startUs = getMonotonicUsCounter();
+	bool ok = pState->loadDb();
+	loadUs = getMonotonicUsCounter() - startUs;
+	ok = ok && (pState->getAidData(loaded) == size) && !memcmp(loaded, pExpect, (size_t) size);
+	delete pState;
+	return ok;
+}
+
+//! Store the messages in the database file, load them after a restart and after damaging it
+/*! \param pStored the messages in the order they are sent, the ephemerides first
+	\return the exit code, 0 if the expected messages were loaded each time
+*/
+static int runDb(const char* pDir, const unsigned char* pStored, int storedSize)
+{
+	char name[256];
+	snprintf(name, sizeof(name), "%s/aiding.ubx", pDir);
+	remove(name);
+
+	// the first start maps an empty database, the receiver then reports its aiding data
+	CAidBench* pState = new CAidBench;
+	pState->setFiles(pDir, true);
+	bool ok = pState->loadDb();
+	int records = 0;
+	long long startUs = getMonotonicUsCounter();
+	for (int ofs = 0; ok && (ofs + 8 <= storedSize); records ++)
+	{
+		unsigned int len = 8 + (pStored[ofs + 4] | (pStored[ofs + 5] << 8));
+		pState->onNewUbxMsg(GPS_STARTED, pStored + ofs, len);
+		ofs += (int) len;
+	}
+	long long storeUs = getMonotonicUsCounter() - startUs;
+	delete pState;
+	long long loadUs = 0;
+	ok = ok && loadDb(pDir, pStored, storedSize, loadUs);
+
+	// a bad checksum and a bad length, the other records stay valid
+	static unsigned char expect[NUM_SVS * (EPH_SIZE + ALM_SIZE + AOP_SIZE + 24) + HUI_SIZE + 8];
+	const int ephLen = EPH_SIZE + 8;
+	memcpy(expect, pStored, 4 * ephLen);
+	memcpy(expect + 4 * ephLen, pStored + 5 * ephLen, 4 * ephLen);
+	memcpy(expect + 8 * ephLen, pStored + 10 * ephLen, (size_t) (storedSize - 10 * ephLen));
+	int fd = open(name, O_RDWR);
+	unsigned char byte = 0;
+	U4 badLen = 2 * EPH_SIZE;
+	long long damagedUs = 0;
+	ok = ok && (fd >= 0) &&
+		 (pread(fd, &byte, 1, CAidBench::ephRecOffset(4) + 4 + 20) == 1) && ((byte ^= 0x01), true) &&
+		 (pwrite(fd, &byte, 1, CAidBench::ephRecOffset(4) + 4 + 20) == 1) &&
+		 (pwrite(fd, &badLen, sizeof(badLen), CAidBench::ephRecOffset(9)) == (ssize_t) sizeof(badLen)) &&
+		 loadDb(pDir, expect, storedSize - 2 * ephLen, damagedUs);
+
+	// another magic word, the file is started over
+	U4 magic = 0;
+	long long freshUs = 0;
+	ok = ok && (pwrite(fd, &magic, sizeof(magic), 0) == (ssize_t) sizeof(magic)) &&
+		 loadDb(pDir, expect, 0, freshUs);
+	if (fd >= 0)
+		close(fd);
+	remove(name);
+
+	printf("database  %d records, store %.2f ms, load %.2f ms, with 2 damaged %.2f ms\n", records,
+		   1e-3 * (double) storeUs, 1e-3 * (double) loadUs, 1e-3 * (double) damagedUs);
+	if (!ok)
+	{
+		printf("FAILED the aiding database does not load the valid records only\n");
+		return 1;
+	}
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! The ways a pass is written
+typedef enum { WAY_STORED_SINGLE, WAY_STORED_BATCH, WAY_EPH_SINGLE, WAY_EPH_BATCH, WAY_NUM } WAY_t;
+
+int main(int argc, char* argv[])
+{
+	int passes = 10;
+	int weeks = 4;
+	int requests = 100;
+	const char* pDir = "/data/local/tmp";
+	int opt;
+	while ((opt = getopt(argc, argv, "n:r:w:q:d:")) != -1)
+	{
+		if ((opt == 'n') && (atoi(optarg) > 0))
+			passes = atoi(optarg);
+		else if ((opt == 'r') && (atoi(optarg) >= 0))
+			s_baud = atoi(optarg);
+		else if ((opt == 'w') && (atoi(optarg) > 0) && (atoi(optarg) <= 4))
+			weeks = atoi(optarg);
+		else if ((opt == 'q') && (atoi(optarg) > 0))
+			requests = atoi(optarg);
+		else if (opt == 'd')
+			pDir = optarg;
+		else
+			break;
+	}
+	if ((opt != -1) || (optind != argc))
+	{
+		fprintf(stderr, "usage: %s [-n passes] [-r baud] [-w weeks] [-q requests] [-d dir]\n", argv[0]);
+		return 1;
+	}
+
+	s_rxFd = posix_openpt(O_RDWR | O_NOCTTY);
+	if ((s_rxFd < 0) || grantpt(s_rxFd) || unlockpt(s_rxFd))
+	{
+		fprintf(stderr, "cannot open a pseudo terminal: %s\n", strerror(errno));
+		return 1;
+	}
+	CSerialPort ser;
+	if (!ser.openSerial(ptsname(s_rxFd), s_baud ? s_baud : 115200, 1))
+	{
+		fprintf(stderr, "cannot open %s\n", ptsname(s_rxFd));
+		return 1;
+	}
+	CAidBench* pState = new CAidBench;
+	pState->setSerial(&ser);
+
+	// the receiver reports its aiding data
+	static unsigned char eph[NUM_SVS][EPH_SIZE + 8];
+	static unsigned char ephPayloads[NUM_SVS * EPH_SIZE];
+	static unsigned char stored[NUM_SVS * (EPH_SIZE + ALM_SIZE + AOP_SIZE + 24) + HUI_SIZE + 8];
+	for (int sv = 1; sv <= NUM_SVS; sv ++)
+	{
+		unsigned char msg[EPH_SIZE + 8];
+		int len = makeUbx(eph[sv - 1], 0x0B, 0x31, EPH_SIZE, sv);
+		pState->onNewUbxMsg(GPS_STARTED, eph[sv - 1], (unsigned int) len);
+		memcpy(ephPayloads + (sv - 1) * EPH_SIZE, eph[sv - 1] + 6, EPH_SIZE);
+		len = makeUbx(msg, 0x0B, 0x30, ALM_SIZE, sv);
+		pState->onNewUbxMsg(GPS_STARTED, msg, (unsigned int) len);
+		len = makeUbx(msg, 0x0B, 0x33, AOP_SIZE, sv);
+		pState->onNewUbxMsg(GPS_STARTED, msg, (unsigned int) len);
+	}
+	unsigned char hui[HUI_SIZE + 8];
+	pState->onNewUbxMsg(GPS_STARTED, hui, (unsigned int) makeUbx(hui, 0x0B, 0x02, HUI_SIZE, 0));
+	int storedSize = pState->getAidData(stored);
+
+	if (!startRx())
+	{
+		fprintf(stderr, "cannot start the receiver\n");
+		return 1;
+	}
+	printf("aiding    %d messages, %d bytes a pass, %d passes at %d baud\n",
+		   3 * NUM_SVS + 1, storedSize, passes, s_baud);
+
+	static const char* const s_name[WAY_NUM] = { "stored    single", "stored    batch ",
+												 "ephemeris single", "ephemeris batch " };
+	bool failed = false;
+	for (int way = 0; way < WAY_NUM; way ++)
+	{
+		bool framed = (way == WAY_EPH_SINGLE) || (way == WAY_EPH_BATCH);
+		int size = framed ? (int) sizeof(eph) : storedSize;
+		long long cpuSum = 0, lineSum = 0, lineMax = 0;
+		int bad = 0, missing = 0;
+		for (int i = 0; i < passes; i ++)
+		{
+			expect(framed ? &eph[0][0] : stored, size);
+			long long startUs = getMonotonicUsCounter();
+			long long startCpu = cpuUs();
+			if (way == WAY_STORED_SINGLE)
+				pState->sendAidDataSingle();
+			else if (way == WAY_STORED_BATCH)
+				pState->sendAidData(true, true, true, true);
+			else if (way == WAY_EPH_SINGLE)
+				pState->writeEphSingle(ephPayloads, NUM_SVS);
+			else
+				pState->writeEphBatch(ephPayloads, NUM_SVS);
+			cpuSum += cpuUs() - startCpu;
+			long long lineUs = await(startUs, bad, missing);
+			lineSum += lineUs;
+			if (lineUs > lineMax)
+				lineMax = lineUs;
+		}
+		printf("%s %6.1f us cpu, %7.2f ms line avg, %7.2f ms max, %d bytes bad, %d missing\n",
+			   s_name[way], (double) cpuSum / passes, 1e-3 * (double) lineSum / passes,
+			   1e-3 * (double) lineMax, bad, missing);
+		if (bad || missing)
+		{
+			printf("FAILED %s does not arrive as framed\n", s_name[way]);
+			failed = true;
+		}
+	}
+
+	stopRx();
+	pState->setSerial(NULL);
+	delete pState;
+
+	if (runDb(pDir, stored, storedSize))
+		failed = true;
+
+	// each way in a process of its own, load maps the file stored by mmap
+	printf("alp       %d weeks, %d bytes, %d requests of %d bytes\n", weeks, weeks * 7 * ALP_DAY_SIZE, requests, ALP_CHUNK);
+	fflush(stdout);
+	for (int way = 0; way < ALP_NUM; way ++)
+	{
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			int code = runAlp((ALP_t) way, &ser, pDir, weeks, requests);
+			fflush(stdout);
+			_exit(code);
+		}
+		int status = 0;
+		if ((pid < 0) || (waitpid(pid, &status, 0) != pid) || !WIFEXITED(status) || WEXITSTATUS(status))
+		{
+			if (pid < 0 || !WIFEXITED(status))
+				printf("FAILED ALP process did not complete\n");
+			failed = true;
+		}
+	}
+	char name[256];
+	const char* const s_ext[] = { "", ".alp", ".alp.tmp" };
+	for (unsigned int i = 0; i < sizeof(s_ext) / sizeof(*s_ext); i ++)
+	{
+		snprintf(name, sizeof(name), "%s/aiding.ubx%s", pDir, s_ext[i]);
+		remove(name);
+	}
+
+	ser.closeSerial();
+	close(s_rxFd);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,543 @@
+/*******************************************************************************
+ *
+ * Copyright (C) u-blox AG
+ * u-blox AG, Thalwil, Switzerland
+ *
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose without fee is hereby granted, provided that this entire notice
+ * is included in all copies of any software which is or includes a copy
+ * or modification of this software and in all copies of the supporting
+ * documentation for such software.
+ *
+ * THIS SOFTWARE IS BEING PROVIDED "AS IS", WITHOUT ANY EXPRESS OR IMPLIED
+ * WARRANTY. IN PARTICULAR, NEITHER THE AUTHOR NOR U-BLOX MAKES ANY
+ * REPRESENTATION OR WARRANTY OF ANY KIND CONCERNING THE MERCHANTABILITY
+ * OF THIS SOFTWARE OR ITS FITNESS FOR ANY PARTICULAR PURPOSE.
+ *
+ *******************************************************************************
+ *
+ * Project: PE_ANS
+ *
+ ******************************************************************************/
+/*!
+  \file
+  \brief  Check and benchmark of the ASN.1 decode arenas
+
+  Decodes SUPL and RRLP messages the way uplDecode and rrlpDecode do,
+  encodes them again and compares the bytes with the original. Each message
+  is decoded while up to 8 earlier ones are still held, so the arenas run
+  out and the decoder falls back to the heap, and the held messages are
+  freed in an order different from the decoding. Then decoding and freeing
+  is timed with and without the arenas, and encoding into a buffer. Before
+  that the PER bit reader and writer of per_support.c are checked against a
+  bit at a time reference on random fields of all widths and alignments.
+  The generated messages are a SUPL
+  END and a SUPL POS carrying an RRLP assistance data PDU with reference
+  time and location, ephemeris of 16 and almanac of 32 satellites,
+  ionospheric and UTC model, the RRLP PDU is checked on its own as well.
+  Run it under AddressSanitizer to catch arena memory used after release.
+
+  usage: ubx_asnBench [-n iterations] [-u ulp-file] [-r rrlp-file] ...
+    -n  decodes of each message timed, default 10000
+    -u  file holding a ULP message as received from the SLP
+    -r  file holding an RRLP PDU as in the payload of a SUPL POS
+*/
+/*******************************************************************************
+ * $Id: ubx_asnBench.cpp $
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "ULP-PDU.h"
+#include "PDU.h"
+#include "per_support.h"
+#include "per_encoder.h"
+#include "per_decoder.h"
+#include "asnarena.h"
+#include "std_types.h"
+#include "ubx_timer.h"
+#include "ubx_benchUtil.h"
+
+#define MSG_MAX		16		//!< Messages checked and timed
+#define HOLD_MAX	8		//!< Most messages held while decoding another, twice the arenas
+#define BITS_RUNS	20000	//!< Runs of the PER bit check
+#define BITS_FIELDS	64		//!< Fields written and read in a run
+#define BITS_MANY	40		//!< Largest field in bytes written with per_put_many_bits
+
+//! An encoded message
+typedef struct
+{
+	const char* pName;				//!< name printed
+	asn_TYPE_descriptor_t* pType;	//!< asn_DEF_ULP_PDU or asn_DEF_PDU
+	void* pData;					//!< UPER encoding
+	int size;						//!< bytes in pData
+} MSG_t;
+
+//! Pseudo random number from lo to hi
+static long long rnd(long long lo, long long hi)
+{
+	return lo + (long long) (benchRandom32() % (unsigned long long) (hi - lo + 1));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Messages
+
+//! Encode a message and free its structure
+static bool encode(asn_TYPE_descriptor_t* pType, void* pStruct, const char* pName, MSG_t& msg)
+{
+	msg.pName = pName;
+	msg.pType = pType;
+	msg.pData = NULL;
+	msg.size = (int) uper_encode_to_new_buffer(pType, NULL, pStruct, &msg.pData);
+	ASN_STRUCT_FREE(*pType, pStruct);
+	if (msg.size <= 0)
+	{
+		fprintf(stderr, "cannot encode %s\n", pName);
+		return false;
+	}
+	return true;
+}
+
+//! Encode a ULP message, with the length in front as sendAndFree writes it
+static bool encodeUlp(ULP_PDU_t* pUlp, const char* pName, MSG_t& msg)
+{
+	void* pData = NULL;
+	ssize_t size = uper_encode_to_new_buffer(&asn_DEF_ULP_PDU, NULL, pUlp, &pData);
+	free(pData);
+	if (size <= 0)
+	{
+		ASN_STRUCT_FREE(asn_DEF_ULP_PDU, pUlp);
+		fprintf(stderr, "cannot encode %s\n", pName);
+		return false;
+	}
+	pUlp->length = (long) size;
+	return encode(&asn_DEF_ULP_PDU, pUlp, pName, msg);
+}
+
+//! Version and session of a message from the SLP to the SET
+static ULP_PDU_t* allocUlp(UlpMessage_PR present)
+{
+	ULP_PDU_t* pUlp = (ULP_PDU_t*) calloc(1, sizeof(ULP_PDU_t));
+	SetSessionID_t* pSetId = (SetSessionID_t*) calloc(1, sizeof(SetSessionID_t));
+	SlpSessionID_t* pSlpId = (SlpSessionID_t*) calloc(1, sizeof(SlpSessionID_t));
+	pUlp->version.maj = 1;
+	pSetId->sessionId = (long) rnd(0, 65535);
+	pSetId->setId.present = SETId_PR_msisdn;
+	OCTET_STRING_fromBuf(&pSetId->setId.choice.msisdn, "\x91\x44\x77\x00\x00\x10\x32\xF4", 8);
+	pUlp->sessionID.setSessionID = pSetId;
+	OCTET_STRING_fromBuf(&pSlpId->sessionID, "\x00\x01\x02\x03", 4);
+	pSlpId->slpId.present = SLPAddress_PR_iPAddress;
+	pSlpId->slpId.choice.iPAddress.present = IPAddress_PR_ipv4Address;
+	OCTET_STRING_fromBuf(&pSlpId->slpId.choice.iPAddress.choice.ipv4Address, "\xC0\xA8\x01\x01", 4);
+	pUlp->sessionID.slpSessionID = pSlpId;
+	pUlp->message.present = present;
+	return pUlp;
+}
+
+static void fillEphemeris(UncompressedEphemeris_t& e)
+{
+	e.ephemCodeOnL2 = (long) rnd(0, 3);
+	e.ephemURA = (long) rnd(0, 15);
+	e.ephemSVhealth = (long) rnd(0, 63);
+	e.ephemIODC = (long) rnd(0, 1023);
+	e.ephemL2Pflag = (long) rnd(0, 1);
+	e.ephemSF1Rsvd.reserved1 = (long) rnd(0, 8388607);
+	e.ephemSF1Rsvd.reserved2 = (long) rnd(0, 16777215);
+	e.ephemSF1Rsvd.reserved3 = (long) rnd(0, 16777215);
+	e.ephemSF1Rsvd.reserved4 = (long) rnd(0, 65535);
+	e.ephemTgd = (long) rnd(-128, 127);
+	e.ephemToc = (long) rnd(0, 37799);
+	e.ephemAF2 = (long) rnd(-128, 127);
+	e.ephemAF1 = (long) rnd(-32768, 32767);
+	e.ephemAF0 = (long) rnd(-2097152, 2097151);
+	e.ephemCrs = (long) rnd(-32768, 32767);
+	e.ephemDeltaN = (long) rnd(-32768, 32767);
+	e.ephemM0 = (long) rnd(-2147483647LL - 1, 2147483647LL);
+	e.ephemCuc = (long) rnd(-32768, 32767);
+	e.ephemE = (unsigned long) rnd(0, 4294967295LL);
+	e.ephemCus = (long) rnd(-32768, 32767);
+	e.ephemAPowerHalf = (unsigned long) rnd(0, 4294967295LL);
+	e.ephemToe = (long) rnd(0, 37799);
+	e.ephemFitFlag = (long) rnd(0, 1);
+	e.ephemAODA = (long) rnd(0, 31);
+	e.ephemCic = (long) rnd(-32768, 32767);
+	e.ephemOmegaA0 = (long) rnd(-2147483647LL - 1, 2147483647LL);
+	e.ephemCis = (long) rnd(-32768, 32767);
+	e.ephemI0 = (long) rnd(-2147483647LL - 1, 2147483647LL);
+	e.ephemCrc = (long) rnd(-32768, 32767);
+	e.ephemW = (long) rnd(-2147483647LL - 1, 2147483647LL);
+	e.ephemOmegaADot = (long) rnd(-8388608, 8388607);
+	e.ephemIDot = (long) rnd(-8192, 8191);
+}
+
+static AlmanacElement_t* allocAlmanac(long sv)
+{
+	AlmanacElement_t* pAlm = (AlmanacElement_t*) calloc(1, sizeof(AlmanacElement_t));
+	pAlm->satelliteID = sv;
+	pAlm->almanacE = (long) rnd(0, 65535);
+	pAlm->alamanacToa = (long) rnd(0, 255);
+	pAlm->almanacKsii = (long) rnd(-32768, 32767);
+	pAlm->almanacOmegaDot = (long) rnd(-32768, 32767);
+	pAlm->almanacSVhealth = (long) rnd(0, 255);
+	pAlm->almanacAPowerHalf = (long) rnd(0, 16777215);
+	pAlm->almanacOmega0 = (long) rnd(-8388608, 8388607);
+	pAlm->almanacW = (long) rnd(-8388608, 8388607);
+	pAlm->almanacM0 = (long) rnd(-8388608, 8388607);
+	pAlm->almanacAF0 = (long) rnd(-1024, 1023);
+	pAlm->almanacAF1 = (long) rnd(-1024, 1023);
+	return pAlm;
+}
+
+//! RRLP assistance data as the SLP sends it for a cold start
+static PDU_t* allocRrlpAssistance(void)
+{
+	PDU_t* pPdu = (PDU_t*) calloc(1, sizeof(PDU_t));
+	pPdu->referenceNumber = (long) rnd(0, 7);
+	pPdu->component.present = RRLP_Component_PR_assistanceData;
+	GPS_AssistData_t* pGps = (GPS_AssistData_t*) calloc(1, sizeof(GPS_AssistData_t));
+	pPdu->component.choice.assistanceData.gps_AssistData = pGps;
+	ControlHeader_t& hdr = pGps->controlHeader;
+
+	hdr.referenceTime = (ReferenceTime_t*) calloc(1, sizeof(ReferenceTime_t));
+	hdr.referenceTime->gpsTime.gpsTOW23b = (long) rnd(0, 7559999);
+	hdr.referenceTime->gpsTime.gpsWeek = (long) rnd(0, 1023);
+
+	// ellipsoid point with altitude and uncertainty ellipsoid
+	hdr.refLocation = (RefLocation_t*) calloc(1, sizeof(RefLocation_t));
+	OCTET_STRING_fromBuf(&hdr.refLocation->threeDLocation,
+						 "\x90\x20\x00\x00\x05\x55\x55\x00\x1E\x11\x22\x00\x00\x3C", 14);
+
+	hdr.navigationModel = (NavigationModel_t*) calloc(1, sizeof(NavigationModel_t));
+	for (int sv = 0; sv < 16; sv ++)
+	{
+		NavModelElement_t* pNav = (NavModelElement_t*) calloc(1, sizeof(NavModelElement_t));
+		pNav->satelliteID = 2 * sv;
+		pNav->satStatus.present = SatStatus_PR_newSatelliteAndModelUC;
+		fillEphemeris(pNav->satStatus.choice.newSatelliteAndModelUC);
+		ASN_SEQUENCE_ADD(&hdr.navigationModel->navModelList.list, pNav);
+	}
+
+	hdr.ionosphericModel = (IonosphericModel_t*) calloc(1, sizeof(IonosphericModel_t));
+	long* pIono = &hdr.ionosphericModel->alfa0;
+	for (int i = 0; i < 8; i ++)
+		pIono[i] = (long) rnd(-128, 127);
+
+	hdr.utcModel = (UTCModel_t*) calloc(1, sizeof(UTCModel_t));
+	hdr.utcModel->utcA1 = (long) rnd(-8388608, 8388607);
+	hdr.utcModel->utcA0 = (long) rnd(-2147483647LL - 1, 2147483647LL);
+	hdr.utcModel->utcTot = (long) rnd(0, 255);
+	hdr.utcModel->utcWNt = (long) rnd(0, 255);
+	hdr.utcModel->utcDeltaTls = (long) rnd(-128, 127);
+	hdr.utcModel->utcWNlsf = (long) rnd(0, 255);
+	hdr.utcModel->utcDN = (long) rnd(-128, 127);
+	hdr.utcModel->utcDeltaTlsf = (long) rnd(-128, 127);
+
+	hdr.almanac = (Almanac_t*) calloc(1, sizeof(Almanac_t));
+	hdr.almanac->alamanacWNa = (long) rnd(0, 255);
+	for (int sv = 0; sv < 32; sv ++)
+		ASN_SEQUENCE_ADD(&hdr.almanac->almanacList.list, allocAlmanac(sv));
+	return pPdu;
+}
+
+//! Generate the messages
+static bool generate(MSG_t* pMsg, int& num)
+{
+	ULP_PDU_t* pEnd = allocUlp(UlpMessage_PR_msSUPLEND);
+	pEnd->message.choice.msSUPLEND.statusCode = (StatusCode_t*) calloc(1, sizeof(StatusCode_t));
+	*pEnd->message.choice.msSUPLEND.statusCode = StatusCode_unspecified;
+	if (!encodeUlp(pEnd, "SUPL END", pMsg[num ++]))
+		return false;
+
+	MSG_t& rrlp = pMsg[num ++];
+	if (!encode(&asn_DEF_PDU, allocRrlpAssistance(), "RRLP assistance", rrlp))
+		return false;
+
+	ULP_PDU_t* pPos = allocUlp(UlpMessage_PR_msSUPLPOS);
+	PosPayLoad_t& payload = pPos->message.choice.msSUPLPOS.posPayLoad;
+	payload.present = PosPayLoad_PR_rrlpPayload;
+	OCTET_STRING_fromBuf(&payload.choice.rrlpPayload, (const char*) rrlp.pData, rrlp.size);
+	return encodeUlp(pPos, "SUPL POS", pMsg[num ++]);
+}
+
+//! Read a message from a file
+static bool load(const char* pName, asn_TYPE_descriptor_t* pType, MSG_t& msg)
+{
+	FILE* pFile = fopen(pName, "rb");
+	if (!pFile)
+	{
+		fprintf(stderr, "cannot open '%s'\n", pName);
+		return false;
+	}
+	fseek(pFile, 0, SEEK_END);
+	long size = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+	msg.pName = pName;
+	msg.pType = pType;
+	msg.pData = malloc((size > 0) ? (size_t) size : 1);
+	msg.size = (int) size;
+	bool ok = (size > 0) && msg.pData && (fread(msg.pData, 1, (size_t) size, pFile) == (size_t) size);
+	fclose(pFile);
+	if (!ok)
+		fprintf(stderr, "cannot read '%s'\n", pName);
+	return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Check and timing
+
+//! Stream written by the PER encoder
+typedef struct
+{
+	unsigned char data[BITS_FIELDS * BITS_MANY + 64];
+	size_t size;
+} STREAM_t;
+
+static int streamOut(const void* pData, size_t size, void* pKey)
+{
+	STREAM_t* pStream = (STREAM_t*) pKey;
+	if (pStream->size + size > sizeof(pStream->data))
+		return -1;
+	memcpy(pStream->data + pStream->size, pData, size);
+	pStream->size += size;
+	return 0;
+}
+
+//! Reference writer, one bit at a time
+static void putRef(unsigned char* pRef, size_t& bit, const unsigned char* pSrc, int bits)
+{
+	for (int i = 0; i < bits; i ++, bit ++)
+	{
+		if (pSrc[i >> 3] & (0x80 >> (i & 7)))
+			pRef[bit >> 3] |= (unsigned char) (0x80 >> (bit & 7));
+	}
+}
+
+//! Random fields through per_put_few_bits and per_put_many_bits and back, bit exact
+static bool checkBits(void)
+{
+	static STREAM_t s_stream;
+	static unsigned char s_ref[sizeof(s_stream.data)];
+	static unsigned char s_field[BITS_FIELDS][BITS_MANY];
+	int width[BITS_FIELDS];
+	for (int run = 0; run < BITS_RUNS; run ++)
+	{
+		asn_per_outp_t po;
+		memset(&po, 0, sizeof(po));
+		po.buffer = po.tmpspace;
+		po.nbits = 8 * sizeof(po.tmpspace);
+		po.outper = streamOut;
+		po.op_key = &s_stream;
+		s_stream.size = 0;
+		memset(s_ref, 0, sizeof(s_ref));
+		size_t refBits = 0;
+		for (int i = 0; i < BITS_FIELDS; i ++)
+		{
+			// a negative width is written with per_put_many_bits
+			width[i] = (benchRandom32() & 1) ? (int) rnd(1, 31) : -(int) rnd(1, 8 * BITS_MANY);
+			int bits = abs(width[i]);
+			for (int j = 0; j < BITS_MANY; j ++)
+				s_field[i][j] = (unsigned char) benchRandom32();
+			if (bits & 7)
+				s_field[i][bits >> 3] &= (unsigned char) (0xFF00 >> (bits & 7));
+			memset(s_field[i] + (bits + 7) / 8, 0, BITS_MANY - (bits + 7) / 8);
+			int res;
+			if (width[i] > 0)
+			{
+				// the value right aligned, as the encoders pass it
+				uint32_t value = 0;
+				for (int j = 0; j < bits; j ++)
+					value = (value << 1) | ((s_field[i][j >> 3] >> (7 - (j & 7))) & 1);
+				res = per_put_few_bits(&po, value, bits);
+			}
+			else
+				res = per_put_many_bits(&po, s_field[i], bits);
+			if (res)
+			{
+				printf("FAILED, writing %d bits\n", bits);
+				return false;
+			}
+			putRef(s_ref, refBits, s_field[i], bits);
+		}
+		// as _uper_encode_flush_outp does
+		unsigned char* pLast = po.buffer + (po.nboff >> 3);
+		if (po.nboff & 7)
+		{
+			pLast[0] &= (unsigned char) (0xFF << (8 - (po.nboff & 7)));
+			pLast ++;
+		}
+		streamOut(po.tmpspace, (size_t) (pLast - po.tmpspace), &s_stream);
+		if ((s_stream.size != (refBits + 7) / 8) || memcmp(s_stream.data, s_ref, s_stream.size))
+		{
+			printf("FAILED, %zu bytes written differ from the reference in run %d\n", s_stream.size, run);
+			return false;
+		}
+
+		asn_per_data_t pd;
+		memset(&pd, 0, sizeof(pd));
+		pd.buffer = s_stream.data;
+		pd.nbits = 8 * s_stream.size;
+		for (int i = 0; i < BITS_FIELDS; i ++)
+		{
+			int bits = abs(width[i]);
+			unsigned char field[BITS_MANY];
+			memset(field, 0, sizeof(field));
+			bool ok;
+			if (width[i] > 0)
+			{
+				int32_t value = per_get_few_bits(&pd, bits);
+				for (int j = 0; j < bits; j ++)
+				{
+					if (value & (1 << (bits - 1 - j)))
+						field[j >> 3] |= (unsigned char) (0x80 >> (j & 7));
+				}
+				ok = (value >= 0);
+			}
+			else
+				ok = !per_get_many_bits(&pd, field, 0, bits);
+			if (!ok || memcmp(field, s_field[i], BITS_MANY))
+			{
+				printf("FAILED, field %d of %d bits read back differs in run %d\n", i, bits, run);
+				return false;
+			}
+		}
+		if (per_get_few_bits(&pd, 8) != -1)
+		{
+			printf("FAILED, read beyond the end in run %d\n", run);
+			return false;
+		}
+	}
+	return true;
+}
+
+//! Decode as uplDecode and rrlpDecode do
+static void* decode(const MSG_t& msg, bool bArena)
+{
+	void* pStruct = NULL;
+	if (bArena)
+		asnArenaBegin();
+	asn_dec_rval_t rval = uper_decode_complete(0, msg.pType, &pStruct, msg.pData, (size_t) msg.size);
+	if (bArena)
+		asnArenaEnd();
+	if (rval.code != RC_OK)
+	{
+		ASN_STRUCT_FREE(*msg.pType, pStruct);
+		return NULL;
+	}
+	return pStruct;
+}
+
+//! Decode while holding earlier messages, the encoding has to give the same bytes
+static bool check(const MSG_t& msg)
+{
+	for (int held = 0; held <= HOLD_MAX; held ++)
+	{
+		void* pHeld[HOLD_MAX];
+		for (int i = 0; i < held; i ++)
+			pHeld[i] = decode(msg, true);
+		void* pStruct = decode(msg, true);
+		void* pData = NULL;
+		ssize_t size = pStruct ? uper_encode_to_new_buffer(msg.pType, NULL, pStruct, &pData) : -1;
+		bool ok = (size == msg.size) && !memcmp(pData, msg.pData, (size_t) msg.size);
+		free(pData);
+		ASN_STRUCT_FREE(*msg.pType, pStruct);
+		// the even ones first, then the odd ones from the last
+		for (int i = 0; i < held; i += 2)
+		{
+			ok = ok && pHeld[i];
+			ASN_STRUCT_FREE(*msg.pType, pHeld[i]);
+		}
+		for (int i = held - 1; i > 0; i --)
+		{
+			if (i & 1)
+			{
+				ok = ok && pHeld[i];
+				ASN_STRUCT_FREE(*msg.pType, pHeld[i]);
+			}
+		}
+		if (!ok)
+		{
+			printf("FAILED, %s differs after decoding with %d messages held\n", msg.pName, held);
+			return false;
+		}
+	}
+	return true;
+}
+
+//! Time decoding and freeing a message
+static double timeDecode(const MSG_t& msg, bool bArena, int num)
+{
+	long long startUs = getMonotonicUsCounter();
+	for (int i = 0; i < num; i ++)
+		ASN_STRUCT_FREE(*msg.pType, decode(msg, bArena));
+	return (double) (getMonotonicUsCounter() - startUs) / num;
+}
+
+//! Time encoding a message into a buffer
+static double timeEncode(const MSG_t& msg, int num)
+{
+	static char s_buf[16384];
+	void* pStruct = decode(msg, false);
+	if (!pStruct)
+		return 0.0;
+	long long startUs = getMonotonicUsCounter();
+	for (int i = 0; i < num; i ++)
+		uper_encode_to_buffer(msg.pType, pStruct, s_buf, sizeof(s_buf));
+	double us = (double) (getMonotonicUsCounter() - startUs) / num;
+	ASN_STRUCT_FREE(*msg.pType, pStruct);
+	return us;
+}
+
+int main(int argc, char* argv[])
+{
+	MSG_t msg[MSG_MAX];
+	int numMsg = 0;
+	int num = 10000;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:u:r:")) != -1)
+	{
+		if (opt == 'n')
+			num = atoi(optarg);
+		else if (((opt == 'u') || (opt == 'r')) && (numMsg < MSG_MAX - 3))
+		{
+			if (!load(optarg, (opt == 'u') ? &asn_DEF_ULP_PDU : &asn_DEF_PDU, msg[numMsg ++]))
+				return 1;
+		}
+		else
+			break;
+	}
+	if ((opt != -1) || (optind < argc) || (num <= 0))
+	{
+		fprintf(stderr, "usage: %s [-n iterations] [-u ulp-file] [-r rrlp-file] ...\n", argv[0]);
+		return 1;
+	}
+	if (!checkBits())
+		return 1;
+	printf("identical %d runs of %d PER fields\n", BITS_RUNS, BITS_FIELDS);
+	if (!generate(msg, numMsg))
+		return 1;
+
+	for (int i = 0; i < numMsg; i ++)
+	{
+		if (!check(msg[i]))
+			return 1;
+	}
+	printf("identical %d messages, decoded holding up to %d others\n", numMsg, HOLD_MAX);
+
+	for (int i = 0; i < numMsg; i ++)
+	{
+		double heapUs = timeDecode(msg[i], false, num);
+		double arenaUs = timeDecode(msg[i], true, num);
+		double encodeUs = timeEncode(msg[i], num);
+		printf("%-16s %5d bytes, decode and free %.2f us heap, %.2f us arena, encode %.2f us, decode %.1f MB/s\n",
+				msg[i].pName, msg[i].size, heapUs, arenaUs, encodeUs,
+				(arenaUs > 0.0) ? msg[i].size / arenaUs : 0.0);
+		free(msg[i].pData);
+	}
+	return 0;
+}
@@ -0,0 +1,82 @@
+/*******************************************************************************
+ *
+ * Copyright (C) u-blox AG
+ * u-blox AG, Thalwil, Switzerland
+ *
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose without fee is hereby granted, provided that this entire notice
+ * is included in all copies of any software which is or includes a copy
+ * or modification of this software and in all copies of the supporting
+ * documentation for such software.
+ *
+ * THIS SOFTWARE IS BEING PROVIDED "AS IS", WITHOUT ANY EXPRESS OR IMPLIED
+ * WARRANTY. IN PARTICULAR, NEITHER THE AUTHOR NOR U-BLOX MAKES ANY
+ * REPRESENTATION OR WARRANTY OF ANY KIND CONCERNING THE MERCHANTABILITY
+ * OF THIS SOFTWARE OR ITS FITNESS FOR ANY PARTICULAR PURPOSE.
+ *
+ *******************************************************************************
+ *
+ * Project: PE_ANS
+ *
+ ******************************************************************************/
+/*!
+  \file
+  \brief  Helpers shared by the host tools
+
+  Also replaces ubx_moduleIf.cpp, the tools set the callbacks they need in
+  CGpsIf::getInstance()->m_callbacks.
+*/
+/*******************************************************************************
+ * $Id: ubx_benchUtil.cpp $
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "std_types.h"
+#include "ubx_moduleIf.h"
+#include "ubx_benchUtil.h"
+
+static CGpsIf s_gpsIf;
+
+CGpsIf::CGpsIf()
+{
+	// MS based, the SUPL sessions of ubx_suplBench ask for assistance
+	m_ready = true;
+	m_mode = GPS_POSITION_MODE_MS_BASED;
+	m_lastStatusValue = GPS_STATUS_NONE;
+	m_capabilities = GPS_CAPABILITY_MSB;
+	memset(&m_callbacks, 0, sizeof(m_callbacks));
+}
+
+CGpsIf* CGpsIf::getInstance()
+{
+	return &s_gpsIf;
+}
+
+unsigned int benchRandom32(void)
+{
+	static unsigned long long s_seed = 12345;
+	s_seed = s_seed * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (unsigned int) (s_seed >> 32);
+}
+
+int benchFrameUbx(unsigned char* pMsg, unsigned char cls, unsigned char id, int len)
+{
+	pMsg[0] = 0xB5;
+	pMsg[1] = 0x62;
+	pMsg[2] = cls;
+	pMsg[3] = id;
+	pMsg[4] = (unsigned char) len;
+	pMsg[5] = (unsigned char) (len >> 8);
+	unsigned char ckA = 0, ckB = 0;
+	for (int i = 2; i < len + 6; i ++)
+	{
+		ckA += pMsg[i];
+		ckB += ckA;
+	}
+	pMsg[len + 6] = ckA;
+	pMsg[len + 7] = ckB;
+	return len + 8;
+}
@@ -0,0 +1,51 @@
+/*******************************************************************************
+ *
+ * Copyright (C) u-blox AG
+ * u-blox AG, Thalwil, Switzerland
+ *
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose without fee is hereby granted, provided that this entire notice
+ * is included in all copies of any software which is or includes a copy
+ * or modification of this software and in all copies of the supporting
+ * documentation for such software.
+ *
+ * THIS SOFTWARE IS BEING PROVIDED "AS IS", WITHOUT ANY EXPRESS OR IMPLIED
+ * WARRANTY. IN PARTICULAR, NEITHER THE AUTHOR NOR U-BLOX MAKES ANY
+ * REPRESENTATION OR WARRANTY OF ANY KIND CONCERNING THE MERCHANTABILITY
+ * OF THIS SOFTWARE OR ITS FITNESS FOR ANY PARTICULAR PURPOSE.
+ *
+ *******************************************************************************
+ *
+ * Project: PE_ANS
+ *
+ ******************************************************************************/
+/*!
+  \file
+  \brief  Helpers shared by the host tools
+
+  The stand-in for the Android framework interface and the generators of
+  test data used by ubx_replay, the benchmarks and ubx_agpsServer. Time is
+  taken with getMonotonicUsCounter of ubx_timer.
+*/
+/*******************************************************************************
+ * $Id: ubx_benchUtil.h $
+ ******************************************************************************/
+#ifndef __UBX_BENCHUTIL_H__
+#define __UBX_BENCHUTIL_H__
+
+//! Pseudo random numbers, the same sequence on every run
+unsigned int benchRandom32(void);
+
+//! Frame a UBX message
+/*! Sets the header and the checksum around a payload already in place
+  \param pMsg	: message, the payload of len bytes starts at pMsg + 6
+  \param cls	: class of the message
+  \param id		: id of the message
+  \param len	: size of the payload
+  \return the size of the message
+*/
+int benchFrameUbx(unsigned char* pMsg, unsigned char cls, unsigned char id, int len);
+
+#endif /* __UBX_BENCHUTIL_H__ */
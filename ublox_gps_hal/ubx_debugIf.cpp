@@ -31,6 +31,8 @@
  ******************************************************************************/
 
 #include "ubx_debugIf.h"
+#include "ubx_rxStats.h"
+#include "ubxgpsstate.h"
 
 #if defined CDEBUGIF_EN
 
@@ -41,11 +43,19 @@ const GpsDebugInterface CDebugIf::s_interface = {
     get_internal_state:     getInternalState,
 };
 
+//! Report the statistics of the receive path
+/*! The format is text unless DEBUG_STATE_BINARY is set in u-blox.conf, 
+	then it is a RXSTATS_t as defined in ubx_rxStats.h.
+  \param buffer     : buffer to fill
+  \param bufferSize : size of the buffer
+  \return number of bytes filled in
+*/
 size_t CDebugIf::getInternalState(char* buffer, size_t bufferSize)
 {
-    ((void) (buffer));
     LOGV("CDebugIf::%s : size=%zd", __FUNCTION__, bufferSize);
-    return 0;
+    if (CUbxGpsState::getInstance()->getDebugStateBinary())
+        return CRxStats::getBinary(buffer, bufferSize);
+    return CRxStats::getText(buffer, bufferSize);
 }
 
 #endif
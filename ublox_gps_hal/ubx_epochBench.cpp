@@ -0,0 +1,422 @@
+/*******************************************************************************
+ *
+ * Copyright (C) u-blox AG
+ * u-blox AG, Thalwil, Switzerland
+ *
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose without fee is hereby granted, provided that this entire notice
+ * is included in all copies of any software which is or includes a copy
+ * or modification of this software and in all copies of the supporting
+ * documentation for such software.
+ *
+ * THIS SOFTWARE IS BEING PROVIDED "AS IS", WITHOUT ANY EXPRESS OR IMPLIED
+ * WARRANTY. IN PARTICULAR, NEITHER THE AUTHOR NOR U-BLOX MAKES ANY
+ * REPRESENTATION OR WARRANTY OF ANY KIND CONCERNING THE MERCHANTABILITY
+ * OF THIS SOFTWARE OR ITS FITNESS FOR ANY PARTICULAR PURPOSE.
+ *
+ *******************************************************************************
+ *
+ * Project: PE_ANS
+ *
+ ******************************************************************************/
+/*!
+  \file
+  \brief  Latency of the epoch end detection
+
+  Feeds generated 1 Hz epochs of the default NMEA output of a receiver,
+  RMC, VTG, GGA, GSA, 3 GPS and 2 GLONASS GSV and GLL, through the parser,
+  protocols and database the GPS thread uses, as ubx_replay does with a
+  capture. The
+  bytes arrive on a simulated serial line and are read in chunks, the last
+  read of an epoch ends with its last byte. For each way of detecting the
+  end of an epoch the latency from the last byte of an epoch to its
+  location_cb is measured, on the serial line clock and as processing time
+  from the start of the read that completed the epoch:
+    repeat   no end marker, the next RMC commits the epoch
+    marker   EPOCH_END_MSG set to GLL
+    eoe      UBX-NAV-EOE after GLL
+  Every epoch must report the satellites of both talkers in sv_status_cb.
+
+  Location batching is run with the marker as well:
+    size     batches of 16 fixes, a read that completes a batch flushes it,
+             the rest is flushed when the engine is stopped
+    interval all fixes held until the flush interval of 100 ms has passed,
+             then flushed the way the GPS thread does at the deadline
+  The fixes have to arrive in order, no fix may be delivered early and
+  no satellite status reported while batching.
+
+  usage: ubx_epochBench [-n epochs] [-b baudrate] [-c read-size]
+    -n  epochs of each scenario, default 1000
+    -b  baudrate of the serial line, default 9600
+    -c  most bytes returned by a read, default 64
+*/
+/*******************************************************************************
+ * $Id: ubx_epochBench.cpp $
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "std_types.h"
+#include "ubx_moduleIf.h"
+#include "ubx_localDb.h"
+#include "gps_thread.h"
+#include "parserbuffer.h"
+#include "protocolubx.h"
+#include "protocolnmea.h"
+#include "protocolunknown.h"
+#include "ubx_timer.h"
+#include "ubx_benchUtil.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// The framework callbacks
+
+static long long s_readLineUs = 0;		//!< serial line time of the read being parsed
+static long long s_readStartUs = 0;		//!< time parsing of the read started
+static long long* s_pEpochEndUs = NULL;	//!< serial line time of the last byte of each epoch
+static int s_epochs = 0;				//!< epochs in s_pEpochEndUs
+static int s_locations = 0;				//!< location_cb calls
+static long long s_lineSumUs = 0;		//!< latency on the serial line clock
+static long long s_lineMaxUs = 0;
+static long long s_procSumUs = 0;		//!< processing time from the start of the read to the callback
+static long long s_procMaxUs = 0;
+static GpsUtcTime s_lastTimestamp = 0;	//!< time of the last fix
+static int s_unordered = 0;				//!< fixes not after the one before
+
+static void benchLocation(GpsLocation* location)
+{
+	// one fix per epoch, in order
+	if (s_locations >= s_epochs)
+		return;
+	long long lineUs = s_readLineUs - s_pEpochEndUs[s_locations];
+	long long procUs = getMonotonicUsCounter() - s_readStartUs;
+	s_locations ++;
+	s_lineSumUs += lineUs;
+	s_procSumUs += procUs;
+	if (lineUs > s_lineMaxUs) s_lineMaxUs = lineUs;
+	if (procUs > s_procMaxUs) s_procMaxUs = procUs;
+	if (location->timestamp <= s_lastTimestamp)
+		s_unordered ++;
+	s_lastTimestamp = location->timestamp;
+}
+
+//! Satellites in view of an epoch, those of GP followed by those of GL
+static const int s_svPrn[] = { 23, 29, 7, 8, 10, 5, 9, 18, 26, 28, 65, 72, 71, 81, 80, 66 };
+static int s_svBad = 0;					//!< sv_status_cb calls with a wrong satellite table
+static int s_svCalls = 0;				//!< sv_status_cb calls
+
+static void benchSvStatus(GpsSvStatus* sv_status)
+{
+	s_svCalls ++;
+	const int num = (int) (sizeof(s_svPrn) / sizeof(*s_svPrn));
+	bool ok = (sv_status->num_svs == num);
+	for (int i = 0; ok && (i < num); i ++)
+		ok = (sv_status->sv_list[i].prn == s_svPrn[i]);
+	if (!ok)
+		s_svBad ++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The data of the serial line
+
+//! Scenarios, the ways the end of an epoch is detected
+typedef enum { SCEN_REPEAT, SCEN_MARKER, SCEN_EOE, SCEN_BATCH_SIZE, SCEN_BATCH_INTERVAL, SCEN_NUM } SCEN_t;
+
+#define BATCH_SIZE			16		//!< fixes of a batch in the size scenario
+#define BATCH_INTERVAL_MS	100		//!< flush interval in the interval scenario
+
+//! Bytes with the serial line time each has been received
+typedef struct
+{
+	unsigned char* pData;
+	long long* pTimeUs;
+	int size;
+	int max;
+} LINE_t;
+
+static bool addBytes(LINE_t& line, const unsigned char* pData, int size, long long& timeUs, int baudrate)
+{
+	if (line.size + size > line.max)
+	{
+		line.max = 2 * (line.size + size);
+		unsigned char* p = (unsigned char*) realloc(line.pData, (size_t) line.max);
+		long long* t = (long long*) realloc(line.pTimeUs, (size_t) line.max * sizeof(long long));
+		if (p) line.pData = p;
+		if (t) line.pTimeUs = t;
+		if (!p || !t)
+			return false;
+	}
+	for (int i = 0; i < size; i ++)
+	{
+		// 10 bits per byte, start, 8 data and stop bit
+		timeUs += 10000000LL / baudrate;
+		line.pData[line.size] = pData[i];
+		line.pTimeUs[line.size ++] = timeUs;
+	}
+	return true;
+}
+
+//! Add a NMEA sentence, the checksum and line end are appended
+static bool addNmea(LINE_t& line, const char* pBody, long long& timeUs, int baudrate)
+{
+	unsigned char ck = 0;
+	for (const char* p = pBody + 1; *p; p ++)
+		ck ^= (unsigned char) *p;
+	char sentence[128];
+	int len = snprintf(sentence, sizeof(sentence), "%s*%02X\r\n", pBody, ck);
+	return addBytes(line, (const unsigned char*) sentence, len, timeUs, baudrate);
+}
+
+//! Add UBX-NAV-EOE
+static bool addEoe(LINE_t& line, unsigned int iTow, long long& timeUs, int baudrate)
+{
+	unsigned char msg[12];
+	msg[6] = (unsigned char) iTow;
+	msg[7] = (unsigned char) (iTow >> 8);
+	msg[8] = (unsigned char) (iTow >> 16);
+	msg[9] = (unsigned char) (iTow >> 24);
+	return addBytes(line, msg, benchFrameUbx(msg, 0x01, 0x61, 4), timeUs, baudrate);
+}
+
+//! Generate the epochs, an epoch starts each second
+static bool generate(LINE_t& line, SCEN_t scen, int epochs, int baudrate)
+{
+	for (int ep = 0; ep < epochs; ep ++)
+	{
+		long long timeUs = 1000000LL * (ep + 1);
+		int s = ep % 60, m = (ep / 60) % 60, h = (9 + ep / 3600) % 24;
+		char body[100];
+		bool ok = true;
+		snprintf(body, sizeof(body), "$GPRMC,%02d%02d%02d.00,A,4717.11437,N,00833.91522,E,0.004,77.52,091202,,,A", h, m, s);
+		ok = ok && addNmea(line, body, timeUs, baudrate);
+		ok = ok && addNmea(line, "$GPVTG,77.52,T,,M,0.004,N,0.008,K,A", timeUs, baudrate);
+		snprintf(body, sizeof(body), "$GPGGA,%02d%02d%02d.00,4717.11399,N,00833.91590,E,1,08,1.01,499.6,M,48.0,M,,", h, m, s);
+		ok = ok && addNmea(line, body, timeUs, baudrate);
+		ok = ok && addNmea(line, "$GPGSA,A,3,23,29,07,08,09,18,26,28,,,,,1.94,1.18,1.54", timeUs, baudrate);
+		ok = ok && addNmea(line, "$GPGSV,3,1,10,23,38,230,44,29,71,156,47,07,29,116,41,08,09,081,36", timeUs, baudrate);
+		ok = ok && addNmea(line, "$GPGSV,3,2,10,10,07,189,,05,05,220,,09,34,274,42,18,25,309,44", timeUs, baudrate);
+		ok = ok && addNmea(line, "$GPGSV,3,3,10,26,82,187,47,28,43,056,46", timeUs, baudrate);
+		ok = ok && addNmea(line, "$GLGSV,2,1,06,65,22,045,38,72,51,301,42,71,33,233,40,81,12,100,31", timeUs, baudrate);
+		ok = ok && addNmea(line, "$GLGSV,2,2,06,80,64,012,45,66,08,151,29", timeUs, baudrate);
+		snprintf(body, sizeof(body), "$GPGLL,4717.11364,N,00833.91565,E,%02d%02d%02d.00,A,A", h, m, s);
+		ok = ok && addNmea(line, body, timeUs, baudrate);
+		if (scen == SCEN_EOE)
+			ok = ok && addEoe(line, (unsigned int) (ep * 1000), timeUs, baudrate);
+		if (!ok)
+			return false;
+		if (timeUs >= 1000000LL * (ep + 2))
+		{
+			fprintf(stderr, "an epoch takes more than a second at %d baud\n", baudrate);
+			return false;
+		}
+		s_pEpochEndUs[ep] = timeUs;
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static int s_batchEarly = 0;			//!< reads after which the delivered fixes did not match the full batches
+static int s_flushes = 0;				//!< times fixes were delivered while batching
+static int s_stopFixes = 0;				//!< fixes flushed at the end of the line
+static long long s_deadlineLateUs = -1;	//!< interval flush after the deadline, -1 if none
+
+//! Feed the line to the GPS thread parser in reads, as the serial port returns them
+static int run(const LINE_t& line, SCEN_t scen, int readSize)
+{
+	int batchSize = 0;
+	int intervalMs = 0;
+	if (scen == SCEN_BATCH_SIZE)
+		batchSize = BATCH_SIZE;
+	else if (scen == SCEN_BATCH_INTERVAL)
+	{
+		// never full, only the interval flushes
+		batchSize = s_epochs + 1;
+		intervalMs = BATCH_INTERVAL_MS;
+	}
+	ControlThreadInfo gpsState;
+	memset(&gpsState, 0, sizeof(gpsState));
+	gpsState.gpsState = GPS_STARTED;
+	CMyDatabase database;
+	database.setGpsState(&gpsState);
+	database.incPublish();
+	database.SetEpochEnd(((scen == SCEN_REPEAT) || (scen == SCEN_EOE)) ? CDatabase::MSG_NUM : CDatabase::MSG_NMEA_GLL);
+	database.setBatching(batchSize, intervalMs);
+	CProtocolUBX  protocolUBX;
+	CProtocolNMEA protocolNmea;
+	CProtocolUnknown protocolUnknown;
+	CParserBuffer parser;				// declare after protocols, so destructor called before protocol destructors
+	parser.Register(&protocolUBX);
+	parser.Register(&protocolNmea);
+	parser.RegisterUnknown(&protocolUnknown);
+
+	int done = 0;
+	int committed = 0;
+	while (done < line.size)
+	{
+		// a read returns at most readSize bytes and ends when the line goes idle
+		int size = 1;
+		while ((size < readSize) && (done + size < line.size) &&
+			   (line.pTimeUs[done + size] - line.pTimeUs[done + size - 1] < 100000))
+			size ++;
+		int space = parser.GetSpace();
+		if (size > space)
+			size = space;
+		if (size == 0)
+		{
+			fprintf(stderr, "parser buffer full\n");
+			return -1;
+		}
+		s_readLineUs = line.pTimeUs[done + size - 1];
+		s_readStartUs = getMonotonicUsCounter();
+		memcpy(parser.GetPointer(), line.pData + done, (size_t) size);
+		parser.Append(size);
+		done += size;
+
+		int before = s_locations;
+		CProtocol* pProtocol;
+		unsigned char* pMsg;
+		int iMsg;
+		while (parser.Parse(pProtocol, pMsg, iMsg))
+		{
+			pProtocol->Process(pMsg, iMsg, &database);
+			parser.Remove(iMsg);
+		}
+		parser.Compact();
+
+		if (batchSize > 0)
+		{
+			// only the full batches of the epochs completed so far may have been delivered
+			while ((committed < s_epochs) && (s_pEpochEndUs[committed] <= s_readLineUs))
+				committed ++;
+			if (s_locations != committed - committed % batchSize)
+				s_batchEarly ++;
+			if (s_locations != before)
+				s_flushes ++;
+		}
+	}
+
+	if (intervalMs > 0)
+	{
+		// the line is fed faster than the interval, wait for the deadline as the GPS thread does
+		int64_t deadlineMs = database.getBatchDeadline();
+		int64_t nowMs;
+		while (deadlineMs && ((nowMs = getMonotonicMsCounter()) < deadlineMs))
+			usleep((useconds_t) (deadlineMs - nowMs) * 1000);
+		if (deadlineMs && (getMonotonicMsCounter() >= database.getBatchDeadline()))
+		{
+			s_deadlineLateUs = getMonotonicUsCounter() - deadlineMs * 1000;
+			int before = s_locations;
+			database.flushBatch();
+			s_stopFixes = s_locations - before;
+			s_flushes ++;
+		}
+	}
+	else if (batchSize > 0)
+	{
+		// the rest is delivered when the engine is stopped
+		int before = s_locations;
+		database.flushBatch();
+		s_stopFixes = s_locations - before;
+		if (s_stopFixes)
+			s_flushes ++;
+	}
+	return s_locations;
+}
+
+int main(int argc, char* argv[])
+{
+	int epochs = 1000;
+	int baudrate = 9600;
+	int readSize = 64;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:b:c:")) != -1)
+	{
+		if (opt == 'n')
+			epochs = atoi(optarg);
+		else if (opt == 'b')
+			baudrate = atoi(optarg);
+		else if (opt == 'c')
+			readSize = atoi(optarg);
+		else
+			break;
+	}
+	if ((opt != -1) || (optind < argc) || (epochs <= 0) || (baudrate <= 0) || (readSize <= 0))
+	{
+		fprintf(stderr, "usage: %s [-n epochs] [-b baudrate] [-c read-size]\n", argv[0]);
+		return 1;
+	}
+	CGpsIf::getInstance()->m_callbacks.location_cb = benchLocation;
+	CGpsIf::getInstance()->m_callbacks.sv_status_cb = benchSvStatus;
+	s_epochs = epochs;
+	s_pEpochEndUs = (long long*) malloc((size_t) epochs * sizeof(long long));
+	if (!s_pEpochEndUs)
+	{
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	static const char* const s_name[SCEN_NUM] = { "repeat", "marker", "eoe", "size", "interval" };
+	printf("%d epochs at %d baud, reads of up to %d bytes\n", epochs, baudrate, readSize);
+	for (int scen = 0; scen < SCEN_NUM; scen ++)
+	{
+		LINE_t line;
+		memset(&line, 0, sizeof(line));
+		if (!generate(line, (SCEN_t) scen, epochs, baudrate))
+			return 1;
+		s_locations = 0;
+		s_svBad = 0;
+		s_svCalls = 0;
+		s_lastTimestamp = 0;
+		s_unordered = 0;
+		s_batchEarly = s_flushes = s_stopFixes = 0;
+		s_deadlineLateUs = -1;
+		s_lineSumUs = s_lineMaxUs = s_procSumUs = s_procMaxUs = 0;
+		int fixes = run(line, (SCEN_t) scen, readSize);
+		free(line.pData);
+		free(line.pTimeUs);
+		if (fixes < 0)
+			return 1;
+		printf("%-8s %5d fixes, last byte to location_cb avg %8.3f ms max %8.3f ms on the line, "
+			   "processing avg %6.1f us max %6.1f us\n", s_name[scen], fixes,
+			   fixes ? 1e-3 * (double) s_lineSumUs / fixes : 0.0, 1e-3 * (double) s_lineMaxUs,
+			   fixes ? (double) s_procSumUs / fixes : 0.0, (double) s_procMaxUs);
+		// without an end marker the last epoch is never committed
+		int expect = (scen == SCEN_REPEAT) ? (epochs - 1) : epochs;
+		if ((fixes != expect) || s_svBad || s_unordered)
+		{
+			printf("FAILED %s: %d of %d fixes, %d out of order, %d epochs without the satellites of both talkers\n",
+				   s_name[scen], fixes, expect, s_unordered, s_svBad);
+			return 1;
+		}
+		if (scen == SCEN_BATCH_SIZE)
+		{
+			printf("%-8s %5d flushes, %d fixes at stop\n", "", s_flushes, s_stopFixes);
+			if (s_batchEarly || s_svCalls || (s_stopFixes != epochs % BATCH_SIZE) ||
+				(s_flushes != (epochs + BATCH_SIZE - 1) / BATCH_SIZE))
+			{
+				printf("FAILED %s: %d reads with other than full batches delivered, %d satellite reports, "
+					   "%d flushes, %d fixes at stop\n", s_name[scen], s_batchEarly, s_svCalls, s_flushes, s_stopFixes);
+				return 1;
+			}
+		}
+		else if (scen == SCEN_BATCH_INTERVAL)
+		{
+			printf("%-8s %5d flushes, %d fixes %.1f ms after the deadline\n", "", s_flushes, s_stopFixes,
+				   1e-3 * (double) s_deadlineLateUs);
+			if (s_batchEarly || s_svCalls || (s_flushes != 1) || (s_deadlineLateUs < 0))
+			{
+				printf("FAILED %s: %d reads with fixes delivered before the deadline, %d satellite reports, %d flushes\n",
+					   s_name[scen], s_batchEarly, s_svCalls, s_flushes);
+				return 1;
+			}
+		}
+	}
+	free(s_pEpochEndUs);
+	return 0;
+}
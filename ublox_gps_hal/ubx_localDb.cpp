@@ -40,6 +40,7 @@
 #include "std_lang_def.h"
 #include "std_macros.h"
 #include "ubx_timer.h"
+#include "ubx_rxStats.h"
 
 #include "ubx_localDb.h"
 
@@ -55,10 +56,18 @@ CMyDatabase::CMyDatabase()
 	m_nextReportEpochMs = 0;
 	// m_lastReportTime = time(NULL) * 1000; // Debug
 	m_publishCount = 0;					// Publishing off by default;
+	m_epochSeq = 0;
+	m_pBatch = NULL;					// Batching off by default
+	m_batchSize = 0;
+	m_batchNum = 0;
+	m_batchIntervalMs = 0;
+	m_batchDeadlineMs = 0;
 }
 
 CMyDatabase::~CMyDatabase()
 {
+	free(m_pBatch);
+	m_pBatch = NULL;
 	pthread_mutex_destroy(&m_timeIntervalMutex);
 	m_pGpsState = NULL;
 }
@@ -118,12 +127,78 @@ GpsUtcTime CMyDatabase::GetGpsUtcTime(void) const
     return 0;
 }
 
+//! Configure location batching
+/*! When batching is on, the fixes are kept in a buffer and handed to the 
+	framework in one go when the buffer is full, the flush interval expired
+	or flushBatch is called, instead of waking the application processor
+	every epoch. Satellite status is not reported while batching.
+  \param size       : number of fixes to keep, 0 turns batching off
+  \param intervalMs : maximum time to hold a fix in ms, 0 flushes only when full
+*/
+void CMyDatabase::setBatching(int size, int intervalMs)
+{
+	flushBatch();
+	free(m_pBatch);
+	m_pBatch = NULL;
+	m_batchSize = 0;
+	m_batchIntervalMs = (intervalMs > 0) ? intervalMs : 0;
+	if (size > 0)
+	{
+		m_pBatch = (GpsLocation*) malloc(size * sizeof(GpsLocation));
+		if (m_pBatch)
+		{
+			m_batchSize = size;
+			LOGV("%s: Batching %d fixes, flush interval %d ms", __FUNCTION__, size, m_batchIntervalMs);
+		}
+		else
+			LOGE("%s: Could not allocate %d fixes, batching off", __FUNCTION__, size);
+	}
+}
+
+//! Hand all batched fixes to the framework, oldest first
+void CMyDatabase::flushBatch(void)
+{
+	if (m_batchNum > 0)
+	{
+		//LOGV("%s: Flushing %d fixes", __FUNCTION__, m_batchNum);
+		if (CGpsIf::getInstance()->m_callbacks.location_cb)
+		{
+			for (int i = 0; i < m_batchNum; i ++)
+				CGpsIf::getInstance()->m_callbacks.location_cb(&m_pBatch[i]);
+		}
+		m_batchNum = 0;
+	}
+	m_batchDeadlineMs = 0;
+}
+
+//! Add a fix to the batch, flushes the batch once it is full
+void CMyDatabase::batchLocation(const GpsLocation& loc)
+{
+	if (!(loc.flags & GPS_LOCATION_HAS_LAT_LONG))
+		return;		// a track only needs positions
+	if ((m_batchNum == 0) && (m_batchIntervalMs > 0))
+		m_batchDeadlineMs = getMonotonicMsCounter() + m_batchIntervalMs;
+	m_pBatch[m_batchNum++] = loc;
+	if (m_batchNum >= m_batchSize)
+		flushBatch();
+}
+
+void CMyDatabase::Reset(void)
+{
+    beginWrite();
+    CDatabase::Reset();
+    endWrite();
+}
+
 CDatabase::STATE_t CMyDatabase::Commit(bool bClear)
 {
     CDatabase::STATE_t state;
 
-    // Store commit time in database
+    // Store commit time in database, readers retry while this is ongoing
+    beginWrite();
     state = CDatabase::Commit(bClear);
+    endWrite();
+    CRxStats::commit();
 
     //LOGV("Perform commit: clear %i   state %i", bClear, state);
 
@@ -206,11 +281,17 @@ CDatabase::STATE_t CMyDatabase::Commit(bool bClear)
 			loc.timestamp = GetGpsUtcTime();
 			if ((loc.flags != 0) && (m_publishCount > 0))
             {
-             	CGpsIf::getInstance()->m_callbacks.location_cb(&loc);
+				if (m_pBatch)
+					batchLocation(loc);
+				else
+				{
+					CRxStats::callback(CRxStats::CB_LOCATION);
+					CGpsIf::getInstance()->m_callbacks.location_cb(&loc);
+				}
             }
         }
     
-        if (CGpsIf::getInstance()->m_callbacks.sv_status_cb) 
+        if (!m_pBatch && CGpsIf::getInstance()->m_callbacks.sv_status_cb) 
         {
             int i;
             // Satellite status
@@ -224,29 +305,30 @@ CDatabase::STATE_t CMyDatabase::Commit(bool bClear)
 #define IS_GLO(prn)  ((prn >= 65 /* R1   */) && (prn <= 87 /* R24  */)) // GLO  publish R1 to R24, R25 to R32 of nmea is not supported by our GPS  
 #define PRN_MASK(prn) (1ul << (prn - 1)) // convert to the prn mask
 
-            // Satellites in view
-            int num = 0;
-            if (varO[DATA_SATELLITES_IN_VIEW].Get(num) && (num > 0))
+            // Satellites in view, straight from the satellite table
+            const SATS_t& sats = satO;
+            int num = sats.inView;
+            if (num > 0)
             {
                 int c = 0;
                 for (i = 0; (i < num) && (c < GPS_MAX_SVS); i++)
                 {
-                    float az = 0.0f, el = 0.0f, snr = 0.0f;
-                    int prn = 0;
-                    bool azelOk = (varO[DATA_SATELLITES_IN_VIEW_ELEVATION_(i)].Get(el)  && (el >= 0.0f) && (el <= 90.0f)) &&
-                        (varO[DATA_SATELLITES_IN_VIEW_AZIMUTH_(i)].Get(az)    && (az >= 0.0f) && (az <= 360.0f));
-                    bool snrOk  = (varO[DATA_SATELLITES_IN_VIEW_STN_RATIO_(i)].Get(snr) && (snr > 0.0f));
-                    prn         = (varO[DATA_SATELLITES_IN_VIEW_PRNS_(i)].Get(prn) && 
+                    float az = sats.az[i], el = sats.el[i], snr = sats.cno[i];
+                    int prn = sats.prn[i];
+                    bool azelOk = IsValid(sats.validAzEl, i) && 
+                        (el >= 0.0f) && (el <= 90.0f) && (az >= 0.0f) && (az <= 360.0f);
+                    bool snrOk  = IsValid(sats.validCno, i) && (snr > 0.0f);
+                    prn         = (IsValid(sats.validPrn, i) && 
                                    (IS_GPS(prn) || IS_SBAS(prn) || IS_GLO(prn))) ? prn : 0;
                     if (azelOk || snrOk || prn) // if have information to share the fill the structure
                     {
-                        int orbsta;
+                        int orbsta = sats.orbSta[i];
 						IF_ANDROID23( svStatus.sv_list[c].size = sizeof(GpsSvInfo); )
                         svStatus.sv_list[c].prn		  = prn;
                         svStatus.sv_list[c].azimuth   = azelOk ? az : -1;
                         svStatus.sv_list[c].elevation = azelOk ? el : -1;
                         svStatus.sv_list[c].snr		  = snrOk ? snr : -1;
-                        if (varO[DATA_UBX_SATELLITES_IN_VIEW_ORB_STA_(i)].Get(orbsta) && IS_GPS(prn))
+                        if (IsValid(sats.validOrbSta, i) && IS_GPS(prn))
                         { 
                             if (orbsta & 0x1 /* EPH */) svStatus.ephemeris_mask |= PRN_MASK(prn);
                             if (orbsta & 0x2 /* ALM */) svStatus.almanac_mask   |= PRN_MASK(prn);
@@ -258,19 +340,16 @@ CDatabase::STATE_t CMyDatabase::Commit(bool bClear)
                 if (c)
                 {
                     // Satellites used
-                    num = 0;
-                    if (varO[DATA_SATELLITES_USED_COUNT].Get(num) && (num > 0))
+                    num = sats.used;
+                    for (i = 0; i < num; i++)
                     {
-                        for (i = 0; i < num; i++)
-                        {
-                            int prn;
-                            if (varO[DATA_SATELLITES_USED_PRNS_(i)].Get(prn) && IS_GPS(prn))
-                                svStatus.used_in_fix_mask |= PRN_MASK(prn);
-                        }
+                        int prn = sats.usedPrn[i];
+                        if (IS_GPS(prn))
+                            svStatus.used_in_fix_mask |= PRN_MASK(prn);
                     }
+                    CRxStats::callback(CRxStats::CB_SV_STATUS);
                     CGpsIf::getInstance()->m_callbacks.sv_status_cb(&svStatus);
                 }
-                svStatus.num_svs = c;
             }
         }
     }
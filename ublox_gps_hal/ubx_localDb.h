@@ -33,6 +33,8 @@
 #ifndef __UBX_LOCALDB_H__
 #define __UBX_LOCALDB_H__
 
+#include <sched.h>
+
 #include "database.h"
 #include "gps_thread.h"
 
@@ -50,7 +52,20 @@ protected:
 	int64_t                 m_nextReportEpochMs;
 	int 					m_publishCount;
 
+	// epoch sequence, odd while varO is being updated
+	volatile unsigned int	m_epochSeq;
+
+	// location batching, only accessed from the GPS thread
+	GpsLocation*			m_pBatch;
+	int						m_batchSize;
+	int						m_batchNum;
+	int						m_batchIntervalMs;
+	int64_t					m_batchDeadlineMs;
+
 	bool GetCurrentTimestamp(TIMESTAMP& rFT);
+	void batchLocation(const GpsLocation& loc);
+	void beginWrite(void) { m_epochSeq++; __sync_synchronize(); }
+	void endWrite(void)   { __sync_synchronize(); m_epochSeq++; }
 	
 public:
     CMyDatabase();
@@ -60,6 +75,7 @@ public:
     GpsUtcTime GetGpsUtcTime(void) const;
 
 	virtual STATE_t Commit(bool bClear);
+	void Reset(void);
 
 	void setEpochInterval(int timeIntervalMs, int64_t nextReportEpochMs);
 	void setGpsState(ControlThreadInfo* pGpsState) { m_pGpsState = pGpsState; };
@@ -67,11 +83,52 @@ public:
 	void incPublish(void);
 	void decPublish(void);
 	void resetPublish(void) { m_publishCount = 0; };
+
+	void setBatching(int size, int intervalMs);
+	bool isBatching(void) const { return m_pBatch != NULL; };
+	//! Time the batched fixes have to be flushed at, 0 if none are pending
+	int64_t getBatchDeadline(void) const { return m_batchDeadlineMs; };
+	void flushBatch(void);
 	
+	//! Start a lock free read of the committed epoch
+	/*! Readers never block the GPS thread. Wrap all getData calls that 
+		have to come from the same epoch in a loop and repeat them while
+		retryRead returns true.
+	  \return the sequence to pass to retryRead
+	*/
+	unsigned int beginRead(void) const
+	{
+		unsigned int seq;
+		while ((seq = m_epochSeq) & 1)
+			sched_yield();
+		__sync_synchronize();
+		return seq;
+	}
+
+	//! Check if a commit happened since beginRead
+	/*!
+	  \param seq : sequence returned by beginRead
+	  \return true if the values read may be torn and have to be read again
+	*/
+	bool retryRead(unsigned int seq) const
+	{
+		__sync_synchronize();
+		return m_epochSeq != seq;
+	}
+
 	template<typename T> bool getData(DATA_t data, T &v)
 	{
 		if (data < DATA_NUM)
-			return varO[data].Get(v);
+		{
+			unsigned int seq;
+			bool r;
+			do
+			{
+				seq = beginRead();
+				r = varO[data].Get(v);
+			} while (retryRead(seq));
+			return r;
+		}
 		return false;
 	}
 };
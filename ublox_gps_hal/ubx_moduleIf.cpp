@@ -47,7 +47,7 @@
 #include "std_types.h"
 #include "ubx_log.h"
 
-//#include "ubx_debugIf.h"
+#include "ubx_debugIf.h"
 #ifdef SUPL_ENABLED
  #include "ubx_rilIf.h"
  #include "ubx_niIf.h"
@@ -0,0 +1,279 @@
+/*******************************************************************************
+ *
+ * Copyright (C) u-blox AG
+ * u-blox AG, Thalwil, Switzerland
+ *
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose without fee is hereby granted, provided that this entire notice
+ * is included in all copies of any software which is or includes a copy
+ * or modification of this software and in all copies of the supporting
+ * documentation for such software.
+ *
+ * THIS SOFTWARE IS BEING PROVIDED "AS IS", WITHOUT ANY EXPRESS OR IMPLIED
+ * WARRANTY. IN PARTICULAR, NEITHER THE AUTHOR NOR U-BLOX MAKES ANY
+ * REPRESENTATION OR WARRANTY OF ANY KIND CONCERNING THE MERCHANTABILITY
+ * OF THIS SOFTWARE OR ITS FITNESS FOR ANY PARTICULAR PURPOSE.
+ *
+ *******************************************************************************
+ *
+ * Project: PE_ANS
+ *
+ ******************************************************************************/
+/*!
+  \file
+  \brief  Check and benchmark of the NMEA number parser
+
+  Compares CProtocolNMEA::ParseDouble with strtod, which GetItem used
+  before, on the fields of the NMEA sentences in a file recorded with
+  SERIAL_CAPTURE and on generated fields: ddmm.mmmmm angles, decimals of
+  all lengths and the rare forms left to strtod. Both have to agree on
+  whether a field is a number and on every bit of its value, the tool
+  fails on the first difference. Then both are timed on the same fields.
+
+  usage: ubx_nmeaNumBench [-n fields] [capture-file]
+    -n  number of generated fields, default 1000000
+*/
+/*******************************************************************************
+ * $Id: ubx_nmeaNumBench.cpp $
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "ubx_serial.h"
+#include "protocolnmea.h"
+#include "ubx_timer.h"
+#include "ubx_benchUtil.h"
+
+#define FIELD_MAX	32		//!< Longest field checked
+
+//! Access to the number parser of the protocol
+class CNmeaNumbers : public CProtocolNMEA
+{
+public:
+	using CProtocolNMEA::ParseDouble;
+};
+
+//! The fields, each followed by a separator as in a sentence
+typedef struct
+{
+	char* pData;			//!< fields back to back
+	int* pStart;			//!< start of each field in pData
+	int num;				//!< number of fields
+	int max;				//!< room for fields
+	int size;				//!< used in pData
+	int dataMax;			//!< room in pData
+} FIELDS_t;
+
+static bool addField(FIELDS_t& f, const char* pField, int len)
+{
+	if (len > FIELD_MAX)
+		return true;
+	if (f.num == f.max)
+	{
+		f.max = f.max ? 2 * f.max : 4096;
+		int* p = (int*) realloc(f.pStart, f.max * sizeof(int));
+		if (!p)
+			return false;
+		f.pStart = p;
+	}
+	if (f.size + len + 1 > f.dataMax)
+	{
+		f.dataMax = 2 * (f.size + len + 1);
+		char* p = (char*) realloc(f.pData, f.dataMax);
+		if (!p)
+			return false;
+		f.pData = p;
+	}
+	f.pStart[f.num ++] = f.size;
+	memcpy(f.pData + f.size, pField, len);
+	f.size += len;
+	f.pData[f.size ++] = ',';
+	return true;
+}
+
+//! Add the fields of all NMEA sentences in a capture
+static bool loadCapture(const char* pName, FIELDS_t& f)
+{
+	FILE* pFile = fopen(pName, "rb");
+	if (!pFile)
+	{
+		fprintf(stderr, "cannot open '%s'\n", pName);
+		return false;
+	}
+	CAPTURE_HEADER_t header;
+	if ((fread(&header, sizeof(header), 1, pFile) != 1) ||
+		(header.magic != CAPTURE_MAGIC) || (header.version != CAPTURE_VERSION))
+	{
+		fprintf(stderr, "'%s' is not a capture file\n", pName);
+		fclose(pFile);
+		return false;
+	}
+	// fields run from a ',' to the next ',', '*' or line end of a sentence
+	char field[FIELD_MAX + 1];
+	int len = -1;					// -1 outside a sentence or its address field
+	bool ok = true;
+	CAPTURE_REC_t rec;
+	while (ok && (fread(&rec, sizeof(rec), 1, pFile) == 1))
+	{
+		for (unsigned int i = 0; ok && (i < rec.size); i ++)
+		{
+			int c = fgetc(pFile);
+			if (c == EOF)
+			{
+				fprintf(stderr, "capture truncated\n");
+				fclose(pFile);
+				return false;
+			}
+			if (c == '$')
+				len = -1;
+			else if ((c == ',') || (c == '*') || (c == '\r') || (c == '\n'))
+			{
+				if (len >= 0)
+					ok = addField(f, field, len);
+				len = (c == ',') ? 0 : -1;
+			}
+			else if ((len >= 0) && (len < FIELD_MAX))
+				field[len ++] = (char) c;
+		}
+	}
+	fclose(pFile);
+	return ok;
+}
+
+//! Add generated fields
+static bool generate(FIELDS_t& f, int num)
+{
+	static const char* const s_rare[] = {
+		"", ".", "-", "+", "-.", "1e3", "1.5E-2", "0x1A", "inf", "nan", " 12.5",
+		"12.5 ", "1.2.3", "12a", "-0", "-0.0", "00000000000000000001.5",
+		"123456789012345678", "0.1234567890123456789", "9007199254740993"
+	};
+	char field[FIELD_MAX + 1];
+	bool ok = true;
+	for (int i = 0; ok && (i < (int) (sizeof(s_rare) / sizeof(s_rare[0]))); i ++)
+		ok = addField(f, s_rare[i], (int) strlen(s_rare[i]));
+	for (int i = 0; ok && (i < num); i ++)
+	{
+		int len;
+		switch (benchRandom32() % 3)
+		{
+		case 0:		// latitude or longitude, dddmm.mmmmm
+			len = sprintf(field, "%0*u%02u.%0*u", (benchRandom32() & 1) ? 3 : 2, benchRandom32() % 180,
+						  benchRandom32() % 60, (int) (1 + benchRandom32() % 7), benchRandom32() % 10000000);
+			break;
+		case 1:		// speed, altitude, DOP and the like
+			len = sprintf(field, "%s%u.%0*u", (benchRandom32() % 8) ? "" : "-", benchRandom32() % 100000,
+						  (int) (benchRandom32() % 4), benchRandom32() % 1000);
+			break;
+		default:	// any digits, up to beyond the precision of a double
+			{
+				int digits = 1 + (int) (benchRandom32() % 20);
+				int dot = (int) (benchRandom32() % (digits + 2));
+				len = 0;
+				for (int j = 0; j < digits; j ++)
+				{
+					if (j == dot)
+						field[len ++] = '.';
+					field[len ++] = (char) ('0' + benchRandom32() % 10);
+				}
+			}
+			break;
+		}
+		ok = addField(f, field, len);
+	}
+	return ok;
+}
+
+//! The number as GetItem got it before, strtod on the zero terminated field
+static bool parseStrtod(char* pStart, char* pEnd, double& dValue)
+{
+	char c = *pEnd;
+	*pEnd = '\0';
+	char* pTemp;
+	dValue = strtod(pStart, &pTemp);
+	*pEnd = c;
+	return (pTemp > pStart);
+}
+
+int main(int argc, char* argv[])
+{
+	int num = 1000000;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:")) != -1)
+	{
+		if (opt == 'n')
+			num = atoi(optarg);
+		else
+			break;
+	}
+	if ((opt != -1) || (optind < argc - 1))
+	{
+		fprintf(stderr, "usage: %s [-n fields] [capture-file]\n", argv[0]);
+		return 1;
+	}
+
+	FIELDS_t f;
+	memset(&f, 0, sizeof(f));
+	if ((optind == argc - 1) && !loadCapture(argv[optind], f))
+		return 1;
+	int captured = f.num;
+	if (!generate(f, num))
+	{
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	printf("fields    %d from the capture, %d generated\n", captured, f.num - captured);
+
+	// same result, bit by bit
+	int numbers = 0;
+	for (int i = 0; i < f.num; i ++)
+	{
+		char* pStart = f.pData + f.pStart[i];
+		char* pEnd = (char*) memchr(pStart, ',', FIELD_MAX + 1);
+		double d1 = 0.0, d2 = 0.0;
+		bool ok1 = CNmeaNumbers::ParseDouble(pStart, pEnd, d1);
+		bool ok2 = parseStrtod(pStart, pEnd, d2);
+		if ((ok1 != ok2) || (ok1 && memcmp(&d1, &d2, sizeof(double))))
+		{
+			printf("FAILED, '%.*s' gives %s %.17g, strtod %s %.17g\n", (int) (pEnd - pStart), pStart,
+					ok1 ? "true" : "false", d1, ok2 ? "true" : "false", d2);
+			return 1;
+		}
+		if (ok1)
+			numbers ++;
+	}
+	printf("identical %d fields, %d numbers\n", f.num, numbers);
+
+	// timing, the sink keeps the compiler from dropping the calls
+	volatile double sink = 0.0;
+	long long startUs = getMonotonicUsCounter();
+	for (int i = 0; i < f.num; i ++)
+	{
+		char* pStart = f.pData + f.pStart[i];
+		double d;
+		if (CNmeaNumbers::ParseDouble(pStart, (char*) memchr(pStart, ',', FIELD_MAX + 1), d))
+			sink = d;
+	}
+	long long parseUs = getMonotonicUsCounter() - startUs;
+	startUs = getMonotonicUsCounter();
+	for (int i = 0; i < f.num; i ++)
+	{
+		char* pStart = f.pData + f.pStart[i];
+		double d;
+		if (parseStrtod(pStart, (char*) memchr(pStart, ',', FIELD_MAX + 1), d))
+			sink = d;
+	}
+	long long strtodUs = getMonotonicUsCounter() - startUs;
+	printf("ParseDouble %.1f ns per field, strtod %.1f ns per field\n",
+			1e3 * (double) parseUs / f.num, 1e3 * (double) strtodUs / f.num);
+	(void) sink;
+	free(f.pData);
+	free(f.pStart);
+	return 0;
+}
@@ -0,0 +1,362 @@
+/*******************************************************************************
+ *
+ * Copyright (C) u-blox AG
+ * u-blox AG, Thalwil, Switzerland
+ *
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose without fee is hereby granted, provided that this entire notice
+ * is included in all copies of any software which is or includes a copy
+ * or modification of this software and in all copies of the supporting
+ * documentation for such software.
+ *
+ * THIS SOFTWARE IS BEING PROVIDED "AS IS", WITHOUT ANY EXPRESS OR IMPLIED
+ * WARRANTY. IN PARTICULAR, NEITHER THE AUTHOR NOR U-BLOX MAKES ANY
+ * REPRESENTATION OR WARRANTY OF ANY KIND CONCERNING THE MERCHANTABILITY
+ * OF THIS SOFTWARE OR ITS FITNESS FOR ANY PARTICULAR PURPOSE.
+ *
+ *******************************************************************************
+ *
+ * Project: PE_ANS
+ *
+ ******************************************************************************/
+/*!
+  \file
+  \brief  Benchmark of the parser buffer layouts and the sync char scan
+
+  Feeds a file recorded with SERIAL_CAPTURE through CParserBuffer, once with
+  the mirrored ring and once with the flat buffer that is compacted after
+  every read. A third run uses the mirrored ring with the protocols asked
+  at every offset, as before the sync char scan. Each read of the capture
+  is appended as it came from the serial port, the capture is repeated 
+  until the requested amount of data is parsed. All runs have to hand out
+  the same messages, the tool fails if they differ.
+
+  Instead of a capture a generated stream of UBX and NMEA messages can be
+  used, clean, with bit errors and garbage between the messages, or only
+  garbage as seen with a wrong baud rate.
+
+  usage: ubx_parserBench [-m MB] capture-file
+         ubx_parserBench [-m MB] -g clean|noisy|garbage
+    -m  data to parse per run in MB, default 50
+    -g  parse a generated stream
+*/
+/*******************************************************************************
+ * $Id: ubx_parserBench.cpp $
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "ubx_serial.h"
+#include "parserbuffer.h"
+#include "protocolubx.h"
+#include "protocolnmea.h"
+#include "protocolunknown.h"
+#include "ubx_timer.h"
+#include "ubx_benchUtil.h"
+
+#define GEN_SIZE		(4 * 1000000)	//!< Size of a generated stream, repeated as needed
+#define GEN_READ_MAX	512				//!< Largest read of a generated stream
+
+//! The reads of a capture, back to back
+typedef struct
+{
+	unsigned char* pData;		//!< data of all reads
+	unsigned int* pSize;		//!< size of each read
+	int num;					//!< number of reads
+	long long bytes;			//!< size of all reads
+} READS_t;
+
+//! A protocol asked at every offset, as all were before the sync char scan
+template <class P> class CSyncAny : public P
+{
+public:
+	int GetSyncChar(void) const { return CProtocol::SYNC_ANY; }
+};
+
+//! Result of parsing with one layout
+typedef struct
+{
+	long long bytes;			//!< bytes parsed
+	long long us;				//!< time spent
+	int msg[3];					//!< ubx, nmea and unknown messages
+	unsigned int hash;			//!< FNV-1a over the protocol and data of all messages
+	bool ok;					//!< all data fitted into the buffer
+} RESULT_t;
+
+static bool loadCapture(const char* pName, READS_t& reads)
+{
+	memset(&reads, 0, sizeof(reads));
+	FILE* pFile = fopen(pName, "rb");
+	if (!pFile)
+	{
+		fprintf(stderr, "cannot open '%s'\n", pName);
+		return false;
+	}
+	CAPTURE_HEADER_t header;
+	if ((fread(&header, sizeof(header), 1, pFile) != 1) ||
+		(header.magic != CAPTURE_MAGIC) || (header.version != CAPTURE_VERSION))
+	{
+		fprintf(stderr, "'%s' is not a capture file\n", pName);
+		fclose(pFile);
+		return false;
+	}
+	int max = 0;
+	long long dataMax = 0;
+	CAPTURE_REC_t rec;
+	while (fread(&rec, sizeof(rec), 1, pFile) == 1)
+	{
+		if (reads.num == max)
+		{
+			max = max ? 2 * max : 1024;
+			unsigned int* p = (unsigned int*) realloc(reads.pSize, max * sizeof(unsigned int));
+			if (!p)
+				break;
+			reads.pSize = p;
+		}
+		if (reads.bytes + rec.size > dataMax)
+		{
+			dataMax = 2 * (reads.bytes + rec.size);
+			unsigned char* p = (unsigned char*) realloc(reads.pData, (size_t) dataMax);
+			if (!p)
+				break;
+			reads.pData = p;
+		}
+		if (fread(reads.pData + reads.bytes, 1, rec.size, pFile) != rec.size)
+		{
+			fprintf(stderr, "capture truncated after %d reads\n", reads.num);
+			break;
+		}
+		reads.pSize[reads.num ++] = rec.size;
+		reads.bytes += rec.size;
+	}
+	fclose(pFile);
+	return reads.bytes > 0;
+}
+
+//! Append a UBX message with a random payload
+static int genUbx(unsigned char* p, unsigned char cls, unsigned char id, int size)
+{
+	for (int i = 0; i < size; i ++)
+		p[6 + i] = (unsigned char) benchRandom32();
+	return benchFrameUbx(p, cls, id, size);
+}
+
+//! Append a NMEA sentence with its checksum
+static int genNmea(unsigned char* p, const char* pBody)
+{
+	unsigned char ck = 0;
+	for (const char* q = pBody; *q; q ++)
+		ck ^= (unsigned char) *q;
+	return sprintf((char*) p, "$%s*%02X\r\n", pBody, ck);
+}
+
+//! Generate the reads of a stream
+/*!
+  \param pKind : "clean", "noisy" or "garbage"
+  \param reads : filled with the reads
+  \return true if successful
+*/
+static bool generate(const char* pKind, READS_t& reads)
+{
+	int kind = !strcmp(pKind, "clean") ? 0 : !strcmp(pKind, "noisy") ? 1 : !strcmp(pKind, "garbage") ? 2 : -1;
+	if (kind < 0)
+	{
+		fprintf(stderr, "unknown stream '%s'\n", pKind);
+		return false;
+	}
+	memset(&reads, 0, sizeof(reads));
+	reads.pData = (unsigned char*) malloc(GEN_SIZE + 4096);
+	reads.pSize = (unsigned int*) malloc(GEN_SIZE * sizeof(unsigned int));
+	if (!reads.pData || !reads.pSize)
+	{
+		fprintf(stderr, "out of memory\n");
+		return false;
+	}
+	// one epoch of a 10 Hz receiver with UBX and NMEA output
+	static const char* const s_nmea[] = {
+		"GPRMC,083559.00,A,4717.11437,N,00833.91522,E,0.004,77.52,091202,,,A",
+		"GPGGA,083559.00,4717.11437,N,00833.91522,E,1,08,1.01,499.6,M,48.0,M,,",
+		"GPGSA,A,3,23,29,07,08,09,18,26,28,,,,,1.94,1.18,1.54",
+		"GPGSV,3,1,10,23,38,230,44,29,71,156,47,07,29,116,41,08,09,081,36",
+		"GPGSV,3,2,10,10,07,189,,05,05,220,,09,34,274,42,18,25,309,44",
+		"GPGSV,3,3,10,26,82,187,47,28,43,056,46",
+	};
+	int num = (int) (sizeof(s_nmea) / sizeof(s_nmea[0]));
+	while (reads.bytes < GEN_SIZE)
+	{
+		unsigned char* p = reads.pData + reads.bytes;
+		int size;
+		if (kind == 2)
+		{
+			size = 4096;
+			for (int i = 0; i < size; i ++)
+				p[i] = (unsigned char) benchRandom32();
+		}
+		else
+		{
+			size  = genUbx(p, 0x01, 0x07, 92);			// NAV-PVT
+			size += genUbx(p + size, 0x01, 0x30, 8 + 12 * 16);	// NAV-SVINFO
+			for (int i = 0; i < num; i ++)
+				size += genNmea(p + size, s_nmea[i]);
+			if (kind == 1)
+			{
+				// about one bit error per epoch and some garbage at the end
+				for (int i = 0; i < size; i ++)
+				{
+					if ((benchRandom32() % 1024) == 0)
+						p[i] ^= (unsigned char) (1 << (benchRandom32() % 8));
+				}
+				int garbage = (int) (benchRandom32() % 64);
+				for (int i = 0; i < garbage; i ++)
+					p[size ++] = (unsigned char) benchRandom32();
+			}
+		}
+		reads.bytes += size;
+	}
+	// split into reads of random size like they come from the serial port
+	for (long long done = 0; done < reads.bytes; )
+	{
+		unsigned int size = 1 + benchRandom32() % GEN_READ_MAX;
+		if (size > reads.bytes - done)
+			size = (unsigned int) (reads.bytes - done);
+		reads.pSize[reads.num ++] = size;
+		done += size;
+	}
+	return true;
+}
+
+//! Parse the reads until at least bytes were parsed
+/*!
+  \param bMirror : use the mirrored ring
+  \param bScan   : let the parser skip to the sync chars of the protocols
+  \param reads   : the data to parse
+  \param bytes   : data to parse, the reads are repeated as needed
+  \param res     : the result
+*/
+static void run(bool bMirror, bool bScan, const READS_t& reads, long long bytes, RESULT_t& res)
+{
+	memset(&res, 0, sizeof(res));
+	res.hash = 2166136261u;
+	res.ok = true;
+
+	CProtocolUBX  protocolUBX;
+	CProtocolNMEA protocolNmea;
+	CSyncAny<CProtocolUBX>  protocolUBXAny;
+	CSyncAny<CProtocolNMEA> protocolNmeaAny;
+	CProtocolUnknown protocolUnknown;
+	CParserBuffer parser(bMirror);		// declare after protocols, so destructor called before protocol destructors
+	CProtocol* pUbx  = bScan ? (CProtocol*) &protocolUBX  : (CProtocol*) &protocolUBXAny;
+	CProtocol* pNmea = bScan ? (CProtocol*) &protocolNmea : (CProtocol*) &protocolNmeaAny;
+	parser.Register(pUbx);
+	parser.Register(pNmea);
+	parser.RegisterUnknown(&protocolUnknown);
+	if (parser.IsMirrored() != bMirror)
+		printf("mirrored ring not supported, using the flat buffer\n");
+
+	long long startUs = getMonotonicUsCounter();
+	while (res.ok && (res.bytes < bytes))
+	{
+		const unsigned char* pRead = reads.pData;
+		for (int i = 0; res.ok && (i < reads.num); pRead += reads.pSize[i ++])
+		{
+			// same as the GPS thread does with a read from the serial port
+			unsigned int done = 0;
+			while (done < reads.pSize[i])
+			{
+				unsigned int space = (unsigned int) parser.GetSpace();
+				unsigned int size = reads.pSize[i] - done;
+				if (size > space)
+					size = space;
+				if (size == 0)
+				{
+					fprintf(stderr, "parser buffer full\n");
+					res.ok = false;
+					break;
+				}
+				memcpy(parser.GetPointer(), pRead + done, size);
+				parser.Append((int) size);
+				done += size;
+
+				CProtocol* pProtocol;
+				unsigned char* pMsg;
+				int iMsg;
+				while (parser.Parse(pProtocol, pMsg, iMsg))
+				{
+					int type = (pProtocol == pUbx) ? 0 : (pProtocol == pNmea) ? 1 : 2;
+					res.msg[type] ++;
+					res.hash = (res.hash ^ (unsigned int) type) * 16777619u;
+					for (int j = 0; j < iMsg; j ++)
+						res.hash = (res.hash ^ pMsg[j]) * 16777619u;
+					parser.Remove(iMsg);
+				}
+				parser.Compact();
+			}
+			res.bytes += done;
+		}
+	}
+	res.us = getMonotonicUsCounter() - startUs;
+}
+
+static void print(const char* pName, const RESULT_t& res)
+{
+	double s = 1e-6 * (double) res.us;
+	printf("%-9s %lld bytes in %.3f s, %.2f MB/s, %d ubx %d nmea %d unknown, hash %08X\n",
+			pName, res.bytes, s, (s > 0.0) ? 1e-6 * (double) res.bytes / s : 0.0,
+			res.msg[0], res.msg[1], res.msg[2], res.hash);
+}
+
+int main(int argc, char* argv[])
+{
+	long long bytes = 50LL * 1000000;
+	const char* pGenerate = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "m:g:")) != -1)
+	{
+		if (opt == 'm')
+			bytes = atoll(optarg) * 1000000;
+		else if (opt == 'g')
+			pGenerate = optarg;
+		else
+			break;
+	}
+	if ((opt != -1) || (pGenerate ? (optind != argc) : (optind != argc - 1)))
+	{
+		fprintf(stderr, "usage: %s [-m MB] capture-file\n"
+						"       %s [-m MB] -g clean|noisy|garbage\n", argv[0], argv[0]);
+		return 1;
+	}
+
+	READS_t reads;
+	if (pGenerate ? !generate(pGenerate, reads) : !loadCapture(argv[optind], reads))
+		return 1;
+	printf("%-9s %d reads, %lld bytes\n", pGenerate ? pGenerate : "capture", reads.num, reads.bytes);
+
+	RESULT_t mirror, flat, noScan;
+	run(true, true, reads, bytes, mirror);
+	print("mirrored", mirror);
+	run(false, true, reads, bytes, flat);
+	print("flat", flat);
+	run(true, false, reads, bytes, noScan);
+	print("no scan", noScan);
+	free(reads.pData);
+	free(reads.pSize);
+
+	if (!mirror.ok || !flat.ok || !noScan.ok || 
+		(mirror.hash != flat.hash) || memcmp(mirror.msg, flat.msg, sizeof(mirror.msg)) ||
+		(mirror.hash != noScan.hash) || memcmp(mirror.msg, noScan.msg, sizeof(mirror.msg)))
+	{
+		printf("FAILED, the runs did not parse the same messages\n");
+		return 1;
+	}
+	if (flat.us > 0)
+		printf("mirrored takes %.1f%% of the flat time\n", 100.0 * (double) mirror.us / (double) flat.us);
+	if (noScan.us > 0)
+		printf("scan takes %.1f%% of the time without it\n", 100.0 * (double) mirror.us / (double) noScan.us);
+	return 0;
+}
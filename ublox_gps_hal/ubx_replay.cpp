@@ -0,0 +1,361 @@
+/*******************************************************************************
+ *
+ * Copyright (C) u-blox AG
+ * u-blox AG, Thalwil, Switzerland
+ *
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose without fee is hereby granted, provided that this entire notice
+ * is included in all copies of any software which is or includes a copy
+ * or modification of this software and in all copies of the supporting
+ * documentation for such software.
+ *
+ * THIS SOFTWARE IS BEING PROVIDED "AS IS", WITHOUT ANY EXPRESS OR IMPLIED
+ * WARRANTY. IN PARTICULAR, NEITHER THE AUTHOR NOR U-BLOX MAKES ANY
+ * REPRESENTATION OR WARRANTY OF ANY KIND CONCERNING THE MERCHANTABILITY
+ * OF THIS SOFTWARE OR ITS FITNESS FOR ANY PARTICULAR PURPOSE.
+ *
+ *******************************************************************************
+ *
+ * Project: PE_ANS
+ *
+ ******************************************************************************/
+/*!
+  \file
+  \brief  Replay of captured receiver data
+
+  Feeds a file recorded with SERIAL_CAPTURE (see CSerialPort::openCapture)
+  through the same parser, protocols and database the GPS thread uses and
+  reports the parse throughput, the commit rate and the latency of the fixes.
+  The replay stands in for the framework, CMyDatabase reports to its
+  callbacks as it does in the HAL.
+
+  The receive path statistics the HAL exports are printed as text and
+  checked against the counts of the replay, in the text and in the binary
+  export, along with the header of the binary export and that neither
+  writes beyond a buffer that is too small.
+
+  usage: ubx_replay [-r] capture-file
+    -r  replay in real time, the default is as fast as possible
+*/
+/*******************************************************************************
+ * $Id: ubx_replay.cpp $
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <limits.h>
+
+#include "std_types.h"
+#include "ubx_serial.h"
+#include "ubx_moduleIf.h"
+#include "ubx_localDb.h"
+#include "ubx_rxStats.h"
+#include "gps_thread.h"
+#include "parserbuffer.h"
+#include "protocolubx.h"
+#include "protocolnmea.h"
+#include "protocolunknown.h"
+#include "ubx_timer.h"
+#include "ubx_benchUtil.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// The framework callbacks
+
+static int s_locations = 0;			//!< location_cb calls
+static int s_svStatus = 0;			//!< sv_status_cb calls
+
+static void replayLocation(GpsLocation* /*location*/)	{ s_locations ++; }
+static void replaySvStatus(GpsSvStatus* /*svInfo*/)		{ s_svStatus ++; }
+
+///////////////////////////////////////////////////////////////////////////////
+//! The HAL database, also measuring the latency of the fixes
+class CReplayDatabase : public CMyDatabase
+{
+public:
+	CReplayDatabase()
+	{
+		m_commits = 0;
+		m_fixes = 0;
+		m_readUs = 0;
+		m_epochStartUs = 0;
+		m_latSumUs = 0;
+		m_latMinUs = LLONG_MAX;
+		m_latMaxUs = 0;
+	}
+
+	//! A message of the read captured at timeUs was fed, the first one of an epoch starts the latency
+	void messageFed(long long timeUs)
+	{
+		m_readUs = timeUs;
+		if (!m_epochStartUs)
+			m_epochStartUs = timeUs;
+	}
+
+	virtual STATE_t Commit(bool bClear)
+	{
+		STATE_t state = CMyDatabase::Commit(bClear);
+		m_commits ++;
+		if ((state == STATE_READY) && m_epochStartUs)
+		{
+			// on the capture clock, so the same in real time and at maximum speed
+			long long lat = m_readUs - m_epochStartUs;
+			m_fixes ++;
+			m_latSumUs += lat;
+			if (lat < m_latMinUs) m_latMinUs = lat;
+			if (lat > m_latMaxUs) m_latMaxUs = lat;
+		}
+		m_epochStartUs = 0;
+		return state;
+	}
+
+	int			m_commits;		//!< number of epochs committed
+	int			m_fixes;		//!< number of epochs committed with a fix
+	long long	m_readUs;		//!< capture time of the read being parsed
+	long long	m_epochStartUs;	//!< capture time of the read with the first message of the epoch, 0 if none yet
+	long long	m_latSumUs;		//!< from the read with the first message of an epoch to the read completing it
+	long long	m_latMinUs;
+	long long	m_latMaxUs;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+//! Samples in the bins of a histogram, these have to add up to its number of samples
+static uint32_t histSum(const RXSTATS_HIST_t& hist)
+{
+	uint32_t num = 0;
+	for (int i = 0; i < RXSTATS_HIST_BINS; i ++)
+		num += hist.bin[i];
+	return num;
+}
+
+//! Check both exports of the receive path statistics against what was replayed
+/*! \return true if the exports match the replay
+*/
+static bool checkStats(const char* pText, int reads, long long bytes, int msgUbx, int msgNmea,
+					   int msgUnknown, int commits, int locations, int svStatus)
+{
+	bool ok = true;
+
+	// the text, the totals of the reads and a bounded copy for a small buffer
+	char line[128];
+	snprintf(line, sizeof(line), "\n  reads %d bytes %lld ", reads, bytes);
+	ok = ok && !strncmp(pText, "u-blox receive path", 19) && (strstr(pText, line) != NULL);
+	char small[33];
+	memset(small, 'x', sizeof(small));
+	size_t len = CRxStats::getText(small, sizeof(small) - 1);
+	ok = ok && (len == sizeof(small) - 2) && (small[len] == '\0') && (small[len + 1] == 'x') &&
+		 !strncmp(small, pText, len);
+
+	// the binary export
+	static char binary[sizeof(RXSTATS_t) + 1];
+	ok = ok && (CRxStats::getBinary(binary, sizeof(RXSTATS_t) - 1) == 0);
+	RXSTATS_t s;
+	ok = ok && (CRxStats::getBinary(binary, sizeof(binary)) == sizeof(RXSTATS_t));
+	memcpy(&s, binary, sizeof(s));
+	ok = ok && (s.magic == RXSTATS_MAGIC) && (s.version == RXSTATS_VERSION) && (s.size == sizeof(RXSTATS_t));
+	uint32_t ubx = s.ubxOther;
+	for (int i = 0; i < RXSTATS_UBX_NUM; i ++)
+		ubx += s.ubx[i].num;
+	uint32_t nmea = s.nmeaOther;
+	for (int i = 0; i < RXSTATS_NMEA_NUM; i ++)
+		nmea += s.nmea[i].num;
+	ok = ok && (s.reads == (uint64_t) reads) && (s.bytesRead == (uint64_t) bytes) &&
+		 (s.bytesUbx + s.bytesNmea + s.bytesUnknown <= s.bytesRead) &&
+		 (ubx == (uint32_t) msgUbx) && (nmea == (uint32_t) msgNmea) && (s.msgUnknown == (uint64_t) msgUnknown) &&
+		 (s.commits == (uint64_t) commits);
+	ok = ok && (s.parse.num == (uint32_t) reads) && (s.readToCommit.num == (uint32_t) commits) &&
+		 (s.commitToLoc.num == (uint32_t) locations) && (s.commitToSv.num == (uint32_t) svStatus);
+	ok = ok && (histSum(s.parse) == s.parse.num) && (histSum(s.readToCommit) == s.readToCommit.num) &&
+		 (histSum(s.commitToLoc) == s.commitToLoc.num) && (histSum(s.commitToSv) == s.commitToSv.num) &&
+		 (histSum(s.readToLoc) == s.readToLoc.num);
+	return ok;
+}
+
+int main(int argc, char* argv[])
+{
+	bool realTime = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "r")) != -1)
+	{
+		if (opt == 'r')
+			realTime = true;
+		else
+		{
+			fprintf(stderr, "usage: %s [-r] capture-file\n", argv[0]);
+			return 1;
+		}
+	}
+	if (optind >= argc)
+	{
+		fprintf(stderr, "usage: %s [-r] capture-file\n", argv[0]);
+		return 1;
+	}
+	CGpsIf::getInstance()->m_callbacks.location_cb = replayLocation;
+	CGpsIf::getInstance()->m_callbacks.sv_status_cb = replaySvStatus;
+
+	FILE* pFile = fopen(argv[optind], "rb");
+	if (!pFile)
+	{
+		fprintf(stderr, "cannot open '%s'\n", argv[optind]);
+		return 1;
+	}
+	CAPTURE_HEADER_t header;
+	if ((fread(&header, sizeof(header), 1, pFile) != 1) ||
+		(header.magic != CAPTURE_MAGIC) || (header.version != CAPTURE_VERSION))
+	{
+		fprintf(stderr, "'%s' is not a capture file\n", argv[optind]);
+		fclose(pFile);
+		return 1;
+	}
+
+	// reporting as if the framework started the receiver
+	ControlThreadInfo gpsState;
+	memset(&gpsState, 0, sizeof(gpsState));
+	gpsState.gpsState = GPS_STARTED;
+	CReplayDatabase database;
+	database.setGpsState(&gpsState);
+	database.incPublish();
+	CProtocolUBX  protocolUBX;
+	CProtocolNMEA protocolNmea;
+	CProtocolUnknown protocolUnknown;
+	CParserBuffer parser;				// declare after protocols, so destructor called before protocol destructors
+	parser.Register(&protocolUBX);
+	parser.Register(&protocolNmea);
+	parser.RegisterUnknown(&protocolUnknown);
+
+	unsigned char* pData = NULL;
+	unsigned int dataSize = 0;
+	long long bytes = 0;
+	int reads = 0;
+	int msgUbx = 0, msgNmea = 0, msgUnknown = 0;
+	long long busyUs = 0;				// time spent in the parser and the database
+	long long firstRecUs = 0, lastRecUs = 0;
+	long long startUs = getMonotonicUsCounter();
+	CAPTURE_REC_t rec;
+
+	while (fread(&rec, sizeof(rec), 1, pFile) == 1)
+	{
+		if (rec.size > dataSize)
+		{
+			unsigned char* p = (unsigned char*) realloc(pData, rec.size);
+			if (!p)
+			{
+				fprintf(stderr, "out of memory\n");
+				break;
+			}
+			pData = p;
+			dataSize = rec.size;
+		}
+		if (fread(pData, 1, rec.size, pFile) != rec.size)
+		{
+			fprintf(stderr, "capture truncated after %d reads\n", reads);
+			break;
+		}
+		if (!reads)
+			firstRecUs = rec.timeUs;
+		lastRecUs = rec.timeUs;
+		reads ++;
+
+		// keep the timing of the capture
+		if (realTime)
+		{
+			long long waitUs = (startUs + (rec.timeUs - firstRecUs)) - getMonotonicUsCounter();
+			if (waitUs > 0)
+				usleep((useconds_t) waitUs);
+		}
+
+		// same as the GPS thread does with a read from the serial port
+		long long feedUs = getMonotonicUsCounter();
+		CRxStats::read((int) rec.size);
+		unsigned int done = 0;
+		while (done < rec.size)
+		{
+			unsigned int space = (unsigned int) parser.GetSpace();
+			unsigned int size = rec.size - done;
+			if (size > space)
+				size = space;
+			if (size == 0)
+			{
+				fprintf(stderr, "parser buffer full\n");
+				break;
+			}
+			memcpy(parser.GetPointer(), pData + done, size);
+			parser.Append((int) size);
+			done += size;
+
+			CProtocol* pProtocol;
+			unsigned char* pMsg;
+			int iMsg;
+			while (parser.Parse(pProtocol, pMsg, iMsg))
+			{
+				if (pProtocol == &protocolUBX)
+				{
+					msgUbx ++;
+					CRxStats::message(CRxStats::MSG_UBX, pMsg, iMsg);
+				}
+				else if (pProtocol == &protocolNmea)
+				{
+					msgNmea ++;
+					CRxStats::message(CRxStats::MSG_NMEA, pMsg, iMsg);
+				}
+				else
+				{
+					msgUnknown ++;
+					CRxStats::message(CRxStats::MSG_UNKNOWN, pMsg, iMsg);
+				}
+				database.messageFed(rec.timeUs);
+				pProtocol->Process(pMsg, iMsg, &database);
+				parser.Remove(iMsg);
+			}
+			parser.Compact();
+		}
+		CRxStats::parsed(feedUs);
+		bytes += done;
+		busyUs += getMonotonicUsCounter() - feedUs;
+		if (done < rec.size)
+			break;
+	}
+	long long totalUs = getMonotonicUsCounter() - startUs;
+	free(pData);
+	fclose(pFile);
+
+	double captureS = 1e-6 * (double) (lastRecUs - firstRecUs);
+	double busyS = 1e-6 * (double) busyUs;
+	printf("capture    %d reads, %lld bytes, %.1f s\n", reads, bytes, captureS);
+	printf("replay     %.3f s (%s), %.3f s in parser and database\n",
+			1e-6 * (double) totalUs, realTime ? "real time" : "max speed", busyS);
+	printf("messages   %d ubx, %d nmea, %d unknown\n", msgUbx, msgNmea, msgUnknown);
+	printf("throughput %.2f MB/s, %.0f messages/s\n",
+			(busyS > 0.0) ? 1e-6 * (double) bytes / busyS : 0.0,
+			(busyS > 0.0) ? (double) (msgUbx + msgNmea + msgUnknown) / busyS : 0.0);
+	printf("commits    %d (%d fixes), %.2f/s of capture, %.0f/s of processing\n",
+			database.m_commits, database.m_fixes,
+			(captureS > 0.0) ? (double) database.m_commits / captureS : 0.0,
+			(busyS > 0.0) ? (double) database.m_commits / busyS : 0.0);
+	printf("callbacks  %d location, %d sv status\n", s_locations, s_svStatus);
+	if (database.m_fixes)
+	{
+		printf("latency    min %.3f ms, avg %.3f ms, max %.3f ms (capture time from first message to commit)\n",
+				1e-3 * (double) database.m_latMinUs,
+				1e-3 * (double) database.m_latSumUs / database.m_fixes,
+				1e-3 * (double) database.m_latMaxUs);
+	}
+	// processing latencies, the same statistics the HAL exports
+	char text[8192];
+	size_t textLen = CRxStats::getText(text, sizeof(text));
+	fputs(text, stdout);
+	if ((textLen != strlen(text)) ||
+		!checkStats(text, reads, bytes, msgUbx, msgNmea, msgUnknown, database.m_commits, s_locations, s_svStatus))
+	{
+		printf("FAILED the receive path statistics do not match the replay\n");
+		return 1;
+	}
+	printf("rxstats    text %u bytes, binary %u bytes match the replay\n",
+			(unsigned int) textLen, (unsigned int) sizeof(RXSTATS_t));
+	return 0;
+}
@@ -0,0 +1,258 @@
+/*******************************************************************************
+ *
+ * Copyright (C) u-blox AG
+ * u-blox AG, Thalwil, Switzerland
+ *
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose without fee is hereby granted, provided that this entire notice
+ * is included in all copies of any software which is or includes a copy
+ * or modification of this software and in all copies of the supporting
+ * documentation for such software.
+ *
+ * THIS SOFTWARE IS BEING PROVIDED "AS IS", WITHOUT ANY EXPRESS OR IMPLIED
+ * WARRANTY. IN PARTICULAR, NEITHER THE AUTHOR NOR U-BLOX MAKES ANY
+ * REPRESENTATION OR WARRANTY OF ANY KIND CONCERNING THE MERCHANTABILITY
+ * OF THIS SOFTWARE OR ITS FITNESS FOR ANY PARTICULAR PURPOSE.
+ *
+ *******************************************************************************
+ *
+ * Project: PE_ANS
+ *
+ ******************************************************************************/
+/*!
+  \file
+  \brief  Statistics of the receive path
+*/
+/*******************************************************************************
+ * $Id: ubx_rxStats.cpp $
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "std_types.h"
+#include "ubx_timer.h"
+#include "ubx_rxStats.h"
+
+RXSTATS_t CRxStats::s_stats;		// zero, the header is filled in by getBinary
+int64_t CRxStats::s_readUs = 0;
+int64_t CRxStats::s_commitReadUs = 0;
+int64_t CRxStats::s_commitUs = 0;
+
+//! Add a sample to a histogram
+void CRxStats::add(RXSTATS_HIST_t& hist, int64_t us)
+{
+	if (us < 0)
+		us = 0;
+	int i = 0;
+	while ((i < RXSTATS_HIST_BINS - 1) && (us >= ((int64_t) RXSTATS_HIST_BASE << i)))
+		i ++;
+	hist.bin[i] ++;
+	hist.num ++;
+	hist.sumUs += (uint64_t) us;
+	if ((uint64_t) us > hist.maxUs)
+		hist.maxUs = (us > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t) us;
+}
+
+//! Data was read from the serial port
+void CRxStats::read(int size)
+{
+	if (!s_stats.startMs)
+		s_stats.startMs = getMonotonicMsCounter();
+	s_readUs = getMonotonicUsCounter();
+	s_stats.reads ++;
+	s_stats.bytesRead += (uint64_t) size;
+}
+
+//! All messages of the last read were parsed and processed
+/*!
+  \param startUs : time parsing started
+*/
+void CRxStats::parsed(int64_t startUs)
+{
+	int64_t us = getMonotonicUsCounter() - startUs;
+	s_stats.parseUs += (uint64_t) us;
+	add(s_stats.parse, us);
+}
+
+//! A message was parsed
+/*!
+  \param type : protocol of the message
+  \param pMsg : the message including framing
+  \param size : size of the message
+*/
+void CRxStats::message(MSG_t type, const unsigned char* pMsg, int size)
+{
+	int i;
+	if (type == MSG_UBX)
+	{
+		s_stats.bytesUbx += (uint64_t) size;
+		uint16_t clsId = (uint16_t) ((pMsg[2] << 8) | pMsg[3]);
+		// open addressing on the class and id, the table is never emptied
+		int ix = (pMsg[2] * 7 + pMsg[3]) & (RXSTATS_UBX_NUM - 1);
+		for (i = 0; i < RXSTATS_UBX_NUM; i ++)
+		{
+			RXSTATS_UBX_t& ubx = s_stats.ubx[(ix + i) & (RXSTATS_UBX_NUM - 1)];
+			if ((ubx.clsId == clsId) || (ubx.clsId == 0))
+			{
+				ubx.clsId = clsId;
+				ubx.num ++;
+				ubx.bytes += (uint64_t) size;
+				return;
+			}
+		}
+		s_stats.ubxOther ++;
+	}
+	else if (type == MSG_NMEA)
+	{
+		s_stats.bytesNmea += (uint64_t) size;
+		// "$GPGGA,..." the name runs up to the first comma
+		char name[sizeof(s_stats.nmea[0].name)];
+		memset(name, 0, sizeof(name));
+		for (i = 0; (i < (int) sizeof(name) - 1) && (i + 1 < size) && (pMsg[i + 1] != ','); i ++)
+			name[i] = (char) pMsg[i + 1];
+		for (i = 0; i < RXSTATS_NMEA_NUM; i ++)
+		{
+			RXSTATS_NMEA_t& nmea = s_stats.nmea[i];
+			if (!nmea.name[0])
+				memcpy(nmea.name, name, sizeof(name));
+			if (!memcmp(nmea.name, name, sizeof(name)))
+			{
+				nmea.num ++;
+				nmea.bytes += (uint64_t) size;
+				return;
+			}
+		}
+		s_stats.nmeaOther ++;
+	}
+	else
+	{
+		s_stats.bytesUnknown += (uint64_t) size;
+		s_stats.msgUnknown ++;
+	}
+}
+
+//! An epoch was committed to the database
+void CRxStats::commit(void)
+{
+	s_commitUs = getMonotonicUsCounter();
+	s_commitReadUs = s_readUs;
+	s_stats.commits ++;
+	if (s_commitReadUs)
+		add(s_stats.readToCommit, s_commitUs - s_commitReadUs);
+}
+
+//! The committed epoch is about to be passed to a framework callback
+void CRxStats::callback(CB_t cb)
+{
+	int64_t now = getMonotonicUsCounter();
+	if (cb == CB_LOCATION)
+	{
+		add(s_stats.commitToLoc, now - s_commitUs);
+		if (s_commitReadUs)
+			add(s_stats.readToLoc, now - s_commitReadUs);
+	}
+	else
+		add(s_stats.commitToSv, now - s_commitUs);
+}
+
+//! Append to a text buffer, stops at the end of the buffer
+/*!
+  \param pBuffer : buffer to print to
+  \param size    : size of the buffer, at least 1
+  \param len     : characters in the buffer, updated
+  \param pFmt    : printf format
+*/
+void CRxStats::print(char* pBuffer, size_t size, size_t& len, const char* pFmt, ...)
+{
+	if (len >= size - 1)
+		return;
+	va_list args;
+	va_start(args, pFmt);
+	int n = vsnprintf(pBuffer + len, size - len, pFmt, args);
+	va_end(args);
+	len = ((n < 0) || ((size_t) n >= size - len)) ? size - 1 : len + (size_t) n;
+}
+
+void CRxStats::printHist(char* pBuffer, size_t size, size_t& len, const char* pName, const RXSTATS_HIST_t& hist)
+{
+	print(pBuffer, size, len, "  %-12s num %u avg %llu us max %u us\n    ", pName, hist.num,
+		  hist.num ? (unsigned long long) (hist.sumUs / hist.num) : 0ULL, hist.maxUs);
+	for (int i = 0; i < RXSTATS_HIST_BINS - 1; i ++)
+	{
+		if (hist.bin[i])
+			print(pBuffer, size, len, "<%uus:%u ", (unsigned) RXSTATS_HIST_BASE << i, hist.bin[i]);
+	}
+	if (hist.bin[RXSTATS_HIST_BINS - 1])
+		print(pBuffer, size, len, ">=%uus:%u ", (unsigned) RXSTATS_HIST_BASE << (RXSTATS_HIST_BINS - 2), 
+			  hist.bin[RXSTATS_HIST_BINS - 1]);
+	print(pBuffer, size, len, "\n");
+}
+
+//! Print the statistics in a dumpsys like text format
+/*!
+  \param pBuffer : buffer to print to
+  \param size    : size of the buffer
+  \return number of characters printed, without the terminating zero
+*/
+size_t CRxStats::getText(char* pBuffer, size_t size)
+{
+	if (!pBuffer || (size == 0))
+		return 0;
+	RXSTATS_t s;
+	memcpy(&s, &s_stats, sizeof(s));	// a snapshot, may be off by a message
+	size_t len = 0;
+	pBuffer[0] = '\0';
+	print(pBuffer, size, len, "u-blox receive path (%lld s)\n",
+		  s.startMs ? (long long) ((getMonotonicMsCounter() - s.startMs) / 1000) : 0LL);
+	print(pBuffer, size, len, "  reads %llu bytes %llu ubx %llu nmea %llu unknown %llu in %llu chunks\n",
+		  (unsigned long long) s.reads, (unsigned long long) s.bytesRead,
+		  (unsigned long long) s.bytesUbx, (unsigned long long) s.bytesNmea,
+		  (unsigned long long) s.bytesUnknown, (unsigned long long) s.msgUnknown);
+	print(pBuffer, size, len, "  parse %llu us commits %llu\n",
+		  (unsigned long long) s.parseUs, (unsigned long long) s.commits);
+	printHist(pBuffer, size, len, "parse",		 s.parse);
+	printHist(pBuffer, size, len, "read-commit", s.readToCommit);
+	printHist(pBuffer, size, len, "commit-loc",	 s.commitToLoc);
+	printHist(pBuffer, size, len, "commit-sv",	 s.commitToSv);
+	printHist(pBuffer, size, len, "read-loc",	 s.readToLoc);
+	for (int i = 0; i < RXSTATS_UBX_NUM; i ++)
+	{
+		if (s.ubx[i].clsId)
+			print(pBuffer, size, len, "  ubx %02X-%02X num %u bytes %llu\n", s.ubx[i].clsId >> 8, s.ubx[i].clsId & 0xFF,
+				  s.ubx[i].num, (unsigned long long) s.ubx[i].bytes);
+	}
+	if (s.ubxOther)
+		print(pBuffer, size, len, "  ubx other num %u\n", s.ubxOther);
+	for (int i = 0; i < RXSTATS_NMEA_NUM; i ++)
+	{
+		if (s.nmea[i].name[0])
+			print(pBuffer, size, len, "  nmea %-5.7s num %u bytes %llu\n", s.nmea[i].name,
+				  s.nmea[i].num, (unsigned long long) s.nmea[i].bytes);
+	}
+	if (s.nmeaOther)
+		print(pBuffer, size, len, "  nmea other num %u\n", s.nmeaOther);
+	return len;
+}
+
+//! Copy the statistics as RXSTATS_t
+/*!
+  \param pBuffer : buffer to copy to
+  \param size    : size of the buffer
+  \return number of bytes copied, 0 if the buffer is too small
+*/
+size_t CRxStats::getBinary(char* pBuffer, size_t size)
+{
+	if (!pBuffer || (size < sizeof(RXSTATS_t)))
+		return 0;
+	RXSTATS_t s;
+	memcpy(&s, &s_stats, sizeof(s));	// a snapshot, may be off by a message
+	s.magic = RXSTATS_MAGIC;
+	s.version = RXSTATS_VERSION;
+	s.size = sizeof(RXSTATS_t);
+	memcpy(pBuffer, &s, sizeof(s));
+	return sizeof(s);
+}
@@ -0,0 +1,128 @@
+/*******************************************************************************
+ *
+ * Copyright (C) u-blox AG
+ * u-blox AG, Thalwil, Switzerland
+ *
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose without fee is hereby granted, provided that this entire notice
+ * is included in all copies of any software which is or includes a copy
+ * or modification of this software and in all copies of the supporting
+ * documentation for such software.
+ *
+ * THIS SOFTWARE IS BEING PROVIDED "AS IS", WITHOUT ANY EXPRESS OR IMPLIED
+ * WARRANTY. IN PARTICULAR, NEITHER THE AUTHOR NOR U-BLOX MAKES ANY
+ * REPRESENTATION OR WARRANTY OF ANY KIND CONCERNING THE MERCHANTABILITY
+ * OF THIS SOFTWARE OR ITS FITNESS FOR ANY PARTICULAR PURPOSE.
+ *
+ *******************************************************************************
+ *
+ * Project: PE_ANS
+ *
+ ******************************************************************************/
+/*!
+  \file
+  \brief  Statistics of the receive path
+
+  Counters and latency histograms updated by the GPS thread on every read,
+  message, commit and callback. They are always on and cheap enough for
+  production, CDebugIf exports them.
+*/
+/*******************************************************************************
+ * $Id: ubx_rxStats.h $
+ ******************************************************************************/
+#ifndef __UBX_RXSTATS_H__
+#define __UBX_RXSTATS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RXSTATS_MAGIC		0x53545852	//!< "RXTS"
+#define RXSTATS_VERSION		1
+#define RXSTATS_HIST_BINS	20			//!< Bins of a latency histogram
+#define RXSTATS_HIST_BASE	16			//!< Upper limit of the first bin in us, doubles with each bin
+#define RXSTATS_UBX_NUM		64			//!< Distinct UBX messages counted, the rest goes to ubxOther
+#define RXSTATS_NMEA_NUM	32			//!< Distinct NMEA sentences counted, the rest goes to nmeaOther
+
+typedef struct RXSTATS_HIST_s		//!< Latency histogram
+{
+	uint32_t	num;				//!< Number of samples
+	uint32_t	maxUs;				//!< Largest sample in us
+	uint64_t	sumUs;				//!< Sum of all samples in us
+	uint32_t	bin[RXSTATS_HIST_BINS];	//!< bin i counts samples below RXSTATS_HIST_BASE << i us, the last all others
+} RXSTATS_HIST_t;
+
+typedef struct RXSTATS_UBX_s		//!< Counter of a UBX message
+{
+	uint16_t	clsId;				//!< Class in the high, id in the low byte, 0 if the slot is free
+	uint16_t	reserved;
+	uint32_t	num;				//!< Number of messages
+	uint64_t	bytes;				//!< Number of bytes including framing
+} RXSTATS_UBX_t;
+
+typedef struct RXSTATS_NMEA_s		//!< Counter of a NMEA sentence
+{
+	char		name[8];			//!< Talker and formatter e.g. "GPGGA", empty if the slot is free
+	uint32_t	num;				//!< Number of sentences
+	uint32_t	reserved;
+	uint64_t	bytes;				//!< Number of bytes including framing
+} RXSTATS_NMEA_t;
+
+typedef struct RXSTATS_s			//!< All statistics, also the binary export format
+{
+	uint32_t		magic;			//!< RXSTATS_MAGIC
+	uint32_t		version;		//!< RXSTATS_VERSION
+	uint32_t		size;			//!< sizeof(RXSTATS_t)
+	uint32_t		reserved;
+	int64_t			startMs;		//!< Monotonic time the statistics were started
+	uint64_t		reads;			//!< Reads from the serial port
+	uint64_t		bytesRead;		//!< Bytes read from the serial port
+	uint64_t		bytesUbx;		//!< Bytes parsed as UBX messages
+	uint64_t		bytesNmea;		//!< Bytes parsed as NMEA sentences
+	uint64_t		bytesUnknown;	//!< Bytes that did not belong to any message
+	uint64_t		msgUnknown;		//!< Chunks of unknown bytes
+	uint64_t		parseUs;		//!< Time spent parsing and processing messages in us
+	uint64_t		commits;		//!< Epochs committed
+	uint32_t		ubxOther;		//!< UBX messages not fitting into ubx
+	uint32_t		nmeaOther;		//!< NMEA sentences not fitting into nmea
+	RXSTATS_HIST_t	parse;			//!< Parse and process time of a read
+	RXSTATS_HIST_t	readToCommit;	//!< From the read completing an epoch to its commit
+	RXSTATS_HIST_t	commitToLoc;	//!< From the commit to location_cb
+	RXSTATS_HIST_t	commitToSv;		//!< From the commit to sv_status_cb
+	RXSTATS_HIST_t	readToLoc;		//!< From the read completing an epoch to location_cb
+	RXSTATS_UBX_t	ubx[RXSTATS_UBX_NUM];
+	RXSTATS_NMEA_t	nmea[RXSTATS_NMEA_NUM];
+} RXSTATS_t;
+
+///////////////////////////////////////////////////////////////////////////////
+
+class CRxStats
+{
+public:
+	typedef enum { MSG_UBX, MSG_NMEA, MSG_UNKNOWN } MSG_t;
+	typedef enum { CB_LOCATION, CB_SV_STATUS } CB_t;
+
+	// recording, only called from the GPS thread
+	static void read(int size);
+	static void parsed(int64_t startUs);
+	static void message(MSG_t type, const unsigned char* pMsg, int size);
+	static void commit(void);
+	static void callback(CB_t cb);
+
+	// export
+	static size_t getText(char* pBuffer, size_t size);
+	static size_t getBinary(char* pBuffer, size_t size);
+
+private:
+	static void add(RXSTATS_HIST_t& hist, int64_t us);
+	static void print(char* pBuffer, size_t size, size_t& len, const char* pFmt, ...);
+	static void printHist(char* pBuffer, size_t size, size_t& len, const char* pName, const RXSTATS_HIST_t& hist);
+
+	static RXSTATS_t s_stats;
+	static int64_t s_readUs;		//!< time of the last read
+	static int64_t s_commitReadUs;	//!< time of the read that completed the committed epoch
+	static int64_t s_commitUs;		//!< time of the last commit
+};
+
+#endif /* __UBX_RXSTATS_H__ */
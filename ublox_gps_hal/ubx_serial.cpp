@@ -36,6 +36,8 @@
 #include <errno.h>
 #include <string.h>
 #include <fcntl.h>
+#include <sys/epoll.h>
+#include <time.h>
 
 #if defined (ANDROID_BUILD)
 #include <termios.h>
@@ -202,9 +204,36 @@ bool CSerialPort::openSerial(const char * pTty, int ttybaud, int blocksize)
 #endif
 	}
 	LOGV("Serial port opened, fd = %d", m_fd);
+	pollAdd();
     return true;
 }
 
+void CSerialPort::pollAdd(void) const
+{
+	if ((m_fd <= 0) || (m_pollFd < 0))
+		return;
+	// closeSerial removes the descriptor from the epoll set, the kernel
+	// would only drop it once no duplicate of it is left open
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = m_fd;
+	if ((epoll_ctl(m_pollFd, EPOLL_CTL_ADD, m_fd, &ev) < 0) && (errno != EEXIST))
+	{
+		LOGE("Cannot poll serial port fd %d (%i)", m_fd, errno);
+	}
+}
+
+void CSerialPort::pollDel(void) const
+{
+	if ((m_fd <= 0) || (m_pollFd < 0))
+		return;
+	if (epoll_ctl(m_pollFd, EPOLL_CTL_DEL, m_fd, NULL) < 0)
+	{
+		LOGE("Cannot stop polling serial port fd %d (%i)", m_fd, errno);
+	}
+}
+
 int CSerialPort::changeBaudrate(char * pTty, int * pBaudrate, const unsigned char * pBuf, int length)
 {
     unsigned long newbaudrate = 0;
@@ -326,3 +355,148 @@ const int CSerialPort::s_baudrateTable[BAUDRATE_TABLE_SIZE] =
     230400,
 };
 
+// writes all buffers, continuing interrupted or partial writes. on a uart
+// the tty layer paces the data out at the configured baud rate, the list is
+// passed to writev as it is, IOV_MAX buffers at a time, and only the rest of
+// a partially written buffer is written on its own. i2c-dev has no writev,
+// the kernel would issue every buffer as a transaction of its own, so there
+// each transfer is copied behind the stream register address into one buffer
+// and written at once. returns the bytes written, -1 if none
+int CSerialPort::writevSerial(const struct iovec *pIov, int iovNum)
+{
+	int total = 0;
+	int ix = 0;			// first buffer not completely written
+	size_t off = 0;		// bytes written of it
+
+	if (m_fd <= 0)
+		return -1;
+	if (m_i2c && !m_pI2cBuf)
+	{
+		m_pI2cBuf = (unsigned char*) malloc(I2C_MAX_WRITE);
+		if (!m_pI2cBuf)
+			return -1;
+		m_pI2cBuf[0] = 0xFF; // allways address the stream register
+	}
+
+	for (;;)
+	{
+		// skip what is written
+		while ((ix < iovNum) && (off == pIov[ix].iov_len))
+		{
+			ix++;
+			off = 0;
+		}
+		if (ix == iovNum)
+			break;
+
+		ssize_t res;
+		if (m_i2c)
+		{
+			// gather the next transfer
+			size_t size = 0;
+			int j = ix;
+			size_t o = off;
+			while ((j < iovNum) && (size < I2C_MAX_WRITE - 1))
+			{
+				size_t len = pIov[j].iov_len - o;
+				if (len > I2C_MAX_WRITE - 1 - size)
+					len = I2C_MAX_WRITE - 1 - size;
+				memcpy(m_pI2cBuf + 1 + size, (char *) pIov[j].iov_base + o, len);
+				size += len;
+				o += len;
+				if (o == pIov[j].iov_len)
+				{
+					j++;
+					o = 0;
+				}
+			}
+			res = write(m_fd, m_pI2cBuf, size + 1);
+		}
+		else if (off)
+			res = write(m_fd, (char *) pIov[ix].iov_base + off, pIov[ix].iov_len - off);
+		else
+			res = writev(m_fd, pIov + ix, ((iovNum - ix) < IOV_MAX) ? (iovNum - ix) : IOV_MAX);
+		if ((res < 0) && (errno == EINTR))
+			continue;
+		if (m_i2c && (res > 0))
+			res--;			// stream register address
+		if (res <= 0)
+			return (total > 0) ? total : -1;
+
+		// advance behind what is written
+		total += (int) res;
+		while (res > 0)
+		{
+			size_t len = pIov[ix].iov_len - off;
+			if ((size_t) res >= len)
+			{
+				res -= (ssize_t) len;
+				ix++;
+				off = 0;
+			}
+			else
+			{
+				off += (size_t) res;
+				res = 0;
+			}
+		}
+	}
+	return total;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Record all data received from now on
+/*! Every read is appended to the file with the time it was received, 
+	see CAPTURE_REC_t. The ubx_replay tool feeds such a file back through 
+	the parser and the database.
+  \param pFile	: file to write, truncated if it exists
+  \return true if the file could be created
+*/
+bool CSerialPort::openCapture(const char* pFile)
+{
+	closeCapture();
+	int fd = open(pFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		LOGE("%s: Could not create capture file '%s' (%i)", __FUNCTION__, pFile, errno);
+		return false;
+	}
+	CAPTURE_HEADER_t header = { CAPTURE_MAGIC, CAPTURE_VERSION };
+	if (write(fd, &header, sizeof(header)) != (ssize_t) sizeof(header))
+	{
+		LOGE("%s: Could not write capture file '%s' (%i)", __FUNCTION__, pFile, errno);
+		close(fd);
+		return false;
+	}
+	LOGV("%s: Capturing received data to '%s'", __FUNCTION__, pFile);
+	m_captureFd = fd;
+	return true;
+}
+
+void CSerialPort::closeCapture(void)
+{
+	if (m_captureFd >= 0)
+		close(m_captureFd);
+	m_captureFd = -1;
+}
+
+void CSerialPort::capture(const void *pBuffer, int size)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	CAPTURE_REC_t rec;
+	rec.timeUs = (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	rec.size = (unsigned int) size;
+	rec.reserved = 0;
+	struct iovec iov[2];
+	iov[0].iov_base = &rec;
+	iov[0].iov_len = sizeof(rec);
+	iov[1].iov_base = (void *) pBuffer;
+	iov[1].iov_len = (size_t) size;
+	if (writev(m_captureFd, iov, 2) != (ssize_t) (sizeof(rec) + (size_t) size))
+	{
+		// a short record would corrupt the rest of the file
+		LOGE("%s: Could not write capture file (%i), capture stopped", __FUNCTION__, errno);
+		closeCapture();
+	}
+}
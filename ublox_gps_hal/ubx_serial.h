@@ -37,8 +37,31 @@
 #include <fcntl.h>
 #include <malloc.h>
 #include <string.h>
+#include <sys/uio.h>
+#include <limits.h>
 
 #define BAUDRATE_TABLE_SIZE 7
+#ifndef IOV_MAX
+#define IOV_MAX				1024	//!< Max number of buffers passed to a single writev, UIO_MAXIOV of the kernel
+#endif
+#define I2C_MAX_WRITE		8192	//!< Max size of a single write to the i2c-dev driver
+
+// Capture file of the received data, replayed by ubx_replay
+#define CAPTURE_MAGIC		0x50414355	//!< "UCAP"
+#define CAPTURE_VERSION		1
+
+typedef struct CAPTURE_HEADER_s		//!< Start of a capture file
+{
+	unsigned int magic;				//!< CAPTURE_MAGIC
+	unsigned int version;			//!< CAPTURE_VERSION
+} CAPTURE_HEADER_t;
+
+typedef struct CAPTURE_REC_s		//!< Record header, followed by the data of one read
+{
+	long long timeUs;				//!< Monotonic time of the read in us
+	unsigned int size;				//!< Number of bytes read
+	unsigned int reserved;
+} CAPTURE_REC_t;
 
 class CSerialPort
 {
@@ -47,8 +70,11 @@ public:
     {
         m_fd = -1;
 		m_i2c = false;
+		m_pollFd = -1;
+		m_captureFd = -1;
+		m_pI2cBuf = NULL;
     };
-    ~CSerialPort(){};
+    ~CSerialPort(){ closeCapture(); free(m_pI2cBuf); };
 
     bool openSerial(const char * pTty, int ttybaud, int blocksize);
 
@@ -66,37 +92,39 @@ public:
     void closeSerial()
     {
         if (m_fd > 0)
+        {
+            pollDel();
             close(m_fd);
+        }
 		m_fd = -1;
 		m_i2c = false; 
     };
 
-    bool fdSet(fd_set &rfds, int &rMaxFd) const
+    //! Register the port with an epoll instance, also every time it is reopened
+    void setPollFd(int pollFd)
     {
-        if (m_fd <= 0)
-            return false;
-        if ((m_fd + 1) > rMaxFd)
-            rMaxFd = m_fd + 1;
-        FD_SET(m_fd, &rfds);
-        return true;
-//lint -e{1764} suppress "could be declared const ref"
+        m_pollFd = pollFd;
+        pollAdd();
     };
 
-    bool fdIsSet(fd_set &rfds) const 
+    bool isFd(int fd) const 
     {
-        if ((m_fd > 0)  && FD_ISSET(m_fd, &rfds))
-            return true;
-        return false;
-//lint -e{1764} suppress "could be declared const ref"
+        return (m_fd > 0) && (m_fd == fd);
     };
 
     int readSerial(void *pBuffer, unsigned int size)
     {
         if (m_fd <= 0)
             return -1;
-        return read(m_fd, pBuffer, size);
+        int res = read(m_fd, pBuffer, size);
+        if ((res > 0) && (m_captureFd >= 0))
+            capture(pBuffer, res);
+        return res;
     };
 
+    bool openCapture(const char* pFile);
+    void closeCapture(void);
+
     int writeSerial(const void *pBuffer, unsigned int size)
     {
 		unsigned char* p;
@@ -118,6 +146,8 @@ public:
 		return (int) size;
 	};
 
+    int writevSerial(const struct iovec *pIov, int iovNum);
+
 	bool isFdOpen(void) const 
 	{
 		return m_fd > 0;
@@ -126,8 +156,14 @@ public:
 private:
     int m_fd;
 	bool m_i2c;
+    int m_pollFd;	//!< epoll instance the port is registered with, -1 if none
+    int m_captureFd;	//!< file recording all received data, -1 if none
+    unsigned char* m_pI2cBuf;	//!< stream register address and data of an i2c transfer, NULL until needed
 
     int settermios(int ttybaud, int blocksize);
+    void capture(const void *pBuffer, int size);
+    void pollAdd(void) const;
+    void pollDel(void) const;
 
     static const int s_baudrateTable[BAUDRATE_TABLE_SIZE];
 
@@ -0,0 +1,886 @@
+/*******************************************************************************
+ *
+ * Copyright (C) u-blox AG
+ * u-blox AG, Thalwil, Switzerland
+ *
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose without fee is hereby granted, provided that this entire notice
+ * is included in all copies of any software which is or includes a copy
+ * or modification of this software and in all copies of the supporting
+ * documentation for such software.
+ *
+ * THIS SOFTWARE IS BEING PROVIDED "AS IS", WITHOUT ANY EXPRESS OR IMPLIED
+ * WARRANTY. IN PARTICULAR, NEITHER THE AUTHOR NOR U-BLOX MAKES ANY
+ * REPRESENTATION OR WARRANTY OF ANY KIND CONCERNING THE MERCHANTABILITY
+ * OF THIS SOFTWARE OR ITS FITNESS FOR ANY PARTICULAR PURPOSE.
+ *
+ *******************************************************************************
+ *
+ * Project: PE_ANS
+ *
+ ******************************************************************************/
+/*!
+  \file
+  \brief  Stress test of the Supl sessions against a stand-in SLP
+
+  Runs the Supl state machines with the RIL, NI and AGPS interfaces of the
+  HAL from a main loop like the one of gps_thread.cpp, against an SLP on the
+  loopback interface. The SLP answers SUPL START with SUPL RESPONSE, and
+  SUPL POS INIT with a SUPL POS carrying RRLP assistance data followed by
+  SUPL END, over TLS with a certificate made up at start. Set initiated
+  sessions keep the handler pool busy while a second thread, in place of
+  the RIL, delivers bursts of SUPL INITs. Every session has to end with its
+  assistance data delivered and no session may be left at the end. The
+  ephemerides of all satellites of the navigation model have to reach the
+  receiver in one sendEphs, the time from the start of the read of the
+  SUPL POS to it is printed as the time to inject. The SLP
+  checks the hash in the SUPL POS INIT of each network initiated session,
+  the server is switched between 127.0.0.1 and localhost so the HMAC key
+  changes. The session rate, the time spent in the Supl calls of the main
+  loop and the time to deliver a SUPL INIT, accepted right after a change
+  of the server, accepted with the same key or rejected, are printed. So
+  are the TLS handshakes the SLP saw, full or resumed, the sessions run on
+  connections kept open with SUPL_KEEP_ALIVE and the average time from the
+  start of a set initiated session to its SUPL START arriving at the SLP.
+  Meanwhile a third thread sends a byte sequence at the baud rate of the
+  receiver into a pipe with the room of a UART buffer, read by the main
+  loop. The SLP can be made slow to handshake, no byte may be lost. The
+  SLP writes its messages whole, several at once, a byte at a time or in
+  pieces of random size, the SET has to put them together again.
+
+  usage: ubx_suplBench [-n sessions] [-c concurrent] [-b burst] [-s bursts]
+                       [-k seconds] [-t] [-d ms] [-r baud] [-f pattern]
+    -n  set initiated sessions run, default 500
+    -c  set initiated sessions run at the same time, default 4
+    -b  SUPL INITs in a burst, one burst every 50 ms, default 20
+    -s  bursts between changes of the server, default 4, 0 for no changes
+    -k  SUPL_KEEP_ALIVE, default 0
+    -t  plain TCP instead of TLS
+    -d  SLP delay before the TLS handshake or the first read, default 0
+    -r  baud rate of the receiver, default 115200
+    -f  whole (a write for each message), coalesced (the answer to a
+        message in one write), bytes or random (1 to 1000 bytes a write),
+        default coalesced
+*/
+/*******************************************************************************
+ * $Id: ubx_suplBench.cpp $
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <openssl/hmac.h>
+
+#include "std_types.h"
+#include "ubx_moduleIf.h"
+#include "ubx_localDb.h"
+#include "ubx_timer.h"
+#include "ubx_agpsIf.h"
+#include "ubx_rilIf.h"
+#include "ubx_niIf.h"
+#include "ubxgpsstate.h"
+#include "gps_thread.h"
+#include "ubx_benchUtil.h"
+#include "suplSMmanager.h"
+#include "upldecod.h"
+#include "uplsend.h"
+#include "ULP-PDU.h"
+#include "PDU.h"
+#include "per_encoder.h"
+
+#define MAX_PDU			5000	//!< Largest ULP message, as MAX_UPL_PACKET
+#define MAX_EVENTS		16		//!< Events taken from epoll at once
+#define BURST_INTERVAL	50000	//!< Time between the bursts of SUPL INITs in us
+#define NAV_MODEL_SATS	12		//!< Satellites in the navigation model of the assistance data
+#define HASH_SLOTS		4096	//!< SUPL INITs remembered for checking the hash
+#define HASH_SIZE		8		//!< Bytes of the HMAC in ver
+#define RX_BUFFER		4096	//!< Bytes the UART buffers, the smallest pipe
+#define RX_CHUNK		1024	//!< Bytes read from the receiver at once
+#define RANDOM_PIECE	1000	//!< Largest piece written by the SLP in random mode
+
+//! How the SLP cuts its messages into writes
+typedef enum { FRAG_WHOLE, FRAG_COALESCED, FRAG_BYTES, FRAG_RANDOM } FRAG_t;
+
+///////////////////////////////////////////////////////////////////////////////
+// The receiver, replaces ubxgpsstate.cpp
+
+pthread_t g_gpsDrvMainThread = 0;
+
+static int s_ephs = 0;				//!< sendEphs calls, one for each session given assistance data
+static int s_ephsBad = 0;			//!< sendEphs calls without all satellites of the navigation model in order
+static long long s_readUs = 0;		//!< Time the read of the Supl socket being handled started
+static long long s_injectSumUs = 0;	//!< Sum of the times from the read to sendEphs
+static long long s_injectMaxUs = 0;	//!< Longest time from the read to sendEphs
+static int s_niStarts = 0;			//!< requestStart_cb calls, NI sessions accepted
+static int s_niStops = 0;			//!< requestStop_cb calls, NI sessions ended
+
+static int s_keepAlive = 0;			//!< SUPL_KEEP_ALIVE
+
+CUbxGpsState::CUbxGpsState()
+{
+	m_almanacRequest = 1;
+	m_utcModelRequest = 1;
+	m_ionosphericModelRequest = 1;
+	m_dgpsCorrectionsRequest = 0;
+	m_refLocRequest = 1;
+	m_refTimeRequest = 1;
+	m_acquisitionAssistRequest = 0;
+	m_realTimeIntegrityRequest = 0;
+	m_navigationModelRequest = 1;
+	m_fakePhone = 1;
+	m_niUiTimeout = 120;
+	m_niResponseTimeout = 75;
+	m_logSuplMessages = false;
+	m_cmccLogActive = false;
+	m_suplMsgToFile = false;
+	m_suplKeepAlive = s_keepAlive;
+}
+
+CUbxGpsState::~CUbxGpsState()
+{
+}
+
+CUbxGpsState* CUbxGpsState::getInstance()
+{
+	static CUbxGpsState s_ubxGpsState;		// made on first use, after the options are read
+	return &s_ubxGpsState;
+}
+
+void CUbxGpsState::lock(void)												{ }
+void CUbxGpsState::unlock(void)												{ }
+void CUbxGpsState::sendAidingData(const GPS_UBX_AID_INI_U5__t* /*pAidingData*/)	{ }
+void CUbxGpsState::sendUtcModel(const GPS_UBX_AID_HUI_t* /*pUtcModel*/)		{ }
+void CUbxGpsState::sendEphs(const void* pData, int size, int num)
+{
+	long long us = getMonotonicUsCounter() - s_readUs;
+	s_ephs ++;
+	s_injectSumUs += us;
+	if (us > s_injectMaxUs)
+		s_injectMaxUs = us;
+	// one AID-EPH payload per satellite, starting with the satellite number
+	bool ok = (num == NAV_MODEL_SATS);
+	for (int i = 0; ok && (i < num); i ++)
+		ok = (*(const U4*) ((const char*) pData + i * size) == (U4) (i + 1));
+	if (!ok)
+		s_ephsBad ++;
+}
+
+static void niStart(void* /*pContext*/)	{ s_niStarts ++; }
+static void niStop(void* /*pContext*/)	{ s_niStops ++; }
+
+static GpsControlEventInterface s_events = { niStart, niStop };
+
+//! The user accepts every NI session at once
+static void niNotify(GpsNiNotification* pNotification)
+{
+	((const GpsNiInterface*) CNiIf::getIf())->respond(pNotification->notification_id, GPS_NI_RESPONSE_ACCEPT);
+}
+
+static void rilRequest(uint32_t /*flags*/)	{ }
+
+///////////////////////////////////////////////////////////////////////////////
+// Messages
+
+static volatile int s_slpSessionId = 0;		//!< Last SLP session ID given out
+
+//! A new SLP session ID
+static SlpSessionID_t* allocSlpId(int& id)
+{
+	id = __sync_add_and_fetch(&s_slpSessionId, 1);
+	char sessionId[4] = { (char) (id >> 24), (char) (id >> 16), (char) (id >> 8), (char) id };
+	SlpSessionID_t* pSlpId = (SlpSessionID_t*) calloc(1, sizeof(SlpSessionID_t));
+	OCTET_STRING_fromBuf(&pSlpId->sessionID, sessionId, 4);
+	pSlpId->slpId.present = SLPAddress_PR_iPAddress;
+	pSlpId->slpId.choice.iPAddress.present = IPAddress_PR_ipv4Address;
+	OCTET_STRING_fromBuf(&pSlpId->slpId.choice.iPAddress.choice.ipv4Address, "\x7F\x00\x00\x01", 4);
+	return pSlpId;
+}
+
+//! The number in an SLP session ID made by allocSlpId
+static int slpIdNumber(const SlpSessionID_t* pSlpId)
+{
+	const uint8_t* p = pSlpId->sessionID.buf;
+	return (pSlpId->sessionID.size == 4) ? (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3] : -1;
+}
+
+//! Encode a ULP message from the SLP and free it, the length in front as sendAndFree writes it
+static void* encodeUlp(ULP_PDU_t* pUlp, int& size)
+{
+	void* pData = NULL;
+	pUlp->version.maj = 1;
+	ssize_t res = uper_encode_to_new_buffer(&asn_DEF_ULP_PDU, NULL, pUlp, &pData);
+	if (res > 0)
+	{
+		free(pData);
+		pData = NULL;
+		pUlp->length = (long) res;
+		res = uper_encode_to_new_buffer(&asn_DEF_ULP_PDU, NULL, pUlp, &pData);
+	}
+	ASN_STRUCT_FREE(asn_DEF_ULP_PDU, pUlp);
+	size = (int) res;
+	return (res > 0) ? pData : NULL;
+}
+
+//! A SUPL INIT as the SLP sends it to start a MS based session
+static void* encodeSuplInit(int& size, int& id)
+{
+	ULP_PDU_t* pUlp = (ULP_PDU_t*) calloc(1, sizeof(ULP_PDU_t));
+	pUlp->sessionID.slpSessionID = allocSlpId(id);
+	pUlp->message.present = UlpMessage_PR_msSUPLINIT;
+	pUlp->message.choice.msSUPLINIT.posMethod = PosMethod_agpsSETbased;
+	pUlp->message.choice.msSUPLINIT.sLPMode = SLPMode_proxy;
+	return encodeUlp(pUlp, size);
+}
+
+//! The RRLP assistance data the SLP sends, reference time and a navigation model
+static void* encodeRrlp(int& size)
+{
+	PDU_t* pPdu = (PDU_t*) calloc(1, sizeof(PDU_t));
+	pPdu->referenceNumber = 1;
+	pPdu->component.present = RRLP_Component_PR_assistanceData;
+	GPS_AssistData_t* pGps = (GPS_AssistData_t*) calloc(1, sizeof(GPS_AssistData_t));
+	pPdu->component.choice.assistanceData.gps_AssistData = pGps;
+	ControlHeader_t& hdr = pGps->controlHeader;
+	hdr.referenceTime = (ReferenceTime_t*) calloc(1, sizeof(ReferenceTime_t));
+	hdr.referenceTime->gpsTime.gpsTOW23b = 3600000;
+	hdr.referenceTime->gpsTime.gpsWeek = 700;
+	hdr.navigationModel = (NavigationModel_t*) calloc(1, sizeof(NavigationModel_t));
+	for (int sv = 0; sv < NAV_MODEL_SATS; sv ++)
+	{
+		NavModelElement_t* pNav = (NavModelElement_t*) calloc(1, sizeof(NavModelElement_t));
+		pNav->satelliteID = sv;
+		pNav->satStatus.present = SatStatus_PR_newSatelliteAndModelUC;
+		ASN_SEQUENCE_ADD(&hdr.navigationModel->navModelList.list, pNav);
+	}
+	void* pData = NULL;
+	size = (int) uper_encode_to_new_buffer(&asn_DEF_PDU, NULL, pPdu, &pData);
+	ASN_STRUCT_FREE(asn_DEF_PDU, pPdu);
+	return (size > 0) ? pData : NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The stand-in SLP, a thread for each connection
+
+static SSL_CTX* s_pSlpCtx = NULL;			//!< TLS context of the SLP, NULL for plain TCP
+static void* s_pRrlp = NULL;				//!< RRLP payload of the SUPL POS
+static int s_rrlpSize = 0;					//!< Size of s_pRrlp
+static pthread_mutex_t s_slpMutex = PTHREAD_MUTEX_INITIALIZER;	//!< Protects the counters below
+static pthread_cond_t s_slpDone = PTHREAD_COND_INITIALIZER;		//!< Signalled when a connection closes
+static int s_slpOpen = 0;					//!< Connections open
+static int s_slpConnections = 0;			//!< Connections accepted
+static int s_slpSessions = 0;				//!< SUPL POS INITs answered
+static int s_slpErrors = 0;					//!< Handshakes failed and messages not decoded
+static int s_slpDelay = 0;					//!< Delay before the TLS handshake or the first read in ms
+static FRAG_t s_frag = FRAG_COALESCED;		//!< How the SLP cuts its messages into writes
+static int s_slpWrites = 0;					//!< Writes of the SLP
+static long long s_slpBytes = 0;			//!< Bytes written by the SLP
+static int s_slpVerified = 0;				//!< SUPL POS INITs with the expected hash
+static int s_slpWrongHash = 0;				//!< SUPL POS INITs with another hash
+static int s_slpHandshakes = 0;				//!< TLS handshakes done
+static int s_slpResumed = 0;				//!< TLS handshakes resuming a session
+static int s_slpStarts = 0;					//!< SUPL STARTs received
+static long long s_slpStartSumUs = 0;		//!< Sum of the times the SUPL STARTs arrived
+static unsigned char s_initHash[HASH_SLOTS][HASH_SIZE];	//!< Hash of each SUPL INIT, by SLP session ID
+
+//! TLS context of the SLP with a key and a self-signed certificate made up for the run
+static SSL_CTX* slpSslContext(void)
+{
+	SSL_CTX* pCtx = SSL_CTX_new(SSLv23_server_method());
+	EVP_PKEY_CTX* pKeyCtx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+	EVP_PKEY* pKey = NULL;
+	X509* pCert = X509_new();
+	bool ok = (pCtx != NULL) && (pKeyCtx != NULL) && (pCert != NULL) &&
+			  (EVP_PKEY_keygen_init(pKeyCtx) > 0) &&
+			  (EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pKeyCtx, NID_X9_62_prime256v1) > 0) &&
+			  (EVP_PKEY_keygen(pKeyCtx, &pKey) > 0);
+	if (ok)
+	{
+		X509_set_version(pCert, 2);
+		ASN1_INTEGER_set(X509_get_serialNumber(pCert), 1);
+		X509_gmtime_adj(X509_get_notBefore(pCert), 0);
+		X509_gmtime_adj(X509_get_notAfter(pCert), 24 * 3600);
+		X509_set_pubkey(pCert, pKey);
+		X509_NAME* pName = X509_get_subject_name(pCert);
+		X509_NAME_add_entry_by_txt(pName, "CN", MBSTRING_ASC, (const unsigned char*) "localhost", -1, -1, 0);
+		X509_set_issuer_name(pCert, pName);
+		ok = (X509_sign(pCert, pKey, EVP_sha256()) > 0) &&
+			 (SSL_CTX_use_certificate(pCtx, pCert) > 0) &&
+			 (SSL_CTX_use_PrivateKey(pCtx, pKey) > 0);
+	}
+	X509_free(pCert);
+	EVP_PKEY_free(pKey);
+	EVP_PKEY_CTX_free(pKeyCtx);
+	if (!ok && pCtx)
+	{
+		SSL_CTX_free(pCtx);
+		pCtx = NULL;
+	}
+	return pCtx;
+}
+
+static void slpError(void)
+{
+	pthread_mutex_lock(&s_slpMutex);
+	s_slpErrors ++;
+	pthread_mutex_unlock(&s_slpMutex);
+}
+
+//! Read exactly size bytes from the SET, false when the connection is closed
+static bool slpRead(SSL* pSsl, int sock, void* pData, int size)
+{
+	char* p = (char*) pData;
+	while (size > 0)
+	{
+		int n = pSsl ? SSL_read(pSsl, p, size) : (int) recv(sock, p, (size_t) size, 0);
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+static bool slpWrite(SSL* pSsl, int sock, const void* pData, int size)
+{
+	const char* p = (const char*) pData;
+	while (size > 0)
+	{
+		int n = pSsl ? SSL_write(pSsl, p, size) : (int) send(sock, p, (size_t) size, MSG_NOSIGNAL);
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+//! Send the answer to a message in pieces as selected with s_frag
+static bool slpSend(SSL* pSsl, int sock, const unsigned char* pData, int size, unsigned int& seed)
+{
+	int writes = 0;
+	for (int pos = 0; pos < size; writes ++)
+	{
+		int num = size - pos;
+		if (s_frag == FRAG_WHOLE)
+			num = (pData[pos] << 8) | pData[pos + 1];	// the length in front of each message
+		else if (s_frag == FRAG_BYTES)
+			num = 1;
+		else if (s_frag == FRAG_RANDOM)
+			num = 1 + (int) (rand_r(&seed) % RANDOM_PIECE);
+		if ((num <= 0) || (num > size - pos))
+			num = size - pos;
+		if (!slpWrite(pSsl, sock, pData + pos, num))
+			return false;
+		pos += num;
+	}
+	pthread_mutex_lock(&s_slpMutex);
+	s_slpWrites += writes;
+	s_slpBytes += size;
+	pthread_mutex_unlock(&s_slpMutex);
+	return true;
+}
+
+//! Answer a message of the SET, the answer is collected in pOut
+static void slpAnswer(const ULP_PDU_t* pMsg, BIO* pOut)
+{
+	if (pMsg->message.present == UlpMessage_PR_msSUPLSTART)
+	{
+		long long arrivedUs = getMonotonicUsCounter();
+		pthread_mutex_lock(&s_slpMutex);
+		s_slpStarts ++;
+		s_slpStartSumUs += arrivedUs;
+		pthread_mutex_unlock(&s_slpMutex);
+		// SET initiated, the SLP chooses MS based
+		ULP_PDU_t* pUlp = (ULP_PDU_t*) calloc(1, sizeof(ULP_PDU_t));
+		pUlp->sessionID.setSessionID = copySetId(pMsg->sessionID.setSessionID);
+		int id;
+		pUlp->sessionID.slpSessionID = allocSlpId(id);
+		pUlp->message.present = UlpMessage_PR_msSUPLRESPONSE;
+		pUlp->message.choice.msSUPLRESPONSE.posMethod = PosMethod_agpsSETbased;
+		int size;
+		void* pData = encodeUlp(pUlp, size);
+		if (pData == NULL)
+		{
+			slpError();
+			return;
+		}
+		BIO_write(pOut, pData, size);
+		free(pData);
+	}
+	else if (pMsg->message.present == UlpMessage_PR_msSUPLPOSINIT)
+	{
+		// the first 64 bits of the HMAC of the SUPL INIT in a network initiated session
+		const Ver_t* pVer = pMsg->message.choice.msSUPLPOSINIT.ver;
+		if (pVer)
+		{
+			int id = slpIdNumber(pMsg->sessionID.slpSessionID);
+			bool ok = (id >= 0) && (pVer->size == HASH_SIZE) &&
+					  !memcmp(pVer->buf, s_initHash[id % HASH_SLOTS], HASH_SIZE);
+			pthread_mutex_lock(&s_slpMutex);
+			if (ok)
+				s_slpVerified ++;
+			else
+				s_slpWrongHash ++;
+			pthread_mutex_unlock(&s_slpMutex);
+		}
+		// the assistance data, then the end of the session
+		suplPosParam_t pos;
+		memset(&pos, 0, sizeof(pos));
+		pos.pSetId = pMsg->sessionID.setSessionID;
+		pos.pSlpId = pMsg->sessionID.slpSessionID;
+		pos.buffer = (char*) s_pRrlp;
+		pos.size = s_rrlpSize;
+		sendSuplPos(pOut, &pos);
+		suplEndParam_t end;
+		memset(&end, 0, sizeof(end));
+		end.pSetId = pMsg->sessionID.setSessionID;
+		end.pSlpId = pMsg->sessionID.slpSessionID;
+		sendSuplEnd(pOut, &end);
+		pthread_mutex_lock(&s_slpMutex);
+		s_slpSessions ++;
+		pthread_mutex_unlock(&s_slpMutex);
+	}
+	// the SUPL POS acknowledging the assistance data and SUPL END need no answer
+}
+
+//! Serve a connection until the SET closes it
+static void* slpConnection(void* pArg)
+{
+	int sock = (int) (long) pArg;
+	unsigned int seed = (unsigned int) sock;
+	if ((s_frag == FRAG_BYTES) || (s_frag == FRAG_RANDOM))
+	{
+		// the pieces go on the line as written
+		int on = 1;
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	}
+	if (s_slpDelay)
+		usleep(s_slpDelay * 1000);
+	SSL* pSsl = s_pSlpCtx ? SSL_new(s_pSlpCtx) : NULL;
+	bool ok = (s_pSlpCtx == NULL);
+	if (pSsl && SSL_set_fd(pSsl, sock) && (SSL_accept(pSsl) > 0))
+	{
+		pthread_mutex_lock(&s_slpMutex);
+		s_slpHandshakes ++;
+		if (SSL_session_reused(pSsl))
+			s_slpResumed ++;
+		pthread_mutex_unlock(&s_slpMutex);
+		ok = true;
+	}
+	if (!ok)
+		slpError();
+	else
+	{
+		unsigned char pdu[MAX_PDU];
+		while (slpRead(pSsl, sock, pdu, 2))
+		{
+			int size = (pdu[0] << 8) | pdu[1];
+			if ((size <= 2) || (size > MAX_PDU) || !slpRead(pSsl, sock, pdu + 2, size - 2))
+				break;
+			ULP_PDU_t* pMsg = uplDecode((const char*) pdu, size);
+			if (pMsg == NULL)
+			{
+				slpError();
+				break;
+			}
+			BIO* pOut = BIO_new(BIO_s_mem());
+			slpAnswer(pMsg, pOut);
+			ASN_STRUCT_FREE(asn_DEF_ULP_PDU, pMsg);
+			char* pData;
+			long len = BIO_get_mem_data(pOut, &pData);
+			ok = (len == 0) || slpSend(pSsl, sock, (const unsigned char*) pData, (int) len, seed);
+			BIO_free(pOut);
+			if (!ok)
+				break;
+		}
+	}
+	if (pSsl)
+		SSL_free(pSsl);
+	close(sock);
+	pthread_mutex_lock(&s_slpMutex);
+	s_slpOpen --;
+	pthread_cond_signal(&s_slpDone);
+	pthread_mutex_unlock(&s_slpMutex);
+	return NULL;
+}
+
+//! Accept connections until the listening socket is shut down
+static void* slpAccept(void* pArg)
+{
+	int listenSock = (int) (long) pArg;
+	for (;;)
+	{
+		int sock = accept(listenSock, NULL, NULL);
+		if (sock < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		pthread_mutex_lock(&s_slpMutex);
+		s_slpOpen ++;
+		s_slpConnections ++;
+		pthread_mutex_unlock(&s_slpMutex);
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, slpConnection, (void*) (long) sock) == 0)
+			pthread_detach(thread);
+		else
+			slpConnection((void*) (long) sock);
+	}
+	return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The RIL, delivering bursts of SUPL INITs
+
+//! Times taken to deliver SUPL INITs
+typedef struct
+{
+	int num;				//!< SUPL INITs
+	long long sumUs;		//!< total time
+	long long maxUs;		//!< longest time
+} LATENCY_t;
+
+static void addLatency(LATENCY_t& l, long long us)
+{
+	l.num ++;
+	l.sumUs += us;
+	if (us > l.maxUs)
+		l.maxUs = us;
+}
+
+static volatile bool s_rilStop = false;	//!< Set by the main thread to end the bursts
+static int s_burst = 20;				//!< SUPL INITs in a burst
+static int s_switch = 4;				//!< Bursts between changes of the server
+static int s_slpPort = 0;				//!< Port of the SLP
+static int s_switches = 0;				//!< Changes of the server
+static LATENCY_t s_rekeyed;				//!< SUPL INITs accepted first after a change of the server
+static LATENCY_t s_accepted;			//!< Other SUPL INITs accepted
+static LATENCY_t s_rejected;			//!< SUPL INITs rejected
+
+static void* rilThread(void* /*pArg*/)
+{
+	const AGpsRilInterface* pRil = (const AGpsRilInterface*) CRilIf::getIf();
+	const char* pHost = "127.0.0.1";
+	bool rekey = false;
+	for (int burst = 1; !s_rilStop; burst ++)
+	{
+		for (int i = 0; i < s_burst; i ++)
+		{
+			int size;
+			int id;
+			void* pInit = encodeSuplInit(size, id);
+			if (pInit == NULL)
+				continue;
+			// the SLP keys the HMAC with its own address, as configured in the SET
+			unsigned char hash[EVP_MAX_MD_SIZE];
+			HMAC(EVP_sha1(), pHost, (int) strlen(pHost), (const unsigned char*) pInit, (size_t) size, hash, NULL);
+			memcpy(s_initHash[id % HASH_SLOTS], hash, HASH_SIZE);
+			int starts = s_niStarts;
+			long long startUs = getMonotonicUsCounter();
+			pRil->ni_message((uint8_t*) pInit, (size_t) size);
+			long long us = getMonotonicUsCounter() - startUs;
+			free(pInit);
+			if (s_niStarts == starts)
+				addLatency(s_rejected, us);
+			else
+			{
+				addLatency(rekey ? s_rekeyed : s_accepted, us);
+				rekey = false;
+			}
+		}
+		usleep(BURST_INTERVAL);
+		if (s_switch && !(burst % s_switch))
+		{
+			pHost = strcmp(pHost, "localhost") ? "localhost" : "127.0.0.1";
+			((const AGpsInterface*) CAgpsIf::getIf())->set_server(AGPS_TYPE_SUPL, pHost, s_slpPort);
+			s_switches ++;
+			rekey = true;
+		}
+	}
+	return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The receiver, a byte sequence at the baud rate
+
+static volatile bool s_rxStop = false;	//!< Set by the main thread to end the sending
+static int s_baud = 115200;				//!< Baud rate, 10 bits a byte
+static int s_rxPipe[2];					//!< The line, read and write end
+static long long s_rxSent = 0;			//!< Bytes sent
+static long long s_rxDropped = 0;		//!< Bytes not fitting into the buffer
+
+static void* rxThread(void* /*pArg*/)
+{
+	unsigned char buf[RX_CHUNK];
+	long long startUs = getMonotonicUsCounter();
+	while (!s_rxStop)
+	{
+		usleep(1000);
+		long long due = (getMonotonicUsCounter() - startUs) * s_baud / 10000000;
+		while (s_rxSent < due)
+		{
+			int num = (due - s_rxSent < RX_CHUNK) ? (int) (due - s_rxSent) : RX_CHUNK;
+			for (int i = 0; i < num; i ++)
+				buf[i] = (unsigned char) (s_rxSent + i);
+			// the UART overruns when the buffer is full, the rest is lost
+			ssize_t n = write(s_rxPipe[1], buf, (size_t) num);
+			s_rxDropped += num - ((n > 0) ? n : 0);
+			s_rxSent += num;
+		}
+	}
+	return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+	int num = 500;
+	int concurrent = 4;
+	bool tls = true;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:c:b:s:k:td:r:f:")) != -1)
+	{
+		if (opt == 'n')
+			num = atoi(optarg);
+		else if (opt == 'c')
+			concurrent = atoi(optarg);
+		else if (opt == 'b')
+			s_burst = atoi(optarg);
+		else if (opt == 's')
+			s_switch = atoi(optarg);
+		else if (opt == 'k')
+			s_keepAlive = atoi(optarg);
+		else if (opt == 't')
+			tls = false;
+		else if (opt == 'd')
+			s_slpDelay = atoi(optarg);
+		else if ((opt == 'r') && (atoi(optarg) > 0))
+			s_baud = atoi(optarg);
+		else if ((opt == 'f') && !strcmp(optarg, "whole"))
+			s_frag = FRAG_WHOLE;
+		else if ((opt == 'f') && !strcmp(optarg, "coalesced"))
+			s_frag = FRAG_COALESCED;
+		else if ((opt == 'f') && !strcmp(optarg, "bytes"))
+			s_frag = FRAG_BYTES;
+		else if ((opt == 'f') && !strcmp(optarg, "random"))
+			s_frag = FRAG_RANDOM;
+		else
+			break;
+	}
+	if ((opt != -1) || (optind != argc))
+	{
+		fprintf(stderr, "usage: %s [-n sessions] [-c concurrent] [-b burst] [-s bursts] [-k seconds] [-t] [-d ms] [-r baud]\n"
+				"       [-f whole|coalesced|bytes|random]\n", argv[0]);
+		return 1;
+	}
+
+	OpenSSL_add_all_algorithms();
+	SSL_library_init();
+	s_pSlpCtx = tls ? slpSslContext() : NULL;
+	s_pRrlp = encodeRrlp(s_rrlpSize);
+	if ((tls && (s_pSlpCtx == NULL)) || (s_pRrlp == NULL))
+	{
+		fprintf(stderr, "cannot set up the SLP\n");
+		return 1;
+	}
+	int listenSock = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addrLen = sizeof(addr);
+	if ((listenSock < 0) || bind(listenSock, (struct sockaddr*) &addr, sizeof(addr)) ||
+		listen(listenSock, 16) || getsockname(listenSock, (struct sockaddr*) &addr, &addrLen))
+	{
+		fprintf(stderr, "cannot listen: %s\n", strerror(errno));
+		return 1;
+	}
+	pthread_t slpThread;
+	pthread_create(&slpThread, NULL, slpAccept, (void*) (long) listenSock);
+
+	// the framework sets up the interfaces as on a phone with a data connection
+	static AGpsRilCallbacks s_rilCallbacks = { rilRequest, rilRequest, NULL };
+	static GpsNiCallbacks s_niCallbacks = { niNotify, NULL };
+	const AGpsRilInterface* pRil = (const AGpsRilInterface*) CRilIf::getIf();
+	pRil->init(&s_rilCallbacks);
+	pRil->update_network_state(1, AGPS_RIL_NETWORK_TYPE_MOBILE, 0, "");
+	pRil->update_network_availability(1, "internet");
+	((const GpsNiInterface*) CNiIf::getIf())->init(&s_niCallbacks);
+	CAgpsIf::getInstance()->setCertificateFileName(tls ? "" : NULL);	// TLS without checking the certificate
+	s_slpPort = ntohs(addr.sin_port);
+	((const AGpsInterface*) CAgpsIf::getIf())->set_server(AGPS_TYPE_SUPL, "127.0.0.1", s_slpPort);
+
+	// the main loop as in ubx_thread
+	g_gpsDrvMainThread = pthread_self();
+	suplInit();
+	suplRegisterEventCallbacks(&s_events, NULL);
+	int pollFd = epoll_create(MAX_EVENTS);
+	if (pipe2(s_rxPipe, O_NONBLOCK) || (fcntl(s_rxPipe[1], F_SETPIPE_SZ, RX_BUFFER) < 0))
+	{
+		fprintf(stderr, "cannot make the receiver line: %s\n", strerror(errno));
+		return 1;
+	}
+	struct epoll_event rxEvent;
+	memset(&rxEvent, 0, sizeof(rxEvent));
+	rxEvent.events = EPOLLIN;
+	rxEvent.data.fd = s_rxPipe[0];
+	epoll_ctl(pollFd, EPOLL_CTL_ADD, s_rxPipe[0], &rxEvent);
+	pthread_t rxThreadId;
+	pthread_create(&rxThreadId, NULL, rxThread, NULL);
+	long long rxReceived = 0;
+	int rxSequenceErrors = 0;
+	long long rxReadUs = getMonotonicUsCounter();
+	long long rxGapUs = 0;
+	pthread_t rilThreadId;
+	pthread_create(&rilThreadId, NULL, rilThread, NULL);
+	bool rilRunning = true;
+
+	int started = 0;
+	int startFailed = 0;
+	int loops = 0;
+	long long suplSumUs = 0;
+	long long suplMaxUs = 0;
+	long long startSumUs = 0;		// the SLP sums the arrival times of the SUPL STARTs
+	long long startUs = getMonotonicUsCounter();
+	for (;;)
+	{
+		long long loopUs = getMonotonicUsCounter();
+		while ((started < num) && (suplCountSessions(false) < concurrent))
+		{
+			long long us = getMonotonicUsCounter();
+			if (!suplStartSetInitiatedAction())
+			{
+				startFailed ++;
+				break;
+			}
+			startSumUs += us;
+			started ++;
+		}
+		if (!suplActiveSessions() && ((started == num) || (startFailed > num)))
+			break;
+		suplAddUplListeners(pollFd);
+		int64_t dueMs = suplGetNextTimeout();
+		loopUs = getMonotonicUsCounter() - loopUs;
+
+		int timeoutMs = 100;
+		if (dueMs >= 0)
+		{
+			int64_t ms = dueMs - getMonotonicMsCounter();
+			timeoutMs = (ms < 0) ? 0 : (ms < timeoutMs) ? (int) ms : timeoutMs;
+		}
+		struct epoll_event events[MAX_EVENTS];
+		int res = epoll_wait(pollFd, events, MAX_EVENTS, timeoutMs);
+
+		long long busyUs = 0;
+		for (int i = 0; i < res; i ++)
+		{
+			if (events[i].data.fd != s_rxPipe[0])
+			{
+				s_readUs = getMonotonicUsCounter();
+				suplReadUplSock(events[i].data.fd);
+				busyUs += getMonotonicUsCounter() - s_readUs;
+				continue;
+			}
+			// every byte follows the one before, else some were lost
+			unsigned char buf[RX_CHUNK];
+			ssize_t n = read(s_rxPipe[0], buf, sizeof(buf));
+			for (ssize_t j = 0; j < n; j ++)
+			{
+				if (buf[j] != (unsigned char) rxReceived)
+				{
+					rxSequenceErrors ++;
+					rxReceived = buf[j];
+				}
+				rxReceived ++;
+			}
+			long long us = getMonotonicUsCounter();
+			if (us - rxReadUs > rxGapUs)
+				rxGapUs = us - rxReadUs;
+			rxReadUs = us;
+		}
+		long long checkUs = getMonotonicUsCounter();
+		suplCheckPendingActions();
+		loopUs += busyUs + getMonotonicUsCounter() - checkUs;
+		loops ++;
+		suplSumUs += loopUs;
+		if (loopUs > suplMaxUs)
+			suplMaxUs = loopUs;
+
+		if (rilRunning && (started == num))
+		{
+			// no more NI sessions, the pool has to drain
+			s_rilStop = true;
+			pthread_join(rilThreadId, NULL);
+			rilRunning = false;
+		}
+	}
+	long long totalUs = getMonotonicUsCounter() - startUs;
+	if (rilRunning)
+	{
+		s_rilStop = true;
+		pthread_join(rilThreadId, NULL);
+	}
+	suplDeinit();
+	s_rxStop = true;
+	pthread_join(rxThreadId, NULL);
+	close(pollFd);
+
+	// the SLP has seen all connections closed
+	shutdown(listenSock, SHUT_RDWR);
+	pthread_join(slpThread, NULL);
+	close(listenSock);
+	pthread_mutex_lock(&s_slpMutex);
+	while (s_slpOpen > 0)
+		pthread_cond_wait(&s_slpDone, &s_slpMutex);
+	pthread_mutex_unlock(&s_slpMutex);
+
+	int sessions = started + s_niStarts;
+	printf("sessions  %d set initiated, %d network initiated of %d SUPL INITs, %d starts failed\n",
+			started, s_niStarts, s_rekeyed.num + s_accepted.num + s_rejected.num, startFailed);
+	printf("slp       %d connections, %d sessions answered, %d errors, %d writes of %.1f bytes average\n",
+			s_slpConnections, s_slpSessions, s_slpErrors, s_slpWrites, s_slpWrites ? (double) s_slpBytes / s_slpWrites : 0.0);
+	printf("connect   %d TLS handshakes, %d resumed, %d sessions on kept connections, %.2f ms to SUPL START\n",
+			s_slpHandshakes, s_slpResumed, s_slpSessions - s_slpConnections,
+			s_slpStarts ? 1e-3 * (double) (s_slpStartSumUs - startSumUs) / s_slpStarts : 0.0);
+	printf("hash      %d verified, %d wrong, %d changes of the server\n", s_slpVerified, s_slpWrongHash, s_switches);
+	printf("rate      %.1f sessions/s, %d main loop iterations, Supl calls %.1f us average, %.1f ms max\n",
+			1e6 * sessions / (double) totalUs, loops, loops ? (double) suplSumUs / loops : 0.0, 1e-3 * (double) suplMaxUs);
+	printf("rrlp      %d navigation models of %d satellites injected, %d incomplete, %.1f us average, %.3f ms max to inject\n",
+			s_ephs, NAV_MODEL_SATS, s_ephsBad, s_ephs ? (double) s_injectSumUs / s_ephs : 0.0, 1e-3 * (double) s_injectMaxUs);
+	const LATENCY_t* const pLatency[] = { &s_rekeyed, &s_accepted, &s_rejected };
+	const char* const pName[] = { "rekeyed", "accepted", "rejected" };
+	for (int i = 0; i < 3; i ++)
+	{
+		const LATENCY_t& l = *pLatency[i];
+		printf("SUPL INIT %-8s %5d, %.1f us average, %.3f ms max to deliver\n", pName[i], l.num,
+				l.num ? (double) l.sumUs / l.num : 0.0, 1e-3 * (double) l.maxUs);
+	}
+	printf("receiver  %lld bytes at %d baud, %lld dropped, %d out of sequence, %.1f ms longest between reads, %.1f ms buffered\n",
+			s_rxSent, s_baud, s_rxDropped, rxSequenceErrors, 1e-3 * (double) rxGapUs, 1e4 * RX_BUFFER / s_baud);
+	if ((started != num) || (s_niStops != s_niStarts) || (s_ephs != sessions) || s_ephsBad ||
+		(s_slpSessions != sessions) || s_slpErrors || (s_slpVerified != s_niStarts) || s_slpWrongHash ||
+		(s_slpStarts != started) || s_rxDropped || rxSequenceErrors)
+	{
+		printf("FAILED, %d sessions given assistance data, %d NI sessions ended\n", s_ephs, s_niStops);
+		return 1;
+	}
+	free(s_pRrlp);
+	SSL_CTX_free(s_pSlpCtx);
+	return 0;
+}
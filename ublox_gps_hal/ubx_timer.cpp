@@ -39,4 +39,11 @@ int64_t getMonotonicMsCounter(void)
 	struct timespec ts;
 	clock_gettime(CLOCK_MONOTONIC, &ts);
 	return (int64_t)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+int64_t getMonotonicUsCounter(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
 }	
@@ -39,5 +39,8 @@
 */
 int64_t getMonotonicMsCounter(void);
 
+//! Same as getMonotonicMsCounter in us, for measuring short intervals
+int64_t getMonotonicUsCounter(void);
+
 
 #endif /* __UBX_TIMER_H__ */
@@ -44,6 +44,7 @@
 #include <errno.h>
 
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <arpa/inet.h>
 #include <time.h>
 
@@ -89,6 +90,22 @@ int CUdpServer::openLocalPort(int udpPort)
     return m_fd;
 }
 
+bool CUdpServer::pollAdd(int pollFd) const
+{
+    if (m_fd <= 0)
+        return false;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = m_fd;
+    if (epoll_ctl(pollFd, EPOLL_CTL_ADD, m_fd, &ev) < 0)
+    {
+        LOGW("CUdpServer::%s: unable to poll socket: %s\n", __FUNCTION__, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
 int CUdpServer::recvPort(char * pBuf,int buflen)
 {
     // Enter here if select has indicated that we can read
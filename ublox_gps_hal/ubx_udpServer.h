@@ -68,15 +68,12 @@ public:
     void checkPort(int slaveOpen);
     void sendPort(const unsigned char * pBuf, int len);
 
-    bool fdSet(fd_set &rfds, int &rMaxFd) const 
+    bool pollAdd(int pollFd) const;
+
+    //! true if clients are connected and need to be kept alive by checkPort
+    bool isActive(void) const
     {
-        if (m_fd <= 0)
-            return false;
-        if ((m_fd + 1) > rMaxFd)
-            rMaxFd = m_fd + 1;
-        FD_SET(m_fd, &rfds);
-        return true;
-//lint -e{1764} suppress "could be declared const ref"
+        return activeConnections() > 0;
     };
 
     void closeUdp()
@@ -85,12 +82,9 @@ public:
 		m_fd = -1;
     };
 
-    bool fdIsSet(fd_set &rfds) const
+    bool isFd(int fd) const
     {
-        if ((m_fd > 0) && (FD_ISSET(m_fd, &rfds)))
-            return true;
-        return false;
-//lint -e{1764} suppress "could be declared const ref"
+        return (m_fd > 0) && (m_fd == fd);
     };
 
 private:
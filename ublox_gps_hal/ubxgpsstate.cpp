@@ -45,6 +45,7 @@
 
 #include <errno.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <ctype.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
@@ -78,11 +79,14 @@
 #define SERPORT_BAUDRATE_DEFAULT	9600
 #define SHUTDOWN_TIMEOUT_DEFAULT    5		//!< 5 seconds
 #define XTRA_POLL_INTERVAL_DEFUALT  20		//!< 20 hours
+#define AGPS_CHUNK_SIZE				4096	//!< Size of the buffer receiving AssistNow Online data, holds more than one message
+#define AGPS_RECV_TIMEOUT			30		//!< Time (in seconds) to wait for AssistNow Online data
 
 #ifdef SUPL_ENABLED
 #define MSA_RESPONSE_DELAY_DEFAULT 	10		//!< Default timeout (in seconds) to response with psedo ranges for MSA session
 #define NI_UI_TIMEOUT_DEFAULT		120		//!< Default timeout (in seconds) to display NI Notify/verify dialog
 #define NI_RESPONSE_TIMEOUT			75		//!< Default timeout (in seconds) to respond to an NI request
+#define SUPL_KEEP_ALIVE_DEFAULT		0		//!< Default time (in seconds) to keep a connection to the SLP open, 0 closes it
 #endif
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -106,9 +110,23 @@ CUbxGpsState::CUbxGpsState()
 	m_baudRate 					= 	cfg.get("BAUDRATE" , 			SERPORT_BAUDRATE_DEFAULT);
 	m_baudRateDef 				= 	cfg.get("BAUDRATE_DEF" , 		SERPORT_BAUDRATE_DEFAULT);
 	m_pAlpTempFile		= strdup(	cfg.get("ALP_TEMP" , 			AIDING_DATA_FILE) );
+	m_pAlpDataFile		= (char*) malloc(strlen(m_pAlpTempFile) + 5);
+	if (m_pAlpDataFile)
+		sprintf(m_pAlpDataFile, "%s.alp", m_pAlpTempFile);
+	m_pAlpDataTmpFile	= (char*) malloc(strlen(m_pAlpTempFile) + 9);
+	if (m_pAlpDataTmpFile)
+		sprintf(m_pAlpDataTmpFile, "%s.alp.tmp", m_pAlpTempFile);
+	m_pAidDb			= NULL;
+	m_pAlpData			= NULL;
 	m_stoppingTimeoutMs 		= 	cfg.get("STOP_TIMEOUT", 		SHUTDOWN_TIMEOUT_DEFAULT) * 1000;
 	m_xtraPollInterval 			= 	cfg.get("XTRA_POLL_INTERVAL", 	XTRA_POLL_INTERVAL_DEFUALT) * 60 * 60 * 1000;
 	m_persistence				=	cfg.get("PERSISTENCE", 			1);
+	m_epochEndMsg				=	lookupEpochEndMsg(cfg.get("EPOCH_END_MSG", ""));
+	m_batchSize					=	cfg.get("BATCH_SIZE",			0);
+	m_batchIntervalMs			=	cfg.get("BATCH_FLUSH_INTERVAL",	0) * 1000;
+	const char* pCapture		=	cfg.get("SERIAL_CAPTURE",		"");
+	m_pCaptureFile		= (pCapture && *pCapture) ? strdup(pCapture) : NULL;
+	m_debugStateBinary			=	cfg.get("DEBUG_STATE_BINARY",	0) ? true : false;
 	m_receiverShutdownAck 		= 	false;
 	
 #ifdef SUPL_ENABLED
@@ -128,6 +146,7 @@ CUbxGpsState::CUbxGpsState()
 	m_logSuplMessages			= (bool) cfg.get("SUPL_LOG_MESSAGES", false);
 	m_cmccLogActive				= (bool) cfg.get("SUPL_CMCC_LOGGING", false);
 	m_suplMsgToFile				= (bool) cfg.get("SUPL_MSG_TO_FILE", false);
+	m_suplKeepAlive				= 		 cfg.get("SUPL_KEEP_ALIVE",				SUPL_KEEP_ALIVE_DEFAULT);
 #endif	
 
 	m_pSer = NULL;
@@ -155,16 +174,59 @@ CUbxGpsState::CUbxGpsState()
 	pthread_mutex_init(&m_ubxStateMutex, NULL);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//! Find the message configured as last message of an epoch
+/*! 
+	\param pName the name of the message, e.g. "GGA" or "NAV-PVT"
+	\return the message, MSG_NUM if the name is empty or unknown
+*/
+CDatabase::MSG_t CUbxGpsState::lookupEpochEndMsg(const char* pName)
+{
+	static const struct { const char* pName; CDatabase::MSG_t msg; } s_msgs[] = 
+	{
+		{ "GBS",		CDatabase::MSG_NMEA_GBS		},
+		{ "GGA",		CDatabase::MSG_NMEA_GGA		},
+		{ "GLL",		CDatabase::MSG_NMEA_GLL		},
+		{ "GNS",		CDatabase::MSG_NMEA_GNS		},
+		{ "GRS",		CDatabase::MSG_NMEA_GRS		},
+		{ "GSA",		CDatabase::MSG_NMEA_GSA		},
+		{ "GST",		CDatabase::MSG_NMEA_GST		},
+		{ "GSV",		CDatabase::MSG_NMEA_GSV_1	},
+		{ "RMC",		CDatabase::MSG_NMEA_RMC		},
+		{ "VTG",		CDatabase::MSG_NMEA_VTG		},
+		{ "ZDA",		CDatabase::MSG_NMEA_ZDA		},
+		{ "NAV-SOL",	CDatabase::MSG_UBX_NAVSOL	},
+		{ "NAV-PVT",	CDatabase::MSG_UBX_NAVPVT	},
+		{ "NAV-SVINFO",	CDatabase::MSG_UBX_SVINFO	},
+	};
+	if ((pName == NULL) || (*pName == '\0'))
+		return CDatabase::MSG_NUM;
+	for (unsigned int i = 0; i < sizeof(s_msgs)/sizeof(*s_msgs); i ++)
+	{
+		if (strcasecmp(pName, s_msgs[i].pName) == 0)
+			return s_msgs[i].msg;
+	}
+	LOGE("%s : Unknown last message of epoch %s", __FUNCTION__, pName);
+	return CDatabase::MSG_NUM;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Destructor
 CUbxGpsState::~CUbxGpsState()
 {
-    // write back the data to the file 
+    // write back the data to the file, unmapping it keeps it when freeing the buffers
+//lint -e{1551} remove Function may throw exception
+    unmapAidingDb();
+//lint -e{1551} remove Function may throw exception
+    unmapAlpData();
 //lint -e{1551} remove Function may throw exception
     deleteAidData(GPS_DELETE_ALL); // this frees all the buffers
     
 	if (m_pSerialDevice) 	free(m_pSerialDevice);
 	if (m_pAlpTempFile) 	free(m_pAlpTempFile);
+	if (m_pAlpDataFile) 	free(m_pAlpDataFile);
+	if (m_pAlpDataTmpFile) 	free(m_pAlpDataTmpFile);
+	if (m_pCaptureFile) 	free(m_pCaptureFile);
 	if (m_agpsThreadParam.server) 	free(m_agpsThreadParam.server);
 	m_pSer = NULL;			// Never allocated in this class, so do not need to free
 #if defined UDP_SERVER_PORT
@@ -235,6 +297,7 @@ void CUbxGpsState::onStartup(void)
 	writeUbxCfgMsg(0x01, 0x30);	    // enable UBX-NAV-SVINFO message
 	writeUbxCfgMsg(0x01, 0x06);	    // enable UBX-NAV-SOL message
 	writeUbxCfgMsg(0x01, 0x07);	    // enable UBX-NAV-PVT message
+	writeUbxCfgMsg(0x01, 0x61);	    // enable UBX-NAV-EOE message (not supported by older receivers)
 	// enable all the adining information 
 	writeUbxCfgMsg(0x0B, 0x30);		// enable UBX-AID-ALM message
 	writeUbxCfgMsg(0x0B, 0x31);		// enable UBX-AID-EPH message
@@ -376,6 +439,11 @@ void CUbxGpsState::setBaudRate()
 */ 
 void CUbxGpsState::sendAidData(bool bEph, bool bAop, bool bAlm, bool bHui)
 {
+	// all stored messages go out in one batch
+	UBX_BATCH_t batch;
+	batch.num = 0;
+	batch.iov = 0;
+	batch.size = 0;
 	BUF_t* p = NULL;
 	if (bEph)
 	{
@@ -384,16 +452,8 @@ void CUbxGpsState::sendAidData(bool bEph, bool bAop, bool bAlm, bool bHui)
 			p = &m_Db.sv[svix].eph;
 			if ((p->p != NULL) && (p->i>0))
             {
-                if ((m_pSer != NULL) && (m_pSer->writeSerial(p->p,p->i) == (int)p->i))
-				{
-//                    LOGV("Send Eph G%d size %d", svix+1, p->i);
-				}
-#if defined UDP_SERVER_PORT
-                if (m_pUdpServer != NULL)
-                {
-                    m_pUdpServer->sendPort(p->p,(int) p->i);
-                }
-#endif
+				addUbxRaw(&batch, p->p, (int) p->i);
+//				LOGV("Send Eph G%d size %d", svix+1, p->i);
             }
 		}
 	}
@@ -404,16 +464,8 @@ void CUbxGpsState::sendAidData(bool bEph, bool bAop, bool bAlm, bool bHui)
 			p = &m_Db.sv[svix].aop;
 			if ((p->p != NULL) && (p->i>0))
             {
-                if ((m_pSer != NULL) && (m_pSer->writeSerial(p->p,p->i) == (int)p->i))
-				{
-//                    LOGV("Send Aop G%d size %d", svix+1, p->i);
-				}
-#if defined UDP_SERVER_PORT
-                if (m_pUdpServer != NULL)
-                {
-                    m_pUdpServer->sendPort(p->p,(int) p->i);
-                }
-#endif
+				addUbxRaw(&batch, p->p, (int) p->i);
+//				LOGV("Send Aop G%d size %d", svix+1, p->i);
             }
 		}
 	}
@@ -424,16 +476,8 @@ void CUbxGpsState::sendAidData(bool bEph, bool bAop, bool bAlm, bool bHui)
 			p = &m_Db.sv[svix].alm;
 			if ((p->p != NULL) && (p->i>0))
             {
-                if ((m_pSer != NULL) && (m_pSer->writeSerial(p->p,p->i) == (int)p->i))
-				{
-//                    LOGV("Send Alm G%d size %d", svix+1, p->i);
-				}
-#if defined UDP_SERVER_PORT
-                if (m_pUdpServer != NULL)
-                {
-                    m_pUdpServer->sendPort(p->p,(int) p->i);
-                }
-#endif
+				addUbxRaw(&batch, p->p, (int) p->i);
+//				LOGV("Send Alm G%d size %d", svix+1, p->i);
             }
 		}
 	}
@@ -442,18 +486,11 @@ void CUbxGpsState::sendAidData(bool bEph, bool bAop, bool bAlm, bool bHui)
 		p = &m_Db.hui;
         if ((p->p != NULL) && (p->i>0))
         {
-            if ((m_pSer != NULL) && (m_pSer->writeSerial(p->p,p->i) == (int)p->i))
-			{
-//                LOGV("Send Hui size %d", p->i);
-			}
-#if defined UDP_SERVER_PORT
-            if (m_pUdpServer != NULL)
-            {
-                m_pUdpServer->sendPort(p->p,(int) p->i);
-            }
-#endif
+			addUbxRaw(&batch, p->p, (int) p->i);
+//			LOGV("Send Hui size %d", p->i);
         }
 	}
+	flushUbx(&batch);
 }
 
 //! poll local aiding data from the receiver
@@ -500,6 +537,7 @@ void CUbxGpsState::onNewUbxMsg(GPS_THREAD_STATES state, const unsigned char* pMs
 			if (replaceBuf(&m_Db.hui, pMsg, iMsg))
             {
                 m_Db.dbAssistChanged = true;
+				storeAidingRec(getAidingRec(msgId), &m_Db.hui);
 				LOGV("Got new Hui");
             }
 		}
@@ -521,6 +559,7 @@ void CUbxGpsState::onNewUbxMsg(GPS_THREAD_STATES state, const unsigned char* pMs
 				if (replaceBuf(&m_Db.sv[svix].alm, pMsg, iMsg))
                 {
                     m_Db.dbAssistChanged = true;
+					storeAidingRec(getAidingRec(msgId, svix), &m_Db.sv[svix].alm);
 					LOGV("Got Alm G%d", svix+1);
                 }
 			}
@@ -530,6 +569,7 @@ void CUbxGpsState::onNewUbxMsg(GPS_THREAD_STATES state, const unsigned char* pMs
 				if (replaceBuf(&m_Db.sv[svix].eph, pMsg, iMsg))
                 {
                     m_Db.dbAssistChanged = true;
+					storeAidingRec(getAidingRec(msgId, svix), &m_Db.sv[svix].eph);
 					LOGV("Got Eph G%d", svix+1);
                 }
 			}
@@ -539,6 +579,7 @@ void CUbxGpsState::onNewUbxMsg(GPS_THREAD_STATES state, const unsigned char* pMs
 				if (replaceBuf(&m_Db.sv[svix].aop, pMsg, iMsg))
                 {
                     m_Db.dbAssistChanged = true;
+					storeAidingRec(getAidingRec(msgId, svix), &m_Db.sv[svix].aop);
 					LOGV("Got Aop G%d", svix+1);
                 }
 			}
@@ -588,29 +629,42 @@ void CUbxGpsState::deleteAidData(GpsAidingData flags)
 		if (flags & GPS_DELETE_EPHEMERIS)
 		{
 			freeBuf(&m_Db.sv[svix].eph);
+			storeAidingRec(getAidingRec(0x31, (unsigned int) svix), &m_Db.sv[svix].eph);
 			//LOGV("Clr Eph G%d", svix+1);
 		}
 		if (flags & GPS_DELETE_SADATA)
 		{
 			freeBuf(&m_Db.sv[svix].aop);
+			storeAidingRec(getAidingRec(0x33, (unsigned int) svix), &m_Db.sv[svix].aop);
 			//LOGV("Clr Aop G%d", svix+1);
 		}
 		if (flags & GPS_DELETE_ALMANAC)
 		{
 			freeBuf(&m_Db.sv[svix].alm);
+			storeAidingRec(getAidingRec(0x30, (unsigned int) svix), &m_Db.sv[svix].alm);
 			//LOGV("Clr Alm G%d", svix+1);
 		}
 	}
 	if (flags & (GPS_DELETE_IONO|GPS_DELETE_UTC|GPS_DELETE_HEALTH))
 	{
 		freeBuf(&m_Db.hui);
+		storeAidingRec(getAidingRec(0x02), &m_Db.hui);
 		//LOGV("Clr Hui");
 	}
 	if (flags & (GPS_DELETE_SVDIR|GPS_DELETE_SVSTEER))
 	{
+		if (m_pAlpData != NULL)
+		{
+			unmapAlpData();
+			if (m_pAlpDataFile) 
+				remove(m_pAlpDataFile);
+		}
 		freeBuf(&m_Db.alp.file);
+		m_Db.dbAlpChanged = true;
 		//LOGV("Clr Apl");
 	}
+	if (flags & (GPS_DELETE_POSITION|GPS_DELETE_TIME))
+		storeAidingPosTime();
 
     m_Db.dbAssistChanged = true;
 
@@ -668,6 +722,7 @@ void CUbxGpsState::putTime(GpsUtcTime timeUtcMs, int64_t timeRefMs, int accMs)
 	m_Db.time.accMs		= accMs;
     
     m_Db.dbAssistChanged = true;
+	storeAidingPosTime();
 }
 
 //! put the position information into the local database 
@@ -688,6 +743,7 @@ void CUbxGpsState::putPos(double latDeg, double lonDeg, float accM)
 	m_Db.pos.timeRefMs = currentRefTimeMs();
     
     m_Db.dbAssistChanged = true;
+	storeAidingPosTime();
 }
 
 //! do send position and time aiding to the receiver
@@ -842,6 +898,7 @@ bool CUbxGpsState::onNewUbxAlpMsg(const unsigned char* pMsg, unsigned int iMsg)
 						LOGV("Update Alp fileId %d offset %d size %d", cli.fileId, offset, size);
                         memcpy(&m_Db.alp.file.p[offset], &pMsg[6+cli.idSize], size);
                         m_Db.dbAssistChanged = true;
+                        m_Db.dbAlpChanged = true;
 						return true;
 					}
 					else
@@ -875,11 +932,44 @@ bool CUbxGpsState::onNewUbxAlpMsg(const unsigned char* pMsg, unsigned int iMsg)
 	the content. Very simple check on the header are done. And if of the file ist saved in the db.
 	The time of reception is recorded to later check if a a file update shal be requested.
 
+	With persistence the file is written to the Assistnow Offline data file and used from 
+	there through a memory mapping, otherwise a copy is kept in memory.
+
 	\param pData The pointer to the complete ALP file
 	\param iData The size of the complete ALP file
 	\return true if sucessfull, false otherwise
 */
 bool CUbxGpsState::putAlpFile(const unsigned char* pData, unsigned int iData)
+{
+	if (!checkAlpHeader(pData, iData))
+		return false;
+	if (m_persistence && storeAlpData(pData, iData))
+		m_Db.dbAlpChanged = false;
+	else 
+	{
+		unmapAlpData();
+		if (!replaceBuf(&m_Db.alp.file, pData, iData))
+			return false;
+		m_Db.alp.fileId ++;
+		m_Db.alp.timeRefMs = currentRefTimeMs();
+		m_Db.dbAlpChanged = true;
+	}
+	m_Db.dbAssistChanged = true;
+	ALP_FILE_HEADER_t head;
+	memcpy(&head, pData, sizeof(head));
+	LOGV("Got Alp file %d size %d at", m_Db.alp.fileId, iData);
+	LOGV("Info Alp time %d:%06d dur %.3fdays\n", head.p_wno, head.p_tow, (head.duration * 10.0) / (60.0 * 24.0));
+	return true;
+}
+
+//! check the header of an Assistnow Offline / Alamanac Plus file 
+/*!	Only the header is checked, the magic word and the size must match. 
+
+	\param pData The pointer to the complete ALP file
+	\param iData The size of the complete ALP file
+	\return true if the header is valid, false otherwise
+*/
+bool CUbxGpsState::checkAlpHeader(const unsigned char* pData, unsigned int iData)
 {
 	if (iData < (int)sizeof(ALP_FILE_HEADER_t))
 		LOGE("Alp size %d too small", iData);
@@ -891,15 +981,8 @@ bool CUbxGpsState::putAlpFile(const unsigned char* pData, unsigned int iData)
 			LOGE("Alp magic bad %08X", head.magic);
 		else if (head.size*4 != iData)
 			LOGE("Alp size bad %d != %d", head.size*4, iData);
-		else if (replaceBuf(&m_Db.alp.file, pData, iData))
-		{
-			m_Db.alp.fileId ++;
-			m_Db.alp.timeRefMs = currentRefTimeMs();
-            m_Db.dbAssistChanged = true;
-			LOGV("Got Alp file %d size %d at", m_Db.alp.fileId, iData);
-			LOGV("Info Alp time %d:%06d dur %.3fdays\n", head.p_wno, head.p_tow, (head.duration * 10.0) / (60.0 * 24.0));
+		else
 			return true;
-		}
 	}
 	return false;
 }
@@ -965,8 +1048,10 @@ void CUbxGpsState::checkAgpsDownload(void)
 				LOGV("CUbxGpsState::%s : Request AssistNow online", __FUNCTION__);
 				m_agpsThreadParam.active = true;
 				if (pthread_create( &m_agpsThreadParam.thread, NULL, 
-					CUbxGpsState::agpsDownloadThread, &m_agpsThreadParam) == 0)
+					CUbxGpsState::agpsDownloadThread, &m_agpsThreadParam) != 0)
 					m_agpsThreadParam.active = false;
+				else
+					pthread_detach(m_agpsThreadParam.thread);
 			}
 			else
 			{
@@ -1031,27 +1116,41 @@ void* CUbxGpsState::agpsDownloadThread(void *pThreadData)
 		return NULL;
 	}
 
-    // send the http get request
+	// do not wait forever for a server that stops sending
+	struct timeval tv;
+	tv.tv_sec = AGPS_RECV_TIMEOUT;
+	tv.tv_usec = 0;
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    // send the request
 	LOGD("Outbound HTTP request: %s", data->request);
 	send(sock, data->request, strlen(data->request), 0);
-	// now receive the header 
-	int iSize = 0;
-	char header[1024];
-	char* p = header;
-	do 
+	// now receive the header, it is followed by the data in the same buffer
+	unsigned char buf[AGPS_CHUNK_SIZE];
+	int iBuf = 0;
+	int iHead = 0;
+	while (iHead == 0)
 	{
-		int b = recv(sock, p, 1, 0);
-		if (b < 0)
+		int b = recv(sock, &buf[iBuf], sizeof(buf) - 1 - (unsigned int) iBuf, 0);
+		if (b <= 0)
 			break;
-		else if ((b > 0) && (*p != '\r'))
-		{
-			p ++;
-			iSize ++;
-		}
-	} while ((iSize < (int)(sizeof(header)-1)) && ((iSize < 2) || (p[-2] != '\n') || (p[-1] != '\n')));
-	if (iSize < (int)(sizeof(header)-1))
+		iBuf += b;
+		buf[iBuf] = '\0';
+		char* pEnd = strstr((char*) buf, "\n\n");
+		char* pEndCr = strstr((char*) buf, "\n\r\n");
+		if (pEndCr && (!pEnd || (pEndCr < pEnd)))
+			iHead = (int) (pEndCr + 3 - (char*) buf);
+		else if (pEnd)
+			iHead = (int) (pEnd + 2 - (char*) buf);
+		else if (iBuf == (int) sizeof(buf) - 1)
+			break;
+	}
+	if (iHead > 0)
 	{
-		*p = '\0';
+		char header[1024];
+		int iHeader = (iHead < (int) sizeof(header)) ? iHead : (int) sizeof(header) - 1;
+		memcpy(header, buf, (unsigned int) iHeader);
+		header[iHeader] = '\0';
 		LOGV("CUbxGpsState::%s Got Online header\n%s", __FUNCTION__, header);
 		// check the two mandatory fields length and type
 		char* pLength = strstr(header, "Content-Length: ");
@@ -1064,39 +1163,77 @@ void* CUbxGpsState::agpsDownloadThread(void *pThreadData)
 			// check the content type, can be either txt (an error message) or ubx protocol (aiding data)
 			bool bUBX  = strncasecmp(pType, "application/ubx", 15)==0;
 			bool bTxt  = strncasecmp(pType, "text/plain",      10)==0;
-			if ((bUBX || bTxt) && (lenght > 0))
+			if ((bUBX || bTxt) && (lenght > 4))
 			{
-				char* pData = (char*)malloc((unsigned int) lenght);
-				if (pData != NULL) 
+				// keep only the data in the buffer 
+				iBuf -= iHead;
+				memmove(buf, &buf[iHead], (unsigned int) iBuf);
+				if (iBuf > lenght)
+					iBuf = lenght;
+				int iRemain = lenght - iBuf;
+				if (bUBX)
 				{
-                    if (lenght > 4)
-                    {
-                        int iRecv = recv(sock, pData, (unsigned int) lenght, MSG_WAITALL);
-                        if (iRecv==lenght)
-                        {
-                            if (bUBX)
-                            {
-                                LOGV("Got agps data of size %d", lenght);
-                                injectDataAgpsOnlineData(pData, lenght);
-
-                                /* Mark the time when the assistance data has been inject */
-                                data->timeoutLastRequest = getMonotonicMsCounter();
-                                LOGV("Agps timeout reload %lld", data->timeoutLastRequest);
-                            }
-                            else if (bTxt)
-                                LOGW("CUbxGpsState::%s : Got message:\n%s", __FUNCTION__, pData);
-                        }
-                        else 
-                            LOGE("%s : agps size does not match Content Length %d/%d", __FUNCTION__, iRecv, lenght);
-                    }
+					// stream the data, complete messages are taken over as soon as they 
+					// arrive and only the start of an incomplete one is kept
+					bool bGot = false;
+					for (;;)
+					{
+						int iUsed = injectDataAgpsOnlineData(buf, iBuf);
+						if (iUsed < 0)
+						{
+							LOGE("Part of the Agps data seems to be invalid %d", iBuf + iRemain);
+							break;
+						}
+						bGot = bGot || (iUsed > 0);
+						iBuf -= iUsed;
+						memmove(buf, &buf[iUsed], (unsigned int) iBuf);
+						if (iRemain == 0)
+							break;
+						int iRecv = (int) sizeof(buf) - iBuf;
+						if (iRecv > iRemain)
+							iRecv = iRemain;
+						int b = recv(sock, &buf[iBuf], (unsigned int) iRecv, 0);
+						if ((b < 0) && (errno == EINTR))
+							continue;
+						if (b <= 0)
+							break;
+						iBuf += b;
+						iRemain -= b;
+					}
+					if ((iRemain == 0) && (iBuf == 0))
+					{
+						LOGV("Got agps data of size %d", lenght);
+						/* Mark the time when the assistance data has been inject */
+						data->timeoutLastRequest = getMonotonicMsCounter();
+						LOGV("Agps timeout reload %lld", data->timeoutLastRequest);
+					}
 					else 
-						LOGE("%s : agps size too small %d", __FUNCTION__, lenght);
-					// free the momory
-					free(pData);
+						LOGE("%s : agps data incomplete, %d of %d received", __FUNCTION__, lenght - iRemain, lenght);
+					if (bGot)
+					{
+						// the messages taken over are kept also from an incomplete download 
+						CUbxGpsState* pUbxGps = CUbxGpsState::getInstance();
+						pUbxGps->lock();
+						pUbxGps->sendAidData(true, false, true, true);
+						pUbxGps->unlock();
+					}
+				}
+				else if (bTxt)
+				{
+					while ((iRemain > 0) && (iBuf < (int) sizeof(buf) - 1))
+					{
+						int b = recv(sock, &buf[iBuf], sizeof(buf) - 1 - (unsigned int) iBuf, 0);
+						if (b <= 0)
+							break;
+						iBuf += b;
+						iRemain -= b;
+					}
+					buf[iBuf] = '\0';
+					LOGW("CUbxGpsState::%s : Got message:\n%s", __FUNCTION__, (char*) buf);
 				}
-				else 
-					LOGE("CUbxGpsState::%s : No memory for agps data of size %d", __FUNCTION__, lenght);
 			}
+			else if (bUBX || bTxt)
+				LOGE("%s : agps size too small %d", __FUNCTION__, lenght);
 			else 
 				LOGE("CUbxGpsState::%s : Invalid Content Type", __FUNCTION__);
 		}
@@ -1114,31 +1251,31 @@ void* CUbxGpsState::agpsDownloadThread(void *pThreadData)
 
 ///////////////////////////////////////////////////////////////////////////////
 //! Handles the injection of agps (AssistNow Online) data in to the receiver
-/*!
+/*! All complete messages are taken over into the local database, they are sent
+    to the receiver with #sendAidData. 
+
   \param data	: Pointer to buffer containing data
   \param length	: Length of buffer
+  \return the number of bytes taken over, -1 if the data is invalid
 */
-void CUbxGpsState::injectDataAgpsOnlineData(const char* data, int length)
+int CUbxGpsState::injectDataAgpsOnlineData(const unsigned char* data, int length)
 {
 	CUbxGpsState* pUbxGps = CUbxGpsState::getInstance();
     pUbxGps->lock();
+	int iUsed = 0;
 	int iMsg;
 	do 
 	{
-		iMsg = CProtocolUBX::ParseFunc((unsigned char *) const_cast<char *>(data), length);
+		iMsg = CProtocolUBX::ParseFunc(&data[iUsed], length - iUsed);
 		if (iMsg > 0) 
 		{
-			pUbxGps->onNewUbxMsg((GPS_THREAD_STATES) -1, (const unsigned char*)data, (unsigned int) iMsg);
-			length -= iMsg;
-			data += iMsg;
+			pUbxGps->onNewUbxMsg((GPS_THREAD_STATES) -1, &data[iUsed], (unsigned int) iMsg);
+			iUsed += iMsg;
 		}
 	}
 	while (iMsg > 0);
-	if (length == 0)
-		pUbxGps->sendAidData(true, false, true, true);
-	else
-		LOGE("Part of the Agps data seems to be invalid %d", length);
 	pUbxGps->unlock();
+	return (iMsg < 0) ? -1 : iUsed;		// not found, otherwise waiting for more data
 }
 
 /*******************************************************************************
@@ -1271,6 +1408,11 @@ void CUbxGpsState::sendEph(const void* pData, int size)
 	writeUbx(UBXID_AID_EPH >> 8, UBXID_AID_EPH & 0xFF, pData, size);
 }
 
+void CUbxGpsState::sendEphs(const void* pData, int size, int num)
+{
+	writeUbxBatch(UBXID_AID_EPH >> 8, UBXID_AID_EPH & 0xFF, pData, size, num);
+}
+
 void CUbxGpsState::sendAidingData(const GPS_UBX_AID_INI_U5__t *pAidingData)
 {
 	writeUbx(UBXID_AID_INI >> 8, UBXID_AID_INI & 0xFF, const_cast<GPS_UBX_AID_INI_U5__t *>(pAidingData), sizeof(GPS_UBX_AID_INI_U5__t));
@@ -1333,67 +1475,205 @@ void CUbxGpsState::crcUbx(unsigned char crc[2], const unsigned char* pData, int
 bool CUbxGpsState::writeUbx(unsigned char classID, unsigned char msgID, 
 						    const void* pData0, int iData0, const void* pData1, int iData1)
 {
+	// a single message needs no batch, just its own header, checksum and scatter list
 	unsigned char head[6];
-	unsigned char crc[2] = {0,0};
-	int iData = iData0 + iData1;
-    unsigned char udpBuf[iData + 8];
-    unsigned char *pUdpBuf = udpBuf;
-	// assemble and create the header
+	unsigned char crc[2];
+	struct iovec vec[4];
+	int iov = frameUbx(vec, head, crc, classID, msgID, pData0, iData0, pData1, iData1);
+	// LOGV("Send UBX-%02X-%02X size %d+8 ok", classID, msgID, iData);
+	return writeUbxVec(vec, iov, iData0 + iData1 + 8);
+}
 
-    if (m_pSer == NULL)
-    {
-        return false;
-    }
+//! Write several UBX messages of the same type to the receiver
+/*! All messages are assembled in one batch and written to the receiver with
+    a single call. 
+
+	\param clsId    the class Id of the messages to be sent
+	\param msgId    the message Id of the messages to be sent
+	\param pData    the pointer to the payloads to be sent, stored one after the other
+	\param iData    the size of each payload
+	\param num      the number of messages to be sent
+	\return         true if sucessfull, false otherwise 
+*/
+bool CUbxGpsState::writeUbxBatch(unsigned char classID, unsigned char msgID, 
+								 const void* pData, int iData, int num)
+{
+	UBX_BATCH_t batch;
+	batch.num = 0;
+	batch.iov = 0;
+	batch.size = 0;
+	bool ok = true;
+	const unsigned char* pPayload = (const unsigned char*) pData;
+	for (int i = 0; i < num; i++)
+	{
+		ok = addUbx(&batch, classID, msgID, pPayload, iData) && ok;
+		pPayload += iData;
+	}
+	return flushUbx(&batch) && ok;
+}
 
+//! Add a UBX message to an output batch
+/*! The header and checksum are framed in the batch, the payload is referenced
+    and must stay unchanged until the batch is flushed. A full batch is flushed
+	first.
+
+	\param pBatch   the batch to add the message to
+	\param clsId    the class Id of the message
+	\param msgId    the message Id of the message
+	\param pData0   the pointer to the first part of the payload (can be NULL)
+	\param iData0   the size of the first part of the payload (can be 0)
+	\param pData1   the pointer to the second part of the payload (can be NULL)
+	\param iData1   the size of the second part of the payload (can be 0)
+	\return         true if sucessfull, false if flushing the full batch failed 
+*/
+bool CUbxGpsState::addUbx(UBX_BATCH_t* pBatch, unsigned char classID, unsigned char msgID, 
+						  const void* pData0, int iData0, const void* pData1, int iData1)
+{
+	bool ok = true;
+	if (pBatch->num == UBX_BATCH_MAX)
+		ok = flushUbx(pBatch);
+	
+	pBatch->iov += frameUbx(&pBatch->vec[pBatch->iov], pBatch->head[pBatch->num], pBatch->crc[pBatch->num], 
+							classID, msgID, pData0, iData0, pData1, iData1);
+	pBatch->num++;
+	pBatch->size += iData0 + iData1 + 8;
+	return ok;
+}
+
+//! Frame a UBX message in a scatter list
+/*! The header and checksum are assembled in the buffers given, the payload is
+    referenced and must stay unchanged until the list is written.
+
+	\param vec      the scatter list to fill, up to 4 entries are used
+	\param head     the buffer for the header
+	\param crc      the buffer for the checksum
+	\param clsId    the class Id of the message
+	\param msgId    the message Id of the message
+	\param pData0   the pointer to the first part of the payload (can be NULL)
+	\param iData0   the size of the first part of the payload (can be 0)
+	\param pData1   the pointer to the second part of the payload (can be NULL)
+	\param iData1   the size of the second part of the payload (can be 0)
+	eturn         the number of entries used in vec
+*/
+int CUbxGpsState::frameUbx(struct iovec vec[4], unsigned char head[6], unsigned char crc[2],
+						   unsigned char classID, unsigned char msgID, 
+						   const void* pData0, int iData0, const void* pData1, int iData1)
+{
+	int iov = 0;
+	int iData = iData0 + iData1;
+	
+	// assemble and create the header
 	head[0] = 0xB5;
     head[1] = 'b';
     head[2] = classID;
     head[3] = msgID;
     head[4] = (unsigned char)iData;
     head[5] = (unsigned char)(iData >> 8);
-	if ((unsigned int) m_pSer->writeSerial(head, sizeof(head)) != sizeof(head))
-		return false;
-    crcUbx(crc, &head[2], sizeof(head)-2);
-
-    memcpy(pUdpBuf, head, sizeof(head));
-    pUdpBuf+=sizeof(head);
-
-	// add/send the first part of payload 
+	crc[0] = 0;
+	crc[1] = 0;
+    crcUbx(crc, &head[2], 4);
+	vec[iov].iov_base = head;
+	vec[iov].iov_len = 6;
+	iov++;
+
+	// add the first part of payload 
 	if ((pData0 != NULL) && (iData0 > 0))
 	{
-		if (m_pSer->writeSerial((char *) const_cast<void *>(pData0), (unsigned int) iData0) != iData0)
-			return false;
 		crcUbx(crc, (const unsigned char*)pData0, iData0);
-        
-        memcpy(pUdpBuf, pData0, (unsigned int) iData0);
-        pUdpBuf+=iData0;
-
+		vec[iov].iov_base = const_cast<void *>(pData0);
+		vec[iov].iov_len = (size_t) iData0;
+		iov++;
 	}
 
-	// add/send the second part of payload 
+	// add the second part of payload 
 	if ((pData1 != NULL) && (iData1 > 0))
 	{
-		if (m_pSer->writeSerial((char *) const_cast<void *>(pData1), (unsigned int) iData1) != iData1)
-			return false;
 		crcUbx(crc, (const unsigned char*)pData1, iData1);
+		vec[iov].iov_base = const_cast<void *>(pData1);
+		vec[iov].iov_len = (size_t) iData1;
+		iov++;
+	}
 
-        memcpy(pUdpBuf, pData1, (unsigned int) iData1);
-        pUdpBuf+=iData1;
+	// and finally the crc
+	vec[iov].iov_base = crc;
+	vec[iov].iov_len = 2;
+	iov++;
+	return iov;
+}
 
-	}
+//! Add a complete UBX message to an output batch
+/*! The message is referenced and must stay unchanged until the batch is 
+    flushed. A full batch is flushed first.
 
-	// and finally send the crc
-	if ((unsigned int) m_pSer->writeSerial(crc, sizeof(crc)) != sizeof(crc))
-		return false;
+	\param pBatch   the batch to add the message to
+	\param pMsg     the pointer to the message including framing and checksum
+	\param iMsg     the size of the message
+	\return         true if sucessfull, false if flushing the full batch failed 
+*/
+bool CUbxGpsState::addUbxRaw(UBX_BATCH_t* pBatch, const void* pMsg, int iMsg)
+{
+	bool ok = true;
+	if (pBatch->num == UBX_BATCH_MAX)
+		ok = flushUbx(pBatch);
+	
+	pBatch->vec[pBatch->iov].iov_base = const_cast<void *>(pMsg);
+	pBatch->vec[pBatch->iov].iov_len = (size_t) iMsg;
+	pBatch->iov++;
+	pBatch->num++;
+	pBatch->size += iMsg;
+	return ok;
+}
 
-    memcpy(pUdpBuf, crc, sizeof(crc));
+//! Write an output batch to the receiver
+/*! All messages of the batch are written with a single writev and the batch
+    is emptied for reuse.
+
+	\param pBatch   the batch to write
+	\return         true if sucessfull, false otherwise 
+*/
+bool CUbxGpsState::flushUbx(UBX_BATCH_t* pBatch)
+{
+	if (pBatch->num == 0)
+		return true;
+	
+	bool ok = writeUbxVec(pBatch->vec, pBatch->iov, pBatch->size);
+	pBatch->num = 0;
+	pBatch->iov = 0;
+	pBatch->size = 0;
+	return ok;
+}
+
+//! Write framed UBX messages to the receiver
+/*! The messages are written with a single writev.
+
+	\param pVec     the scatter list referencing the messages
+	\param iov      the number of entries in pVec
+	\param size     the number of bytes referenced
+	eturn         true if sucessfull, false otherwise 
+*/
+bool CUbxGpsState::writeUbxVec(const struct iovec* pVec, int iov, int size)
+{
+	bool ok = (m_pSer != NULL) && (m_pSer->writevSerial(pVec, iov) == size);
 
 #if defined UDP_SERVER_PORT
     if (m_pUdpServer != NULL)
-        m_pUdpServer->sendPort(udpBuf, sizeof(udpBuf));
+	{
+		// the udp server needs the messages in one piece
+		unsigned char *pUdpBuf = (unsigned char *) malloc(size);
+		if (pUdpBuf)
+		{
+			unsigned char *p = pUdpBuf;
+			for (int i = 0; i < iov; i++)
+			{
+				memcpy(p, pVec[i].iov_base, pVec[i].iov_len);
+				p += pVec[i].iov_len;
+			}
+			m_pUdpServer->sendPort(pUdpBuf, size);
+			free(pUdpBuf);
+		}
+	}
 #endif
-	// LOGV("Send UBX-%02X-%02X size %d+8 ok", classID, msgID, iData);
-	return true;
+	return ok;
 }
 
 
@@ -1402,8 +1682,9 @@ bool CUbxGpsState::writeUbx(unsigned char classID, unsigned char msgID,
  *******************************************************************************/
 
 //! Loads the temporary stored aiding data
-/*! Loads the temporay file containing the last know aiding data, and transfers
-    it to the receiver. 
+/*! Maps the file containing the last know aiding data and takes over the valid 
+    records, they are transferred to the receiver afterwards. The file stays mapped 
+	and is updated in place whenever new aiding data arrives. 
 
     \return true if all aiding data sucessfully loaded, false otherwise 
 */
@@ -1413,19 +1694,37 @@ bool CUbxGpsState::loadAiding(void)
     {
         LOGV("%s : Loading last aiding data from %s", __FUNCTION__, m_pAlpTempFile);
         
-        int fd = open(m_pAlpTempFile, O_RDONLY);
-        
-        if (fd == -1)
+        if (!mapAidingDb())
         {
             // Failed
             LOGV("%s : Can not load aiding data from %s : %i", __FUNCTION__, m_pAlpTempFile, errno);
             return false;
         }
         
-        if (loadDatabase(fd, &m_Db))
+        int records = 0;
+        unsigned char crc[2] = { 0, 0 };
+        crcUbx(crc, (const unsigned char*) &m_pAidDb->pos, sizeof(m_pAidDb->pos));
+        if (0 == memcmp(crc, m_pAidDb->posCrc, sizeof(crc)))
+            memcpy(&m_Db.pos, &m_pAidDb->pos, sizeof(m_Db.pos));
+        memset(crc, 0, sizeof(crc));
+        crcUbx(crc, (const unsigned char*) &m_pAidDb->time, sizeof(m_pAidDb->time));
+        if (0 == memcmp(crc, m_pAidDb->timeCrc, sizeof(crc)))
+            memcpy(&m_Db.time, &m_pAidDb->time, sizeof(m_Db.time));
+        if (loadAidingRec(&m_pAidDb->hui, &m_Db.hui))
+            records ++;
+        for (int svix = 0; svix < NUM_GPS_SVS; svix ++)
         {
-            m_Db.dbAssistCleared = false;
-            LOGV("%s : Aiding data loaded successfully", __FUNCTION__);
+            if (loadAidingRec(&m_pAidDb->eph[svix], &m_Db.sv[svix].eph))
+                records ++;
+            if (loadAidingRec(&m_pAidDb->alm[svix], &m_Db.sv[svix].alm))
+                records ++;
+            if (loadAidingRec(&m_pAidDb->aop[svix], &m_Db.sv[svix].aop))
+                records ++;
+        }
+        loadAlpData();
+        
+        m_Db.dbAssistCleared = false;
+        LOGV("%s : Aiding data loaded successfully, %d records", __FUNCTION__, records);
 
 		char brand[PROPERTY_VALUE_MAX];
 		char model[PROPERTY_VALUE_MAX];
@@ -1436,13 +1735,6 @@ bool CUbxGpsState::loadAiding(void)
 		else
 			snprintf(m_agpsThreadParam.request, MAX_REQUEST, "and=%s.%s", brand, model);
 		m_agpsThreadParam.request[MAX_REQUEST-1] = '\0';
-        }
-        else
-        {
-            LOGV("%s : Failed to load aiding data", __FUNCTION__);
-        }
-        
-        close(fd);
     }
     else
     {
@@ -1453,193 +1745,181 @@ bool CUbxGpsState::loadAiding(void)
     return true;
 }
 
-//! Reads data from a file into a DB_s structure
-/*! The DB_s structure is populated one field at a time.
-    To populate each field, a corresponding 'loadBuffer' function is called for handling that field type. 
+//! Maps the aiding database file to memory
+/*! Opens or creates the aiding database file and maps it. A file with a different 
+    magic word, version or size is reinitialised and gets the aiding data currently 
+	held in memory.
 
-	\param fd the file handle of the file to read
-	\param pDb a pointer to the structure to populate
-	\return true if all fields were populated, false otherwise 
+	\return true if the file is mapped, false otherwise 
 */
-bool CUbxGpsState::loadDatabase(int fd, struct DB_s* pDb)
+bool CUbxGpsState::mapAidingDb(void)
 {
-    LOGV("%s : Loading DB 'hui'", __FUNCTION__);
-    if (!loadBuffer(fd, &pDb->hui))
-    {
-        LOGV("%s : Failed to load database 'hui' field", __FUNCTION__);
-        return false;
-    }
-    
-    LOGV("%s : Loading DB 'apl'", __FUNCTION__);
-    if (!loadBuffer(fd, &pDb->alp))
-    {
-        LOGV("%s : Failed to load database 'alp' field", __FUNCTION__);
+    if (m_pAidDb != NULL)
+        return true;
+        
+    int fd = open(m_pAlpTempFile, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd == -1)
         return false;
-    }
-
-    LOGV("%s : Loading DB 'pos'", __FUNCTION__);
-    if (!loadBuffer(fd, (unsigned char*) &pDb->pos, sizeof(pDb->pos)))
+        
+    struct stat st;
+    bool fresh = (fstat(fd, &st) != 0) || (st.st_size != (off_t) sizeof(AIDDB_FILE_t));
+    if (fresh)
     {
-        LOGV("%s : Failed to load database 'pos' field", __FUNCTION__);
-        return false;
+        // drop a file of an older layout and zero fill the new one 
+        if ((ftruncate(fd, 0) != 0) || (ftruncate(fd, (off_t) sizeof(AIDDB_FILE_t)) != 0))
+        {
+            close(fd);
+            return false;
+        }
     }
-
-    LOGV("%s : Loading DB 'time'", __FUNCTION__);
-    if (!loadBuffer(fd, (unsigned char*) &pDb->time, sizeof(pDb->time)))
-    {
-        LOGV("%s : Failed to load database 'time' field", __FUNCTION__);
+    void* p = mmap(NULL, sizeof(AIDDB_FILE_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
         return false;
-    }
-
-    // Save ok so far, so continue
-    for(int i = 0; i < NUM_GPS_SVS; i++)
+    m_pAidDb = (AIDDB_FILE_t*) p;
+    
+    if (fresh || (m_pAidDb->magic != AIDDB_MAGIC) || 
+        (m_pAidDb->version != AIDDB_VERSION) || (m_pAidDb->size != sizeof(AIDDB_FILE_t)))
     {
-        //LOGV("%s : Loading DB 'sv'[%i]", __FUNCTION__, i);
-        if (!loadBuffer(fd, &pDb->sv[i]))
+        LOGV("%s : Initialising aiding database %s", __FUNCTION__, m_pAlpTempFile);
+        memset(m_pAidDb, 0, sizeof(AIDDB_FILE_t));
+        m_pAidDb->magic = AIDDB_MAGIC;
+        m_pAidDb->version = AIDDB_VERSION;
+        m_pAidDb->size = sizeof(AIDDB_FILE_t);
+        storeAidingPosTime();
+        storeAidingRec(&m_pAidDb->hui, &m_Db.hui);
+        for (int svix = 0; svix < NUM_GPS_SVS; svix ++)
         {
-            LOGV("%s : Failed to load database sv[%i] field", __FUNCTION__, i);
-            return false;               // Failed, give up
+            storeAidingRec(&m_pAidDb->eph[svix], &m_Db.sv[svix].eph);
+            storeAidingRec(&m_pAidDb->alm[svix], &m_Db.sv[svix].alm);
+            storeAidingRec(&m_pAidDb->aop[svix], &m_Db.sv[svix].aop);
         }
+        syncAidingDb(m_pAidDb, sizeof(AIDDB_FILE_t), MS_SYNC);
     }
-       
-    LOGV("%s : Aiding database loaded", __FUNCTION__);
     return true;
 }
 
-//! Reads data from a file into a BUF_t structure
-/*! The BUF_t structure is populated one field at a time.
-    To populate each field, a corresponding 'loadBuffer' function is called for handling that field type. 
-
-	\param fd the file handle of the file to read
-	\param pBuffer a pointer to the structure to populate
-	\return true if all fields were populated, false otherwise 
+//! Unmaps the aiding database file
+/*! Writes back all pending changes and unmaps the file, further changes of the 
+    aiding data are no longer stored.
 */
-bool CUbxGpsState::loadBuffer(int fd, BUF_t* pBuffer)
+void CUbxGpsState::unmapAidingDb(void)
 {
-    unsigned int length = 0;
-    
-    //LOGV("%s : Loading BUF_t 'i'", __FUNCTION__);
-    //LOGV("%s : Initial Buf  p %p  i %i", __FUNCTION__, pBuffer->p, pBuffer->i);
-    if (!loadBuffer(fd, (unsigned char*) &length, sizeof(length)))
-    {
-        LOGV("%s : Failed to load buffer length", __FUNCTION__);
-        return false;
-    }
-    
-    unsigned char* p = NULL;
-    if (length > 0)
+    if (m_pAidDb != NULL)
     {
-        p = (unsigned char*) malloc(length);
-        if (!p)
-        {
-            LOGV("%s : Failed to allocate buffer", __FUNCTION__);
-            return false;
-        }
-        //LOGV("%s : Loading BUF_t 'p'", __FUNCTION__);
-        if (!loadBuffer(fd, p, (int) length))
-        {
-            LOGV("%s : Failed to load buffer", __FUNCTION__);
-            free(p);
-            return false;
-        }
+        syncAidingDb(m_pAidDb, sizeof(AIDDB_FILE_t), MS_SYNC);
+        munmap(m_pAidDb, sizeof(AIDDB_FILE_t));
+        m_pAidDb = NULL;
     }
-    
-    free(pBuffer->p);
-    pBuffer->p = p;
-    pBuffer->i = length;
+}
 
-    return true;
+//! Gets the record of the aiding database file for a message
+/*! \param msgId the message Id of the UBX-AID message
+	\param svix  the satellite index for per satellite messages
+	\return the record or NULL if the file is not mapped or the message is not stored
+*/
+CUbxGpsState::AIDDB_REC_t* CUbxGpsState::getAidingRec(unsigned char msgId, unsigned int svix /*= 0*/)
+{
+    if ((m_pAidDb == NULL) || (svix >= NUM_GPS_SVS))
+        return NULL;
+    if (msgId == 0x02)
+        return &m_pAidDb->hui;
+    if (msgId == 0x30)
+        return &m_pAidDb->alm[svix];
+    if (msgId == 0x31)
+        return &m_pAidDb->eph[svix];
+    if (msgId == 0x33)
+        return &m_pAidDb->aop[svix];
+    return NULL;
 }
 
-//! Reads data from a file into a DBALP_t structure
-/*! The DBALP_t structure is populated one field at a time.
-    To populate each field, a corresponding 'loadBuffer' function is called for handling that field type. 
+//! Stores a buffer in a record of the aiding database file
+/*! The record is updated in place and its pages are scheduled for writing. An 
+    empty buffer clears the record. 
 
-	\param fd the file handle of the file to read
-	\param pBuffer a pointer to the structure to populate
-	\return true if all fields were populated, false otherwise 
+	\param pRec the record to update, may be NULL
+	\param pBuf the buffer to store
 */
-bool CUbxGpsState::loadBuffer(int fd, DBALP_t* pBuffer)
+void CUbxGpsState::storeAidingRec(AIDDB_REC_t* pRec, const BUF_t* pBuf)
 {
-    //LOGV("%s : Loading DBALP_t 'file'", __FUNCTION__);
-    if (!loadBuffer(fd, &pBuffer->file))
-    {
-        LOGV("%s : Failed to load DBALP_t 'file' field", __FUNCTION__);
-        return false;
-    }
-    
-    //LOGV("%s : Loading DBALP_t 'fileId'", __FUNCTION__);
-    if (!loadBuffer(fd, (unsigned char*) &pBuffer->fileId, sizeof(pBuffer->fileId)))
+    if (pRec == NULL)
+        return;
+    if ((pBuf->p == NULL) || (pBuf->i > sizeof(pRec->msg)))
     {
-        LOGV("%s : Failed to load DBALP_t 'fileId' field", __FUNCTION__);
-        return false;
+        if (pBuf->p != NULL)
+            LOGW("%s : Message size %d exceeds record, not stored", __FUNCTION__, pBuf->i);
+        pRec->len = 0;
     }
-    
-    //LOGV("%s : Loading DBALP_t 'timeRefMs'", __FUNCTION__);
-    if (!loadBuffer(fd, (unsigned char*) &pBuffer->timeRefMs, sizeof(pBuffer->timeRefMs)))
+    else
     {
-        LOGV("%s : Failed to load DBALP_t 'timeRefMs' field", __FUNCTION__);
-        return false;
+        pRec->len = 0;
+        memcpy(pRec->msg, pBuf->p, pBuf->i);
+        pRec->len = pBuf->i;
     }
-    
-    return true;
+    syncAidingDb(pRec, sizeof(*pRec), MS_ASYNC);
 }
 
-//! Reads data from a file into a DBSV_t structure
-/*! The DBSV_t structure is populated one field at a time.
-    To populate each field, a corresponding 'loadBuffer' function is called for handling that field type. 
+//! Loads a buffer from a record of the aiding database file
+/*! The record is only taken over if it holds a complete UBX message with a valid 
+    checksum. 
 
-	\param fd the file handle of the file to read
-	\param pBuffer a pointer to the structure to populate
-	\return true if all fields were populated, false otherwise 
+	\param pRec the record to load
+	\param pBuf the buffer to populate
+	\return true if the record was loaded, false if empty or invalid
 */
-bool CUbxGpsState::loadBuffer(int fd, DBSV_t* pBuffer)
+bool CUbxGpsState::loadAidingRec(const AIDDB_REC_t* pRec, BUF_t* pBuf)
 {
-    //LOGV("%s : Loading DBSV_t 'eph'", __FUNCTION__);
-    if (!loadBuffer(fd, &pBuffer->eph))
-    {
-        LOGV("%s : Failed to load DBSV_t 'eph' field", __FUNCTION__);
+    unsigned int len = pRec->len;
+    if ((len < 8) || (len > sizeof(pRec->msg)))
         return false;
-    }
-    
-    //LOGV("%s : Loading DBSV_t 'alm'", __FUNCTION__);
-    if (!loadBuffer(fd, &pBuffer->alm))
-    {
-        LOGV("%s : Failed to load DBSV_t 'alm' field", __FUNCTION__);
+    const unsigned char* pMsg = pRec->msg;
+    if ((pMsg[0] != 0xB5) || (pMsg[1] != 'b') || 
+        ((unsigned int) (pMsg[4] | (pMsg[5] << 8)) + 8 != len))
         return false;
-    }
-
-    //LOGV("%s : Loading DBSV_t 'aop'", __FUNCTION__);
-    if (!loadBuffer(fd, &pBuffer->aop))
+    unsigned char crc[2] = { 0, 0 };
+    crcUbx(crc, &pMsg[2], (int) len - 4);
+    if ((crc[0] != pMsg[len-2]) || (crc[1] != pMsg[len-1]))
     {
-        LOGV("%s : Failed to load DBSV_t 'aop' field", __FUNCTION__);
+        LOGV("%s : Bad checksum UBX-%02X-%02X", __FUNCTION__, pMsg[2], pMsg[3]);
         return false;
     }
-
+    replaceBuf(pBuf, pMsg, len);
     return true;
 }
 
-//! Reads data from a file into memory
-/*! This is the lowest level loadBuffer fuction which reads the file and puts the data into a memory buffer
-    which typically repesents a field within a bigger structure.
+//! Stores the position and time aiding in the aiding database file
+/*! Both are updated in place together with their checksums.
+*/
+void CUbxGpsState::storeAidingPosTime(void)
+{
+    if (m_pAidDb == NULL)
+        return;
+    memcpy(&m_pAidDb->pos, &m_Db.pos, sizeof(m_pAidDb->pos));
+    memset(m_pAidDb->posCrc, 0, sizeof(m_pAidDb->posCrc));
+    crcUbx(m_pAidDb->posCrc, (const unsigned char*) &m_pAidDb->pos, sizeof(m_pAidDb->pos));
+    memcpy(&m_pAidDb->time, &m_Db.time, sizeof(m_pAidDb->time));
+    memset(m_pAidDb->timeCrc, 0, sizeof(m_pAidDb->timeCrc));
+    crcUbx(m_pAidDb->timeCrc, (const unsigned char*) &m_pAidDb->time, sizeof(m_pAidDb->time));
+    syncAidingDb(&m_pAidDb->pos, (size_t) ((const unsigned char*) &m_pAidDb->hui - (const unsigned char*) &m_pAidDb->pos), MS_ASYNC);
+}
 
-	\param fd the file handle of the file to read
-	\param pBuffer a pointer to memory to populate
-    \param length the number of bytes to read into the buffer
-	\return true if all bytes were read, false otherwise 
+//! Writes back a range of the aiding database file
+/*! \param p     the start of the range within the mapping
+	\param size  the size of the range
+	\param flags MS_SYNC to wait for the write or MS_ASYNC to only schedule it
 */
-bool CUbxGpsState::loadBuffer(int fd, unsigned char* pBuffer, int length)
+void CUbxGpsState::syncAidingDb(const void* p, size_t size, int flags)
 {
-    //LOGV("%s : Loading stream of %i bytes", __FUNCTION__, length);
-    if (read(fd, pBuffer, (unsigned int) length) == length)
-        return true;
-        
-    return false;
+    // msync needs a page aligned start 
+    uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t) p & ~(page - 1);
+    if (msync((void*) start, (size_t) ((uintptr_t) p + size - start), flags) != 0)
+        LOGV("%s : msync failed : %i", __FUNCTION__, errno);
 }
 
 //! Saves aiding data to a temporary file.
-/*! Saves the current aiding data to a temporary file, ready to be loaded back into
-    the receiver the next time it is started.
+/*! The aiding records are already updated in the mapped file, so only the pending 
+    writes are completed. The Assistnow Offline file is stored if it has changed.
 */
 void CUbxGpsState::saveAiding(void)
 {
@@ -1647,31 +1927,22 @@ void CUbxGpsState::saveAiding(void)
     {
         LOGV("%s : Saving aiding data to %s", __FUNCTION__, m_pAlpTempFile);
 
-        int fd = open(m_pAlpTempFile, O_CREAT | O_WRONLY | O_TRUNC, O_RDWR);
-        
-        if (fd == -1)
+        if (m_pAidDb == NULL)
         {
             // failed
-            LOGV("%s : Can not save aiding data to %s : %i", __FUNCTION__, m_pAlpTempFile, errno);
+            LOGV("%s : Can not save aiding data to %s", __FUNCTION__, m_pAlpTempFile);
             return;
         }
   
-        // Save the database
-        if (saveDatabase(fd, &m_Db))
+        syncAidingDb(m_pAidDb, sizeof(AIDDB_FILE_t), MS_SYNC);
+        if (m_Db.dbAlpChanged && !saveAlpData())
         {
-            // Success
-            close(fd);
-            chmod(m_pAlpTempFile, S_IRUSR | S_IWUSR);
-            LOGV("%s : Aiding data saved succesfully", __FUNCTION__);
-            
-            m_Db.dbAssistChanged = false;
+            LOGV("%s : Alp data save failed - file removed", __FUNCTION__);
         }
         else
         {
-            // Failed
-            close(fd);
-            remove(m_pAlpTempFile);
-            LOGV("%s : Aiding data save failed - temp file removed", __FUNCTION__);
+            LOGV("%s : Aiding data saved succesfully", __FUNCTION__);
+            m_Db.dbAssistChanged = false;
         }
     }
     else
@@ -1680,171 +1951,153 @@ void CUbxGpsState::saveAiding(void)
     }
 }
 
-//! Write data to a file into a DB_s structure
-/*! The DB_s structure is written one field at a time.
-    To write each field, a corresponding 'saveBuffer' function is called for handling that field type. 
-
-	\param fd the file handle of the file to write too
-	\param pDb a pointer to the structure to write
-	\return true if all fields were written, false otherwise 
+//! Maps the stored Assistnow Offline file 
+/*! \return true if the file was mapped, false otherwise 
 */
-bool CUbxGpsState::saveDatabase(int fd, const struct DB_s* pDb)
+bool CUbxGpsState::loadAlpData(void)
 {
-    LOGV("%s : saving DB 'hui'", __FUNCTION__); 
-    if (!saveBuffer(fd, &pDb->hui))
-    {
-        LOGV("%s : Failed to save database hui field", __FUNCTION__);
+    if (m_pAlpDataFile == NULL)
         return false;
-    }  
-    
-    LOGV("%s : saving DB 'alp'", __FUNCTION__); 
-    if (!saveBuffer(fd, &pDb->alp))
-    {
-        LOGV("%s : Failed to save database alp field", __FUNCTION__);
-        return false;
-    }
-
-    LOGV("%s : saving DB 'pos'", __FUNCTION__); 
-    if (!saveBuffer(fd, (unsigned char *) const_cast<CUbxGpsState::DBPOS_s*>(&pDb->pos), sizeof(pDb->pos)))
-    {
-        LOGV("%s : Failed to save database pos field", __FUNCTION__);
-        return false;
-    }
-    
-    LOGV("%s : saving DB 'time'", __FUNCTION__); 
-    if (!saveBuffer(fd, (unsigned char *) const_cast<CUbxGpsState::DBTIME_s*>(&pDb->time), sizeof(pDb->time)))
-    {
-        LOGV("%s : Failed to save database time field", __FUNCTION__);
+    int fd = open(m_pAlpDataFile, O_RDWR);
+    if (fd == -1)
         return false;
-    }
- 
-    for(int i = 0; i < NUM_GPS_SVS; i++)
-    {
-        LOGV("%s : saving DB 'sv'[%i]", __FUNCTION__, i); 
-        if (!saveBuffer(fd, &pDb->sv[i]))
-        {
-            LOGV("%s : Failed to save database sv[%i] field", __FUNCTION__, i);
-            return false;               // Failed, give up
-        }
-    }
-    
-    return true;
+    bool ok = mapAlpData(fd);
+    close(fd);
+    LOGV("%s : Alp file %s %s", __FUNCTION__, m_pAlpDataFile, ok ? "loaded" : "invalid");
+    return ok;
 }
 
-//! Write data to a file from a DBSV_t structure
-/*! Each field in the DBSV_t structure is individually written to the file.
-    To write each field, a corresponding 'saveBuffer' function is called for handling that field type. 
+//! Maps an Assistnow Offline data file
+/*! The file replaces the current ALP file. Only the headers are checked, the data 
+    is paged in when the receiver requests it. Updates from the receiver are written
+	to the mapping. 
 
-	\param fd the file handle of the file to write too
-	\param pBuffer a pointer to the structure to write to the file
-	\return true if all fields were written, false otherwise 
+	\param fd the file handle of the file to map
+	\return true if the file was mapped, false otherwise 
 */
-bool CUbxGpsState::saveBuffer(int fd, const DBSV_t* pBuffer)
+bool CUbxGpsState::mapAlpData(int fd)
 {
-    //LOGV("%s : saving DBSV_t 'eph'", __FUNCTION__); 
-    if (!saveBuffer(fd, &pBuffer->eph))
-    {
-        LOGV("%s : Failed to save DBSV_t 'eph' field", __FUNCTION__);
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (st.st_size <= (off_t) sizeof(ALP_DATA_HEADER_t)))
         return false;
-    }
-    
-    //LOGV("%s : saving DBSV_t 'alm'", __FUNCTION__); 
-    if (!saveBuffer(fd, &pBuffer->alm))
-    {
-        LOGV("%s : Failed to save DBSV_t 'alm' field", __FUNCTION__);
+    void* p = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
         return false;
-    }
-        
-    //LOGV("%s : saving DBSV_t 'aop'", __FUNCTION__); 
-    if (!saveBuffer(fd, &pBuffer->aop))
+    ALP_DATA_HEADER_t* pHead = (ALP_DATA_HEADER_t*) p;
+    if (((off_t) (sizeof(*pHead) + pHead->size) != st.st_size) || 
+        !checkAlpHeader((const unsigned char*) &pHead[1], pHead->size))
     {
-        LOGV("%s : Failed to save DBSV_t 'aop' field", __FUNCTION__);
+        munmap(p, (size_t) st.st_size);
         return false;
     }
-    
+    unmapAlpData();
+    freeBuf(&m_Db.alp.file);
+    m_pAlpData = pHead;
+    m_Db.alp.file.p = (unsigned char*) &pHead[1];
+    m_Db.alp.file.i = pHead->size;
+    m_Db.alp.fileId = pHead->fileId;
+    m_Db.alp.timeRefMs = pHead->timeRefMs;
     return true;
 }
 
-//! Write data to a file from a BUF_t structure
-/*! Each field in the BUF_t structure is individually written to the file.
-    To write each field, a corresponding 'saveBuffer' function is called for handling that field type. 
-
-	\param fd the file handle of the file to write too
-	\param pBuffer a pointer to the structure to write to the file
-	\return true if all fields were written, false otherwise 
+//! Unmaps the Assistnow Offline data file
+/*! The ALP file is no longer available afterwards. 
 */
-bool CUbxGpsState::saveBuffer(int fd, const BUF_t* pBuffer)
+void CUbxGpsState::unmapAlpData(void)
 {
-    //LOGV("%s : saving BUF_t 'i'", __FUNCTION__); 
-    if (!(saveBuffer(fd, (unsigned char *) const_cast<unsigned int*>(&pBuffer->i), sizeof(pBuffer->i))))
+    if (m_pAlpData != NULL)
     {
-        LOGV("%s : Failed to save BUF_t length", __FUNCTION__);
-        return false;
+        munmap(m_pAlpData, sizeof(ALP_DATA_HEADER_t) + m_pAlpData->size);
+        m_pAlpData = NULL;
+        m_Db.alp.file.p = NULL;
+        m_Db.alp.file.i = 0;
     }
-
-    //LOGV("%s : saving BUF_t 'p'", __FUNCTION__);     
-    if (!saveBuffer(fd, pBuffer->p, (int) pBuffer->i))
-    {
-        LOGV("%s : Failed to save BUF_t buffer", __FUNCTION__);
-        return false;
-    }
-    
-    return true;
 }
 
-//! Write data to a file from a DBALP_t structure
-/*! Each field in the DBALP_t structure is individually written to the file.
-    To write each field, a corresponding 'saveBuffer' function is called for handling that field type. 
+//! Stores a new Assistnow Offline file and maps it
+/*! The file is written with a single call to a temporary file which then replaces
+    the stored one, so a stored file is always complete. 
 
-	\param fd the file handle of the file to write too
-	\param pBuffer a pointer to the structure to write to the file
-	\return true if all fields were written, false otherwise 
+	\param pData The pointer to the complete ALP file
+	\param iData The size of the complete ALP file
+	\return true if the file was stored and mapped, false otherwise 
 */
-bool CUbxGpsState::saveBuffer(int fd, const DBALP_t* pBuffer)
+bool CUbxGpsState::storeAlpData(const unsigned char* pData, unsigned int iData)
 {
-    //LOGV("%s : saving DBALP_t 'file'", __FUNCTION__); 
-    if (!saveBuffer(fd, &pBuffer->file))
-    {
-        LOGV("%s : Failed to save DBALP_t 'file' field", __FUNCTION__);
+    if ((m_pAlpDataFile == NULL) || (m_pAlpDataTmpFile == NULL))
         return false;
-    }
-        
-    //LOGV("%s : saving DBALP_t 'fileId'", __FUNCTION__); 
-    if (!saveBuffer(fd, (unsigned char *) const_cast<U2 *>(&pBuffer->fileId), sizeof(pBuffer->fileId)))
+    const char* tmpFile = m_pAlpDataTmpFile;
+    int fd = open(tmpFile, O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1)
     {
-        LOGV("%s : Failed to save DBALP_t 'fileId' field", __FUNCTION__);
+        LOGE("%s : Can not create %s : %i", __FUNCTION__, tmpFile, errno);
         return false;
     }
-    
-    //LOGV("%s : saving DBALP_t 'timeRefMs'", __FUNCTION__); 
-    if (!saveBuffer(fd, (unsigned char *) const_cast<int64_t*>(&pBuffer->timeRefMs), sizeof(pBuffer->timeRefMs)))
+    ALP_DATA_HEADER_t head;
+    memset(&head, 0, sizeof(head));
+    head.size = iData;
+    head.fileId = (U2) (m_Db.alp.fileId + 1);
+    head.timeRefMs = currentRefTimeMs();
+    struct iovec iov[2];
+    iov[0].iov_base = &head;
+    iov[0].iov_len = sizeof(head);
+    iov[1].iov_base = const_cast<unsigned char*>(pData);
+    iov[1].iov_len = iData;
+    bool ok = (writev(fd, iov, 2) == (ssize_t) (sizeof(head) + iData)) && 
+              (rename(tmpFile, m_pAlpDataFile) == 0) && 
+              mapAlpData(fd);
+    close(fd);
+    if (!ok)
     {
-        LOGV("%s : Failed to save DBALP_t 'timeRefMs' field", __FUNCTION__);
-        return false;
+        LOGE("%s : Can not store %s : %i", __FUNCTION__, m_pAlpDataFile, errno);
+        remove(tmpFile);
     }
-    
-    return true;
+    return ok;
 }
 
-//! Write data from memory to a file
-/*! This is the lowest level loadBuffer fuction which reads the file and puts the data into a memory buffer
-    which typically repesents a field within a bigger structure.
+//! Saves the Assistnow Offline file 
+/*! A mapped file only has its updates written back. A file kept in memory is written 
+    with a single call, without a file a stored one is removed.
 
-	\param fd the file handle of the file to write too
-	\param pBuffer a pointer to memory containing data to write
-    \param length the number of bytes to write to the file
-	\return true if all bytes were written, false otherwise 
+	\return true if the file was saved or removed, false otherwise 
 */
-bool CUbxGpsState::saveBuffer(int fd, const unsigned char* pBuffer, int length)
+bool CUbxGpsState::saveAlpData(void)
 {
-    //LOGV("%s : saving buffer of length %i", __FUNCTION__, length);
-    if (length > 0)
+    if (m_pAlpDataFile == NULL)
+        return false;
+    if (m_pAlpData != NULL)
     {
-        if (write(fd, pBuffer, (unsigned int) length) != length)
-            return false;
+        syncAidingDb(m_pAlpData, sizeof(ALP_DATA_HEADER_t) + m_pAlpData->size, MS_SYNC);
+        m_Db.dbAlpChanged = false;
+        return true;
+    }
+    if ((m_Db.alp.file.p == NULL) || (m_Db.alp.file.i == 0))
+    {
+        remove(m_pAlpDataFile);
+        m_Db.dbAlpChanged = false;
+        return true;
     }
     
-    return true;
+    int fd = open(m_pAlpDataFile, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1)
+        return false;
+    ALP_DATA_HEADER_t head;
+    memset(&head, 0, sizeof(head));
+    head.size = m_Db.alp.file.i;
+    head.fileId = m_Db.alp.fileId;
+    head.timeRefMs = m_Db.alp.timeRefMs;
+    struct iovec iov[2];
+    iov[0].iov_base = &head;
+    iov[0].iov_len = sizeof(head);
+    iov[1].iov_base = m_Db.alp.file.p;
+    iov[1].iov_len = m_Db.alp.file.i;
+    bool ok = (writev(fd, iov, 2) == (ssize_t) (sizeof(head) + m_Db.alp.file.i));
+    close(fd);
+    if (ok)
+        m_Db.dbAlpChanged = false;
+    else
+        remove(m_pAlpDataFile);
+    return ok;
 }
 
 
@@ -49,6 +49,7 @@
 #include "ubx_udpServer.h"
 #include "gps_thread.h"
 #include "ubx_messageDef.h"
+#include "database.h"
 
 //lint -sem(CUbxGpsState::lock,thread_lock)
 //lint -sem(CUbxGpsState::unlock,thread_unlock)
@@ -111,6 +112,11 @@ public:
     const char* getAlpFilename(void) const { return m_pAlpTempFile; };
     int getStoppingTimeoutMs(void) const { return m_stoppingTimeoutMs; };
     int getXtraPollingInterval(void) const { return m_xtraPollInterval; };
+    CDatabase::MSG_t getEpochEndMsg(void) const { return m_epochEndMsg; };
+    int getBatchSize(void) const { return m_batchSize; };
+    int getBatchIntervalMs(void) const { return m_batchIntervalMs; };
+    const char* getCaptureFile(void) const { return m_pCaptureFile; };
+    bool getDebugStateBinary(void) const { return m_debugStateBinary; };
 
 	// Threading help
 	void lock(void);
@@ -124,6 +130,7 @@ public:
 	
 #ifdef SUPL_ENABLED	
 	void sendEph(const void* pData, int size);
+	void sendEphs(const void* pData, int size, int num);
 	void sendAidingData(const GPS_UBX_AID_INI_U5__t *pAidingData);
 	void sendUtcModel(const GPS_UBX_AID_HUI_t *pUtcModel);
 	
@@ -143,6 +150,7 @@ public:
 	bool getLogSuplMessages(void) const { return m_logSuplMessages; };
 	bool getCmccLogActive(void) const { return m_cmccLogActive; };
 	bool getSuplMsgToFile(void) const { return m_suplMsgToFile; };
+	int getSuplKeepAlive(void) const { return m_suplKeepAlive; };
 #endif
 
 protected:
@@ -150,10 +158,17 @@ protected:
     int m_baudRate;				//!< General baud rate to communicate with receiver
     int m_baudRateDef;			//!< Initial baud rate to communicate with receiver
     char* m_pAlpTempFile;		//!< Path and filename to store alp data
+    char* m_pAlpDataFile;		//!< Path and filename to store the Assistnow Offline file
+    char* m_pAlpDataTmpFile;	//!< Path and filename the Assistnow Offline file is written to before it replaces m_pAlpDataFile
     int m_stoppingTimeoutMs;	//!< Maximum time (in ms) to wait for receiver acknowlegements during 'stopping'
     int m_xtraPollInterval;		//!< Interval between polling AssistNow Offline server (in ms)
 	bool m_receiverShutdownAck;	//!< True if receiver's shutdown acknowledgement has been received
 	int m_persistence;			//!< Persistence flag. True - save alp database to file. False - don't
+	CDatabase::MSG_t m_epochEndMsg;	//!< Message output last in each epoch, MSG_NUM if not configured
+	int m_batchSize;			//!< Number of fixes to batch before reporting them, 0 reports every fix
+	int m_batchIntervalMs;		//!< Maximum time (in ms) to hold a batched fix, 0 holds until the batch is full
+	char* m_pCaptureFile;		//!< File to record the received data to, NULL if not configured
+	bool m_debugStateBinary;	//!< Report the receive path statistics of the debug interface binary instead of text
 	
 	CSerialPort* m_pSer;		//!< Pointer to serial communications class instance
 #if defined UDP_SERVER_PORT    
@@ -240,8 +255,50 @@ protected:
 		int			rateMs;				//!< The requested measurement rate
         bool        dbAssistChanged;    //!< Flag indicating if the DB assistance data has changed since it was last loaded
         bool        dbAssistCleared;    //!< Flag indicating if the DB assistance data is cleared 
+        bool        dbAlpChanged;       //!< Flag indicating if the Assistnow Offline file has changed since it was last saved
 	} m_Db;
 
+	enum 
+	{ 
+		AIDDB_MAGIC				= 0x42446275,	//!< magic word of the aiding database file ("ubDB")
+		AIDDB_VERSION			= 1,			//!< version of the aiding database file layout
+		AIDDB_MSG_MAX			= 256			//!< maximum size of a UBX message stored in the aiding database file
+	};
+
+	//! Persistent aiding record, a complete UBX message validated by its own checksum 
+	typedef struct AIDDB_REC_s
+	{
+		U4 len;								//!< Length of the message, 0 if empty
+		unsigned char msg[AIDDB_MSG_MAX];	//!< The message including framing and checksum
+	} AIDDB_REC_t;
+
+	//! Fixed layout of the memory mapped aiding database file 
+	typedef struct AIDDB_FILE_s
+	{
+		U4			magic;					//!< Magic word #AIDDB_MAGIC
+		U4			version;				//!< Layout version #AIDDB_VERSION
+		U4			size;					//!< Size of the file, must match sizeof(AIDDB_FILE_t)
+		DBPOS_t		pos;					//!< Position Aiding database
+		U1			posCrc[2];				//!< UBX checksum of pos
+		DBTIME_t	time;					//!< Time Aiding database
+		U1			timeCrc[2];				//!< UBX checksum of time
+		AIDDB_REC_t	hui;					//!< Health/UTC/Ionosphere UBX-AID-HUI message
+		AIDDB_REC_t	eph[NUM_GPS_SVS];		//!< Ephemeris UBX-AID-EPH messages
+		AIDDB_REC_t	alm[NUM_GPS_SVS];		//!< Almanac UBX-AID-ALM messages
+		AIDDB_REC_t	aop[NUM_GPS_SVS];		//!< AssistNow Autonomous UBX-AID-AOP messages
+	} AIDDB_FILE_t;
+	AIDDB_FILE_t* m_pAidDb;				//!< The aiding database file mapped to memory, NULL if not mapped
+
+	//! Header of the stored Assistnow Offline file, followed by the ALP file
+	typedef struct ALP_DATA_HEADER_s
+	{
+		U4 size;			//!< Size of the ALP file following the header
+		U2 fileId;			//!< The file id chosen
+		U2 reserved;		//!< Reserved
+		int64_t timeRefMs;	//!< The time when the file was received
+	} ALP_DATA_HEADER_t;
+	ALP_DATA_HEADER_t* m_pAlpData;		//!< The stored Assistnow Offline file mapped to memory, NULL if not mapped
+
 #ifdef SUPL_ENABLED
 	int m_almanacRequest;				//!< If true, request almanac assistance data in Supl transaction 
 	int m_utcModelRequest;				//!< If true, request utc model assistance data in Supl transaction
@@ -258,35 +315,64 @@ protected:
 	bool m_logSuplMessages;				//!< If true, log SUPL & RRLP messages
 	bool m_cmccLogActive;				//!< If true, generate CMCC logging
 	bool m_suplMsgToFile;				//!< If true, redirect Supl & RRLP messages to log file
+	int m_suplKeepAlive;				//!< Time (in seconds) to keep a connection to the SLP open for the next session, 0 disables
 #endif	
 	
 	// UBX Message creation and writing 
+	#define UBX_BATCH_MAX (3 * NUM_GPS_SVS + 1)	//!< Max number of messages in an output batch
+	//! Output batch, messages are written to the receiver with a single writev
+	typedef struct UBX_BATCH_s
+	{
+		int			num;						//!< Number of messages framed in the batch
+		int			iov;						//!< Number of used entries in vec
+		int			size;						//!< Number of bytes in the batch
+		unsigned char head[UBX_BATCH_MAX][6];	//!< Headers of the messages framed in the batch
+		unsigned char crc[UBX_BATCH_MAX][2];	//!< Checksums of the messages framed in the batch
+		struct iovec vec[4 * UBX_BATCH_MAX];	//!< Scatter list referencing headers, payloads and checksums
+	} UBX_BATCH_t;
+	
 	static void crcUbx(unsigned char crc[2], const unsigned char* pData, int iData);
+	static int frameUbx(struct iovec vec[4], unsigned char head[6], unsigned char crc[2],
+						unsigned char classID, unsigned char msgID, 
+						const void* pData0, int iData0, const void* pData1, int iData1);
+	bool writeUbxVec(const struct iovec* pVec, int iov, int size);
 	bool writeUbx(unsigned char classID, unsigned char msgID, 
 				  const void* pData0, int iData0, 
 				  const void* pData1 = NULL, int iData1 = 0);
+	bool writeUbxBatch(unsigned char classID, unsigned char msgID, 
+					   const void* pData, int iData, int num);
+	bool addUbx(UBX_BATCH_t* pBatch, unsigned char classID, unsigned char msgID, 
+				const void* pData0, int iData0, 
+				const void* pData1 = NULL, int iData1 = 0);
+	bool addUbxRaw(UBX_BATCH_t* pBatch, const void* pMsg, int iMsg);
+	bool flushUbx(UBX_BATCH_t* pBatch);
                         
+    // Epoch handling
+    static CDatabase::MSG_t lookupEpochEndMsg(const char* pName);
+
     // Power handling
     static bool powerOn(void);
     static void powerOff(void);
     
 	// Load/Saving of aiding data
     bool loadAiding(void);
-    static bool loadDatabase(int fd, struct DB_s* pDb);
-    static bool loadBuffer(int fd, BUF_t* pBuffer);
-    static bool loadBuffer(int fd, DBALP_t* pBuffer);
-    static bool loadBuffer(int fd, DBSV_t* pBuffer);
-    static bool loadBuffer(int fd, unsigned char* pBuffer, int length);
-
     void saveAiding(void);
-    static bool saveDatabase(int fd, const struct DB_s* pDb);
-    static bool saveBuffer(int fd, const BUF_t* pBuffer);
-    static bool saveBuffer(int fd, const DBALP_t* pBuffer);
-    static bool saveBuffer(int fd, const DBSV_t* pBuffer);
-    static bool saveBuffer(int fd, const unsigned char* pBuffer, int length);
+    bool mapAidingDb(void);
+    void unmapAidingDb(void);
+    AIDDB_REC_t* getAidingRec(unsigned char msgId, unsigned int svix = 0);
+    void storeAidingRec(AIDDB_REC_t* pRec, const BUF_t* pBuf);
+    static bool loadAidingRec(const AIDDB_REC_t* pRec, BUF_t* pBuf);
+    void storeAidingPosTime(void);
+    static void syncAidingDb(const void* p, size_t size, int flags);
+    bool loadAlpData(void);
+    bool saveAlpData(void);
+    bool storeAlpData(const unsigned char* pData, unsigned int iData);
+    bool mapAlpData(int fd);
+    void unmapAlpData(void);
+    static bool checkAlpHeader(const unsigned char* pData, unsigned int iData);
 	
 	// Agps
-	static void injectDataAgpsOnlineData(const char* data, int length);
+	static int injectDataAgpsOnlineData(const unsigned char* data, int length);
 };
 
 